@@ -26,6 +26,13 @@
 #define SCO_OPTIONS   0x01
 #define SOL_SCO 17
 
+#ifndef SOL_BLUETOOTH
+#define SOL_BLUETOOTH 274
+#endif
+#define BT_VOICE 11
+#define BT_VOICE_TRANSPARENT 0x0003
+#define BT_VOICE_CVSD_16BIT 0x0060
+
 #define HCIGETDEVINFO   _IOR('H', 211, int)
 
 typedef struct {
@@ -65,3 +72,7 @@ struct hci_dev_info {
 struct sco_options {
 	uint16_t mtu;
 };
+
+struct bt_voice {
+	uint16_t setting;
+};
@@ -6,13 +6,24 @@
 #ifndef COMMON_CRAS_AUDIO_CODEC_H_
 #define COMMON_CRAS_AUDIO_CODEC_H_
 
-/* A audio codec that transforms audio between different formats.
+#include <stddef.h>
+#include <stdint.h>
+
+/* A audio codec that transforms audio between different formats. Both
+ * directions work on batches, a call processes as many whole frames as the
+ * input and output buffers hold.
  * decode - Function to decode audio samples. Returns the number of decoded
  *   bytes of input buffer, number of decoded bytes of output buffer
  *   will be filled in count.
  * encode - Function to encode audio samples. Returns the number of encoded
  *   bytes of input buffer, number of encoded bytes of output buffer
  *   will be filled in count.
+ * destroy - Function to free the codec.
+ * get_codesize - Function to get the size in bytes of the PCM block coded
+ *   in one frame.
+ * get_frame_length - Function to get the size in bytes of a coded frame.
+ * set_bitpool - Function to change the bitpool of the encoder from the next
+ *   frame, returns the new frame length. NULL if the codec has no bitpool.
  * priv_data - Private data for specific use.
  */
 struct cras_audio_codec {
@@ -22,6 +33,10 @@ struct cras_audio_codec {
 	int (*encode)(struct cras_audio_codec *codec, const void *input,
 		      size_t intput_len, void *output, size_t output_len,
 		      size_t *count);
+	void (*destroy)(struct cras_audio_codec *codec);
+	int (*get_codesize)(struct cras_audio_codec *codec);
+	int (*get_frame_length)(struct cras_audio_codec *codec);
+	int (*set_bitpool)(struct cras_audio_codec *codec, uint8_t bitpool);
 	void *priv_data;
 };
 
@@ -16,6 +16,9 @@
 /* CRAS_CONFIG_FILE_DIR is defined as $sysconfdir/cras by the configure
    script. */
 
+/* CRAS_STATE_FILE_DIR is the directory for files kept across reboots, set
+   by --with-statedir in the configure script. */
+
 /* Gets the path to save UDS socket files. */
 const char *cras_config_get_system_socket_file_dir();
 
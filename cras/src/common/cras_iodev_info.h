@@ -69,12 +69,15 @@ struct __attribute__ ((__packed__)) cras_ionode_info {
  *    IONODE_ATTR_VOLUME - set the node's output volume.
  *    IONODE_ATTR_CAPTURE_GAIN - set the node's capture gain.
  *    IONODE_ATTR_SWAP_LEFT_RIGHT - Swap the node's left and right channel.
+ *    IONODE_ATTR_PREROLL_MS - Keep the node's input device capturing into a
+ *        pre-roll ring of this many milliseconds while enabled, 0 to disable.
  */
 enum ionode_attr {
 	IONODE_ATTR_PLUGGED,
 	IONODE_ATTR_VOLUME,
 	IONODE_ATTR_CAPTURE_GAIN,
-	IONODE_ATTR_SWAP_LEFT_RIGHT
+	IONODE_ATTR_SWAP_LEFT_RIGHT,
+	IONODE_ATTR_PREROLL_MS
 };
 
 #endif /* CRAS_IODEV_INFO_H_ */
@@ -75,6 +75,7 @@ enum CRAS_CLIENT_MESSAGE_ID {
 	CRAS_CLIENT_NODE_LEFT_RIGHT_SWAPPED_CHANGED,
 	CRAS_CLIENT_INPUT_NODE_GAIN_CHANGED,
 	CRAS_CLIENT_NUM_ACTIVE_STREAMS_CHANGED,
+	CRAS_CLIENT_OUTPUT_LEVELS_CHANGED,
 };
 
 /* Messages that control the server. These are sent from the client to affect
@@ -736,6 +737,32 @@ static inline void cras_fill_client_num_active_streams_changed (
 	m->num_active_streams = num_active_streams;
 };
 
+/* Levels of an output device over the last metering window, 1.0 is full
+ * scale. Only the first num_channels entries are valid. */
+struct __attribute__ ((__packed__)) cras_client_output_levels_changed {
+	struct cras_client_message header;
+	uint32_t dev_idx;
+	uint32_t num_channels;
+	float peak[CRAS_CH_MAX];
+	float rms[CRAS_CH_MAX];
+};
+static inline void cras_fill_client_output_levels_changed (
+		struct cras_client_output_levels_changed *m,
+		uint32_t dev_idx,
+		uint32_t num_channels,
+		const float *peak,
+		const float *rms)
+{
+	memset(m, 0, sizeof(*m));
+	m->header.id = CRAS_CLIENT_OUTPUT_LEVELS_CHANGED;
+	m->header.length = sizeof(*m);
+	m->dev_idx = dev_idx;
+	m->num_channels = num_channels < CRAS_CH_MAX ?
+			  num_channels : CRAS_CH_MAX;
+	memcpy(m->peak, peak, m->num_channels * sizeof(*peak));
+	memcpy(m->rms, rms, m->num_channels * sizeof(*rms));
+};
+
 /*
  * Messages specific to passing audio between client and server
  */
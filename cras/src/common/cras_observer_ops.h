@@ -55,6 +55,11 @@ struct cras_observer_ops {
 	/* State regarding whether non-empty audio is being played/captured has
 	 * changed. */
 	void (*non_empty_audio_state_changed)(void *context, int non_empty);
+	/* Peak and RMS levels of an output device over the last metering
+	 * window, one entry per channel, 1.0 is full scale. */
+	void (*output_levels_changed)(void *context, uint32_t dev_idx,
+				      uint32_t num_channels,
+				      const float *peak, const float *rms);
 };
 
 #endif /* CRAS_OBSERVER_OPS_H */
@@ -81,18 +81,34 @@ int cras_sbc_encode(struct cras_audio_codec *codec, const void *input,
 	return processed;
 }
 
-int cras_sbc_get_codesize(struct cras_audio_codec *codec)
+static int libsbc_get_codesize(struct cras_audio_codec *codec)
 {
 	struct cras_sbc_data *data = (struct cras_sbc_data *)codec->priv_data;
 	return data->codesize;
 }
 
-int cras_sbc_get_frame_length(struct cras_audio_codec *codec)
+static int libsbc_get_frame_length(struct cras_audio_codec *codec)
 {
 	struct cras_sbc_data *data = (struct cras_sbc_data *)codec->priv_data;
 	return data->frame_length;
 }
 
+static int libsbc_set_bitpool(struct cras_audio_codec *codec, uint8_t bitpool)
+{
+	struct cras_sbc_data *data = (struct cras_sbc_data *)codec->priv_data;
+
+	data->sbc.bitpool = bitpool;
+	data->frame_length = sbc_get_frame_length(&data->sbc);
+	return data->frame_length;
+}
+
+static void libsbc_destroy(struct cras_audio_codec *codec)
+{
+	sbc_finish(&((struct cras_sbc_data *)codec->priv_data)->sbc);
+	free(codec->priv_data);
+	free(codec);
+}
+
 struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq,
 		   uint8_t mode, uint8_t subbands, uint8_t alloc,
 		   uint8_t blocks, uint8_t bitpool) {
@@ -122,6 +138,10 @@ struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq,
 
 	codec->decode = cras_sbc_decode;
 	codec->encode = cras_sbc_encode;
+	codec->destroy = libsbc_destroy;
+	codec->get_codesize = libsbc_get_codesize;
+	codec->get_frame_length = libsbc_get_frame_length;
+	codec->set_bitpool = libsbc_set_bitpool;
 	return codec;
 
 create_error:
@@ -129,9 +149,51 @@ create_error:
 	return NULL;
 }
 
+struct cras_audio_codec *cras_msbc_codec_create()
+{
+	struct cras_audio_codec *codec;
+	struct cras_sbc_data *data;
+
+	codec = (struct cras_audio_codec *)calloc(1, sizeof(*codec));
+	if (!codec)
+		return NULL;
+
+	data = (struct cras_sbc_data *)calloc(1, sizeof(*data));
+	if (!data) {
+		free(codec);
+		return NULL;
+	}
+
+	sbc_init_msbc(&data->sbc, 0L);
+	data->sbc.endian = SBC_LE;
+	data->codesize = sbc_get_codesize(&data->sbc);
+	data->frame_length = sbc_get_frame_length(&data->sbc);
+
+	codec->priv_data = data;
+	codec->decode = cras_sbc_decode;
+	codec->encode = cras_sbc_encode;
+	codec->destroy = libsbc_destroy;
+	codec->get_codesize = libsbc_get_codesize;
+	codec->get_frame_length = libsbc_get_frame_length;
+	return codec;
+}
+
 void cras_sbc_codec_destroy(struct cras_audio_codec *codec)
 {
-	sbc_finish(&((struct cras_sbc_data *)codec->priv_data)->sbc);
-	free(codec->priv_data);
-	free(codec);
+	codec->destroy(codec);
+}
+
+int cras_sbc_get_codesize(struct cras_audio_codec *codec)
+{
+	return codec->get_codesize(codec);
+}
+
+int cras_sbc_get_frame_length(struct cras_audio_codec *codec)
+{
+	return codec->get_frame_length(codec);
+}
+
+int cras_sbc_set_bitpool(struct cras_audio_codec *codec, uint8_t bitpool)
+{
+	return codec->set_bitpool(codec, bitpool);
 }
@@ -23,6 +23,12 @@ struct cras_audio_codec *cras_sbc_codec_create(uint8_t freq,
 		   uint8_t mode, uint8_t subbands, uint8_t alloc,
 		   uint8_t blocks, uint8_t bitpool);
 
+/* Creates an mSBC codec, the SBC variant of HFP wideband speech: 16kHz
+ * mono, 8 subbands, 15 blocks and bitpool 26. Each 57 byte frame codes 120
+ * frames of PCM. The bitpool is fixed, set_bitpool is NULL.
+ */
+struct cras_audio_codec *cras_msbc_codec_create();
+
 /* Destroys an sbc codec.
  * Args:
  *    codec: the codec to destroy.
@@ -37,4 +43,14 @@ int cras_sbc_get_codesize(struct cras_audio_codec *codec);
  */
 int cras_sbc_get_frame_length(struct cras_audio_codec *codec);
 
+/* Changes the bitpool of an sbc encoder. The encoder picks the new
+ * bitpool up on the next frame it encodes.
+ * Args:
+ *    codec: the codec to update.
+ *    bitpool: the new bitpool.
+ * Returns:
+ *    The new frame_length in bytes.
+ */
+int cras_sbc_set_bitpool(struct cras_audio_codec *codec, uint8_t bitpool);
+
 #endif /* COMMON_CRAS_SBC_CODEC_H_ */
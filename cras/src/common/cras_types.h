@@ -71,6 +71,12 @@ enum CRAS_STREAM_DIRECTION {
  *      and does not want to receive data. Used with HOTWORD_STREAM.
  *  SERVER_ONLY - This stream doesn't associate to a client. It's used mainly
  *      for audio data to flow from hardware through iodev's dsp pipeline.
+ *  PREROLL_AUDIO - When attached to a warm input device, start the stream
+ *      with the audio kept in the device's pre-roll ring instead of the
+ *      live samples.
+ *  LOW_LATENCY - Keep no more than two callbacks of this stream queued in
+ *      the output device it plays to, even when streams with larger
+ *      callbacks share the device. Output streams only.
  */
 enum CRAS_INPUT_STREAM_FLAG {
 	BULK_AUDIO_OK = 0x01,
@@ -78,6 +84,8 @@ enum CRAS_INPUT_STREAM_FLAG {
 	HOTWORD_STREAM = BULK_AUDIO_OK | USE_DEV_TIMING,
 	TRIGGER_ONLY = 0x04,
 	SERVER_ONLY = 0x08,
+	PREROLL_AUDIO = 0x10,
+	LOW_LATENCY = 0x20,
 };
 
 /*
@@ -180,8 +188,11 @@ static inline uint32_t node_index_of(cras_node_id_t id)
 #define CRAS_MAX_AUDIO_THREAD_SNAPSHOTS 10
 #define CRAS_HOTWORD_STRING_SIZE 256
 #define MAX_DEBUG_DEVS 4
+#define CRAS_UNDERRUN_LOG_CYCLES 16
 #define MAX_DEBUG_STREAMS 8
+#define MAX_DEBUG_THREADS 5
 #define AUDIO_THREAD_EVENT_LOG_SIZE (1024*6)
+#define CRAS_WAKE_ERR_HIST_BUCKETS 7
 
 /* There are 8 bits of space for events. */
 enum AUDIO_THREAD_LOG_EVENTS {
@@ -204,9 +215,12 @@ enum AUDIO_THREAD_LOG_EVENTS {
 	AUDIO_THREAD_STREAM_REMOVED,
 	AUDIO_THREAD_A2DP_ENCODE,
 	AUDIO_THREAD_A2DP_WRITE,
+	AUDIO_THREAD_A2DP_SEND_PACKET,
+	AUDIO_THREAD_A2DP_SET_BITPOOL,
 	AUDIO_THREAD_DEV_STREAM_MIX,
 	AUDIO_THREAD_CAPTURE_POST,
 	AUDIO_THREAD_CAPTURE_WRITE,
+	AUDIO_THREAD_CAPTURE_PREROLL,
 	AUDIO_THREAD_CONV_COPY,
 	AUDIO_THREAD_STREAM_SLEEP_TIME,
 	AUDIO_THREAD_STREAM_SLEEP_ADJUST,
@@ -224,6 +238,9 @@ enum AUDIO_THREAD_LOG_EVENTS {
 	AUDIO_THREAD_FILL_ODEV_ZEROS,
 	AUDIO_THREAD_UNDERRUN,
 	AUDIO_THREAD_SEVERE_UNDERRUN,
+	AUDIO_THREAD_WAKE_PREDICTION,
+	AUDIO_THREAD_MIN_BUFFER_LEVEL,
+	AUDIO_THREAD_DEV_HW_CALLS,
 };
 
 struct __attribute__ ((__packed__)) audio_thread_event {
@@ -234,13 +251,38 @@ struct __attribute__ ((__packed__)) audio_thread_event {
 	uint32_t data3;
 };
 
-/* Ring buffer of log events from the audio thread. */
-struct __attribute__ ((__packed__)) audio_thread_event_log {
+/* Ring buffer of log events from the audio threads. Not packed so that
+ * write_pos can be advanced atomically, the layout has no padding either way.
+ */
+struct audio_thread_event_log {
 	uint32_t write_pos;
 	uint32_t len;
 	struct audio_thread_event log[AUDIO_THREAD_EVENT_LOG_SIZE];
 };
 
+/* One audio thread wake up of an output device.
+ *    wake_sec, wake_nsec - Time the audio thread woke up.
+ *    hw_level_before - Frames queued in the device before writing, on top of
+ *        min_buffer_level.
+ *    hw_level_after - Frames queued after writing, on top of
+ *        min_buffer_level.
+ *    frames_written - Frames written to the device.
+ *    dsp_us - Time spent in the DSP pipeline.
+ *    slowest_stream_id - The stream whose fetch had been pending the longest
+ *        in this wake up, zero if no fetch was pending.
+ *    slowest_fetch_us - How long that fetch had been pending.
+ */
+struct __attribute__ ((__packed__)) cras_dev_cycle_info {
+	uint32_t wake_sec;
+	uint32_t wake_nsec;
+	uint32_t hw_level_before;
+	uint32_t hw_level_after;
+	uint32_t frames_written;
+	uint32_t dsp_us;
+	uint64_t slowest_stream_id;
+	uint32_t slowest_fetch_us;
+};
+
 struct __attribute__ ((__packed__)) audio_dev_debug_info {
 	char dev_name[CRAS_NODE_NAME_BUFFER_SIZE];
 	uint32_t buffer_size;
@@ -254,6 +296,22 @@ struct __attribute__ ((__packed__)) audio_dev_debug_info {
 	uint32_t num_underruns;
 	uint32_t num_severe_underruns;
 	uint32_t highest_hw_level;
+	uint32_t audio_thread;
+	uint32_t longest_wake_to_write_us;
+	int32_t min_slack_frames;
+	uint32_t missed_deadlines;
+	uint32_t num_level_channels;
+	float peak_level[CRAS_CH_MAX];
+	float rms_level[CRAS_CH_MAX];
+	int32_t wake_correction_frames;
+	uint32_t wake_err_hist[CRAS_WAKE_ERR_HIST_BUCKETS];
+	uint32_t configured_min_buffer_level;
+	uint32_t lowest_min_buffer_level;
+	uint32_t min_buffer_level_backoffs;
+	uint32_t underrun_log_sec;
+	uint32_t underrun_log_nsec;
+	uint32_t num_underrun_cycles;
+	struct cras_dev_cycle_info underrun_cycles[CRAS_UNDERRUN_LOG_CYCLES];
 };
 
 struct __attribute__ ((__packed__)) audio_stream_debug_info {
@@ -271,14 +329,31 @@ struct __attribute__ ((__packed__)) audio_stream_debug_info {
 	uint32_t longest_fetch_nsec;
 	uint32_t num_overruns;
 	int8_t channel_layout[CRAS_CH_MAX];
+	uint32_t delay_us;
+	uint32_t fetch_p99_us;
+	uint32_t num_late_fetches;
+};
+
+/* Scheduling of an audio thread. runtime_us and period_us are the
+ * SCHED_DEADLINE reservation, zero if the thread runs with SCHED_RR. */
+struct __attribute__ ((__packed__)) audio_thread_debug_info {
+	uint32_t sched_deadline;
+	uint32_t runtime_us;
+	uint32_t period_us;
+	uint32_t budget_overruns;
+	uint32_t longest_wake_us;
 };
 
-/* Debug info shared from server to client. */
+/* Debug info shared from server to client. wakeups_per_sec is summed over
+ * all audio threads. */
 struct __attribute__ ((__packed__)) audio_debug_info {
 	uint32_t num_streams;
 	uint32_t num_devs;
+	uint32_t num_threads;
+	uint32_t wakeups_per_sec;
 	struct audio_dev_debug_info devs[MAX_DEBUG_DEVS];
 	struct audio_stream_debug_info streams[MAX_DEBUG_STREAMS];
+	struct audio_thread_debug_info threads[MAX_DEBUG_THREADS];
 	struct audio_thread_event_log log;
 };
 
@@ -312,6 +387,22 @@ struct __attribute__ ((__packed__)) cras_audio_thread_snapshot_buffer{
 	int pos;
 };
 
+/* How long an ALSA card took to come up.
+ *    card_index - Index ALSA uses to refer to the card.  The X in "hw:X".
+ *    probe_ms - Time spent opening the card's control, UCM and mixer, and
+ *      scanning it for jacks.
+ *    complete_ms - Time spent creating the card's devices on the main thread.
+ *    ready_ms - Time from the card being found until its devices were added,
+ *      including waiting for a probe worker.
+ */
+#define CRAS_MAX_ALSA_CARDS 32
+struct __attribute__ ((__packed__)) cras_alsa_card_ready_info {
+	uint32_t card_index;
+	uint32_t probe_ms;
+	uint32_t complete_ms;
+	uint32_t ready_ms;
+};
+
 /* The server state that is shared with clients.
  *    state_version - Version of this structure.
  *    volume - index from 0-100.
@@ -357,8 +448,10 @@ struct __attribute__ ((__packed__)) cras_audio_thread_snapshot_buffer{
  *        played/captured.
  *    aec_supported - Flag to indicate if system aec is supported.
  *    snapshot_buffer - ring buffer for storing audio thread snapshots.
+ *    num_alsa_cards - Number of ALSA cards added to the system.
+ *    alsa_cards - How long each of the ALSA cards took to become ready.
  */
-#define CRAS_SERVER_STATE_VERSION 2
+#define CRAS_SERVER_STATE_VERSION 13
 struct __attribute__ ((packed, aligned(4))) cras_server_state {
 	uint32_t state_version;
 	uint32_t volume;
@@ -393,6 +486,8 @@ struct __attribute__ ((packed, aligned(4))) cras_server_state {
 	int32_t non_empty_status;
 	int32_t aec_supported;
 	struct cras_audio_thread_snapshot_buffer snapshot_buffer;
+	uint32_t num_alsa_cards;
+	struct cras_alsa_card_ready_info alsa_cards[CRAS_MAX_ALSA_CARDS];
 };
 
 /* Actions for card add/remove/change. */
@@ -53,6 +53,65 @@ int cras_set_thread_priority(int priority)
 	return err;
 }
 
+int cras_set_thread_cpu(int cpu)
+{
+	cpu_set_t cpus;
+	int err;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+
+	err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	if (err)
+		syslog(LOG_WARNING,
+		       "Failed to pin thread to cpu %d, rc: %d\n", cpu, err);
+
+	return err;
+}
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+/* Argument of the sched_setattr syscall, which glibc doesn't wrap. */
+struct cras_sched_attr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+int cras_set_thread_deadline(uint64_t runtime_ns, uint64_t period_ns)
+{
+#ifdef __NR_sched_setattr
+	struct cras_sched_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = SCHED_DEADLINE;
+	attr.sched_runtime = runtime_ns;
+	attr.sched_deadline = period_ns;
+	attr.sched_period = period_ns;
+
+	if (syscall(__NR_sched_setattr, 0, &attr, 0)) {
+		int err = errno;
+
+		syslog(LOG_WARNING,
+		       "Failed to set deadline runtime %llu period %llu"
+		       ", rc: %d\n", (unsigned long long)runtime_ns,
+		       (unsigned long long)period_ns, err);
+		return -err;
+	}
+	return 0;
+#else
+	return -ENOSYS;
+#endif
+}
+
 int cras_set_nice_level(int nice)
 {
 	int rc;
@@ -25,6 +25,12 @@ extern "C" {
 int cras_set_rt_scheduling(int rt_lim);
 /* Sets the priority. */
 int cras_set_thread_priority(int priority);
+/* Pins the calling thread to the given CPU. */
+int cras_set_thread_cpu(int cpu);
+/* Runs the calling thread with SCHED_DEADLINE, reserving runtime_ns of CPU
+ * time in every period_ns. Returns 0 on success, or a negative error if the
+ * kernel doesn't support it or refuses the reservation. */
+int cras_set_thread_deadline(uint64_t runtime_ns, uint64_t period_ns);
 /* Sets the niceness level of the current thread. */
 int cras_set_nice_level(int nice);
 
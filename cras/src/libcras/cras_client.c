@@ -1865,6 +1865,17 @@ static int handle_message_from_server(struct cras_client *client)
 					direction, cmsg->num_active_streams);
 		break;
 	}
+	case CRAS_CLIENT_OUTPUT_LEVELS_CHANGED: {
+		struct cras_client_output_levels_changed *cmsg =
+		    (struct cras_client_output_levels_changed *)msg;
+		if (client->observer_ops.output_levels_changed)
+			client->observer_ops.output_levels_changed(
+					client->observer_context,
+					cmsg->dev_idx,
+					MIN(cmsg->num_channels, CRAS_CH_MAX),
+					cmsg->peak, cmsg->rms);
+		break;
+	}
 	default:
 		break;
 	}
@@ -2887,6 +2898,31 @@ read_clients_again:
 	return num;
 }
 
+int cras_client_get_alsa_card_ready_info(
+		const struct cras_client *client,
+		struct cras_alsa_card_ready_info *cards,
+		size_t max_cards)
+{
+	const struct cras_server_state *state;
+	unsigned num, version;
+	int lock_rc;
+
+	lock_rc = server_state_rdlock(client);
+	if (lock_rc)
+		return -EINVAL;
+	state = client->server_state;
+
+read_cards_again:
+	version = begin_server_state_read(state);
+	num = MIN(max_cards, state->num_alsa_cards);
+	memcpy(cards, state->alsa_cards, num * sizeof(*cards));
+	if (end_server_state_read(state, version))
+		goto read_cards_again;
+	server_state_unlock(client, lock_rc);
+
+	return num;
+}
+
 /* Find an output ionode on an iodev with the matching name.
  *
  * Args:
@@ -3514,6 +3550,17 @@ int cras_client_set_num_active_streams_changed_callback(
 	      client, CRAS_CLIENT_NUM_ACTIVE_STREAMS_CHANGED, cb != NULL);
 }
 
+int cras_client_set_output_levels_changed_callback(
+		struct cras_client *client,
+		cras_client_output_levels_changed_callback cb)
+{
+	if (!client)
+		return -EINVAL;
+	client->observer_ops.output_levels_changed = cb;
+	return cras_send_register_notification(
+	      client, CRAS_CLIENT_OUTPUT_LEVELS_CHANGED, cb != NULL);
+}
+
 static int reregister_notifications(struct cras_client *client)
 {
 	int rc;
@@ -3587,6 +3634,13 @@ static int reregister_notifications(struct cras_client *client)
 		if (rc != 0)
 			return rc;
 	}
+	if (client->observer_ops.output_levels_changed) {
+		rc = cras_client_set_output_levels_changed_callback(
+			       client,
+			       client->observer_ops.output_levels_changed);
+		if (rc != 0)
+			return rc;
+	}
 	return 0;
 }
 
@@ -382,6 +382,22 @@ int cras_client_get_attached_clients(const struct cras_client *client,
 				     struct cras_attached_client_info *clients,
 				     size_t max_clients);
 
+/* Returns how long each ALSA card in the system took to become ready.
+ *
+ * Requires that the connection to the server has been established.
+ *
+ * Args:
+ *    client - This client (from cras_client_create).
+ *    cards - Array that will be filled with the info of each card.
+ *    max_cards - Maximum number of cards to put in the array.
+ * Returns:
+ *    The number of cards filled in, or negative error code.
+ */
+int cras_client_get_alsa_card_ready_info(
+		const struct cras_client *client,
+		struct cras_alsa_card_ready_info *cards,
+		size_t max_cards);
+
 /* Find a node info with the matching node id.
  *
  * Requires that the connection to the server has been established.
@@ -1245,6 +1261,22 @@ typedef void (*cras_client_num_active_streams_changed_callback)(
 		void* context, enum CRAS_STREAM_DIRECTION direction,
 		uint32_t num_active_streams);
 
+/* Output levels callback, called for each playing output device about ten
+ * times a second while the callback is set. The levels are measured after
+ * software volume, so they show what the device plays.
+ *
+ * Args:
+ *    context - Context pointer set with
+ *              cras_client_set_state_change_callback_context().
+ *    dev_idx - Index of the output device.
+ *    num_channels - Number of entries in peak and rms.
+ *    peak - Peak level of each channel, 1.0 is full scale.
+ *    rms - RMS level of each channel, 1.0 is full scale.
+ */
+typedef void (*cras_client_output_levels_changed_callback)(
+		void* context, uint32_t dev_idx, uint32_t num_channels,
+		const float *peak, const float *rms);
+
 /* Set system state information callbacks.
  * NOTE: These callbacks are executed from the client control thread.
  * Each state change callback is given the context pointer set with
@@ -1286,6 +1318,9 @@ int cras_client_set_input_node_gain_changed_callback(
 int cras_client_set_num_active_streams_changed_callback(
 		struct cras_client *client,
 		cras_client_num_active_streams_changed_callback cb);
+int cras_client_set_output_levels_changed_callback(
+		struct cras_client *client,
+		cras_client_output_levels_changed_callback cb);
 
 #ifdef __cplusplus
 }
@@ -7,6 +7,7 @@
 #define _GNU_SOURCE /* for ppoll */
 #endif
 
+#include <limits.h>
 #include <pthread.h>
 #include <poll.h>
 #include <stdbool.h>
@@ -18,9 +19,11 @@
 #include "cras_config.h"
 #include "cras_fmt_conv.h"
 #include "cras_iodev.h"
+#include "cras_level_meter.h"
 #include "cras_rstream.h"
 #include "cras_system_state.h"
 #include "cras_types.h"
+#include "cras_underrun_log.h"
 #include "cras_util.h"
 #include "dev_stream.h"
 #include "audio_thread.h"
@@ -28,6 +31,12 @@
 
 #define MIN_PROCESS_TIME_US 500 /* 0.5ms - min amount of time to mix/src. */
 #define SLEEP_FUZZ_FRAMES 10 /* # to consider "close enough" to sleep frames. */
+
+/* The SCHED_DEADLINE period while no device is open, and the bounds of the
+ * reservation. */
+#define DL_DEFAULT_PERIOD_NS (10 * 1000 * 1000ULL)
+#define DL_MIN_PERIOD_NS (1000 * 1000ULL)
+#define DL_MIN_RUNTIME_NS (200 * 1000ULL)
 #define MIN_READ_WAIT_US 2000 /* 2ms */
 /*
  * # to check whether a busyloop event happens
@@ -98,8 +107,10 @@ struct audio_thread_aec_dump_msg {
 /* Audio thread logging. */
 struct audio_thread_event_log *atlog;
 
+/* Number of audio threads sharing atlog. */
+static unsigned int num_log_users;
+
 static struct iodev_callback_list *iodev_callbacks;
-static struct timespec longest_wake;
 
 struct iodev_callback_list {
 	int fd;
@@ -168,6 +179,14 @@ void audio_thread_enable_callback(int fd, int enabled)
 	}
 }
 
+/* Returns the callbacks to poll in the thread. Callbacks are added for devices
+ * of the main audio thread, device group workers don't poll them. */
+static struct iodev_callback_list *thread_callbacks(
+		const struct audio_thread *thread)
+{
+	return thread->worker_idx ? NULL : iodev_callbacks;
+}
+
 /* Sends a response (error code) from the audio thread to the main thread.
  * Indicates that the last message sent to the audio thread has been handled
  * with an error code of rc.
@@ -308,9 +327,11 @@ static int append_stream(struct audio_thread *thread,
 
 		/* When the first input stream is added, flush the input buffer
 		 * so that we can read from multiple input devices of the same
-		 * buffer level.
+		 * buffer level. A warm device is kept drained while idle and
+		 * its buffered samples continue its pre-roll, so keep them.
 		 */
-		if ((stream->direction == CRAS_STREAM_INPUT) && !dev->streams) {
+		if ((stream->direction == CRAS_STREAM_INPUT) && !dev->streams &&
+		    !dev->preroll) {
 			int num_flushed = dev->flush_buffer(dev);
 			if (num_flushed < 0) {
 				rc = num_flushed;
@@ -358,6 +379,66 @@ static int append_stream(struct audio_thread *thread,
 	return rc;
 }
 
+/* Returns the shortest callback interval of the devices open on thread. */
+static uint64_t thread_dl_period_ns(const struct audio_thread *thread)
+{
+	struct open_dev *adev;
+	uint64_t period_ns = DL_DEFAULT_PERIOD_NS;
+	uint64_t cb_ns;
+	unsigned int dir;
+
+	for (dir = 0; dir < CRAS_NUM_DIRECTIONS; dir++) {
+		DL_FOREACH(thread->open_devs[dir], adev) {
+			if (!adev->dev->ext_format ||
+			    !adev->dev->ext_format->frame_rate ||
+			    !adev->dev->min_cb_level)
+				continue;
+			cb_ns = adev->dev->min_cb_level * 1000000000ULL /
+				adev->dev->ext_format->frame_rate;
+			period_ns = MIN(period_ns, cb_ns);
+		}
+	}
+
+	return MAX(period_ns, DL_MIN_PERIOD_NS);
+}
+
+/*
+ * Sets the scheduling policy of the calling audio thread. With sched_deadline
+ * set, reserves twice the longest time the thread stayed awake, up to half of
+ * the callback interval of its devices. Runs the thread with SCHED_RR if that
+ * isn't wanted or the kernel refuses the reservation.
+ */
+static void thread_set_scheduling(struct audio_thread *thread)
+{
+	uint64_t runtime_ns, period_ns;
+
+	if (thread->sched_deadline) {
+		period_ns = thread_dl_period_ns(thread);
+		runtime_ns = 2 * (thread->longest_wake.tv_sec * 1000000000ULL +
+				  thread->longest_wake.tv_nsec);
+		runtime_ns = MAX(runtime_ns, DL_MIN_RUNTIME_NS);
+		runtime_ns = MIN(runtime_ns, period_ns / 2);
+
+		if (runtime_ns == thread->dl_runtime_ns &&
+		    period_ns == thread->dl_period_ns)
+			return;
+		if (cras_set_thread_deadline(runtime_ns, period_ns) == 0) {
+			thread->dl_runtime_ns = runtime_ns;
+			thread->dl_period_ns = period_ns;
+			return;
+		}
+
+		syslog(LOG_WARNING, "Audio thread %u falls back to SCHED_RR",
+		       thread->worker_idx);
+		thread->sched_deadline = 0;
+		thread->dl_runtime_ns = 0;
+		thread->dl_period_ns = 0;
+	}
+
+	if (cras_set_rt_scheduling(CRAS_SERVER_RT_THREAD_PRIORITY) == 0)
+		cras_set_thread_priority(CRAS_SERVER_RT_THREAD_PRIORITY);
+}
+
 /* Handles messages from main thread to add a new active device. */
 static int thread_add_open_dev(struct audio_thread *thread,
 			       struct cras_iodev *iodev)
@@ -371,6 +452,7 @@ static int thread_add_open_dev(struct audio_thread *thread,
 
 	adev = (struct open_dev *)calloc(1, sizeof(*adev));
 	adev->dev = iodev;
+	adev->min_slack_frames = INT_MAX;
 
 	/*
 	 * Start output devices by padding the output. This avoids a burst of
@@ -383,6 +465,10 @@ static int thread_add_open_dev(struct audio_thread *thread,
 
 	DL_APPEND(thread->open_devs[iodev->direction], adev);
 
+	/* The reservation follows the callback interval of the devices. */
+	if (thread->sched_deadline)
+		thread_set_scheduling(thread);
+
 	return 0;
 }
 
@@ -396,6 +482,9 @@ static int thread_rm_open_dev(struct audio_thread *thread,
 		return -EINVAL;
 
 	dev_io_rm_open_dev(&thread->open_devs[iodev->direction], adev);
+
+	if (thread->sched_deadline)
+		thread_set_scheduling(thread);
 	return 0;
 }
 
@@ -550,10 +639,12 @@ static void terminate_pb_thread()
 	pthread_exit(0);
 }
 
-static void append_dev_dump_info(struct audio_dev_debug_info *di,
+static void append_dev_dump_info(struct audio_thread *thread,
+				 struct audio_dev_debug_info *di,
 				 struct open_dev *adev)
 {
 	struct cras_audio_format *fmt = adev->dev->ext_format;
+	float peak[CRAS_CH_MAX], rms[CRAS_CH_MAX];
 	strncpy(di->dev_name, adev->dev->info.name, sizeof(di->dev_name));
 	di->buffer_size = adev->dev->buffer_size;
 	di->min_buffer_level = adev->dev->min_buffer_level;
@@ -564,6 +655,53 @@ static void append_dev_dump_info(struct audio_dev_debug_info *di,
 	di->num_severe_underruns = cras_iodev_get_num_severe_underruns(
 			adev->dev);
 	di->highest_hw_level = adev->dev->highest_hw_level;
+	di->audio_thread = thread->worker_idx;
+	di->longest_wake_to_write_us =
+		adev->longest_wake_to_write.tv_sec * 1000000 +
+		adev->longest_wake_to_write.tv_nsec / 1000;
+	adev->longest_wake_to_write.tv_sec = 0;
+	adev->longest_wake_to_write.tv_nsec = 0;
+	di->min_slack_frames = (adev->min_slack_frames == INT_MAX) ?
+			0 : adev->min_slack_frames;
+	adev->min_slack_frames = INT_MAX;
+	di->missed_deadlines = adev->missed_deadlines;
+	if (adev->dev->level_meter) {
+		di->num_level_channels = cras_level_meter_get(
+				adev->dev->level_meter, peak, rms);
+		memcpy(di->peak_level, peak,
+		       di->num_level_channels * sizeof(*peak));
+		memcpy(di->rms_level, rms,
+		       di->num_level_channels * sizeof(*rms));
+	} else {
+		di->num_level_channels = 0;
+	}
+	di->wake_correction_frames = (int32_t)adev->wake_pred.correction;
+	memcpy(di->wake_err_hist, adev->wake_pred.err_hist,
+	       sizeof(di->wake_err_hist));
+	if (adev->dev->dynamic_min_buffer_level) {
+		di->configured_min_buffer_level =
+			adev->dev->latency_ctl.configured;
+		di->lowest_min_buffer_level = adev->dev->latency_ctl.lowest;
+		di->min_buffer_level_backoffs =
+			adev->dev->latency_ctl.num_backoffs;
+	} else {
+		di->configured_min_buffer_level = di->min_buffer_level;
+		di->lowest_min_buffer_level = di->min_buffer_level;
+		di->min_buffer_level_backoffs = 0;
+	}
+	if (adev->dev->underrun_log) {
+		struct timespec frozen_ts;
+
+		di->num_underrun_cycles = cras_underrun_log_get(
+				adev->dev->underrun_log, di->underrun_cycles,
+				&frozen_ts);
+		di->underrun_log_sec = frozen_ts.tv_sec;
+		di->underrun_log_nsec = frozen_ts.tv_nsec;
+	} else {
+		di->num_underrun_cycles = 0;
+		di->underrun_log_sec = 0;
+		di->underrun_log_nsec = 0;
+	}
 	if (fmt) {
 		di->frame_rate = fmt->frame_rate;
 		di->num_channels = fmt->num_channels;
@@ -575,6 +713,24 @@ static void append_dev_dump_info(struct audio_dev_debug_info *di,
 	}
 }
 
+/* Appends the scheduling info of thread after that of other threads. */
+static void append_thread_dump_info(struct audio_thread *thread,
+				    struct audio_debug_info *info)
+{
+	struct audio_thread_debug_info *ti;
+
+	if (info->num_threads >= MAX_DEBUG_THREADS)
+		return;
+
+	ti = &info->threads[info->num_threads++];
+	ti->sched_deadline = thread->sched_deadline;
+	ti->runtime_us = thread->dl_runtime_ns / 1000;
+	ti->period_us = thread->dl_period_ns / 1000;
+	ti->budget_overruns = thread->dl_overruns;
+	ti->longest_wake_us = thread->longest_wake.tv_sec * 1000000 +
+			      thread->longest_wake.tv_nsec / 1000;
+}
+
 /* Put stream info for the given stream into the info struct. */
 static void append_stream_dump_info(struct audio_debug_info *info,
 				    struct dev_stream *stream,
@@ -599,9 +755,30 @@ static void append_stream_dump_info(struct audio_debug_info *info,
 	si->longest_fetch_nsec = stream->stream->longest_fetch_interval.tv_nsec;
 	si->num_overruns = cras_shm_num_overruns(&stream->stream->shm);
 	si->effects = cras_apm_list_get_effects(stream->stream->apm_list);
+	si->delay_us = si->frame_rate ?
+		stream->stream->delay_frames * 1000000ULL / si->frame_rate :
+		0;
+	si->fetch_p99_us = stream->stream->fetch_pred.p99_us;
+	si->num_late_fetches = stream->stream->num_late_fetches;
+}
 
-	longest_wake.tv_sec = 0;
-	longest_wake.tv_nsec = 0;
+/* Returns the wake up rate of the thread since the last call, and restarts
+ * counting. */
+static unsigned int thread_wakeups_per_sec(struct audio_thread *thread)
+{
+	struct timespec now, elapsed;
+	uint64_t elapsed_us;
+	unsigned int rate = 0;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	subtract_timespecs(&now, &thread->wakes_since, &elapsed);
+	elapsed_us = elapsed.tv_sec * 1000000ULL + elapsed.tv_nsec / 1000;
+	if (elapsed_us)
+		rate = thread->num_wakes * 1000000ULL / elapsed_us;
+
+	thread->num_wakes = 0;
+	thread->wakes_since = now;
+	return rate;
 }
 
 /* Handle a message sent to the playback thread */
@@ -670,18 +847,24 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 		struct open_dev *adev;
 		struct audio_thread_dump_debug_info_msg *dmsg;
 		struct audio_debug_info *info;
-		unsigned int num_streams = 0;
-		unsigned int num_devs = 0;
+		unsigned int num_streams;
+		unsigned int num_devs;
 
 		ret = 0;
 		dmsg = (struct audio_thread_dump_debug_info_msg *)msg;
 		info = dmsg->info;
 
+		/* Append after the info dumped by other threads. */
+		num_devs = MIN(info->num_devs, MAX_DEBUG_DEVS);
+		num_streams = MIN(info->num_streams, MAX_DEBUG_STREAMS);
+
 		/* Go through all open devices. */
 		DL_FOREACH(thread->open_devs[CRAS_STREAM_OUTPUT], adev) {
-			append_dev_dump_info(&info->devs[num_devs], adev);
-			if (++num_devs == MAX_DEBUG_DEVS)
+			if (num_devs == MAX_DEBUG_DEVS)
 				break;
+			append_dev_dump_info(thread, &info->devs[num_devs],
+					     adev);
+			++num_devs;
 			DL_FOREACH(adev->dev->streams, curr) {
 				if (num_streams == MAX_DEBUG_STREAMS)
 					break;
@@ -693,7 +876,8 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 		DL_FOREACH(thread->open_devs[CRAS_STREAM_INPUT], adev) {
 			if (num_devs == MAX_DEBUG_DEVS)
 				break;
-			append_dev_dump_info(&info->devs[num_devs], adev);
+			append_dev_dump_info(thread, &info->devs[num_devs],
+					     adev);
 			DL_FOREACH(adev->dev->streams, curr) {
 				if (num_streams == MAX_DEBUG_STREAMS)
 					break;
@@ -708,6 +892,12 @@ static int handle_playback_thread_message(struct audio_thread *thread)
 		info->num_streams = num_streams;
 
 		memcpy(&info->log, atlog, sizeof(info->log));
+
+		info->wakeups_per_sec += thread_wakeups_per_sec(thread);
+		append_thread_dump_info(thread, info);
+
+		thread->longest_wake.tv_sec = 0;
+		thread->longest_wake.tv_nsec = 0;
 		break;
 	}
 	case AUDIO_THREAD_DRAIN_STREAM: {
@@ -770,7 +960,7 @@ static int get_next_stream_wake_from_list(struct dev_stream *streams,
 	int ret = 0; /* The total number of streams to wait on. */
 
 	DL_FOREACH(streams, dev_stream) {
-		const struct timespec *next_cb_ts;
+		struct timespec fetch_ts;
 
 		if (cras_rstream_get_is_draining(dev_stream->stream) &&
 		    dev_stream_playback_frames(dev_stream) <= 0)
@@ -778,15 +968,16 @@ static int get_next_stream_wake_from_list(struct dev_stream *streams,
 		if (!dev_stream_can_fetch(dev_stream))
 			continue;
 
-		next_cb_ts = dev_stream_next_cb_ts(dev_stream);
-		if (!next_cb_ts)
+		/* Output streams are woken ahead of their callback time by
+		 * the response time of their client. */
+		if (dev_stream_wake_time(dev_stream, 0, NULL, 0, 0, &fetch_ts))
 			continue;
 
 		ATLOG(atlog, AUDIO_THREAD_STREAM_SLEEP_TIME,
-		      dev_stream->stream->stream_id, next_cb_ts->tv_sec,
-		      next_cb_ts->tv_nsec);
-		if (timespec_after(min_ts, next_cb_ts))
-			*min_ts = *next_cb_ts;
+		      dev_stream->stream->stream_id, fetch_ts.tv_sec,
+		      fetch_ts.tv_nsec);
+		if (timespec_after(min_ts, &fetch_ts))
+			*min_ts = fetch_ts;
 		ret++;
 	}
 
@@ -863,19 +1054,19 @@ static struct pollfd *add_pollfd(struct audio_thread *thread,
 	return &thread->pollfds[thread->num_pollfds - 1];
 }
 
-static int continuous_zero_sleep_count = 0;
-static void check_busyloop(struct timespec* wait_ts)
+static void check_busyloop(struct audio_thread *thread,
+			   struct timespec* wait_ts)
 {
 	if(wait_ts->tv_sec == 0 && wait_ts->tv_nsec == 0)
 	{
-		continuous_zero_sleep_count ++;
-		if(continuous_zero_sleep_count ==
+		thread->continuous_zero_sleep_count ++;
+		if(thread->continuous_zero_sleep_count ==
 		   MAX_CONTINUOUS_ZERO_SLEEP_COUNT)
 			cras_audio_thread_busyloop();
 	}
 	else
 	{
-		continuous_zero_sleep_count = 0;
+		thread->continuous_zero_sleep_count = 0;
 	}
 }
 
@@ -897,13 +1088,20 @@ static void *audio_io_thread(void *arg)
 
 	msg_fd = thread->to_thread_fds[0];
 
+	/* The kernel refuses SCHED_DEADLINE for a thread pinned to a subset
+	 * of the CPUs, pinned workers fall back to SCHED_RR. */
+	if (thread->cpu >= 0)
+		cras_set_thread_cpu(thread->cpu);
+
 	/* Attempt to get realtime scheduling */
-	if (cras_set_rt_scheduling(CRAS_SERVER_RT_THREAD_PRIORITY) == 0)
-		cras_set_thread_priority(CRAS_SERVER_RT_THREAD_PRIORITY);
+	thread_set_scheduling(thread);
 
 	last_wake.tv_sec = 0;
-	longest_wake.tv_sec = 0;
-	longest_wake.tv_nsec = 0;
+	thread->longest_wake.tv_sec = 0;
+	thread->longest_wake.tv_nsec = 0;
+	thread->num_wakes = 0;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &thread->wakes_since);
+	dev_io_set_wake_tolerance(&thread->wake_tolerance);
 
 	thread->pollfds[0].fd = msg_fd;
 	thread->pollfds[0].events = POLLIN;
@@ -926,7 +1124,7 @@ static void *audio_io_thread(void *arg)
 restart_poll_loop:
 		thread->num_pollfds = 1;
 
-		DL_FOREACH(iodev_callbacks, iodev_cb) {
+		DL_FOREACH(thread_callbacks(thread), iodev_cb) {
 			if (!iodev_cb->enabled)
 				continue;
 			iodev_cb->pollfd = add_pollfd(thread, iodev_cb->fd,
@@ -959,16 +1157,27 @@ restart_poll_loop:
 			struct timespec this_wake;
 			clock_gettime(CLOCK_MONOTONIC_RAW, &now);
 			subtract_timespecs(&now, &last_wake, &this_wake);
-			if (timespec_after(&this_wake, &longest_wake))
-				longest_wake = this_wake;
+			if (timespec_after(&this_wake, &thread->longest_wake))
+				thread->longest_wake = this_wake;
+
+			/* Grow the reservation when it was too short. */
+			if (thread->sched_deadline &&
+			    this_wake.tv_sec * 1000000000ULL +
+			    this_wake.tv_nsec > thread->dl_runtime_ns) {
+				thread->dl_overruns++;
+				thread_set_scheduling(thread);
+			}
 		}
 
 		ATLOG(atlog, AUDIO_THREAD_SLEEP, wait_ts ? wait_ts->tv_sec : 0,
-		      wait_ts ? wait_ts->tv_nsec : 0, longest_wake.tv_nsec);
+		      wait_ts ? wait_ts->tv_nsec : 0,
+		      thread->longest_wake.tv_nsec);
 		if(wait_ts)
-			check_busyloop(wait_ts);
+			check_busyloop(thread, wait_ts);
 		rc = ppoll(thread->pollfds, thread->num_pollfds, wait_ts, NULL);
 		clock_gettime(CLOCK_MONOTONIC_RAW, &last_wake);
+		dev_io_set_wake_ts(&last_wake);
+		thread->num_wakes++;
 		ATLOG(atlog, AUDIO_THREAD_WAKE, rc, 0, 0);
 		if (rc <= 0)
 			continue;
@@ -979,7 +1188,7 @@ restart_poll_loop:
 				syslog(LOG_INFO, "handle message %d", rc);
 		}
 
-		DL_FOREACH(iodev_callbacks, iodev_cb) {
+		DL_FOREACH(thread_callbacks(thread), iodev_cb) {
 			if (iodev_cb->pollfd &&
 			    iodev_cb->pollfd->revents & (POLLIN | POLLOUT)) {
 				ATLOG(atlog, AUDIO_THREAD_IODEV_CB,
@@ -1224,6 +1433,12 @@ struct audio_thread *audio_thread_create()
 	thread->to_thread_fds[1] = -1;
 	thread->to_main_fds[0] = -1;
 	thread->to_main_fds[1] = -1;
+	thread->cpu = -1;
+	thread->wake_tolerance.tv_sec =
+		cras_system_get_wake_tolerance_us() / 1000000;
+	thread->wake_tolerance.tv_nsec =
+		(cras_system_get_wake_tolerance_us() % 1000000) * 1000;
+	thread->sched_deadline = cras_system_get_sched_deadline();
 
 	/* Two way pipes for communication with the device's audio thread. */
 	rc = pipe(thread->to_thread_fds);
@@ -1239,7 +1454,9 @@ struct audio_thread *audio_thread_create()
 		return NULL;
 	}
 
-	atlog = audio_thread_event_log_init();
+	/* All audio threads log to the same event log. */
+	if (num_log_users++ == 0)
+		atlog = audio_thread_event_log_init();
 
 	thread->pollfds_size = 32;
 	thread->pollfds =
@@ -1249,6 +1466,21 @@ struct audio_thread *audio_thread_create()
 	return thread;
 }
 
+struct audio_thread *audio_thread_create_worker(unsigned int worker_idx,
+						int cpu)
+{
+	struct audio_thread *thread;
+
+	thread = audio_thread_create();
+	if (!thread)
+		return NULL;
+
+	thread->worker_idx = worker_idx + 1;
+	thread->cpu = cpu;
+
+	return thread;
+}
+
 int audio_thread_add_open_dev(struct audio_thread *thread,
 				struct cras_iodev *dev)
 {
@@ -1332,7 +1564,10 @@ void audio_thread_destroy(struct audio_thread *thread)
 
 	free(thread->pollfds);
 
-	audio_thread_event_log_deinit(atlog);
+	if (--num_log_users == 0) {
+		audio_thread_event_log_deinit(atlog);
+		atlog = NULL;
+	}
 
 	if (thread->to_thread_fds[0] != -1) {
 		close(thread->to_thread_fds[0]);
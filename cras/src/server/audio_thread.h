@@ -31,6 +31,23 @@ struct dev_stream;
  *    pollfds_size - Number of available poll fds.
  *    num_pollfds - Number of currently registered poll fds.
  *    remix_converter - Format converter used to remix output channels.
+ *    worker_idx - Zero for the main audio thread. For a device group worker,
+ *        one plus the index of the worker. Workers only service the devices
+ *        added to them and don't poll the callbacks added with
+ *        audio_thread_add_callback().
+ *    cpu - The CPU the thread is pinned to, or -1 if it isn't pinned.
+ *    longest_wake - The longest time between two wake ups of the thread.
+ *    continuous_zero_sleep_count - Number of consecutive zero length sleeps,
+ *        used to detect busy loops.
+ *    wake_tolerance - How early the thread may service streams so that those
+ *        due close together share one wake up.
+ *    num_wakes - Number of wake ups since wakes_since.
+ *    wakes_since - When num_wakes was last reset by a debug dump.
+ *    sched_deadline - Non-zero while the thread runs with SCHED_DEADLINE.
+ *    dl_runtime_ns - The CPU time reserved each period with SCHED_DEADLINE.
+ *    dl_period_ns - The SCHED_DEADLINE period, the shortest callback
+ *        interval of the open devices.
+ *    dl_overruns - Number of wake ups that ran longer than dl_runtime.
  */
 struct audio_thread {
 	int to_thread_fds[2];
@@ -43,6 +60,17 @@ struct audio_thread {
 	size_t pollfds_size;
 	size_t num_pollfds;
 	struct cras_fmt_conv *remix_converter;
+	unsigned int worker_idx;
+	int cpu;
+	struct timespec longest_wake;
+	unsigned int continuous_zero_sleep_count;
+	struct timespec wake_tolerance;
+	unsigned int num_wakes;
+	struct timespec wakes_since;
+	int sched_deadline;
+	uint64_t dl_runtime_ns;
+	uint64_t dl_period_ns;
+	unsigned int dl_overruns;
 };
 
 /* Callback function to be handled in main loop in audio thread.
@@ -58,6 +86,18 @@ typedef int (*thread_callback)(void *data);
  */
 struct audio_thread *audio_thread_create();
 
+/* Creates a worker thread for a group of devices that share no streams with
+ * the devices of other threads.
+ * Args:
+ *    worker_idx - Index of the worker, starting from zero.
+ *    cpu - The CPU to pin the thread to, -1 to leave it unpinned.
+ * Returns:
+ *    A pointer to the newly created audio thread.  It must be freed by calling
+ *    audio_thread_destroy().  Returns NULL on error.
+ */
+struct audio_thread *audio_thread_create_worker(unsigned int worker_idx,
+						int cpu);
+
 /* Adds an open device.
  * Args:
  *    thread - The thread to add open device to.
@@ -171,7 +211,10 @@ int audio_thread_disconnect_stream(struct audio_thread *thread,
 				   struct cras_rstream *stream,
 				   struct cras_iodev *iodev);
 
-/* Dumps information about all active streams to syslog. */
+/* Dumps information about the devices and streams of the thread. The devices
+ * and streams are appended after the info->num_devs devices and
+ * info->num_streams streams already dumped, so the info of several threads
+ * can be collected into one struct. */
 int audio_thread_dump_thread_info(struct audio_thread *thread,
 				  struct audio_debug_info *info);
 
@@ -2,7 +2,7 @@
  * Use of this source code is governed by a BSD-style license that can be
  * found in the LICENSE file.
  *
- * The blow logging funcitons must only be called from the audio thread.
+ * The blow logging funcitons must only be called from the audio threads.
  */
 
 #ifndef AUDIO_THREAD_LOG_H_
@@ -41,6 +41,24 @@ void audio_thread_event_log_deinit(struct audio_thread_event_log *log)
 	free(log);
 }
 
+/* Claims the next entry of the log. Device group worker threads share the
+ * log with the main audio thread, so the write position is advanced
+ * atomically to give each writer its own entry.
+ */
+static inline uint32_t audio_thread_event_log_claim(
+		struct audio_thread_event_log *log)
+{
+	uint32_t pos, next;
+
+	pos = __atomic_load_n(&log->write_pos, __ATOMIC_RELAXED);
+	do {
+		next = (pos + 1) % AUDIO_THREAD_EVENT_LOG_SIZE;
+	} while (!__atomic_compare_exchange_n(&log->write_pos, &pos, next, 0,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+	return pos;
+}
+
 /* Log a tag and the current time, Uses two words, the first is split
  * 8 bits for tag and 24 for seconds, second word is micro seconds.
  */
@@ -52,17 +70,16 @@ static inline void audio_thread_event_log_data(
 		uint32_t data3)
 {
 	struct timespec now;
+	uint32_t pos;
 
 	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
-	log->log[log->write_pos].tag_sec =
+	pos = audio_thread_event_log_claim(log);
+	log->log[pos].tag_sec =
 			(event << 24) | (now.tv_sec & 0x00ffffff);
-	log->log[log->write_pos].nsec = now.tv_nsec;
-	log->log[log->write_pos].data1 = data1;
-	log->log[log->write_pos].data2 = data2;
-	log->log[log->write_pos].data3 = data3;
-
-	log->write_pos++;
-	log->write_pos %= AUDIO_THREAD_EVENT_LOG_SIZE;
+	log->log[pos].nsec = now.tv_nsec;
+	log->log[pos].data1 = data1;
+	log->log[pos].data2 = data2;
+	log->log[pos].data3 = data3;
 }
 
 #endif /* AUDIO_THREAD_LOG_H_ */
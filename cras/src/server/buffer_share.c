@@ -105,15 +105,10 @@ int buffer_share_rm_id(struct buffer_share *mix, unsigned int id)
 int buffer_share_offset_update(struct buffer_share *mix, unsigned int id,
 			       unsigned int delta)
 {
-	unsigned int i;
+	struct id_offset *o = find_id(mix, id);
 
-	for (i = 0; i < mix->id_sz; i++) {
-		if (id != mix->wr_idx[i].id)
-			continue;
-
-		mix->wr_idx[i].offset += delta;
-		break;
-	}
+	if (o)
+		o->offset += delta;
 
 	return 0;
 }
@@ -142,30 +137,49 @@ unsigned int buffer_share_get_new_write_point(struct buffer_share *mix)
 	return min_written;
 }
 
-static struct id_offset *get_id_offset(const struct buffer_share *mix,
-				       unsigned int id)
-{
-	unsigned int i;
-	struct id_offset *o;
-
-	for (i = 0; i < mix->id_sz; i++) {
-		o = &mix->wr_idx[i];
-		if (o->used && o->id == id)
-			return o;
-	}
-	return NULL;
-}
-
 unsigned int buffer_share_id_offset(const struct buffer_share *mix,
 				    unsigned int id)
 {
-	struct id_offset *o = get_id_offset(mix, id);
+	struct id_offset *o = find_id(mix, id);
 	return o ? o->offset : 0;
 }
 
 void *buffer_share_get_data(const struct buffer_share *mix,
 			    unsigned int id)
 {
-	struct id_offset *o = get_id_offset(mix, id);
+	struct id_offset *o = find_id(mix, id);
 	return o ? o->data : NULL;
 }
+
+int buffer_share_id_slot(const struct buffer_share *mix, unsigned int id)
+{
+	struct id_offset *o = find_id(mix, id);
+	return o ? o - mix->wr_idx : -ENOENT;
+}
+
+unsigned int buffer_share_slot_offset(const struct buffer_share *mix,
+				      unsigned int slot)
+{
+	return mix->wr_idx[slot].offset;
+}
+
+void buffer_share_slot_offset_update(struct buffer_share *mix,
+				     unsigned int slot, unsigned int frames)
+{
+	mix->wr_idx[slot].offset += frames;
+}
+
+unsigned int buffer_share_max_offset(const struct buffer_share *mix)
+{
+	unsigned int max_offset = 0;
+	unsigned int i;
+
+	for (i = 0; i < mix->id_sz; i++) {
+		const struct id_offset *o = &mix->wr_idx[i];
+
+		if (o->used)
+			max_offset = MAX(max_offset, o->offset);
+	}
+
+	return max_offset;
+}
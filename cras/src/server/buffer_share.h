@@ -59,4 +59,23 @@ unsigned int buffer_share_id_offset(const struct buffer_share *mix,
 void *buffer_share_get_data(const struct buffer_share *mix,
 			    unsigned int id);
 
+/*
+ * Gets the slot of the user given by id, its index in wr_idx. The slot is
+ * kept until the id is removed, so callers on hot paths can look the id up
+ * once and use the slot functions below instead of searching each time.
+ * Returns the slot, or -ENOENT if id isn't sharing the buffer.
+ */
+int buffer_share_id_slot(const struct buffer_share *mix, unsigned int id);
+
+/* The amount by which the user in slot is ahead of the current write point. */
+unsigned int buffer_share_slot_offset(const struct buffer_share *mix,
+				      unsigned int slot);
+
+/* Updates the offset of the user in slot into the shared buffer. */
+void buffer_share_slot_offset_update(struct buffer_share *mix,
+				     unsigned int slot, unsigned int frames);
+
+/* The largest offset of all users, how far the buffer has been written. */
+unsigned int buffer_share_max_offset(const struct buffer_share *mix);
+
 #endif /* BUFFER_SHARE_H_ */
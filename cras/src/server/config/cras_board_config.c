@@ -13,10 +13,26 @@ static const unsigned int MAX_INI_NAME_LEN = 63;
 static const unsigned int MAX_KEY_LEN = 63;
 static const int32_t DEFAULT_OUTPUT_BUFFER_SIZE = 512;
 static const int32_t AEC_SUPPORTED_DEFAULT = 0;
+static const int32_t DEVICE_GROUP_WORKERS_DEFAULT = 0;
+static const int32_t WAKE_TOLERANCE_US_DEFAULT = 0;
+static const int32_t SCHED_DEADLINE_DEFAULT = 0;
+static const int32_t A2DP_ENCODER_WORKER_DEFAULT = 0;
+static const int32_t A2DP_ADAPTIVE_RATE_DEFAULT = 0;
+static const int32_t HFP_WIDEBAND_SPEECH_DEFAULT = 0;
+static const int32_t A2DP_SINK_DEFAULT = 0;
+static const int32_t CARD_PROBE_WORKERS_DEFAULT = 4;
 
 #define CONFIG_NAME "board.ini"
 #define DEFAULT_OUTPUT_BUF_SIZE_INI_KEY "output:default_output_buffer_size"
 #define AEC_SUPPORTED_INI_KEY "processing:aec_supported"
+#define DEVICE_GROUP_WORKERS_INI_KEY "audio_thread:device_group_workers"
+#define WAKE_TOLERANCE_US_INI_KEY "audio_thread:wake_tolerance_us"
+#define SCHED_DEADLINE_INI_KEY "audio_thread:sched_deadline"
+#define A2DP_ENCODER_WORKER_INI_KEY "bluetooth:a2dp_encoder_worker"
+#define A2DP_ADAPTIVE_RATE_INI_KEY "bluetooth:a2dp_adaptive_rate"
+#define HFP_WIDEBAND_SPEECH_INI_KEY "bluetooth:hfp_wideband_speech"
+#define A2DP_SINK_INI_KEY "bluetooth:a2dp_sink"
+#define CARD_PROBE_WORKERS_INI_KEY "alsa:card_probe_workers"
 
 
 void cras_board_config_get(const char *config_path,
@@ -28,6 +44,14 @@ void cras_board_config_get(const char *config_path,
 
 	board_config->default_output_buffer_size = DEFAULT_OUTPUT_BUFFER_SIZE;
 	board_config->aec_supported = AEC_SUPPORTED_DEFAULT;
+	board_config->device_group_workers = DEVICE_GROUP_WORKERS_DEFAULT;
+	board_config->wake_tolerance_us = WAKE_TOLERANCE_US_DEFAULT;
+	board_config->sched_deadline = SCHED_DEADLINE_DEFAULT;
+	board_config->a2dp_encoder_worker = A2DP_ENCODER_WORKER_DEFAULT;
+	board_config->a2dp_adaptive_rate = A2DP_ADAPTIVE_RATE_DEFAULT;
+	board_config->hfp_wideband_speech = HFP_WIDEBAND_SPEECH_DEFAULT;
+	board_config->a2dp_sink = A2DP_SINK_DEFAULT;
+	board_config->card_probe_workers = CARD_PROBE_WORKERS_DEFAULT;
 	if (config_path == NULL)
 		return;
 
@@ -50,6 +74,46 @@ void cras_board_config_get(const char *config_path,
 	board_config->aec_supported =
 		iniparser_getint(ini, ini_key, AEC_SUPPORTED_DEFAULT);
 
+	snprintf(ini_key, MAX_KEY_LEN, DEVICE_GROUP_WORKERS_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->device_group_workers =
+		iniparser_getint(ini, ini_key, DEVICE_GROUP_WORKERS_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, WAKE_TOLERANCE_US_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->wake_tolerance_us =
+		iniparser_getint(ini, ini_key, WAKE_TOLERANCE_US_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, SCHED_DEADLINE_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->sched_deadline =
+		iniparser_getint(ini, ini_key, SCHED_DEADLINE_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, A2DP_ENCODER_WORKER_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->a2dp_encoder_worker =
+		iniparser_getint(ini, ini_key, A2DP_ENCODER_WORKER_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, A2DP_ADAPTIVE_RATE_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->a2dp_adaptive_rate =
+		iniparser_getint(ini, ini_key, A2DP_ADAPTIVE_RATE_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, HFP_WIDEBAND_SPEECH_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->hfp_wideband_speech =
+		iniparser_getint(ini, ini_key, HFP_WIDEBAND_SPEECH_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, A2DP_SINK_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->a2dp_sink =
+		iniparser_getint(ini, ini_key, A2DP_SINK_DEFAULT);
+
+	snprintf(ini_key, MAX_KEY_LEN, CARD_PROBE_WORKERS_INI_KEY);
+	ini_key[MAX_KEY_LEN] = 0;
+	board_config->card_probe_workers =
+		iniparser_getint(ini, ini_key, CARD_PROBE_WORKERS_DEFAULT);
+
 	iniparser_freedict(ini);
 	syslog(LOG_DEBUG, "Loaded ini file %s", ini_name);
 }
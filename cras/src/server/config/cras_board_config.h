@@ -11,6 +11,14 @@
 struct cras_board_config {
 	int32_t default_output_buffer_size;
 	int32_t aec_supported;
+	int32_t device_group_workers;
+	int32_t wake_tolerance_us;
+	int32_t sched_deadline;
+	int32_t a2dp_encoder_worker;
+	int32_t a2dp_adaptive_rate;
+	int32_t hfp_wideband_speech;
+	int32_t a2dp_sink;
+	int32_t card_probe_workers;
 };
 
 /* Gets a configuration based on the config file specified.
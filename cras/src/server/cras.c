@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <syslog.h>
 
+#include "cras_alsa_caps_cache.h"
 #include "cras_apm_list.h"
 #include "cras_config.h"
 #include "cras_iodev_list.h"
@@ -21,6 +22,7 @@ static struct option long_options[] = {
 	{"dsp_config", required_argument, 0, 'd'},
 	{"syslog_mask", required_argument, 0, 'l'},
 	{"device_config_dir", required_argument, 0, 'c'},
+	{"state_dir", required_argument, 0, 's'},
 	{"disable_profile", required_argument, 0, 'D'},
 	{"internal_ucm_suffix", required_argument, 0, 'u'},
 	{0, 0, 0, 0}
@@ -41,8 +43,10 @@ int main(int argc, char **argv)
 	const char default_dsp_config[] = CRAS_CONFIG_FILE_DIR "/dsp.ini";
 	const char *dsp_config = default_dsp_config;
 	const char *device_config_dir = CRAS_CONFIG_FILE_DIR;
+	const char *state_dir = CRAS_STATE_FILE_DIR;
 	const char *internal_ucm_suffix = NULL;
 	unsigned int profile_disable_mask = 0;
+	char *caps_cache_path;
 
 	set_signals();
 
@@ -66,6 +70,10 @@ int main(int argc, char **argv)
 			device_config_dir = optarg;
 			break;
 
+		case 's':
+			state_dir = optarg;
+			break;
+
 		case 'd':
 			dsp_config = optarg;
 			break;
@@ -131,6 +139,13 @@ int main(int argc, char **argv)
 			       exp_state,
 			       sizeof(*exp_state));
         free(shm_name);
+	/* The device config dir is read only, remember probed PCM capabilities
+	 * in the state dir so reboots, restarts and hotplugs can reuse them. */
+	if (asprintf(&caps_cache_path, "%s/%s", state_dir,
+		     CRAS_ALSA_CAPS_CACHE_FILE) >= 0) {
+		cras_alsa_caps_cache_init(caps_cache_path);
+		free(caps_cache_path);
+	}
 	if (internal_ucm_suffix)
 		cras_system_state_set_internal_ucm_suffix(internal_ucm_suffix);
 	cras_dsp_init(dsp_config);
@@ -0,0 +1,362 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for sendmmsg */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_thread_log.h"
+#include "cras_a2dp_encoder.h"
+#include "cras_a2dp_info.h"
+#include "cras_util.h"
+
+/* Number of encoded packets the worker can run ahead of the sender. */
+#define NUM_PACKET_SLOTS 8
+
+/* An encoded RTP packet.
+ * Members:
+ *    data - The packet, RTP header included.
+ *    len - Size of the packet in bytes.
+ *    frames - Number of PCM frames encoded in the packet.
+ *    encode_us - Time spent encoding the packet in microseconds.
+ */
+struct a2dp_packet {
+	uint8_t data[A2DP_BUF_SIZE_BYTES];
+	size_t len;
+	unsigned int frames;
+	unsigned int encode_us;
+};
+
+/* The encoder stage. The positions are absolute byte or packet counts, each
+ * one is only stored by one side and loaded with acquire ordering by the
+ * other.
+ * Members:
+ *    a2dp - The codec and encoded state, only used by the worker.
+ *    format_bytes - Number of bytes per PCM frame.
+ *    link_mtu - The maximum transmit unit of the transport.
+ *    pcm - The PCM ring.
+ *    pcm_bytes - Size of the PCM ring.
+ *    pcm_write_pos - Bytes committed by the audio thread.
+ *    pcm_read_pos - Bytes consumed by the worker.
+ *    packets - The ring of encoded packets.
+ *    pkt_write_pos - Packets queued by the worker.
+ *    pkt_read_pos - Packets sent by the audio thread.
+ *    frames_committed - Frames committed, only used by the audio thread.
+ *    frames_sent - Frames sent, only used by the audio thread.
+ *    encode_ns - Encode time of the packet the worker is filling.
+ *    wake_fds - Pipe the audio thread wakes the worker with.
+ *    ready_fds - Pipe the worker signals queued packets with.
+ *    running - Cleared to stop the worker.
+ *    tid - The worker thread.
+ */
+struct a2dp_encoder {
+	struct a2dp_info *a2dp;
+	unsigned int format_bytes;
+	size_t link_mtu;
+	uint8_t *pcm;
+	unsigned int pcm_bytes;
+	uint64_t pcm_write_pos;
+	uint64_t pcm_read_pos;
+	struct a2dp_packet packets[NUM_PACKET_SLOTS];
+	uint64_t pkt_write_pos;
+	uint64_t pkt_read_pos;
+	uint64_t frames_committed;
+	uint64_t frames_sent;
+	uint64_t encode_ns;
+	int wake_fds[2];
+	int ready_fds[2];
+	int running;
+	pthread_t tid;
+};
+
+static uint64_t elapsed_ns(const struct timespec *start)
+{
+	struct timespec now, diff;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	subtract_timespecs(&now, start, &diff);
+	return (uint64_t)diff.tv_sec * 1000000000ULL + diff.tv_nsec;
+}
+
+/* Encodes the PCM committed so far into the a2dp buffer, moving each full
+ * packet to a free slot. Stops when the PCM runs out or all slots are used.
+ */
+static void encode_packets(struct a2dp_encoder *enc)
+{
+	struct a2dp_packet *pkt;
+	struct timespec start;
+	uint64_t write_pos, read_pos, pkt_write_pos;
+	unsigned int offset, readable;
+	int processed, frames;
+
+	pkt_write_pos = enc->pkt_write_pos;
+	while (pkt_write_pos -
+	       __atomic_load_n(&enc->pkt_read_pos, __ATOMIC_ACQUIRE) <
+	       NUM_PACKET_SLOTS) {
+		pkt = &enc->packets[pkt_write_pos % NUM_PACKET_SLOTS];
+		frames = a2dp_take_packet(enc->a2dp, enc->link_mtu, pkt->data,
+					  &pkt->len);
+		if (frames > 0) {
+			pkt->frames = frames;
+			pkt->encode_us = enc->encode_ns / 1000;
+			enc->encode_ns = 0;
+			pkt_write_pos++;
+			__atomic_store_n(&enc->pkt_write_pos, pkt_write_pos,
+					 __ATOMIC_RELEASE);
+			if (write(enc->ready_fds[1], "p", 1) < 0 &&
+			    errno != EAGAIN)
+				syslog(LOG_ERR, "a2dp encoder signal ready %d",
+				       errno);
+			continue;
+		}
+
+		write_pos = __atomic_load_n(&enc->pcm_write_pos,
+					    __ATOMIC_ACQUIRE);
+		read_pos = enc->pcm_read_pos;
+		if (write_pos == read_pos)
+			return;
+		offset = read_pos % enc->pcm_bytes;
+		readable = MIN(write_pos - read_pos, enc->pcm_bytes - offset);
+
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		processed = a2dp_encode(enc->a2dp, enc->pcm + offset, readable,
+					enc->format_bytes, enc->link_mtu);
+		enc->encode_ns += elapsed_ns(&start);
+		if (processed <= 0)
+			return;
+
+		__atomic_store_n(&enc->pcm_read_pos, read_pos + processed,
+				 __ATOMIC_RELEASE);
+	}
+}
+
+static void *encoder_thread(void *arg)
+{
+	struct a2dp_encoder *enc = (struct a2dp_encoder *)arg;
+	char buf[64];
+	int rc;
+
+	while (__atomic_load_n(&enc->running, __ATOMIC_ACQUIRE)) {
+		encode_packets(enc);
+
+		rc = read(enc->wake_fds[0], buf, sizeof(buf));
+		if (rc < 0 && errno != EINTR) {
+			syslog(LOG_ERR, "a2dp encoder wait %d", errno);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static int set_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return -errno;
+	return 0;
+}
+
+static void close_pipe(int fds[2])
+{
+	if (fds[0] >= 0)
+		close(fds[0]);
+	if (fds[1] >= 0)
+		close(fds[1]);
+	fds[0] = fds[1] = -1;
+}
+
+struct a2dp_encoder *a2dp_encoder_create(struct a2dp_info *a2dp,
+					 unsigned int format_bytes,
+					 size_t link_mtu,
+					 unsigned int pcm_bytes)
+{
+	struct a2dp_encoder *enc;
+	int rc;
+
+	if (format_bytes == 0 || pcm_bytes == 0)
+		return NULL;
+
+	enc = (struct a2dp_encoder *)calloc(1, sizeof(*enc));
+	if (!enc)
+		return NULL;
+
+	enc->a2dp = a2dp;
+	enc->format_bytes = format_bytes;
+	enc->link_mtu = MIN(link_mtu, A2DP_BUF_SIZE_BYTES);
+	enc->pcm_bytes = pcm_bytes;
+	enc->wake_fds[0] = enc->wake_fds[1] = -1;
+	enc->ready_fds[0] = enc->ready_fds[1] = -1;
+
+	enc->pcm = (uint8_t *)malloc(pcm_bytes);
+	if (!enc->pcm)
+		goto error;
+
+	/* The audio thread must never block on either pipe, the worker
+	 * sleeps reading the wake pipe. */
+	if (pipe(enc->wake_fds) || pipe(enc->ready_fds)) {
+		syslog(LOG_ERR, "a2dp encoder pipe %d", errno);
+		goto error;
+	}
+	if (set_nonblock(enc->wake_fds[1]) ||
+	    set_nonblock(enc->ready_fds[0]) ||
+	    set_nonblock(enc->ready_fds[1]))
+		goto error;
+
+	enc->running = 1;
+	rc = pthread_create(&enc->tid, NULL, encoder_thread, enc);
+	if (rc) {
+		syslog(LOG_ERR, "a2dp encoder pthread_create %d", rc);
+		goto error;
+	}
+
+	return enc;
+
+error:
+	close_pipe(enc->wake_fds);
+	close_pipe(enc->ready_fds);
+	free(enc->pcm);
+	free(enc);
+	return NULL;
+}
+
+void a2dp_encoder_destroy(struct a2dp_encoder **enc)
+{
+	struct a2dp_encoder *e = *enc;
+
+	if (e == NULL)
+		return;
+
+	__atomic_store_n(&e->running, 0, __ATOMIC_RELEASE);
+	if (write(e->wake_fds[1], "q", 1) < 0)
+		syslog(LOG_ERR, "a2dp encoder stop %d", errno);
+	pthread_join(e->tid, NULL);
+
+	close_pipe(e->wake_fds);
+	close_pipe(e->ready_fds);
+	free(e->pcm);
+	free(e);
+	*enc = NULL;
+}
+
+int a2dp_encoder_ready_fd(const struct a2dp_encoder *enc)
+{
+	return enc->ready_fds[0];
+}
+
+uint8_t *a2dp_encoder_pcm_write_pointer(struct a2dp_encoder *enc,
+					unsigned int *writable)
+{
+	uint64_t read_pos = __atomic_load_n(&enc->pcm_read_pos,
+					    __ATOMIC_ACQUIRE);
+	unsigned int offset = enc->pcm_write_pos % enc->pcm_bytes;
+	unsigned int avail = enc->pcm_bytes - (enc->pcm_write_pos - read_pos);
+
+	*writable = MIN(avail, enc->pcm_bytes - offset);
+	return enc->pcm + offset;
+}
+
+int a2dp_encoder_pcm_commit(struct a2dp_encoder *enc, unsigned int nbytes)
+{
+	unsigned int writable;
+
+	a2dp_encoder_pcm_write_pointer(enc, &writable);
+	if (nbytes > writable)
+		return -EINVAL;
+
+	enc->frames_committed += nbytes / enc->format_bytes;
+	__atomic_store_n(&enc->pcm_write_pos, enc->pcm_write_pos + nbytes,
+			 __ATOMIC_RELEASE);
+
+	/* A full pipe already holds a pending wake up. */
+	if (write(enc->wake_fds[1], "w", 1) < 0 && errno != EAGAIN)
+		return -errno;
+	return 0;
+}
+
+unsigned int a2dp_encoder_queued_frames(const struct a2dp_encoder *enc)
+{
+	return enc->frames_committed - enc->frames_sent;
+}
+
+unsigned int a2dp_encoder_packets_queued(const struct a2dp_encoder *enc)
+{
+	return __atomic_load_n(&enc->pkt_write_pos, __ATOMIC_ACQUIRE) -
+	       enc->pkt_read_pos;
+}
+
+int a2dp_encoder_send(struct a2dp_encoder *enc, int fd,
+		      unsigned int min_frames, unsigned int max_frames)
+{
+	struct mmsghdr msgs[NUM_PACKET_SLOTS];
+	struct iovec iovs[NUM_PACKET_SLOTS];
+	struct a2dp_packet *pkt;
+	unsigned int queued, frames = 0;
+	unsigned int i, n = 0;
+	char buf[64];
+	int rc;
+
+	/* Clear the ready signal before looking at the packets, a packet
+	 * queued from here on signals again. */
+	while (read(enc->ready_fds[0], buf, sizeof(buf)) > 0)
+		;
+
+	memset(msgs, 0, sizeof(msgs));
+	queued = a2dp_encoder_packets_queued(enc);
+	for (n = 0; n < queued; n++) {
+		pkt = &enc->packets[(enc->pkt_read_pos + n) % NUM_PACKET_SLOTS];
+
+		if (frames + pkt->frames > max_frames)
+			break;
+
+		/* Keep enough queued to not underrun once something is
+		 * sent. */
+		if (frames && min_frames + frames + pkt->frames >
+				      a2dp_encoder_queued_frames(enc))
+			break;
+
+		frames += pkt->frames;
+		iovs[n].iov_base = pkt->data;
+		iovs[n].iov_len = pkt->len;
+		msgs[n].msg_hdr.msg_iov = &iovs[n];
+		msgs[n].msg_hdr.msg_iovlen = 1;
+	}
+	if (n == 0)
+		return 0;
+
+	/* All the packets due go out in one call. */
+	rc = sendmmsg(fd, msgs, n, MSG_DONTWAIT);
+	if (rc < 0)
+		return -errno;
+
+	frames = 0;
+	for (i = 0; i < (unsigned int)rc; i++) {
+		pkt = &enc->packets[enc->pkt_read_pos % NUM_PACKET_SLOTS];
+		enc->frames_sent += pkt->frames;
+		frames += pkt->frames;
+		__atomic_store_n(&enc->pkt_read_pos, enc->pkt_read_pos + 1,
+				 __ATOMIC_RELEASE);
+		ATLOG(atlog, AUDIO_THREAD_A2DP_SEND_PACKET, pkt->frames,
+		      pkt->encode_us, a2dp_encoder_packets_queued(enc));
+	}
+
+	/* Freed slots let the worker encode more. */
+	if (write(enc->wake_fds[1], "s", 1) < 0 && errno != EAGAIN)
+		return -errno;
+
+	return frames;
+}
@@ -0,0 +1,82 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CRAS_A2DP_ENCODER_H_
+#define CRAS_A2DP_ENCODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct a2dp_info;
+struct a2dp_encoder;
+
+/*
+ * Creates an encoder stage which encodes PCM audio to RTP packets on a
+ * worker thread, so that the audio thread only has to copy PCM samples in
+ * and send the packets out. PCM samples are passed in through a single
+ * producer single consumer ring, and the encoded packets come back through
+ * a small ring of packet slots. Neither side ever takes a lock.
+ * While the encoder exists the worker is the only user of |a2dp|.
+ * Args:
+ *    a2dp - The codec and encoded state used to build the packets.
+ *    format_bytes - Number of bytes per PCM frame.
+ *    link_mtu - The maximum transmit unit of the transport.
+ *    pcm_bytes - Size of the PCM ring in bytes, must be a multiple of the
+ *        codesize so that a codec frame never wraps around.
+ * Returns:
+ *    The encoder, or NULL on failure.
+ */
+struct a2dp_encoder *a2dp_encoder_create(struct a2dp_info *a2dp,
+					 unsigned int format_bytes,
+					 size_t link_mtu,
+					 unsigned int pcm_bytes);
+
+/* Stops the worker thread, frees the encoder and sets the pointer to NULL. */
+void a2dp_encoder_destroy(struct a2dp_encoder **enc);
+
+/*
+ * Returns the fd which becomes readable when the worker has queued packets
+ * to send.
+ */
+int a2dp_encoder_ready_fd(const struct a2dp_encoder *enc);
+
+/*
+ * Gets the pointer to write PCM samples to.
+ * Args:
+ *    enc - The encoder.
+ *    writable - Filled with the number of contiguous bytes writable.
+ */
+uint8_t *a2dp_encoder_pcm_write_pointer(struct a2dp_encoder *enc,
+					unsigned int *writable);
+
+/* Hands |nbytes| written PCM bytes over to the worker and wakes it up. */
+int a2dp_encoder_pcm_commit(struct a2dp_encoder *enc, unsigned int nbytes);
+
+/*
+ * Returns the number of frames committed but not yet sent, whether they
+ * are still PCM or already encoded.
+ */
+unsigned int a2dp_encoder_queued_frames(const struct a2dp_encoder *enc);
+
+/* Returns the number of encoded packets waiting to be sent. */
+unsigned int a2dp_encoder_packets_queued(const struct a2dp_encoder *enc);
+
+/*
+ * Sends the queued packets to |fd| without blocking, all in one sendmmsg()
+ * call. After the first packet sending stops once the queued frames would
+ * get within |min_frames|, so that sending doesn't make the device underrun.
+ * Args:
+ *    enc - The encoder.
+ *    fd - The socket to send the packets to.
+ *    min_frames - The level of queued frames to keep.
+ *    max_frames - The most frames to send, to pace the packets.
+ * Returns:
+ *    The number of frames sent, or negative error code if none could be.
+ *    -EAGAIN if the socket is full. The packets not sent stay queued.
+ */
+int a2dp_encoder_send(struct a2dp_encoder *enc, int fd,
+		      unsigned int min_frames, unsigned int max_frames);
+
+#endif /* CRAS_A2DP_ENCODER_H_ */
@@ -10,6 +10,7 @@
 #include "a2dp-codecs.h"
 #include "cras_a2dp_endpoint.h"
 #include "cras_a2dp_iodev.h"
+#include "cras_a2dp_sink_iodev.h"
 #include "cras_iodev.h"
 #include "cras_bt_constants.h"
 #include "cras_bt_endpoint.h"
@@ -26,6 +27,9 @@ static struct a2dp {
 	struct cras_bt_device *device;
 } connected_a2dp;
 
+/* The capture device of a remote A2DP source streaming to us. */
+static struct cras_iodev *a2dp_sink_iodev;
+
 static int cras_a2dp_get_capabilities(struct cras_bt_endpoint *endpoint,
 				      void *capabilities, int *len)
 {
@@ -160,6 +164,45 @@ static void a2dp_transport_state_changed(struct cras_bt_endpoint *endpoint,
 	}
 }
 
+static void cras_a2dp_sink_set_configuration(
+		struct cras_bt_endpoint *endpoint,
+		struct cras_bt_transport *transport)
+{
+	if (a2dp_sink_iodev) {
+		syslog(LOG_WARNING,
+		       "Replacing existing sink endpoint configuration");
+		a2dp_sink_iodev_destroy(a2dp_sink_iodev);
+	}
+
+	a2dp_sink_iodev = a2dp_sink_iodev_create(transport);
+	if (!a2dp_sink_iodev)
+		syslog(LOG_WARNING, "Failed to create a2dp sink iodev");
+}
+
+static void cras_a2dp_sink_suspend(struct cras_bt_endpoint *endpoint,
+				   struct cras_bt_transport *transport)
+{
+	if (!a2dp_sink_iodev)
+		return;
+
+	syslog(LOG_INFO, "Destroying iodev for A2DP source device");
+	a2dp_sink_iodev_destroy(a2dp_sink_iodev);
+	a2dp_sink_iodev = NULL;
+}
+
+static void a2dp_sink_transport_state_changed(
+		struct cras_bt_endpoint *endpoint,
+		struct cras_bt_transport *transport)
+{
+	/* The remote source starts streaming on its own, the transport is
+	 * pending until it's acquired. Keep it if it's open for capture. */
+	if (a2dp_sink_iodev && transport &&
+	    cras_bt_transport_fd(transport) != -1 &&
+	    cras_bt_transport_state(transport) ==
+			CRAS_BT_TRANSPORT_STATE_PENDING)
+		cras_bt_transport_try_acquire(transport);
+}
+
 static struct cras_bt_endpoint cras_a2dp_endpoint = {
 	/* BlueZ connects the device A2DP Sink to our A2DP Source endpoint,
 	 * and the device A2DP Source to our A2DP Sink. It's best if you don't
@@ -176,9 +219,27 @@ static struct cras_bt_endpoint cras_a2dp_endpoint = {
 	.transport_state_changed = a2dp_transport_state_changed
 };
 
+static struct cras_bt_endpoint cras_a2dp_sink_endpoint = {
+	.object_path = A2DP_SINK_ENDPOINT_PATH,
+	.uuid = A2DP_SINK_UUID,
+	.codec = A2DP_CODEC_SBC,
+
+	.get_capabilities = cras_a2dp_get_capabilities,
+	.select_configuration = cras_a2dp_select_configuration,
+	.set_configuration = cras_a2dp_sink_set_configuration,
+	.suspend = cras_a2dp_sink_suspend,
+	.transport_state_changed = a2dp_sink_transport_state_changed
+};
+
 int cras_a2dp_endpoint_create(DBusConnection *conn)
 {
-	return cras_bt_endpoint_add(conn, &cras_a2dp_endpoint);
+	int rc;
+
+	rc = cras_bt_endpoint_add(conn, &cras_a2dp_endpoint);
+	if (rc || !cras_system_get_a2dp_sink())
+		return rc;
+
+	return cras_bt_endpoint_add(conn, &cras_a2dp_sink_endpoint);
 }
 
 void cras_a2dp_start(struct cras_bt_device *device)
@@ -3,8 +3,16 @@
  * found in the LICENSE file.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for sendmmsg */
+#endif
+
+#include <errno.h>
 #include <netinet/in.h>
 #include <sbc/sbc.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
 #include <syslog.h>
 
 #include "cras_a2dp_info.h"
@@ -12,10 +20,11 @@
 #include "cras_types.h"
 #include "rtp.h"
 
-int init_a2dp(struct a2dp_info *a2dp, a2dp_sbc_t *sbc)
+/* Creates an SBC codec for the negotiated configuration, coding at its max
+ * bitpool. */
+static struct cras_audio_codec *create_sbc_codec(const a2dp_sbc_t *sbc)
 {
-	uint8_t frequency = 0, mode = 0, subbands = 0, allocation, blocks = 0,
-		bitpool;
+	uint8_t frequency = 0, mode = 0, subbands = 0, allocation, blocks = 0;
 
 	if (sbc->frequency & SBC_SAMPLING_FREQ_48000)
 		frequency = SBC_FREQ_48000;
@@ -64,10 +73,21 @@ int init_a2dp(struct a2dp_info *a2dp, a2dp_sbc_t *sbc)
 		break;
 	}
 
+	return cras_sbc_codec_create(frequency, mode, subbands, allocation,
+				     blocks, sbc->max_bitpool);
+}
+
+int init_a2dp(struct a2dp_info *a2dp, a2dp_sbc_t *sbc)
+{
+	uint8_t bitpool;
+
 	bitpool = sbc->max_bitpool;
+	a2dp->min_bitpool = MIN(sbc->min_bitpool, sbc->max_bitpool);
+	a2dp->max_bitpool = sbc->max_bitpool;
+	a2dp->bitpool = bitpool;
+	a2dp->next_bitpool = bitpool;
 
-	a2dp->codec = cras_sbc_codec_create(frequency, mode, subbands,
-					    allocation, blocks, bitpool);
+	a2dp->codec = create_sbc_codec(sbc);
 	if (!a2dp->codec)
 		return -1;
 
@@ -84,6 +104,11 @@ int init_a2dp(struct a2dp_info *a2dp, a2dp_sbc_t *sbc)
 	return 0;
 }
 
+struct cras_audio_codec *a2dp_create_decoder(const a2dp_sbc_t *sbc)
+{
+	return create_sbc_codec(sbc);
+}
+
 void destroy_a2dp(struct a2dp_info *a2dp)
 {
 	cras_sbc_codec_destroy(a2dp->codec);
@@ -101,7 +126,14 @@ int a2dp_block_size(struct a2dp_info *a2dp, int a2dp_bytes)
 
 int a2dp_queued_frames(const struct a2dp_info *a2dp)
 {
-	return a2dp->samples;
+	return a2dp->samples + a2dp->packets_queued_samples;
+}
+
+int a2dp_set_bitpool(struct a2dp_info *a2dp, int bitpool)
+{
+	bitpool = MAX(MIN(bitpool, a2dp->max_bitpool), a2dp->min_bitpool);
+	__atomic_store_n(&a2dp->next_bitpool, bitpool, __ATOMIC_RELAXED);
+	return bitpool;
 }
 
 void a2dp_drain(struct a2dp_info *a2dp)
@@ -111,11 +143,14 @@ void a2dp_drain(struct a2dp_info *a2dp)
 	a2dp->samples = 0;
 	a2dp->seq_num = 0;
 	a2dp->frame_count = 0;
+	a2dp->packet_head = 0;
+	a2dp->packets_queued = 0;
+	a2dp->packets_queued_samples = 0;
 }
 
-static int avdtp_write(int stream_fd, struct a2dp_info *a2dp)
+/* Fills the RTP header and payload header of the queued a2dp buffer. */
+static void fill_rtp_header(struct a2dp_info *a2dp)
 {
-	int err, samples;
 	struct rtp_header *header;
 	struct rtp_payload *payload;
 
@@ -129,17 +164,16 @@ static int avdtp_write(int stream_fd, struct a2dp_info *a2dp)
 	header->sequence_number = htons(a2dp->seq_num);
 	header->timestamp = htonl(a2dp->nsamples);
 	header->ssrc = htonl(1);
+}
 
-	err = send(stream_fd, a2dp->a2dp_buf, a2dp->a2dp_buf_used,
-		   MSG_DONTWAIT);
-	if (err < 0)
-		return -errno;
-
-	/* Returns the number of samples in frame. */
-	samples = a2dp->samples;
+/* Resets the a2dp buffer after its content has been sent or taken, returns
+ * the number of samples it held. */
+static int reset_a2dp_buf(struct a2dp_info *a2dp)
+{
+	int samples = a2dp->samples;
 
-	/* Reset some data */
-	a2dp->a2dp_buf_used = sizeof(*header) + sizeof(*payload);
+	a2dp->a2dp_buf_used = sizeof(struct rtp_header)
+			+ sizeof(struct rtp_payload);
 	a2dp->frame_count = 0;
 	a2dp->samples = 0;
 	a2dp->seq_num++;
@@ -147,10 +181,59 @@ static int avdtp_write(int stream_fd, struct a2dp_info *a2dp)
 	return samples;
 }
 
+/* Returns non-zero if the a2dp buffer can't hold another SBC frame. */
+static int a2dp_buf_full(const struct a2dp_info *a2dp, size_t link_mtu)
+{
+	return a2dp->a2dp_buf_used + a2dp->frame_length >
+	       link_mtu - sizeof(struct rtp_header) -
+			       sizeof(struct rtp_payload);
+}
+
+/* Sends the waiting packets in one call, stopping before the one which
+ * would take the frames sent above max_frames. Returns the number of frames
+ * sent, or negative error code if none could be. */
+static int avdtp_write(int stream_fd, struct a2dp_info *a2dp,
+		       unsigned int max_frames)
+{
+	struct mmsghdr msgs[A2DP_NUM_QUEUED_PACKETS];
+	struct iovec iovs[A2DP_NUM_QUEUED_PACKETS];
+	unsigned int i, idx, frames = 0;
+	int sent;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < a2dp->packets_queued; i++) {
+		idx = (a2dp->packet_head + i) % A2DP_NUM_QUEUED_PACKETS;
+		if (frames + a2dp->packet_samples[idx] > max_frames)
+			break;
+		frames += a2dp->packet_samples[idx];
+		iovs[i].iov_base = a2dp->packets[idx];
+		iovs[i].iov_len = a2dp->packet_len[idx];
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	if (i == 0)
+		return 0;
+
+	sent = sendmmsg(stream_fd, msgs, i, MSG_DONTWAIT);
+	if (sent < 0)
+		return -errno;
+
+	/* Returns the number of samples in the packets sent. */
+	frames = 0;
+	for (i = 0; i < (unsigned int)sent; i++) {
+		idx = a2dp->packet_head;
+		frames += a2dp->packet_samples[idx];
+		a2dp->packets_queued_samples -= a2dp->packet_samples[idx];
+		a2dp->packet_head = (idx + 1) % A2DP_NUM_QUEUED_PACKETS;
+		a2dp->packets_queued--;
+	}
+	return frames;
+}
+
 int a2dp_encode(struct a2dp_info *a2dp, const void *pcm_buf, int pcm_buf_size,
 		int format_bytes, size_t link_mtu)
 {
-	int processed;
+	int processed, next_bitpool;
 	size_t out_encoded;
 
 	if (link_mtu > A2DP_BUF_SIZE_BYTES)
@@ -158,6 +241,14 @@ int a2dp_encode(struct a2dp_info *a2dp, const void *pcm_buf, int pcm_buf_size,
 	if (link_mtu == a2dp->a2dp_buf_used)
 		return 0;
 
+	/* Only switch bitpool between packets. */
+	next_bitpool = __atomic_load_n(&a2dp->next_bitpool, __ATOMIC_RELAXED);
+	if (next_bitpool != a2dp->bitpool && a2dp->frame_count == 0) {
+		a2dp->frame_length = cras_sbc_set_bitpool(a2dp->codec,
+							  next_bitpool);
+		a2dp->bitpool = next_bitpool;
+	}
+
 	processed = a2dp->codec->encode(a2dp->codec, pcm_buf, pcm_buf_size,
 					a2dp->a2dp_buf + a2dp->a2dp_buf_used,
 					link_mtu - a2dp->a2dp_buf_used,
@@ -177,12 +268,45 @@ int a2dp_encode(struct a2dp_info *a2dp, const void *pcm_buf, int pcm_buf_size,
 	return processed;
 }
 
-int a2dp_write(struct a2dp_info *a2dp, int stream_fd, size_t link_mtu)
+int a2dp_queue_packet(struct a2dp_info *a2dp, size_t link_mtu)
 {
-	/* Do avdtp write when the max number of SBC frames is reached. */
-	if (a2dp->a2dp_buf_used + a2dp->frame_length >
-	    link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-		return avdtp_write(stream_fd, a2dp);
+	unsigned int idx;
+	int samples;
 
-	return 0;
+	if (a2dp->packets_queued == A2DP_NUM_QUEUED_PACKETS)
+		return 0;
+
+	idx = (a2dp->packet_head + a2dp->packets_queued) %
+	      A2DP_NUM_QUEUED_PACKETS;
+	samples = a2dp_take_packet(a2dp, link_mtu, a2dp->packets[idx],
+				   &a2dp->packet_len[idx]);
+	if (samples <= 0)
+		return 0;
+
+	a2dp->packet_samples[idx] = samples;
+	a2dp->packets_queued++;
+	a2dp->packets_queued_samples += samples;
+	return samples;
+}
+
+int a2dp_write(struct a2dp_info *a2dp, int stream_fd, size_t link_mtu,
+	       unsigned int max_frames)
+{
+	/* Queue the packet when the max number of SBC frames is reached. */
+	a2dp_queue_packet(a2dp, link_mtu);
+
+	return avdtp_write(stream_fd, a2dp, max_frames);
+}
+
+int a2dp_take_packet(struct a2dp_info *a2dp, size_t link_mtu,
+		     uint8_t *packet, size_t *packet_len)
+{
+	if (!a2dp_buf_full(a2dp, link_mtu))
+		return 0;
+
+	fill_rtp_header(a2dp);
+	memcpy(packet, a2dp->a2dp_buf, a2dp->a2dp_buf_used);
+	*packet_len = a2dp->a2dp_buf_used;
+
+	return reset_a2dp_buf(a2dp);
 }
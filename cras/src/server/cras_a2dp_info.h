@@ -9,6 +9,8 @@
 #include "a2dp-codecs.h"
 
 #define A2DP_BUF_SIZE_BYTES 1024
+/* Number of full RTP packets which can wait to be sent together. */
+#define A2DP_NUM_QUEUED_PACKETS 4
 
 /* Represents the codec and encoded state of a2dp iodev.
  * Members:
@@ -21,6 +23,18 @@
  *    samples - Queued PCM frame count currently in a2dp buffer.
  *    nsamples - Cumulative number of encoded PCM frames.
  *    a2dp_buf_used - Used a2dp buffer counter in bytes.
+ *    min_bitpool - The lowest bitpool negotiated with the sink.
+ *    max_bitpool - The highest bitpool negotiated with the sink.
+ *    bitpool - The bitpool the codec encodes with.
+ *    next_bitpool - The bitpool to switch to at the start of the next
+ *        packet. Set from the audio thread while the encoder worker may be
+ *        encoding, so it is accessed atomically.
+ *    packets - Full RTP packets waiting to be sent.
+ *    packet_len - Size in bytes of each packet in packets.
+ *    packet_samples - Number of PCM frames in each packet in packets.
+ *    packet_head - Index in packets of the oldest packet.
+ *    packets_queued - Number of packets waiting to be sent.
+ *    packets_queued_samples - Number of PCM frames in all waiting packets.
  */
 struct a2dp_info {
 	struct cras_audio_codec *codec;
@@ -32,6 +46,16 @@ struct a2dp_info {
 	int samples;
 	int nsamples;
 	size_t a2dp_buf_used;
+	int min_bitpool;
+	int max_bitpool;
+	int bitpool;
+	int next_bitpool;
+	uint8_t packets[A2DP_NUM_QUEUED_PACKETS][A2DP_BUF_SIZE_BYTES];
+	size_t packet_len[A2DP_NUM_QUEUED_PACKETS];
+	int packet_samples[A2DP_NUM_QUEUED_PACKETS];
+	unsigned int packet_head;
+	unsigned int packets_queued;
+	int packets_queued_samples;
 };
 
 /*
@@ -39,6 +63,12 @@ struct a2dp_info {
  */
 int init_a2dp(struct a2dp_info *a2dp, a2dp_sbc_t *sbc);
 
+/*
+ * Creates an SBC decoder for the given sbc configuration, to decode what a
+ * remote A2DP source sends. Destroy with cras_sbc_codec_destroy().
+ */
+struct cras_audio_codec *a2dp_create_decoder(const a2dp_sbc_t *sbc);
+
 /*
  * Destroys an a2dp_info.
  */
@@ -55,7 +85,8 @@ int a2dp_codesize(struct a2dp_info *a2dp);
 int a2dp_block_size(struct a2dp_info *a2dp, int encoded_bytes);
 
 /*
- * Gets the number of queued frames in a2dp_info.
+ * Gets the number of queued frames in a2dp_info, including the packets
+ * waiting to be sent.
  */
 int a2dp_queued_frames(const struct a2dp_info *a2dp);
 
@@ -64,6 +95,13 @@ int a2dp_queued_frames(const struct a2dp_info *a2dp);
  */
 void a2dp_drain(struct a2dp_info *a2dp);
 
+/*
+ * Requests a new bitpool, clamped to the negotiated range. It takes effect
+ * from the next packet so that all SBC frames of a packet are the same
+ * length. Returns the bitpool that will be used.
+ */
+int a2dp_set_bitpool(struct a2dp_info *a2dp, int bitpool);
+
 /*
  * Encodes samples using the codec for this a2dp instance, returns the number of
  * pcm bytes processed.
@@ -78,12 +116,42 @@ int a2dp_encode(struct a2dp_info *a2dp, const void *pcm_buf, int pcm_buf_size,
 		int format_bytes, size_t link_mtu);
 
 /*
- * Writes samples using a2dp, returns number of frames written.
+ * Moves the encoded frames to the packets waiting to be sent when the max
+ * number of SBC frames is reached, so that encoding can continue with the
+ * next packet. Returns the number of samples in the packet, or 0 if it isn't
+ * full yet or too many packets are waiting.
+ * Args:
+ *    a2dp: The a2dp info object.
+ *    link_mtu: The maximum transmit unit.
+ */
+int a2dp_queue_packet(struct a2dp_info *a2dp, size_t link_mtu);
+
+/*
+ * Writes samples using a2dp. The encoded frames are queued as a packet if
+ * full, then the waiting packets are sent together with one sendmmsg()
+ * call. Returns number of frames written, or negative error code if the
+ * first packet couldn't be sent.
  * Args:
  *    a2dp: The a2dp info object.
  *    stream_fd: The file descriptor to send stream to.
  *    link_mtu: The maximum transmit unit.
+ *    max_frames: Don't send the packets which would take the number of
+ *        frames written above this.
+ */
+int a2dp_write(struct a2dp_info *a2dp, int stream_fd, size_t link_mtu,
+	       unsigned int max_frames);
+
+/*
+ * Moves the encoded frames out as a complete RTP packet when the max number
+ * of SBC frames is reached, the same condition a2dp_write() sends on.
+ * Returns the number of samples in the packet, or 0 if it isn't full yet.
+ * Args:
+ *    a2dp: The a2dp info object.
+ *    link_mtu: The maximum transmit unit.
+ *    packet: Buffer of at least A2DP_BUF_SIZE_BYTES to copy the packet to.
+ *    packet_len: Filled with the size of the packet in bytes.
  */
-int a2dp_write(struct a2dp_info *a2dp, int stream_fd, size_t link_mtu);
+int a2dp_take_packet(struct a2dp_info *a2dp, size_t link_mtu,
+		     uint8_t *packet, size_t *packet_len);
 
 #endif /* CRAS_A2DP_INFO_H_ */
@@ -3,6 +3,7 @@
  * found in the LICENSE file.
  */
 
+#include <limits.h>
 #include <stdint.h>
 #include <sys/ioctl.h>
 #include <sys/param.h>
@@ -16,12 +17,15 @@
 #include "audio_thread_log.h"
 #include "byte_buffer.h"
 #include "cras_iodev_list.h"
+#include "cras_a2dp_encoder.h"
 #include "cras_a2dp_endpoint.h"
 #include "cras_a2dp_info.h"
 #include "cras_a2dp_iodev.h"
+#include "cras_a2dp_rate_ctrl.h"
 #include "cras_audio_area.h"
 #include "cras_bt_device.h"
 #include "cras_iodev.h"
+#include "cras_system_state.h"
 #include "cras_util.h"
 #include "sfh.h"
 #include "rtp.h"
@@ -37,12 +41,19 @@
  *    transport - The transport object for bluez media API.
  *    sock_depth_frames - Socket depth in frames of the a2dp socket.
  *    pcm_buf - Buffer to hold pcm samples before encode.
+ *    encoder - The encoder stage when encoding on a worker thread, pcm_buf
+ *        isn't used in that case.
  *    destroyed - Flag to note if this a2dp_io is about to destroy.
  *    pre_fill_complete - Flag to note if socket pre-fill is completed.
  *    bt_written_frames - Accumulated frames written to a2dp socket. Used
  *        together with the device open timestamp to estimate how many virtual
  *        buffer is queued there.
  *    dev_open_time - The last time a2dp_ios is opened.
+ *    adaptive_rate - Flag to note if the bitpool adapts to congestion of the
+ *        link and packets are paced.
+ *    rate_ctrl - The bitpool and pacing controller used when adaptive_rate
+ *        is set.
+ *    sndbuf_bytes - Size of the transport socket send buffer, 0 if unknown.
  */
 struct a2dp_io {
 	struct cras_iodev base;
@@ -50,13 +61,18 @@ struct a2dp_io {
 	struct cras_bt_transport *transport;
 	unsigned sock_depth_frames;
 	struct byte_buffer *pcm_buf;
+	struct a2dp_encoder *encoder;
 	int destroyed;
 	int pre_fill_complete;
 	uint64_t bt_written_frames;
 	struct timespec dev_open_time;
+	int adaptive_rate;
+	struct a2dp_rate_ctrl rate_ctrl;
+	int sndbuf_bytes;
 };
 
 static int flush_data(void *arg);
+static int pre_fill_socket(struct a2dp_io *a2dpio);
 
 static int update_supported_formats(struct cras_iodev *iodev)
 {
@@ -122,24 +138,119 @@ static int bt_queued_frames(const struct cras_iodev *iodev, int fr)
 }
 
 
+/* Returns the number of bytes queued in the transport socket, or negative
+ * error code if it can't be told. Bluetooth sockets report the free space of
+ * the send buffer for SIOCOUTQ. */
+static int socket_queued_bytes(const struct a2dp_io *a2dpio)
+{
+	int free_bytes;
+
+	if (a2dpio->sndbuf_bytes <= 0)
+		return -EINVAL;
+	if (ioctl(cras_bt_transport_fd(a2dpio->transport), SIOCOUTQ,
+		  &free_bytes) < 0)
+		return -errno;
+	return MAX(a2dpio->sndbuf_bytes - free_bytes, 0);
+}
+
+/* Returns the number of frames queued in the transport socket, or negative
+ * error code if it can't be told. The send buffer holds sock_depth_frames
+ * when full, the kernel accounts the packet overhead in the same
+ * proportion. */
+static int socket_queued_frames(const struct a2dp_io *a2dpio)
+{
+	int queued_bytes = socket_queued_bytes(a2dpio);
+
+	if (queued_bytes < 0)
+		return queued_bytes;
+	return (uint64_t)queued_bytes * a2dpio->sock_depth_frames /
+	       a2dpio->sndbuf_bytes;
+}
+
+/* Returns the frames not sent to the socket yet. */
+static int local_queued_frames(const struct a2dp_io *a2dpio)
+{
+	if (a2dpio->encoder)
+		return a2dp_encoder_queued_frames(a2dpio->encoder);
+	return a2dp_queued_frames(&a2dpio->a2dp) +
+	       buf_queued(a2dpio->pcm_buf) /
+			cras_get_format_bytes(a2dpio->base.format);
+}
+
 static int frames_queued(const struct cras_iodev *iodev,
 			 struct timespec *tstamp)
 {
 	struct a2dp_io *a2dpio = (struct a2dp_io *)iodev;
 	int estimate_queued_frames = bt_queued_frames(iodev, 0);
-	int local_queued_frames =
-			a2dp_queued_frames(&a2dpio->a2dp) +
-			buf_queued(a2dpio->pcm_buf) /
-				cras_get_format_bytes(iodev->format);
+	int local_queued = local_queued_frames(a2dpio);
+	int socket_queued = socket_queued_frames(a2dpio);
+
+	/* What is in the socket hasn't left the host yet. */
+	if (socket_queued > 0)
+		local_queued += socket_queued;
 	clock_gettime(CLOCK_MONOTONIC_RAW, tstamp);
 	return MIN(iodev->buffer_size,
-		   MAX(estimate_queued_frames, local_queued_frames));
+		   MAX(estimate_queued_frames, local_queued));
+}
+
+/* Starts pacing and bitpool control once the socket is pre-filled. */
+static void start_rate_ctrl(struct a2dp_io *a2dpio)
+{
+	if (!a2dpio->adaptive_rate)
+		return;
+
+	/* Pace one socket depth ahead of real time, and treat the link as
+	 * congested while more than half the send buffer stays queued. */
+	a2dp_rate_ctrl_init(&a2dpio->rate_ctrl,
+			    a2dpio->base.format->frame_rate,
+			    a2dpio->sock_depth_frames,
+			    a2dpio->a2dp.min_bitpool,
+			    a2dpio->a2dp.max_bitpool,
+			    a2dpio->sndbuf_bytes / 2,
+			    &a2dpio->dev_open_time);
+	a2dp_set_bitpool(&a2dpio->a2dp, a2dpio->rate_ctrl.bitpool);
+}
+
+/* Returns the number of frames which can be sent now. */
+static unsigned int frames_due(struct a2dp_io *a2dpio)
+{
+	struct timespec now;
+
+	if (!a2dpio->adaptive_rate)
+		return UINT_MAX;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	return a2dp_rate_ctrl_frames_due(&a2dpio->rate_ctrl, &now);
+}
+
+/* Feeds the result of a write to the controller, and switches bitpool if
+ * it asks for another one. */
+static void update_rate_ctrl(struct a2dp_io *a2dpio, int written)
+{
+	struct timespec now;
+	unsigned int queued_bytes;
+	int bitpool;
+
+	if (!a2dpio->adaptive_rate)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	queued_bytes = MAX(socket_queued_bytes(a2dpio), 0);
+	bitpool = a2dp_rate_ctrl_update(&a2dpio->rate_ctrl, &now, written,
+					queued_bytes);
+	if (bitpool == a2dpio->a2dp.next_bitpool)
+		return;
+
+	a2dp_set_bitpool(&a2dpio->a2dp, bitpool);
+	ATLOG(atlog, AUDIO_THREAD_A2DP_SET_BITPOOL, bitpool, queued_bytes,
+	      a2dpio->rate_ctrl.num_eagain);
 }
 
 static int configure_dev(struct cras_iodev *iodev)
 {
 	struct a2dp_io *a2dpio = (struct a2dp_io *)iodev;
 	int sock_depth;
+	socklen_t optlen;
 	int err;
 
 	err = cras_bt_transport_acquire(a2dpio->transport);
@@ -159,10 +270,6 @@ static int configure_dev(struct cras_iodev *iodev)
 	iodev->format->format = SND_PCM_FORMAT_S16_LE;
 	cras_iodev_init_audio_area(iodev, iodev->format->num_channels);
 
-	a2dpio->pcm_buf = byte_buffer_create(PCM_BUF_MAX_SIZE_BYTES);
-	if (!a2dpio->pcm_buf)
-		return -ENOMEM;
-
 	iodev->buffer_size = PCM_BUF_MAX_SIZE_FRAMES;
 
 	/* Set up the socket to hold two MTUs full of data before returning
@@ -171,6 +278,12 @@ static int configure_dev(struct cras_iodev *iodev)
 	sock_depth = 2 * cras_bt_transport_write_mtu(a2dpio->transport);
 	setsockopt(cras_bt_transport_fd(a2dpio->transport),
 		   SOL_SOCKET, SO_SNDBUF, &sock_depth, sizeof(sock_depth));
+	/* The kernel adjusts the size set, read back what it uses. The
+	 * socket queue isn't measured if that fails. */
+	optlen = sizeof(a2dpio->sndbuf_bytes);
+	if (getsockopt(cras_bt_transport_fd(a2dpio->transport), SOL_SOCKET,
+		       SO_SNDBUF, &a2dpio->sndbuf_bytes, &optlen))
+		a2dpio->sndbuf_bytes = 0;
 
 	a2dpio->sock_depth_frames =
 		a2dp_block_size(&a2dpio->a2dp,
@@ -179,11 +292,48 @@ static int configure_dev(struct cras_iodev *iodev)
 	iodev->min_buffer_level = a2dpio->sock_depth_frames;
 
 	a2dpio->pre_fill_complete = 0;
+	a2dpio->adaptive_rate = cras_system_get_a2dp_adaptive_rate();
 
 	/* Initialize variables for bt_queued_frames() */
 	a2dpio->bt_written_frames = 0;
 	clock_gettime(CLOCK_MONOTONIC_RAW, &a2dpio->dev_open_time);
 
+	if (cras_system_get_a2dp_encoder_worker()) {
+		/* The worker encodes whole codesize blocks, so the ring holds
+		 * a whole number of them and none wraps around. */
+		unsigned int codesize = a2dp_codesize(&a2dpio->a2dp);
+		unsigned int pcm_bytes = PCM_BUF_MAX_SIZE_BYTES / codesize *
+					 codesize;
+
+		/* The worker owns the a2dp state once it starts, so pre-fill
+		 * the socket before that rather than on the first write. */
+		pre_fill_socket(a2dpio);
+		a2dpio->pre_fill_complete = 1;
+		clock_gettime(CLOCK_MONOTONIC_RAW, &a2dpio->dev_open_time);
+		start_rate_ctrl(a2dpio);
+
+		a2dpio->encoder = a2dp_encoder_create(
+				&a2dpio->a2dp,
+				cras_get_format_bytes(iodev->format),
+				cras_bt_transport_write_mtu(a2dpio->transport),
+				pcm_bytes);
+		if (a2dpio->encoder)
+			iodev->buffer_size =
+				pcm_bytes / cras_get_format_bytes(iodev->format);
+		else
+			syslog(LOG_ERR, "Fail to start a2dp encoder worker");
+	}
+
+	if (a2dpio->encoder) {
+		audio_thread_add_callback(
+				a2dp_encoder_ready_fd(a2dpio->encoder),
+				flush_data, iodev);
+	} else {
+		a2dpio->pcm_buf = byte_buffer_create(PCM_BUF_MAX_SIZE_BYTES);
+		if (!a2dpio->pcm_buf)
+			return -ENOMEM;
+	}
+
 	audio_thread_add_write_callback(cras_bt_transport_fd(a2dpio->transport),
 					flush_data, iodev);
 	audio_thread_enable_callback(cras_bt_transport_fd(a2dpio->transport),
@@ -205,6 +355,12 @@ static int close_dev(struct cras_iodev *iodev)
 	audio_thread_rm_callback_sync(
 			cras_iodev_list_get_audio_thread(),
 			cras_bt_transport_fd(a2dpio->transport));
+	if (a2dpio->encoder) {
+		audio_thread_rm_callback_sync(
+				cras_iodev_list_get_audio_thread(),
+				a2dp_encoder_ready_fd(a2dpio->encoder));
+		a2dp_encoder_destroy(&a2dpio->encoder);
+	}
 
 	err = cras_bt_transport_release(a2dpio->transport,
 					!a2dpio->destroyed);
@@ -242,7 +398,8 @@ static int pre_fill_socket(struct a2dp_io *a2dpio)
 		written = a2dp_write(
 				&a2dpio->a2dp,
 				cras_bt_transport_fd(a2dpio->transport),
-				cras_bt_transport_write_mtu(a2dpio->transport));
+				cras_bt_transport_write_mtu(a2dpio->transport),
+				UINT_MAX);
 		/* Full when EAGAIN is returned. */
 		if (written == -EAGAIN)
 			break;
@@ -256,6 +413,19 @@ static int pre_fill_socket(struct a2dp_io *a2dpio)
 	return 0;
 }
 
+/* Returns non-zero if another packet can be encoded before sending. Like
+ * for encoding more after a write, enough PCM must stay queued to not
+ * underrun. */
+static int can_queue_packet(struct a2dp_io *a2dpio)
+{
+	unsigned int queued_frames =
+		buf_queued(a2dpio->pcm_buf) /
+		cras_get_format_bytes(a2dpio->base.format);
+
+	return a2dpio->base.min_buffer_level +
+	       a2dp_queued_frames(&a2dpio->a2dp) < queued_frames;
+}
+
 /* Flushes queued buffer, including pcm and a2dp buffer.
  * Returns:
  *    0 when the flush succeeded, -1 when error occurred.
@@ -279,6 +449,20 @@ static int flush_data(void *arg)
 	if (device == NULL)
 		return -EINVAL;
 
+	/* The worker has done the encoding, only send what it queued. */
+	if (a2dpio->encoder) {
+		written = a2dp_encoder_send(
+				a2dpio->encoder,
+				cras_bt_transport_fd(a2dpio->transport),
+				iodev->min_buffer_level,
+				frames_due(a2dpio));
+		ATLOG(atlog, AUDIO_THREAD_A2DP_WRITE,
+					    written,
+					    a2dp_encoder_queued_frames(
+						    a2dpio->encoder), 0);
+		goto check_written;
+	}
+
 encode_more:
 	while (buf_queued(a2dpio->pcm_buf)) {
 		processed = a2dp_encode(
@@ -292,6 +476,13 @@ encode_more:
 					    buf_queued(a2dpio->pcm_buf),
 					    buf_readable(a2dpio->pcm_buf)
 					    );
+		/* A full packet is queued so the next one can be encoded and
+		 * both sent together. */
+		if (processed == 0 && can_queue_packet(a2dpio) &&
+		    a2dp_queue_packet(
+				&a2dpio->a2dp,
+				cras_bt_transport_write_mtu(a2dpio->transport)))
+			continue;
 		if (processed == -ENOSPC || processed == 0)
 			break;
 		if (processed < 0)
@@ -300,12 +491,16 @@ encode_more:
 		buf_increment_read(a2dpio->pcm_buf, processed);
 	}
 
+	/* Packets which would run ahead of the pacing are held back. */
 	written = a2dp_write(&a2dpio->a2dp,
 			     cras_bt_transport_fd(a2dpio->transport),
-			     cras_bt_transport_write_mtu(a2dpio->transport));
+			     cras_bt_transport_write_mtu(a2dpio->transport),
+			     frames_due(a2dpio));
 	ATLOG(atlog, AUDIO_THREAD_A2DP_WRITE,
 				    written,
 				    a2dp_queued_frames(&a2dpio->a2dp), 0);
+check_written:
+	update_rate_ctrl(a2dpio, written);
 	if (written == -EAGAIN) {
 		/* If EAGAIN error lasts longer than 5 seconds, suspend the
 		 * a2dp connection. */
@@ -328,10 +523,14 @@ encode_more:
 	/* If it looks okay to write more and we do have queued data, try
 	 * encode more. But avoid the case when PCM buffer level is too close
 	 * to min_buffer_level so that another A2DP write could causes underrun.
+	 * The encoder applies the same limit itself.
 	 */
-	queued_frames = buf_queued(a2dpio->pcm_buf) / format_bytes;
-	if (written && (iodev->min_buffer_level + written < queued_frames))
-		goto encode_more;
+	if (!a2dpio->encoder) {
+		queued_frames = buf_queued(a2dpio->pcm_buf) / format_bytes;
+		if (written &&
+		    (iodev->min_buffer_level + written < queued_frames))
+			goto encode_more;
+	}
 
 	/* everything written. */
 	audio_thread_enable_callback(
@@ -345,7 +544,11 @@ static int delay_frames(const struct cras_iodev *iodev)
 	const struct a2dp_io *a2dpio = (struct a2dp_io *)iodev;
 	struct timespec tstamp;
 
-	/* The number of frames in the pcm buffer plus two mtu packets */
+	/* frames_queued() counts what is in the socket when it can be
+	 * measured, otherwise assume the socket is full with two mtu
+	 * packets. */
+	if (socket_queued_frames(a2dpio) >= 0)
+		return frames_queued(iodev, &tstamp);
 	return frames_queued(iodev, &tstamp) + a2dpio->sock_depth_frames;
 }
 
@@ -355,6 +558,8 @@ static int get_buffer(struct cras_iodev *iodev,
 {
 	size_t format_bytes;
 	struct a2dp_io *a2dpio;
+	uint8_t *buf;
+	unsigned int writable;
 
 	a2dpio = (struct a2dp_io *)iodev;
 
@@ -363,12 +568,17 @@ static int get_buffer(struct cras_iodev *iodev,
 	if (iodev->direction != CRAS_STREAM_OUTPUT)
 		return 0;
 
-	*frames = MIN(*frames, buf_writable(a2dpio->pcm_buf) /
-					format_bytes);
+	if (a2dpio->encoder) {
+		buf = a2dp_encoder_pcm_write_pointer(a2dpio->encoder,
+						     &writable);
+	} else {
+		buf = buf_write_pointer(a2dpio->pcm_buf);
+		writable = buf_writable(a2dpio->pcm_buf);
+	}
+
+	*frames = MIN(*frames, writable / format_bytes);
 	iodev->area->frames = *frames;
-	cras_audio_area_config_buf_pointers(
-			iodev->area, iodev->format,
-			buf_write_pointer(a2dpio->pcm_buf));
+	cras_audio_area_config_buf_pointers(iodev->area, iodev->format, buf);
 	*area = iodev->area;
 	return 0;
 }
@@ -377,15 +587,21 @@ static int put_buffer(struct cras_iodev *iodev, unsigned nwritten)
 {
 	size_t written_bytes;
 	size_t format_bytes;
+	int rc;
 	struct a2dp_io *a2dpio = (struct a2dp_io *)iodev;
 
 	format_bytes = cras_get_format_bytes(iodev->format);
 	written_bytes = nwritten * format_bytes;
 
-	if (written_bytes > buf_writable(a2dpio->pcm_buf))
-		return -EINVAL;
-
-	buf_increment_write(a2dpio->pcm_buf, written_bytes);
+	if (a2dpio->encoder) {
+		rc = a2dp_encoder_pcm_commit(a2dpio->encoder, written_bytes);
+		if (rc < 0)
+			return rc;
+	} else {
+		if (written_bytes > buf_writable(a2dpio->pcm_buf))
+			return -EINVAL;
+		buf_increment_write(a2dpio->pcm_buf, written_bytes);
+	}
 
 	bt_queued_frames(iodev, nwritten);
 
@@ -396,6 +612,7 @@ static int put_buffer(struct cras_iodev *iodev, unsigned nwritten)
 		a2dpio->pre_fill_complete = 1;
 		/* Start measuring frames_consumed from now. */
 		clock_gettime(CLOCK_MONOTONIC_RAW, &a2dpio->dev_open_time);
+		start_rate_ctrl(a2dpio);
 	}
 
 	return flush_data(iodev);
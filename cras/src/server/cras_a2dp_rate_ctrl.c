@@ -0,0 +1,128 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <sys/param.h>
+
+#include "cras_a2dp_rate_ctrl.h"
+#include "cras_util.h"
+
+/* Bitpool steps taken on congestion and when the link has been clear. */
+#define BITPOOL_DECREASE_STEP 4
+#define BITPOOL_INCREASE_STEP 2
+/* Time for a change to take effect before lowering the bitpool again. */
+#define DECREASE_INTERVAL_MS 200
+/* Time the link has to stay clear before raising the bitpool. */
+#define INCREASE_INTERVAL_MS 3000
+
+/* Returns the time since |ts| in milliseconds. */
+static unsigned int ms_since(const struct timespec *ts,
+			     const struct timespec *now)
+{
+	struct timespec diff;
+
+	if (!timespec_after(now, ts))
+		return 0;
+	subtract_timespecs(now, ts, &diff);
+	return timespec_to_ms(&diff);
+}
+
+void a2dp_rate_ctrl_init(struct a2dp_rate_ctrl *ctrl, unsigned int rate,
+			 unsigned int pace_window, int min_bitpool,
+			 int max_bitpool, size_t congested_bytes,
+			 const struct timespec *now)
+{
+	ctrl->rate = rate;
+	ctrl->pace_window = pace_window;
+	ctrl->min_bitpool = MIN(min_bitpool, max_bitpool);
+	ctrl->max_bitpool = max_bitpool;
+	ctrl->bitpool = max_bitpool;
+	ctrl->congested_bytes = congested_bytes;
+	ctrl->start_ts = *now;
+	ctrl->sent_frames = 0;
+	ctrl->last_change_ts = *now;
+	ctrl->last_congestion_ts = *now;
+	ctrl->queue_high_ts.tv_sec = 0;
+	ctrl->queue_high_ts.tv_nsec = 0;
+	ctrl->num_eagain = 0;
+	ctrl->num_decreases = 0;
+	ctrl->num_increases = 0;
+}
+
+unsigned int a2dp_rate_ctrl_frames_due(const struct a2dp_rate_ctrl *ctrl,
+				       const struct timespec *now)
+{
+	struct timespec elapsed;
+	uint64_t limit;
+
+	elapsed.tv_sec = 0;
+	elapsed.tv_nsec = 0;
+	if (timespec_after(now, &ctrl->start_ts))
+		subtract_timespecs(now, &ctrl->start_ts, &elapsed);
+	limit = (uint64_t)elapsed.tv_sec * ctrl->rate +
+		(uint64_t)elapsed.tv_nsec * ctrl->rate / 1000000000ULL +
+		ctrl->pace_window;
+
+	if (limit <= ctrl->sent_frames)
+		return 0;
+	return MIN(limit - ctrl->sent_frames, UINT32_MAX);
+}
+
+/* Returns non-zero if the send shows the link can't keep up. The queue
+ * depth alone only counts once it has stayed high for a while, a burst
+ * such as the socket pre-fill drains on its own. */
+static int link_congested(struct a2dp_rate_ctrl *ctrl,
+			  const struct timespec *now, int written,
+			  size_t queued_bytes)
+{
+	if (written == -EAGAIN) {
+		ctrl->num_eagain++;
+		return 1;
+	}
+
+	if (queued_bytes <= ctrl->congested_bytes) {
+		ctrl->queue_high_ts.tv_sec = 0;
+		ctrl->queue_high_ts.tv_nsec = 0;
+		return 0;
+	}
+	if (!timespec_is_nonzero(&ctrl->queue_high_ts)) {
+		ctrl->queue_high_ts = *now;
+		return 0;
+	}
+	return ms_since(&ctrl->queue_high_ts, now) >= DECREASE_INTERVAL_MS;
+}
+
+int a2dp_rate_ctrl_update(struct a2dp_rate_ctrl *ctrl,
+			  const struct timespec *now, int written,
+			  size_t queued_bytes)
+{
+	if (written > 0)
+		ctrl->sent_frames += written;
+
+	if (link_congested(ctrl, now, written, queued_bytes)) {
+		ctrl->last_congestion_ts = *now;
+		if (ctrl->bitpool > ctrl->min_bitpool &&
+		    ms_since(&ctrl->last_change_ts, now) >=
+				DECREASE_INTERVAL_MS) {
+			ctrl->bitpool = MAX(ctrl->bitpool -
+						BITPOOL_DECREASE_STEP,
+					    ctrl->min_bitpool);
+			ctrl->last_change_ts = *now;
+			ctrl->num_decreases++;
+		}
+		return ctrl->bitpool;
+	}
+
+	if (ctrl->bitpool < ctrl->max_bitpool &&
+	    ms_since(&ctrl->last_congestion_ts, now) >= INCREASE_INTERVAL_MS &&
+	    ms_since(&ctrl->last_change_ts, now) >= INCREASE_INTERVAL_MS) {
+		ctrl->bitpool = MIN(ctrl->bitpool + BITPOOL_INCREASE_STEP,
+				    ctrl->max_bitpool);
+		ctrl->last_change_ts = *now;
+		ctrl->num_increases++;
+	}
+
+	return ctrl->bitpool;
+}
@@ -0,0 +1,92 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CRAS_A2DP_RATE_CTRL_H_
+#define CRAS_A2DP_RATE_CTRL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Adapts the SBC bitpool of an A2DP stream to what the link can carry and
+ * paces the packets sent. The link is considered congested when a send
+ * returns EAGAIN, or when the transport socket stays filled above a
+ * threshold. Congestion lowers the bitpool quickly, a link which stays
+ * clear raises it back slowly. Packets are sent no further ahead of real
+ * time than the pacing window, so that the socket isn't filled with a
+ * burst which the sink would only drain at the link rate.
+ * Members:
+ *    rate - Frame rate of the stream.
+ *    pace_window - Number of frames sending may run ahead of real time.
+ *    min_bitpool - The lowest bitpool to use.
+ *    max_bitpool - The highest bitpool to use.
+ *    bitpool - The current bitpool.
+ *    congested_bytes - Socket queue depth above which the link is
+ *        congested.
+ *    start_ts - The time sending started.
+ *    sent_frames - Frames sent since start_ts.
+ *    last_change_ts - The last time the bitpool changed.
+ *    last_congestion_ts - The last time congestion was seen.
+ *    queue_high_ts - The time the socket queue went above congested_bytes,
+ *        zero while it is below.
+ *    num_eagain - Number of sends which returned EAGAIN.
+ *    num_decreases - Number of times the bitpool was lowered.
+ *    num_increases - Number of times the bitpool was raised.
+ */
+struct a2dp_rate_ctrl {
+	unsigned int rate;
+	unsigned int pace_window;
+	int min_bitpool;
+	int max_bitpool;
+	int bitpool;
+	size_t congested_bytes;
+	struct timespec start_ts;
+	uint64_t sent_frames;
+	struct timespec last_change_ts;
+	struct timespec last_congestion_ts;
+	struct timespec queue_high_ts;
+	unsigned int num_eagain;
+	unsigned int num_decreases;
+	unsigned int num_increases;
+};
+
+/*
+ * Initializes the controller when sending starts.
+ * Args:
+ *    ctrl - The controller.
+ *    rate - Frame rate of the stream.
+ *    pace_window - Number of frames sending may run ahead of real time.
+ *    min_bitpool, max_bitpool - The negotiated bitpool range.
+ *    congested_bytes - Socket queue depth above which the link is
+ *        congested.
+ *    now - The current time.
+ */
+void a2dp_rate_ctrl_init(struct a2dp_rate_ctrl *ctrl, unsigned int rate,
+			 unsigned int pace_window, int min_bitpool,
+			 int max_bitpool, size_t congested_bytes,
+			 const struct timespec *now);
+
+/*
+ * Returns the number of frames which can be sent at |now| without running
+ * further ahead of real time than the pacing window.
+ */
+unsigned int a2dp_rate_ctrl_frames_due(const struct a2dp_rate_ctrl *ctrl,
+				       const struct timespec *now);
+
+/*
+ * Updates the controller with the result of a send.
+ * Args:
+ *    ctrl - The controller.
+ *    now - The time of the send.
+ *    written - Frames sent, 0 if nothing was sent or negative error code.
+ *    queued_bytes - Bytes queued in the transport socket after the send.
+ * Returns:
+ *    The bitpool to encode with.
+ */
+int a2dp_rate_ctrl_update(struct a2dp_rate_ctrl *ctrl,
+			  const struct timespec *now, int written,
+			  size_t queued_bytes);
+
+#endif /* CRAS_A2DP_RATE_CTRL_H_ */
@@ -0,0 +1,610 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "audio_thread.h"
+#include "byte_buffer.h"
+#include "cras_a2dp_info.h"
+#include "cras_a2dp_sink_iodev.h"
+#include "cras_audio_area.h"
+#include "cras_audio_codec.h"
+#include "cras_bt_device.h"
+#include "cras_iodev.h"
+#include "cras_iodev_list.h"
+#include "cras_sbc_codec.h"
+#include "cras_util.h"
+#include "rtp.h"
+#include "sfh.h"
+
+#define PCM_BUF_MAX_SIZE_FRAMES (4096*4)
+#define PCM_BUF_MAX_SIZE_BYTES (PCM_BUF_MAX_SIZE_FRAMES * 4)
+
+/* Max number of packets read from the socket in one wake up. */
+#define A2DP_SINK_MAX_READ_BATCH 8
+/* Sequence number gaps up to this many packets are packets lost on the
+ * link, larger ones are the source restarting the stream. */
+#define A2DP_SINK_MAX_SEQ_GAP 8
+/* Audio buffered before the capture starts, and how much more to buffer
+ * every time the source couldn't keep up, in milliseconds. */
+#define A2DP_SINK_TARGET_MS 40
+#define A2DP_SINK_TARGET_STEP_MS 20
+#define A2DP_SINK_MAX_TARGET_MS 200
+/* Max deviation of the playout rate from the nominal rate, applied when
+ * the buffer level is a whole target away from the target. */
+#define A2DP_SINK_MAX_SKEW 0.002
+
+/* Child of cras_iodev to capture the audio a remote A2DP source streams.
+ * The decoded audio is held in a jitter buffer and played out to the audio
+ * thread at a rate that follows the buffer level, so the clock of the
+ * source shows in the rate estimated for this device and the streams
+ * resample for it.
+ * Members:
+ *    base - The cras_iodev structure "base class".
+ *    transport - The transport object for bluez media API.
+ *    codec - The SBC decoder.
+ *    codesize - Size in bytes of the PCM decoded from one SBC frame.
+ *    pcm_buf - Buffer holding the decoded audio.
+ *    packet - Buffer to receive a packet, packet_size bytes.
+ *    packet_size - Size of packet, the read mtu of the transport.
+ *    destroyed - Flag to note if this a2dp_sink_io is about to destroy.
+ *    seq_valid - Flag to note if next_seq was set by a packet.
+ *    next_seq - The RTP sequence number expected next.
+ *    packet_frames - Number of frames in the last decoded packet.
+ *    playing - Flag to note if the target level was reached and frames are
+ *        played out to the audio thread.
+ *    playable - Number of frames played out but not read yet.
+ *    last_playout - The last time frames were played out.
+ *    target_frames - Level of pcm_buf to reach before playing out.
+ *    max_target_frames - The highest target_frames can grow to.
+ *    num_packets - Number of packets decoded.
+ *    num_lost - Number of packets lost, replaced by silence.
+ *    num_late - Number of packets dropped for arriving out of order.
+ *    num_bad - Number of packets dropped for failing to parse or decode.
+ *    num_overflows - Number of packets not fully decoded for pcm_buf being
+ *        full.
+ *    num_underruns - Number of times pcm_buf ran out while playing.
+ */
+struct a2dp_sink_io {
+	struct cras_iodev base;
+	struct cras_bt_transport *transport;
+	struct cras_audio_codec *codec;
+	unsigned int codesize;
+	struct byte_buffer *pcm_buf;
+	uint8_t *packet;
+	size_t packet_size;
+	int destroyed;
+	int seq_valid;
+	uint16_t next_seq;
+	unsigned int packet_frames;
+	int playing;
+	double playable;
+	struct timespec last_playout;
+	unsigned int target_frames;
+	unsigned int max_target_frames;
+	unsigned int num_packets;
+	unsigned int num_lost;
+	unsigned int num_late;
+	unsigned int num_bad;
+	unsigned int num_overflows;
+	unsigned int num_underruns;
+};
+
+static unsigned int frame_bytes(const struct a2dp_sink_io *a2dpio)
+{
+	return cras_get_format_bytes(a2dpio->base.format);
+}
+
+static unsigned int ms_to_frames(const struct a2dp_sink_io *a2dpio,
+				 unsigned int ms)
+{
+	return (uint64_t)a2dpio->base.format->frame_rate * ms / 1000;
+}
+
+static unsigned int buffered_frames(const struct a2dp_sink_io *a2dpio)
+{
+	return buf_queued(a2dpio->pcm_buf) / frame_bytes(a2dpio);
+}
+
+static int update_supported_formats(struct cras_iodev *iodev)
+{
+	struct a2dp_sink_io *a2dpio = (struct a2dp_sink_io *)iodev;
+	size_t rate = 0;
+	size_t channel;
+	a2dp_sbc_t a2dp;
+
+	cras_bt_transport_configuration(a2dpio->transport, &a2dp,
+					sizeof(a2dp));
+
+	iodev->format->format = SND_PCM_FORMAT_S16_LE;
+	channel = (a2dp.channel_mode == SBC_CHANNEL_MODE_MONO) ? 1 : 2;
+
+	if (a2dp.frequency & SBC_SAMPLING_FREQ_48000)
+		rate = 48000;
+	else if (a2dp.frequency & SBC_SAMPLING_FREQ_44100)
+		rate = 44100;
+	else if (a2dp.frequency & SBC_SAMPLING_FREQ_32000)
+		rate = 32000;
+	else if (a2dp.frequency & SBC_SAMPLING_FREQ_16000)
+		rate = 16000;
+
+	free(iodev->supported_rates);
+	iodev->supported_rates = (size_t *)malloc(2 * sizeof(rate));
+	iodev->supported_rates[0] = rate;
+	iodev->supported_rates[1] = 0;
+
+	free(iodev->supported_channel_counts);
+	iodev->supported_channel_counts = (size_t *)malloc(2 * sizeof(channel));
+	iodev->supported_channel_counts[0] = channel;
+	iodev->supported_channel_counts[1] = 0;
+
+	free(iodev->supported_formats);
+	iodev->supported_formats =
+		(snd_pcm_format_t *)malloc(2 * sizeof(snd_pcm_format_t));
+	iodev->supported_formats[0] = SND_PCM_FORMAT_S16_LE;
+	iodev->supported_formats[1] = 0;
+
+	return 0;
+}
+
+/* Fills frames of silence for packets lost on the link. The decoder writes
+ * whole codesize blocks, so this keeps the same alignment. */
+static void insert_silence(struct a2dp_sink_io *a2dpio, unsigned int frames)
+{
+	unsigned int bytes = frames * frame_bytes(a2dpio);
+	unsigned int writable;
+	uint8_t *dst;
+
+	while (bytes) {
+		dst = buf_write_pointer_size(a2dpio->pcm_buf, &writable);
+		writable = MIN(writable, bytes);
+		if (writable == 0)
+			break;
+		memset(dst, 0, writable);
+		buf_increment_write(a2dpio->pcm_buf, writable);
+		bytes -= writable;
+	}
+}
+
+/* Checks the sequence number of a received packet. Returns 0 if it should
+ * be decoded, or -EINVAL if it came too late and is dropped. */
+static int check_sequence(struct a2dp_sink_io *a2dpio, uint16_t seq)
+{
+	uint16_t gap = seq - a2dpio->next_seq;
+
+	if (!a2dpio->seq_valid) {
+		a2dpio->seq_valid = 1;
+	} else if (gap > UINT16_MAX - A2DP_SINK_MAX_SEQ_GAP) {
+		/* A packet already played, or replaced by silence. */
+		a2dpio->num_late++;
+		return -EINVAL;
+	} else if (gap && gap <= A2DP_SINK_MAX_SEQ_GAP) {
+		a2dpio->num_lost += gap;
+		insert_silence(a2dpio, gap * a2dpio->packet_frames);
+	}
+
+	a2dpio->next_seq = seq + 1;
+	return 0;
+}
+
+/* Finds the SBC frames in the received RTP packet. Returns the offset of
+ * the first frame in packet, or negative error code if the packet isn't a
+ * valid, unfragmented A2DP packet.
+ * Args:
+ *    a2dpio - The a2dp sink iodev.
+ *    len - Size of the packet in bytes, updated to exclude the padding.
+ *    seq - Filled with the sequence number of the packet.
+ */
+static int parse_packet(struct a2dp_sink_io *a2dpio, size_t *len,
+			uint16_t *seq)
+{
+	const struct rtp_header *header =
+			(const struct rtp_header *)a2dpio->packet;
+	const struct rtp_payload *payload;
+	size_t header_len;
+	uint8_t padding;
+
+	if (*len < sizeof(*header) || header->v != 2)
+		return -EINVAL;
+
+	header_len = sizeof(*header) + header->cc * sizeof(uint32_t);
+	if (*len < header_len)
+		return -EINVAL;
+	if (header->p) {
+		padding = a2dpio->packet[*len - 1];
+		if (padding > *len - header_len)
+			return -EINVAL;
+		*len -= padding;
+	}
+	if (header->x) {
+		if (*len < header_len + 4)
+			return -EINVAL;
+		/* The extension length is in 32 bit words, after the 16 bit
+		 * profile defined field. */
+		header_len += 4 + 4 * ((a2dpio->packet[header_len + 2] << 8) |
+				       a2dpio->packet[header_len + 3]);
+	}
+	if (*len < header_len + sizeof(*payload))
+		return -EINVAL;
+
+	payload = (const struct rtp_payload *)(a2dpio->packet + header_len);
+	if (payload->is_fragmented)
+		return -EINVAL;
+
+	*seq = ntohs(header->sequence_number);
+	return header_len + sizeof(*payload);
+}
+
+/* Decodes all SBC frames of a packet straight into pcm_buf. Returns the
+ * number of frames decoded. */
+static unsigned int decode_frames(struct a2dp_sink_io *a2dpio,
+				  const uint8_t *frames, size_t len)
+{
+	unsigned int decoded = 0;
+	unsigned int writable;
+	uint8_t *dst;
+	size_t count;
+	int processed;
+
+	while (len) {
+		dst = buf_write_pointer_size(a2dpio->pcm_buf, &writable);
+		if (writable < a2dpio->codesize) {
+			a2dpio->num_overflows++;
+			break;
+		}
+		processed = a2dpio->codec->decode(a2dpio->codec, frames, len,
+						  dst, writable, &count);
+		if (processed <= 0 || count == 0) {
+			a2dpio->num_bad++;
+			break;
+		}
+		buf_increment_write(a2dpio->pcm_buf, count);
+		decoded += count;
+		frames += processed;
+		len -= processed;
+	}
+
+	return decoded / frame_bytes(a2dpio);
+}
+
+/* Reads and decodes the packets waiting in the transport socket. */
+static int read_packets(void *arg)
+{
+	struct a2dp_sink_io *a2dpio = (struct a2dp_sink_io *)arg;
+	int fd = cras_bt_transport_fd(a2dpio->transport);
+	unsigned int decoded;
+	size_t len;
+	uint16_t seq;
+	ssize_t rc;
+	int offset;
+	int i;
+
+	for (i = 0; i < A2DP_SINK_MAX_READ_BATCH; i++) {
+		rc = recv(fd, a2dpio->packet, a2dpio->packet_size,
+			  MSG_DONTWAIT);
+		if (rc < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			syslog(LOG_ERR, "Read a2dp sink error %d", errno);
+			return -errno;
+		}
+		if (rc == 0) {
+			syslog(LOG_ERR, "A2DP source closed the stream");
+			return -EPIPE;
+		}
+
+		len = rc;
+		offset = parse_packet(a2dpio, &len, &seq);
+		if (offset < 0) {
+			a2dpio->num_bad++;
+			continue;
+		}
+		if (check_sequence(a2dpio, seq))
+			continue;
+
+		decoded = decode_frames(a2dpio, a2dpio->packet + offset,
+					len - offset);
+		if (decoded)
+			a2dpio->packet_frames = decoded;
+		a2dpio->num_packets++;
+	}
+
+	return 0;
+}
+
+/* Plays out the frames due since the last call. The rate is skewed by how
+ * far the level is from the target, which follows the clock of the source
+ * over time. Running out of frames starts buffering again, to a higher
+ * target. */
+static void update_playout(struct a2dp_sink_io *a2dpio,
+			   const struct timespec *now)
+{
+	unsigned int buffered = buffered_frames(a2dpio);
+	struct timespec elapsed;
+	double skew;
+
+	if (!a2dpio->playing) {
+		if (buffered < a2dpio->target_frames)
+			return;
+		a2dpio->playing = 1;
+		a2dpio->last_playout = *now;
+		return;
+	}
+
+	subtract_timespecs(now, &a2dpio->last_playout, &elapsed);
+	a2dpio->last_playout = *now;
+
+	skew = ((double)buffered - a2dpio->playable - a2dpio->target_frames) /
+	       a2dpio->target_frames * A2DP_SINK_MAX_SKEW;
+	skew = MAX(MIN(skew, A2DP_SINK_MAX_SKEW), -A2DP_SINK_MAX_SKEW);
+	a2dpio->playable += (elapsed.tv_sec + elapsed.tv_nsec / 1000000000.0) *
+			    a2dpio->base.format->frame_rate * (1.0 + skew);
+	if (a2dpio->playable <= buffered)
+		return;
+
+	a2dpio->playable = buffered;
+	a2dpio->playing = 0;
+	a2dpio->num_underruns++;
+	a2dpio->target_frames = MIN(
+		a2dpio->target_frames +
+			ms_to_frames(a2dpio, A2DP_SINK_TARGET_STEP_MS),
+		a2dpio->max_target_frames);
+}
+
+static int frames_queued(const struct cras_iodev *iodev,
+			 struct timespec *tstamp)
+{
+	struct a2dp_sink_io *a2dpio = (struct a2dp_sink_io *)iodev;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, tstamp);
+	update_playout(a2dpio, tstamp);
+	return a2dpio->playable;
+}
+
+static int delay_frames(const struct cras_iodev *iodev)
+{
+	const struct a2dp_sink_io *a2dpio = (const struct a2dp_sink_io *)iodev;
+
+	/* Everything buffered was captured before the next frame read. */
+	return buffered_frames(a2dpio);
+}
+
+static int configure_dev(struct cras_iodev *iodev)
+{
+	struct a2dp_sink_io *a2dpio = (struct a2dp_sink_io *)iodev;
+	unsigned int used_size;
+	a2dp_sbc_t sbc;
+	int err;
+
+	err = cras_bt_transport_acquire(a2dpio->transport);
+	if (err < 0) {
+		syslog(LOG_ERR, "transport_acquire failed");
+		return err;
+	}
+
+	/* Assert format is set before opening device. */
+	if (iodev->format == NULL)
+		return -EINVAL;
+	iodev->format->format = SND_PCM_FORMAT_S16_LE;
+	cras_iodev_init_audio_area(iodev, iodev->format->num_channels);
+
+	cras_bt_transport_configuration(a2dpio->transport, &sbc, sizeof(sbc));
+	a2dpio->codec = a2dp_create_decoder(&sbc);
+	if (!a2dpio->codec)
+		return -ENOMEM;
+	a2dpio->codesize = cras_sbc_get_codesize(a2dpio->codec);
+
+	a2dpio->packet_size = cras_bt_transport_read_mtu(a2dpio->transport);
+	a2dpio->packet = (uint8_t *)malloc(a2dpio->packet_size);
+	a2dpio->pcm_buf = byte_buffer_create(PCM_BUF_MAX_SIZE_BYTES);
+	if (!a2dpio->packet || !a2dpio->pcm_buf)
+		return -ENOMEM;
+
+	/* Decode whole codesize blocks up to the end of the buffer. */
+	used_size = PCM_BUF_MAX_SIZE_BYTES / a2dpio->codesize *
+		    a2dpio->codesize;
+	byte_buffer_set_used_size(a2dpio->pcm_buf, used_size);
+	iodev->buffer_size = used_size / frame_bytes(a2dpio);
+
+	a2dpio->seq_valid = 0;
+	a2dpio->packet_frames = 0;
+	a2dpio->playing = 0;
+	a2dpio->playable = 0;
+	a2dpio->target_frames = ms_to_frames(a2dpio, A2DP_SINK_TARGET_MS);
+	a2dpio->max_target_frames = ms_to_frames(a2dpio,
+						 A2DP_SINK_MAX_TARGET_MS);
+	a2dpio->num_packets = 0;
+	a2dpio->num_lost = 0;
+	a2dpio->num_late = 0;
+	a2dpio->num_bad = 0;
+	a2dpio->num_overflows = 0;
+	a2dpio->num_underruns = 0;
+
+	audio_thread_add_callback(cras_bt_transport_fd(a2dpio->transport),
+				  read_packets, a2dpio);
+	return 0;
+}
+
+static int close_dev(struct cras_iodev *iodev)
+{
+	struct a2dp_sink_io *a2dpio = (struct a2dp_sink_io *)iodev;
+	int err;
+
+	/* Remove audio thread callback and sync before releasing
+	 * the transport. */
+	audio_thread_rm_callback_sync(
+			cras_iodev_list_get_audio_thread(),
+			cras_bt_transport_fd(a2dpio->transport));
+
+	syslog(LOG_INFO, "A2DP sink packets %u lost %u late %u bad %u "
+	       "overflows %u underruns %u",
+	       a2dpio->num_packets, a2dpio->num_lost, a2dpio->num_late,
+	       a2dpio->num_bad, a2dpio->num_overflows,
+	       a2dpio->num_underruns);
+
+	err = cras_bt_transport_release(a2dpio->transport,
+					!a2dpio->destroyed);
+	if (err < 0)
+		syslog(LOG_ERR, "transport_release failed");
+
+	if (a2dpio->codec) {
+		cras_sbc_codec_destroy(a2dpio->codec);
+		a2dpio->codec = NULL;
+	}
+	free(a2dpio->packet);
+	a2dpio->packet = NULL;
+	byte_buffer_destroy(&a2dpio->pcm_buf);
+	cras_iodev_free_format(iodev);
+	cras_iodev_free_audio_area(iodev);
+	return 0;
+}
+
+static int get_buffer(struct cras_iodev *iodev,
+		      struct cras_audio_area **area,
+		      unsigned *frames)
+{
+	struct a2dp_sink_io *a2dpio = (struct a2dp_sink_io *)iodev;
+	unsigned int readable;
+	uint8_t *buf;
+
+	buf = buf_read_pointer_size(a2dpio->pcm_buf, &readable);
+	*frames = MIN(*frames, MIN(readable / frame_bytes(a2dpio),
+				   (unsigned int)a2dpio->playable));
+
+	iodev->area->frames = *frames;
+	cras_audio_area_config_buf_pointers(iodev->area, iodev->format, buf);
+	*area = iodev->area;
+	return 0;
+}
+
+static int put_buffer(struct cras_iodev *iodev, unsigned nread)
+{
+	struct a2dp_sink_io *a2dpio = (struct a2dp_sink_io *)iodev;
+
+	if (nread > a2dpio->playable)
+		return -EINVAL;
+
+	buf_increment_read(a2dpio->pcm_buf, nread * frame_bytes(a2dpio));
+	a2dpio->playable -= nread;
+	return 0;
+}
+
+static int flush_buffer(struct cras_iodev *iodev)
+{
+	struct a2dp_sink_io *a2dpio = (struct a2dp_sink_io *)iodev;
+
+	/* Drop what is buffered and buffer up again before playing out. */
+	buf_reset(a2dpio->pcm_buf);
+	a2dpio->playable = 0;
+	a2dpio->playing = 0;
+	return 0;
+}
+
+static void update_active_node(struct cras_iodev *iodev, unsigned node_idx,
+			       unsigned dev_enabled)
+{
+}
+
+static void free_resources(struct a2dp_sink_io *a2dpio)
+{
+	struct cras_ionode *node;
+
+	node = a2dpio->base.active_node;
+	if (node) {
+		cras_iodev_rm_node(&a2dpio->base, node);
+		free(node);
+	}
+	free(a2dpio->base.supported_channel_counts);
+	free(a2dpio->base.supported_rates);
+	free(a2dpio->base.supported_formats);
+	cras_iodev_free_resources(&a2dpio->base);
+}
+
+struct cras_iodev *a2dp_sink_iodev_create(
+		struct cras_bt_transport *transport)
+{
+	struct a2dp_sink_io *a2dpio;
+	struct cras_iodev *iodev;
+	struct cras_ionode *node;
+	struct cras_bt_device *device;
+	const char *name;
+
+	a2dpio = (struct a2dp_sink_io *)calloc(1, sizeof(*a2dpio));
+	if (!a2dpio)
+		return NULL;
+
+	a2dpio->transport = transport;
+	iodev = &a2dpio->base;
+	iodev->direction = CRAS_STREAM_INPUT;
+
+	/* Set iodev's name by bluetooth device's readable name, if
+	 * the readable name is not available, use address instead.
+	 */
+	device = cras_bt_transport_device(transport);
+	name = cras_bt_device_name(device);
+	if (!name)
+		name = cras_bt_transport_object_path(a2dpio->transport);
+
+	snprintf(iodev->info.name, sizeof(iodev->info.name), "%s", name);
+	iodev->info.name[ARRAY_SIZE(iodev->info.name) - 1] = '\0';
+	iodev->info.stable_id = SuperFastHash(
+			cras_bt_device_object_path(device),
+			strlen(cras_bt_device_object_path(device)),
+			strlen(cras_bt_device_object_path(device)));
+	iodev->info.stable_id_new = iodev->info.stable_id;
+
+	iodev->configure_dev = configure_dev;
+	iodev->frames_queued = frames_queued;
+	iodev->delay_frames = delay_frames;
+	iodev->get_buffer = get_buffer;
+	iodev->put_buffer = put_buffer;
+	iodev->flush_buffer = flush_buffer;
+	iodev->close_dev = close_dev;
+	iodev->update_supported_formats = update_supported_formats;
+	iodev->update_active_node = update_active_node;
+
+	/* Create a dummy ionode */
+	node = (struct cras_ionode *)calloc(1, sizeof(*node));
+	node->dev = iodev;
+	strcpy(node->name, iodev->info.name);
+	node->plugged = 1;
+	node->type = CRAS_NODE_TYPE_BLUETOOTH;
+	node->volume = 100;
+	gettimeofday(&node->plugged_time, NULL);
+
+	cras_iodev_add_node(iodev, node);
+	cras_iodev_set_active_node(iodev, node);
+
+	if (cras_iodev_list_add_input(iodev)) {
+		free_resources(a2dpio);
+		free(a2dpio);
+		return NULL;
+	}
+
+	return iodev;
+}
+
+void a2dp_sink_iodev_destroy(struct cras_iodev *iodev)
+{
+	struct a2dp_sink_io *a2dpio = (struct a2dp_sink_io *)iodev;
+
+	a2dpio->destroyed = 1;
+
+	if (cras_iodev_list_rm_input(iodev) == -EBUSY) {
+		syslog(LOG_ERR, "Failed to remove iodev %s", iodev->info.name);
+		return;
+	}
+
+	free_resources(a2dpio);
+	free(a2dpio);
+}
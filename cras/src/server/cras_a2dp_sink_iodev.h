@@ -0,0 +1,27 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef CRAS_A2DP_SINK_IODEV_H_
+#define CRAS_A2DP_SINK_IODEV_H_
+
+#include "cras_bt_transport.h"
+
+struct cras_iodev;
+
+/*
+ * Creates an input iodev to capture the audio a remote A2DP source streams
+ * over the transport, and adds it to the iodev list.
+ * Args:
+ *    transport - The transport configured on our A2DP sink endpoint.
+ */
+struct cras_iodev *a2dp_sink_iodev_create(
+		struct cras_bt_transport *transport);
+
+/*
+ * Removes the a2dp sink iodev from the iodev list and destroys it.
+ */
+void a2dp_sink_iodev_destroy(struct cras_iodev *iodev);
+
+#endif /* CRAS_A2DP_SINK_IODEV_H_ */
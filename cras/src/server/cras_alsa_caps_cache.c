@@ -0,0 +1,358 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#define _GNU_SOURCE /* for asprintf */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "cras_alsa_caps_cache.h"
+#include "cras_checksum.h"
+#include "utlist.h"
+
+/* Most values kept for each of rates, channel counts and formats. This is
+ * larger than the number of candidates cras_alsa_fill_properties tests. */
+#define CAPS_MAX_VALUES 32
+/* Most devices remembered, the least recently used one is dropped. */
+#define CAPS_MAX_ENTRIES 64
+#define CAPS_LINE_LENGTH 1024
+
+/* Capabilities of one PCM device.
+ * Members:
+ *    key - Identity of the device, from cras_alsa_caps_cache_key().
+ *    rates, channel_counts, formats - Zero terminated arrays.
+ */
+struct caps_entry {
+	uint32_t key;
+	size_t rates[CAPS_MAX_VALUES + 1];
+	size_t channel_counts[CAPS_MAX_VALUES + 1];
+	size_t formats[CAPS_MAX_VALUES + 1];
+	struct caps_entry *prev, *next;
+};
+
+/* Cache state.
+ * Members:
+ *    path - File the cache is persisted to, NULL when disabled.
+ *    loaded - Non-zero once path has been read.
+ *    entries - Cached devices, most recently used first.
+ *    num_entries - Length of entries.
+ */
+static struct {
+	char *path;
+	int loaded;
+	struct caps_entry *entries;
+	unsigned int num_entries;
+} cache;
+
+static void clear_entries()
+{
+	struct caps_entry *entry;
+
+	DL_FOREACH(cache.entries, entry) {
+		DL_DELETE(cache.entries, entry);
+		free(entry);
+	}
+	cache.num_entries = 0;
+}
+
+static struct caps_entry *find_entry(uint32_t key)
+{
+	struct caps_entry *entry;
+
+	DL_FOREACH(cache.entries, entry)
+		if (entry->key == key)
+			return entry;
+	return NULL;
+}
+
+static void remove_entry(struct caps_entry *entry)
+{
+	DL_DELETE(cache.entries, entry);
+	free(entry);
+	cache.num_entries--;
+}
+
+static void add_entry(struct caps_entry *entry)
+{
+	struct caps_entry *last;
+
+	DL_PREPEND(cache.entries, entry);
+	if (++cache.num_entries <= CAPS_MAX_ENTRIES)
+		return;
+	last = cache.entries->prev;
+	remove_entry(last);
+}
+
+/* Copies a zero terminated array, returns -E2BIG if it doesn't fit. */
+static int copy_values(size_t *dst, const size_t *src)
+{
+	unsigned int i;
+
+	for (i = 0; src[i]; i++) {
+		if (i == CAPS_MAX_VALUES)
+			return -E2BIG;
+		dst[i] = src[i];
+	}
+	dst[i] = 0;
+	return 0;
+}
+
+/* Parses "name=v1,v2,..." into a zero terminated array. */
+static int parse_values(char *token, const char *name, size_t *values)
+{
+	unsigned int n = 0;
+	size_t len = strlen(name);
+	char *pos, *end;
+	unsigned long value;
+
+	if (!token || strncmp(token, name, len) || token[len] != '=')
+		return -EINVAL;
+	pos = token + len + 1;
+	while (*pos) {
+		if (n == CAPS_MAX_VALUES)
+			return -E2BIG;
+		value = strtoul(pos, &end, 10);
+		if (end == pos || value == 0)
+			return -EINVAL;
+		values[n++] = value;
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -EINVAL;
+		pos = end;
+	}
+	if (n == 0)
+		return -EINVAL;
+	values[n] = 0;
+	return 0;
+}
+
+static void write_values(FILE *f, const char *name, const size_t *values)
+{
+	unsigned int i;
+
+	fprintf(f, " %s=", name);
+	for (i = 0; values[i]; i++)
+		fprintf(f, "%s%zu", i ? "," : "", values[i]);
+}
+
+/* Reads the cache file once. Malformed lines are skipped so a truncated file
+ * only loses the entries it damaged. */
+static void load()
+{
+	struct caps_entry *entry;
+	char line[CAPS_LINE_LENGTH];
+	char *saveptr, *token;
+	FILE *f;
+
+	if (cache.loaded || !cache.path)
+		return;
+	cache.loaded = 1;
+
+	f = fopen(cache.path, "r");
+	if (!f)
+		return;
+
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		entry = (struct caps_entry *)calloc(1, sizeof(*entry));
+		if (!entry)
+			break;
+		token = strtok_r(line, " ", &saveptr);
+		if (!token || sscanf(token, "%x", &entry->key) != 1 ||
+		    find_entry(entry->key) ||
+		    parse_values(strtok_r(NULL, " ", &saveptr), "rates",
+				 entry->rates) ||
+		    parse_values(strtok_r(NULL, " ", &saveptr), "channels",
+				 entry->channel_counts) ||
+		    parse_values(strtok_r(NULL, " ", &saveptr), "formats",
+				 entry->formats)) {
+			free(entry);
+			continue;
+		}
+		/* Keep the file order, most recently used first. */
+		DL_APPEND(cache.entries, entry);
+		if (++cache.num_entries == CAPS_MAX_ENTRIES)
+			break;
+	}
+	fclose(f);
+}
+
+/* Writes all entries to a temporary file and renames it over the cache file
+ * so a crash never leaves a partial file behind. */
+static int save()
+{
+	struct caps_entry *entry;
+	char *tmp_path;
+	FILE *f;
+	int rc = 0;
+
+	if (asprintf(&tmp_path, "%s.tmp", cache.path) < 0)
+		return -ENOMEM;
+
+	f = fopen(tmp_path, "w");
+	if (!f) {
+		rc = -errno;
+		syslog(LOG_WARNING, "Can't write caps cache %s: %d",
+		       tmp_path, rc);
+		free(tmp_path);
+		return rc;
+	}
+	DL_FOREACH(cache.entries, entry) {
+		fprintf(f, "%08x", entry->key);
+		write_values(f, "rates", entry->rates);
+		write_values(f, "channels", entry->channel_counts);
+		write_values(f, "formats", entry->formats);
+		fprintf(f, "\n");
+	}
+	if (fclose(f))
+		rc = -errno;
+	if (!rc && rename(tmp_path, cache.path))
+		rc = -errno;
+	if (rc) {
+		syslog(LOG_WARNING, "Can't save caps cache %s: %d",
+		       cache.path, rc);
+		unlink(tmp_path);
+	}
+	free(tmp_path);
+	return rc;
+}
+
+/*
+ * Exported Interface.
+ */
+
+void cras_alsa_caps_cache_init(const char *path)
+{
+	cras_alsa_caps_cache_deinit();
+	if (path)
+		cache.path = strdup(path);
+}
+
+void cras_alsa_caps_cache_deinit()
+{
+	clear_entries();
+	free(cache.path);
+	cache.path = NULL;
+	cache.loaded = 0;
+}
+
+uint32_t cras_alsa_caps_cache_key(const char *card_name,
+				  const char *dev_name,
+				  size_t device_index,
+				  enum CRAS_STREAM_DIRECTION direction,
+				  size_t usb_vid,
+				  size_t usb_pid,
+				  const char *usb_serial_number,
+				  uint32_t usb_desc_checksum)
+{
+	char id[CAPS_LINE_LENGTH];
+	int len;
+
+	len = snprintf(id, sizeof(id), "%s|%s|%zu|%d|%04zx:%04zx|%s|%08x",
+		       card_name ? card_name : "",
+		       dev_name ? dev_name : "",
+		       device_index, direction, usb_vid, usb_pid,
+		       usb_serial_number ? usb_serial_number : "",
+		       usb_desc_checksum);
+	if (len >= (int)sizeof(id))
+		len = sizeof(id) - 1;
+	return crc32_checksum((const unsigned char *)id, len);
+}
+
+int cras_alsa_caps_cache_get(uint32_t key,
+			     size_t **rates,
+			     size_t **channel_counts,
+			     snd_pcm_format_t **formats)
+{
+	struct caps_entry *entry;
+	unsigned int i;
+
+	load();
+	entry = find_entry(key);
+	if (!entry)
+		return -ENOENT;
+
+	*rates = (size_t *)malloc(sizeof(entry->rates));
+	*channel_counts = (size_t *)malloc(sizeof(entry->channel_counts));
+	*formats = (snd_pcm_format_t *)malloc(
+			(CAPS_MAX_VALUES + 1) * sizeof(**formats));
+	if (!*rates || !*channel_counts || !*formats) {
+		free(*rates);
+		free(*channel_counts);
+		free(*formats);
+		*rates = NULL;
+		*channel_counts = NULL;
+		*formats = NULL;
+		return -ENOMEM;
+	}
+	memcpy(*rates, entry->rates, sizeof(entry->rates));
+	memcpy(*channel_counts, entry->channel_counts,
+	       sizeof(entry->channel_counts));
+	for (i = 0; i <= CAPS_MAX_VALUES; i++)
+		(*formats)[i] = (snd_pcm_format_t)entry->formats[i];
+
+	if (entry != cache.entries) {
+		DL_DELETE(cache.entries, entry);
+		DL_PREPEND(cache.entries, entry);
+	}
+	return 0;
+}
+
+int cras_alsa_caps_cache_put(uint32_t key,
+			     const size_t *rates,
+			     const size_t *channel_counts,
+			     const snd_pcm_format_t *formats)
+{
+	struct caps_entry *entry, *old;
+	size_t format_values[CAPS_MAX_VALUES + 1];
+	unsigned int i;
+
+	if (!cache.path)
+		return -ENOENT;
+	load();
+
+	for (i = 0; formats[i]; i++) {
+		if (i == CAPS_MAX_VALUES)
+			return -E2BIG;
+		format_values[i] = formats[i];
+	}
+	format_values[i] = 0;
+
+	entry = (struct caps_entry *)calloc(1, sizeof(*entry));
+	if (!entry)
+		return -ENOMEM;
+	entry->key = key;
+	if (copy_values(entry->rates, rates) ||
+	    copy_values(entry->channel_counts, channel_counts) ||
+	    copy_values(entry->formats, format_values) ||
+	    !entry->rates[0] || !entry->channel_counts[0] ||
+	    !entry->formats[0]) {
+		free(entry);
+		return -EINVAL;
+	}
+
+	old = find_entry(key);
+	if (old)
+		remove_entry(old);
+	add_entry(entry);
+	return save();
+}
+
+void cras_alsa_caps_cache_invalidate(uint32_t key)
+{
+	struct caps_entry *entry;
+
+	load();
+	entry = find_entry(key);
+	if (!entry)
+		return;
+	remove_entry(entry);
+	save();
+}
@@ -0,0 +1,78 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Persistent cache of the sample rates, channel counts and formats probed
+ * from ALSA PCM devices. Probing a PCM walks hw params for every candidate
+ * rate, channel count and format, which is slow on some USB devices. Entries
+ * are keyed by the identity of the card and device so a device that comes
+ * back after a hotplug or server restart can skip probing. The cache file is
+ * read lazily on the first lookup and rewritten whenever an entry changes.
+ * A cached entry is only trusted until the device rejects a configuration
+ * derived from it, at which point the caller invalidates it.
+ */
+#ifndef CRAS_ALSA_CAPS_CACHE_H_
+#define CRAS_ALSA_CAPS_CACHE_H_
+
+#include <alsa/asoundlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cras_types.h"
+
+/* Name of the cache file inside the server state directory. */
+#define CRAS_ALSA_CAPS_CACHE_FILE "alsa_caps_cache"
+
+/* Sets the file used to persist the cache. Nothing is read until the first
+ * lookup. Passing NULL disables the cache.
+ * Args:
+ *    path - Path of the cache file, its directory must exist.
+ */
+void cras_alsa_caps_cache_init(const char *path);
+
+/* Drops all in memory entries and disables the cache. */
+void cras_alsa_caps_cache_deinit();
+
+/* Computes the key identifying a PCM device across restarts.
+ * Args:
+ *    card_name - Name of the ALSA card.
+ *    dev_name - Name of the PCM device on the card.
+ *    device_index - ALSA device index of the PCM.
+ *    direction - Input or output.
+ *    usb_vid, usb_pid - USB vendor and product ids, zero if not USB.
+ *    usb_serial_number - USB serial number, may be NULL.
+ *    usb_desc_checksum - Checksum of the USB descriptors, zero if not USB.
+ */
+uint32_t cras_alsa_caps_cache_key(const char *card_name,
+				  const char *dev_name,
+				  size_t device_index,
+				  enum CRAS_STREAM_DIRECTION direction,
+				  size_t usb_vid,
+				  size_t usb_pid,
+				  const char *usb_serial_number,
+				  uint32_t usb_desc_checksum);
+
+/* Looks up the capabilities stored for key. On success the zero terminated
+ * arrays are allocated and owned by the caller, in the same layout as
+ * cras_alsa_fill_properties() returns.
+ * Returns:
+ *    0 on success, -ENOENT if there is no entry, or -ENOMEM.
+ */
+int cras_alsa_caps_cache_get(uint32_t key,
+			     size_t **rates,
+			     size_t **channel_counts,
+			     snd_pcm_format_t **formats);
+
+/* Stores the zero terminated capability arrays for key and writes the cache
+ * file. Returns 0 on success or a negative error code. */
+int cras_alsa_caps_cache_put(uint32_t key,
+			     const size_t *rates,
+			     const size_t *channel_counts,
+			     const snd_pcm_format_t *formats);
+
+/* Removes the entry for key, if any, and writes the cache file. */
+void cras_alsa_caps_cache_invalidate(uint32_t key);
+
+#endif /* CRAS_ALSA_CAPS_CACHE_H_ */
@@ -12,6 +12,7 @@
 
 #include "cras_alsa_card.h"
 #include "cras_alsa_io.h"
+#include "cras_alsa_jack.h"
 #include "cras_alsa_mixer.h"
 #include "cras_alsa_ucm.h"
 #include "cras_device_blacklist.h"
@@ -51,6 +52,12 @@ struct hctl_poll_fd {
  * hctl - ALSA high-level control interface.
  * hctl_poll_fds - List of fds registered with cras_system_state.
  * config - Config info for this card, can be NULL if none found.
+ * ctl - Control handle, open from probing until the iodevs are created.
+ * card_name - The name ALSA reports for the card.
+ * probe_ms - Time it took to open the card, its mixer and UCM.
+ * jack_scan - Jack controls and GPIO switches of the card, found while
+ *     probing so the iodevs don't walk them on the main thread.
+ * complete_ms - Time it took to create the iodevs on the main thread.
  */
 struct cras_alsa_card {
 	char name[MAX_ALSA_PCM_NAME_LENGTH];
@@ -61,6 +68,11 @@ struct cras_alsa_card {
 	snd_hctl_t *hctl;
 	struct hctl_poll_fd *hctl_poll_fds;
 	struct cras_card_config *config;
+	snd_ctl_t *ctl;
+	char *card_name;
+	unsigned int probe_ms;
+	struct cras_alsa_jack_scan *jack_scan;
+	unsigned int complete_ms;
 };
 
 /* Creates an iodev for the given device.
@@ -122,13 +134,15 @@ struct cras_iodev *create_iodev_for_device(
 					   direction,
 					   info->usb_vendor_id,
 					   info->usb_product_id,
-					   info->usb_serial_number);
+					   info->usb_serial_number,
+					   info->usb_desc_checksum);
 	if (new_dev->iodev == NULL) {
 		syslog(LOG_ERR, "Couldn't create alsa_iodev for %u:%u\n",
 		       info->card_index, device_index);
 		free(new_dev);
 		return NULL;
 	}
+	alsa_iodev_set_jack_scan(new_dev->iodev, alsa_card->jack_scan);
 
 	syslog(LOG_DEBUG, "New %s device %u:%d",
 	       direction == CRAS_STREAM_OUTPUT ? "playback" : "capture",
@@ -451,17 +465,16 @@ static void configure_echo_reference_dev(struct cras_alsa_card *alsa_card)
  * Exported Interface.
  */
 
-struct cras_alsa_card *cras_alsa_card_create(
+struct cras_alsa_card *cras_alsa_card_probe(
 		struct cras_alsa_card_info *info,
 		const char *device_config_dir,
-		struct cras_device_blacklist *blacklist,
 		const char *ucm_suffix)
 {
-	snd_ctl_t *handle = NULL;
-	int rc, n;
+	int rc;
 	snd_ctl_card_info_t *card_info;
 	const char *card_name;
 	struct cras_alsa_card *alsa_card;
+	struct timespec start, ucm_ready, now, elapsed, ucm_elapsed;
 
 	if (info->card_index >= MAX_ALSA_CARDS) {
 		syslog(LOG_ERR,
@@ -471,6 +484,7 @@ struct cras_alsa_card *cras_alsa_card_create(
 	}
 
 	snd_ctl_card_info_alloca(&card_info);
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
 
 	alsa_card = calloc(1, sizeof(*alsa_card));
 	if (alsa_card == NULL)
@@ -482,13 +496,14 @@ struct cras_alsa_card *cras_alsa_card_create(
 		 "hw:%u",
 		 info->card_index);
 
-	rc = snd_ctl_open(&handle, alsa_card->name, 0);
+	rc = snd_ctl_open(&alsa_card->ctl, alsa_card->name, 0);
 	if (rc < 0) {
 		syslog(LOG_ERR, "Fail opening control %s.", alsa_card->name);
+		alsa_card->ctl = NULL;
 		goto error_bail;
 	}
 
-	rc = snd_ctl_card_info(handle, card_info);
+	rc = snd_ctl_card_info(alsa_card->ctl, card_info);
 	if (rc < 0) {
 		syslog(LOG_ERR, "Error getting card info.");
 		goto error_bail;
@@ -499,6 +514,10 @@ struct cras_alsa_card *cras_alsa_card_create(
 		syslog(LOG_ERR, "Error getting card name.");
 		goto error_bail;
 	}
+	alsa_card->card_name = strdup(card_name);
+	if (alsa_card->card_name == NULL)
+		goto error_bail;
+	card_name = alsa_card->card_name;
 
 	/* Read config file for this card if it exists. */
 	alsa_card->config = cras_card_config_create(device_config_dir,
@@ -524,6 +543,7 @@ struct cras_alsa_card *cras_alsa_card_create(
 		       alsa_card->name, card_name,
 		       alsa_card->ucm ? "yes" : "no");
 	}
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ucm_ready);
 
 	rc = snd_hctl_open(&alsa_card->hctl,
 			   alsa_card->name,
@@ -556,14 +576,46 @@ struct cras_alsa_card *cras_alsa_card_create(
 		goto error_bail;
 	}
 
+	/* Walking the controls and input devices for jacks is slow, do it
+	 * here rather than for each iodev on the main thread. */
+	alsa_card->jack_scan = cras_alsa_jack_scan_create(card_name,
+							  alsa_card->hctl);
+
+	/* Card probing runs at boot and on hotplug, log how long it took. */
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	subtract_timespecs(&now, &start, &elapsed);
+	subtract_timespecs(&ucm_ready, &start, &ucm_elapsed);
+	alsa_card->probe_ms = timespec_to_ms(&elapsed);
+	syslog(LOG_INFO, "Card %s probed in %u ms, UCM parsed in %u ms",
+	       alsa_card->name, alsa_card->probe_ms,
+	       timespec_to_ms(&ucm_elapsed));
+	return alsa_card;
+
+error_bail:
+	cras_alsa_card_destroy(alsa_card);
+	return NULL;
+}
+
+int cras_alsa_card_complete(struct cras_alsa_card *alsa_card,
+			    struct cras_alsa_card_info *info,
+			    struct cras_device_blacklist *blacklist)
+{
+	struct timespec start, now, elapsed;
+	struct iodev_list_node *node;
+	int rc, n;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
 	if (alsa_card->ucm && ucm_has_fully_specified_ucm_flag(alsa_card->ucm))
 		rc = add_controls_and_iodevs_with_ucm(
-				info, alsa_card, card_name, handle);
+				info, alsa_card, alsa_card->card_name,
+				alsa_card->ctl);
 	else
 		rc = add_controls_and_iodevs_by_matching(
-				info, blacklist, alsa_card, card_name, handle);
+				info, blacklist, alsa_card,
+				alsa_card->card_name, alsa_card->ctl);
 	if (rc)
-		goto error_bail;
+		return rc;
 
 	configure_echo_reference_dev(alsa_card);
 
@@ -575,18 +627,15 @@ struct cras_alsa_card *cras_alsa_card_create(
 		int i;
 
 		pollfds = malloc(n * sizeof(*pollfds));
-		if (pollfds == NULL) {
-			rc = -ENOMEM;
-			goto error_bail;
-		}
+		if (pollfds == NULL)
+			return -ENOMEM;
 
 		n = snd_hctl_poll_descriptors(alsa_card->hctl, pollfds, n);
 		for (i = 0; i < n; i++) {
 			registered_fd = calloc(1, sizeof(*registered_fd));
 			if (registered_fd == NULL) {
 				free(pollfds);
-				rc = -ENOMEM;
-				goto error_bail;
+				return -ENOMEM;
 			}
 			registered_fd->fd = pollfds[i].fd;
 			DL_APPEND(alsa_card->hctl_poll_fds, registered_fd);
@@ -597,21 +646,48 @@ struct cras_alsa_card *cras_alsa_card_create(
 			if (rc < 0) {
 				DL_DELETE(alsa_card->hctl_poll_fds,
 					  registered_fd);
+				free(registered_fd);
 				free(pollfds);
-				goto error_bail;
+				return rc;
 			}
 		}
 		free(pollfds);
 	}
 
-	snd_ctl_close(handle);
-	return alsa_card;
+	/* The control handle and jack scan were only needed to create the
+	 * iodevs. */
+	snd_ctl_close(alsa_card->ctl);
+	alsa_card->ctl = NULL;
+	DL_FOREACH(alsa_card->iodevs, node)
+		alsa_iodev_set_jack_scan(node->iodev, NULL);
+	cras_alsa_jack_scan_destroy(alsa_card->jack_scan);
+	alsa_card->jack_scan = NULL;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	subtract_timespecs(&now, &start, &elapsed);
+	alsa_card->complete_ms = timespec_to_ms(&elapsed);
+	syslog(LOG_INFO, "Card %s devices added in %u ms",
+	       alsa_card->name, alsa_card->complete_ms);
+	return 0;
+}
 
-error_bail:
-	if (handle != NULL)
-		snd_ctl_close(handle);
-	cras_alsa_card_destroy(alsa_card);
-	return NULL;
+struct cras_alsa_card *cras_alsa_card_create(
+		struct cras_alsa_card_info *info,
+		const char *device_config_dir,
+		struct cras_device_blacklist *blacklist,
+		const char *ucm_suffix)
+{
+	struct cras_alsa_card *alsa_card;
+
+	alsa_card = cras_alsa_card_probe(info, device_config_dir, ucm_suffix);
+	if (alsa_card == NULL)
+		return NULL;
+
+	if (cras_alsa_card_complete(alsa_card, info, blacklist)) {
+		cras_alsa_card_destroy(alsa_card);
+		return NULL;
+	}
+	return alsa_card;
 }
 
 void cras_alsa_card_destroy(struct cras_alsa_card *alsa_card)
@@ -640,6 +716,10 @@ void cras_alsa_card_destroy(struct cras_alsa_card *alsa_card)
 		cras_alsa_mixer_destroy(alsa_card->mixer);
 	if (alsa_card->config)
 		cras_card_config_destroy(alsa_card->config);
+	if (alsa_card->ctl)
+		snd_ctl_close(alsa_card->ctl);
+	cras_alsa_jack_scan_destroy(alsa_card->jack_scan);
+	free(alsa_card->card_name);
 	free(alsa_card);
 }
 
@@ -648,3 +728,17 @@ size_t cras_alsa_card_get_index(const struct cras_alsa_card *alsa_card)
 	assert(alsa_card);
 	return alsa_card->card_index;
 }
+
+unsigned int cras_alsa_card_get_probe_ms(
+		const struct cras_alsa_card *alsa_card)
+{
+	assert(alsa_card);
+	return alsa_card->probe_ms;
+}
+
+unsigned int cras_alsa_card_get_complete_ms(
+		const struct cras_alsa_card *alsa_card)
+{
+	assert(alsa_card);
+	return alsa_card->complete_ms;
+}
@@ -36,6 +36,36 @@ struct cras_alsa_card *cras_alsa_card_create(
 		struct cras_device_blacklist *blacklist,
 		const char *ucm_suffix);
 
+/* Does the first half of cras_alsa_card_create(): opens the control, UCM,
+ * hctl and mixer of the card. It touches no other server state, so it may
+ * run on a worker thread.
+ * Args:
+ *    card_info - Contains the card index, type, and priority.
+ *    device_config_dir - The directory of device configs which contains the
+ *                        volume curves.
+ *    ucm_suffix - The ucm config name is formed as <card-name>.<suffix>
+ * Returns:
+ *    A probed card to pass to cras_alsa_card_complete(), or NULL on error.
+ */
+struct cras_alsa_card *cras_alsa_card_probe(
+		struct cras_alsa_card_info *info,
+		const char *device_config_dir,
+		const char *ucm_suffix);
+
+/* Creates the iodevs of a card returned by cras_alsa_card_probe() and adds
+ * them to the system. Must be called from the main thread.
+ * Args:
+ *    alsa_card - The probed card.
+ *    card_info - The info the card was probed with.
+ *    blacklist - List of devices that should be ignored.
+ * Returns:
+ *    0 on success, or a negative error code, in which case the card must
+ *    still be destroyed by the caller.
+ */
+int cras_alsa_card_complete(struct cras_alsa_card *alsa_card,
+			    struct cras_alsa_card_info *info,
+			    struct cras_device_blacklist *blacklist);
+
 /* Destroys a cras_alsa_card that was returned from cras_alsa_card_create.
  * Args:
  *    alsa_card - The cras_alsa_card pointer returned from
@@ -50,4 +80,13 @@ void cras_alsa_card_destroy(struct cras_alsa_card *alsa_card);
  */
 size_t cras_alsa_card_get_index(const struct cras_alsa_card *alsa_card);
 
+/* Returns how long cras_alsa_card_probe() took for the given card, in ms. */
+unsigned int cras_alsa_card_get_probe_ms(
+		const struct cras_alsa_card *alsa_card);
+
+/* Returns how long cras_alsa_card_complete() took for the given card, in ms.
+ * This is the part of bringing up a card that runs on the main thread. */
+unsigned int cras_alsa_card_get_complete_ms(
+		const struct cras_alsa_card *alsa_card);
+
 #endif /* _CRAS_ALSA_CARD_H */
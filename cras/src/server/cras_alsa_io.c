@@ -15,6 +15,7 @@
 #include <time.h>
 
 #include "audio_thread.h"
+#include "cras_alsa_caps_cache.h"
 #include "cras_alsa_helpers.h"
 #include "cras_alsa_io.h"
 #include "cras_alsa_jack.h"
@@ -126,6 +127,12 @@ struct alsa_input_node {
  * severe_underrun_frames - The threshold for severe underrun.
  * default_volume_curve - Default volume curve that converts from an index
  *                        to dBFS.
+ * caps_cacheable - True if the probed formats of this device can be kept in
+ *                  the capability cache. HDMI capabilities depend on the
+ *                  attached monitor so they are always probed.
+ * caps_key - Key of this device in the capability cache.
+ * caps_from_cache - True if the supported formats came from the capability
+ *                   cache and haven't been accepted by the device yet.
  */
 struct alsa_io {
 	struct cras_iodev base;
@@ -155,6 +162,9 @@ struct alsa_io {
 	snd_pcm_uframes_t severe_underrun_frames;
 	struct cras_volume_curve *default_volume_curve;
 	int hwparams_set;
+	int caps_cacheable;
+	uint32_t caps_key;
+	int caps_from_cache;
 };
 
 static void init_device_settings(struct alsa_io *aio);
@@ -266,9 +276,20 @@ static int set_hwparams(struct cras_iodev *iodev)
 	rc = cras_alsa_set_hwparams(aio->handle, iodev->format,
 				    &iodev->buffer_size, period_wakeup,
 				    aio->dma_period_set_microsecs);
-	if (rc < 0)
+	if (rc < 0) {
+		/* The format was picked from cached capabilities that may be
+		 * stale, probe the device again on the next open. */
+		if (aio->caps_from_cache) {
+			syslog(LOG_WARNING,
+			       "Cached formats rejected by %s, dropping them",
+			       aio->dev);
+			cras_alsa_caps_cache_invalidate(aio->caps_key);
+			aio->caps_from_cache = 0;
+		}
 		return rc;
+	}
 
+	aio->caps_from_cache = 0;
 	aio->hwparams_set = 1;
 	return 0;
 }
@@ -284,6 +305,8 @@ static int frames_queued(const struct cras_iodev *iodev,
 	int rc;
 	snd_pcm_uframes_t frames;
 
+	/* snd_pcm_avail and snd_pcm_htimestamp. */
+	aio->base.num_hw_calls += 2;
 	rc = cras_alsa_get_avail_frames(aio->handle,
 					aio->base.buffer_size,
 					aio->severe_underrun_frames,
@@ -309,6 +332,7 @@ static int delay_frames(const struct cras_iodev *iodev)
 	snd_pcm_sframes_t delay;
 	int rc;
 
+	aio->base.num_hw_calls++;
 	rc = cras_alsa_get_delay_frames(aio->handle,
 					iodev->buffer_size,
 					&delay);
@@ -404,6 +428,7 @@ static int configure_dev(struct cras_iodev *iodev)
 	rc = cras_alsa_set_swparams(aio->handle, &aio->enable_htimestamp);
 	if (rc < 0)
 		return rc;
+	iodev->hw_timestamps = aio->enable_htimestamp;
 
 	/* Initialize device settings. */
 	init_device_settings(aio);
@@ -507,6 +532,7 @@ static int get_buffer(struct cras_iodev *iodev,
 	aio->mmap_offset = 0;
 	format_bytes = cras_get_format_bytes(iodev->format);
 
+	iodev->num_hw_calls++;
 	rc = cras_alsa_mmap_begin(aio->handle,
 				  format_bytes,
 				  &dst,
@@ -526,6 +552,7 @@ static int put_buffer(struct cras_iodev *iodev, unsigned nwritten)
 {
 	struct alsa_io *aio = (struct alsa_io *)iodev;
 
+	iodev->num_hw_calls++;
 	return cras_alsa_mmap_commit(aio->handle,
 				     aio->mmap_offset,
 				     nwritten);
@@ -1633,7 +1660,9 @@ static int get_fixed_rate(struct alsa_io *aio)
 }
 
 /*
- * Updates the supported sample rates and channel counts.
+ * Updates the supported sample rates and channel counts. Uses the capability
+ * cache when it knows this device, otherwise probes the PCM and remembers the
+ * result.
  */
 static int update_supported_formats(struct cras_iodev *iodev)
 {
@@ -1648,12 +1677,26 @@ static int update_supported_formats(struct cras_iodev *iodev)
 	free(iodev->supported_formats);
 	iodev->supported_formats = NULL;
 
-	err = cras_alsa_fill_properties(aio->handle,
-					&iodev->supported_rates,
-					&iodev->supported_channel_counts,
-					&iodev->supported_formats);
-	if (err)
-		return err;
+	aio->caps_from_cache = aio->caps_cacheable &&
+		cras_alsa_caps_cache_get(aio->caps_key,
+					 &iodev->supported_rates,
+					 &iodev->supported_channel_counts,
+					 &iodev->supported_formats) == 0;
+	if (!aio->caps_from_cache) {
+		err = cras_alsa_fill_properties(
+				aio->handle,
+				&iodev->supported_rates,
+				&iodev->supported_channel_counts,
+				&iodev->supported_formats);
+		if (err)
+			return err;
+		if (aio->caps_cacheable)
+			cras_alsa_caps_cache_put(
+					aio->caps_key,
+					iodev->supported_rates,
+					iodev->supported_channel_counts,
+					iodev->supported_formats);
+	}
 
 	if (aio->ucm) {
 		/* Allow UCM to override supplied rates. */
@@ -1943,7 +1986,8 @@ struct cras_iodev *alsa_iodev_create(size_t card_index,
 				     enum CRAS_STREAM_DIRECTION direction,
 				     size_t usb_vid,
 				     size_t usb_pid,
-				     char *usb_serial_number)
+				     char *usb_serial_number,
+				     uint32_t usb_desc_checksum)
 {
 	struct alsa_io *aio;
 	struct cras_iodev *iodev;
@@ -1993,6 +2037,8 @@ struct cras_iodev *alsa_iodev_create(size_t card_index,
 		aio->base.set_mute = set_alsa_mute;
 		aio->base.output_underrun = alsa_output_underrun;
 	}
+	/* Each level read is a system call, read it once per wake up. */
+	iodev->cache_hw_status = 1;
 	iodev->open_dev = open_dev;
 	iodev->configure_dev = configure_dev;
 	iodev->close_dev = close_dev;
@@ -2046,6 +2092,12 @@ struct cras_iodev *alsa_iodev_create(size_t card_index,
 		rc = ucm_get_min_buffer_level(ucm, &level);
 		if (!rc && direction == CRAS_STREAM_OUTPUT)
 			iodev->min_buffer_level = level;
+		if (direction == CRAS_STREAM_OUTPUT)
+			iodev->dynamic_min_buffer_level =
+				ucm_get_dynamic_min_buffer_level_flag(ucm);
+		if (iodev->dynamic_min_buffer_level &&
+		    !ucm_get_min_buffer_level_floor(ucm, &level))
+			iodev->min_buffer_level_floor = level;
 
 		aio->enable_htimestamp =
 			ucm_get_enable_htimestamp_flag(ucm);
@@ -2054,6 +2106,13 @@ struct cras_iodev *alsa_iodev_create(size_t card_index,
 	set_iodev_name(iodev, card_name, dev_name, card_index, device_index,
 		       card_type, usb_vid, usb_pid, usb_serial_number);
 
+	aio->caps_cacheable = !strstr(dev_name, HDMI);
+	aio->caps_key = cras_alsa_caps_cache_key(card_name, dev_name,
+						 device_index, direction,
+						 usb_vid, usb_pid,
+						 usb_serial_number,
+						 usb_desc_checksum);
+
 	aio->jack_list =
 		cras_alsa_jack_list_create(
 			card_index,
@@ -2297,6 +2356,13 @@ int alsa_iodev_has_hctl_jacks(struct cras_iodev *iodev)
 	return cras_alsa_jack_list_has_hctl_jacks(aio->jack_list);
 }
 
+void alsa_iodev_set_jack_scan(struct cras_iodev *iodev,
+			      const struct cras_alsa_jack_scan *scan)
+{
+	struct alsa_io *aio = (struct alsa_io *)iodev;
+	cras_alsa_jack_list_set_scan(aio->jack_list, scan);
+}
+
 static void alsa_iodev_unmute_node(struct alsa_io *aio,
 				   struct cras_ionode *ionode)
 {
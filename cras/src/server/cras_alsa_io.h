@@ -11,6 +11,7 @@
 #include "cras_card_config.h"
 #include "cras_types.h"
 
+struct cras_alsa_jack_scan;
 struct cras_alsa_mixer;
 struct cras_ionode;
 struct cras_use_case_mgr;
@@ -33,6 +34,7 @@ struct ucm_section;
  *    usb_vid - vendor ID of USB device.
  *    usb_pid - product ID of USB device.
  *    usb_serial_number - serial number of USB device.
+ *    usb_desc_checksum - checksum of the USB descriptors.
  * Returns:
  *    A pointer to the newly created iodev if successful, NULL otherwise.
  */
@@ -50,7 +52,8 @@ struct cras_iodev *alsa_iodev_create(size_t card_index,
 				     enum CRAS_STREAM_DIRECTION direction,
 				     size_t usb_vid,
 				     size_t usb_pid,
-				     char *usb_serial_number);
+				     char *usb_serial_number,
+				     uint32_t usb_desc_checksum);
 
 /* Complete initializeation of this iodev with the legacy method.
  * Add IO nodes and find jacks for this iodev with magic sauce, then choose
@@ -90,4 +93,9 @@ unsigned alsa_iodev_index(struct cras_iodev *iodev);
 /* Returns whether this IODEV has ALSA hctl jacks. */
 int alsa_iodev_has_hctl_jacks(struct cras_iodev *iodev);
 
+/* Makes the iodev find its jacks in a scan of its card, or walk the card
+ * again if scan is NULL. See cras_alsa_jack_list_set_scan. */
+void alsa_iodev_set_jack_scan(struct cras_iodev *iodev,
+			      const struct cras_alsa_jack_scan *scan);
+
 #endif /* CRAS_ALSA_IO_H_ */
@@ -116,6 +116,8 @@ struct cras_alsa_jack {
  *    change_callback - function to call when the state of a jack changes.
  *    callback_data - data to pass back to the callback.
  *    jacks - list of jacks for this device.
+ *    scan - Card scan from the probe phase, used instead of walking hctl and
+ *        the input devices when set.
  */
 struct cras_alsa_jack_list {
 	snd_hctl_t *hctl;
@@ -129,6 +131,7 @@ struct cras_alsa_jack_list {
 	jack_state_change_callback *change_callback;
 	void *callback_data;
 	struct cras_alsa_jack *jacks;
+	const struct cras_alsa_jack_scan *scan;
 };
 
 /* Used to contain information needed while looking through GPIO jacks.
@@ -136,12 +139,15 @@ struct cras_alsa_jack_list {
  *    section - An associated UCM section.
  *    result_jack - The resulting jack.
  *    rc - The return code for the operation.
+ *    switch_bits - Switches of the current device if already read by a scan,
+ *        otherwise NULL.
  */
 struct gpio_switch_list_data {
 	struct cras_alsa_jack_list *jack_list;
 	struct ucm_section *section;
 	struct cras_alsa_jack *result_jack;
 	int rc;
+	const unsigned long *switch_bits;
 };
 
 /*
@@ -156,6 +162,53 @@ struct gpio_switch_list_data {
 #define LONG(x)			((x) / BITS_PER_LONG)
 #define IS_BIT_SET(bit, array)	!!((array[LONG(bit)]) & (1UL << OFF(bit)))
 
+/* An input device named after the card, found by a jack scan.
+ *    dev_path - Full path to the device.
+ *    dev_name - The name of the device.
+ *    bits - The switches the device supports.
+ */
+struct jack_scan_switch {
+	char *dev_path;
+	char *dev_name;
+	unsigned long bits[NBITS(SW_CNT)];
+	struct jack_scan_switch *prev, *next;
+};
+
+/* The parts of a card that can be jacks, found when the card is probed.
+ *    switches - GPIO switch devices named after the card.
+ *    jack_elems - hctl controls whose names match a jack of either direction.
+ *    num_jack_elems - Number of entries in jack_elems.
+ *    eld_elems - ELD controls of the card.
+ *    num_eld_elems - Number of entries in eld_elems.
+ */
+struct cras_alsa_jack_scan {
+	struct jack_scan_switch *switches;
+	snd_hctl_elem_t **jack_elems;
+	size_t num_jack_elems;
+	snd_hctl_elem_t **eld_elems;
+	size_t num_eld_elems;
+};
+
+/* Used while looking through the input devices of a card for a jack scan.
+ *    scan - The scan to add switches to.
+ *    card_name - The name of the card being scanned.
+ */
+struct jack_scan_data {
+	struct cras_alsa_jack_scan *scan;
+	const char *card_name;
+};
+
+static const char * const output_jack_base_names[] = {
+	"Headphone Jack",
+	"Front Headphone Jack",
+	"HDMI/DP",
+	"Speaker Phantom Jack",
+};
+static const char * const input_jack_base_names[] = {
+	"Mic Jack",
+};
+static const char eld_control_name[] = "ELD";
+
 static int sys_input_get_switch_state(int fd, unsigned sw, unsigned *state)
 {
 	unsigned long bits[NBITS(SW_CNT)];
@@ -453,6 +506,7 @@ static int create_jack_for_gpio(struct cras_alsa_jack_list *jack_list,
 				const char *pathname,
 				const char *dev_name,
 				unsigned switch_event,
+				const unsigned long *switch_bits,
 				struct cras_alsa_jack **out_jack)
 {
 	struct cras_alsa_jack *jack;
@@ -464,6 +518,10 @@ static int create_jack_for_gpio(struct cras_alsa_jack_list *jack_list,
 		return -EINVAL;
 	*out_jack = NULL;
 
+	/* A scan already has the switches, skip devices that can't match. */
+	if (switch_bits && !IS_BIT_SET(switch_event, switch_bits))
+		return -EIO;
+
 	jack = cras_alloc_jack(1);
 	if (jack == NULL)
 		return -ENOMEM;
@@ -483,8 +541,9 @@ static int create_jack_for_gpio(struct cras_alsa_jack_list *jack_list,
 	}
 
 	if (!strstr(jack->gpio.device_name, card_name) ||
-	    (gpio_switch_eviocgbit(jack->gpio.fd, bits, sizeof(bits)) < 0) ||
-	    !IS_BIT_SET(switch_event, bits)) {
+	    (!switch_bits &&
+	     ((gpio_switch_eviocgbit(jack->gpio.fd, bits, sizeof(bits)) < 0) ||
+	      !IS_BIT_SET(switch_event, bits)))) {
 		r = -EIO;
 		goto error;
 	}
@@ -558,7 +617,7 @@ static int open_and_monitor_gpio(struct gpio_switch_list_data *data,
 	int r;
 
 	r = create_jack_for_gpio(jack_list, pathname, dev_name,
-				 switch_event, &jack);
+				 switch_event, data->switch_bits, &jack);
 	if (r != 0)
 		return r;
 
@@ -611,7 +670,7 @@ static int open_and_monitor_gpio_with_section(
 	int r;
 
 	r = create_jack_for_gpio(jack_list, pathname, section->jack_name,
-				 switch_event, &jack);
+				 switch_event, data->switch_bits, &jack);
 	if (r != 0)
 		return r;
 
@@ -769,26 +828,35 @@ static int find_gpio_jacks(struct cras_alsa_jack_list *jack_list,
 	 * only associated with on-board devices.
 	 */
 	struct gpio_switch_list_data data;
+	gpio_switch_list_callback callback;
+	const struct jack_scan_switch *sw;
 	int rc;
 
-	rc = wait_for_dev_input_access();
-	if (rc != 0) {
-		syslog(LOG_WARNING, "Could not access /dev/input/event0: %s",
-		       strerror(rc));
-		return 0;
-	}
-
 	data.jack_list = jack_list;
 	data.section = section;
 	data.result_jack = NULL;
 	data.rc = 0;
+	data.switch_bits = NULL;
+
+	callback = section ? gpio_switch_list_with_section
+			   : gpio_switch_list_by_matching;
 
-	if (section)
-		gpio_switch_list_for_each(
-			gpio_switch_list_with_section, &data);
-	else
-		gpio_switch_list_for_each(
-			gpio_switch_list_by_matching, &data);
+	if (jack_list->scan) {
+		DL_FOREACH(jack_list->scan->switches, sw) {
+			data.switch_bits = sw->bits;
+			if (callback(sw->dev_path, sw->dev_name, &data))
+				break;
+		}
+	} else {
+		rc = wait_for_dev_input_access();
+		if (rc != 0) {
+			syslog(LOG_WARNING,
+			       "Could not access /dev/input/event0: %s",
+			       strerror(rc));
+			return 0;
+		}
+		gpio_switch_list_for_each(callback, &data);
+	}
 	if (result_jack)
 		*result_jack = data.result_jack;
 	return data.rc;
@@ -878,31 +946,22 @@ static int is_jack_uac2(const char *jack_name,
 				  "^.* - Output Jack$" : "^.* - Input Jack$");
 }
 
-/* Looks for any JACK controls.  Monitors any found controls for changes and
- * decides to route based on plug/unlpug events. */
-static int find_jack_controls(struct cras_alsa_jack_list *jack_list)
+/* Adds a jack for elem if it is a jack control of this jack_list.
+ * Args:
+ *    jack_list - Jack list to add to.
+ *    elem - The hctl control to check.
+ * Returns:
+ *    0 for success, or negative on error. Controls that aren't jacks of this
+ *    jack_list are skipped.
+ */
+static int add_jack_control(struct cras_alsa_jack_list *jack_list,
+			    snd_hctl_elem_t *elem)
 {
-	snd_hctl_elem_t *elem;
 	struct cras_alsa_jack *jack;
 	const char *name;
-	static const char * const output_jack_base_names[] = {
-		"Headphone Jack",
-		"Front Headphone Jack",
-		"HDMI/DP",
-		"Speaker Phantom Jack",
-	};
-	static const char * const input_jack_base_names[] = {
-		"Mic Jack",
-	};
-	static const char eld_control_name[] = "ELD";
 	const char * const *jack_names;
 	unsigned int num_jack_names;
 
-	if (!jack_list->hctl) {
-		syslog(LOG_WARNING, "Can't search hctl for jacks.");
-		return 0;
-	}
-
 	if (jack_list->direction == CRAS_STREAM_OUTPUT) {
 		jack_names = output_jack_base_names;
 		num_jack_names = ARRAY_SIZE(output_jack_base_names);
@@ -911,57 +970,111 @@ static int find_jack_controls(struct cras_alsa_jack_list *jack_list)
 		num_jack_names = ARRAY_SIZE(input_jack_base_names);
 	}
 
-	for (elem = snd_hctl_first_elem(jack_list->hctl); elem != NULL;
-			elem = snd_hctl_elem_next(elem)) {
-		snd_ctl_elem_iface_t iface;
+	if (snd_hctl_elem_get_interface(elem) != SND_CTL_ELEM_IFACE_CARD)
+		return 0;
+	name = snd_hctl_elem_get_name(elem);
+	if (!is_jack_control_in_list(jack_names, num_jack_names, name) &&
+	    !is_jack_uac2(name, jack_list->direction))
+		return 0;
+	if (hctl_jack_device_index(name) != jack_list->device_index)
+		return 0;
 
-		iface = snd_hctl_elem_get_interface(elem);
-		if (iface != SND_CTL_ELEM_IFACE_CARD)
-			continue;
-		name = snd_hctl_elem_get_name(elem);
-		if (!is_jack_control_in_list(jack_names, num_jack_names, name) &&
-		    !is_jack_uac2(name, jack_list->direction))
-			continue;
-		if (hctl_jack_device_index(name) != jack_list->device_index)
-			continue;
+	jack = cras_alloc_jack(0);
+	if (jack == NULL)
+		return -ENOMEM;
+	jack->elem = elem;
+	jack->jack_list = jack_list;
+	DL_APPEND(jack_list->jacks, jack);
 
-		jack = cras_alloc_jack(0);
-		if (jack == NULL)
-			return -ENOMEM;
-		jack->elem = elem;
-		jack->jack_list = jack_list;
-		DL_APPEND(jack_list->jacks, jack);
+	snd_hctl_elem_set_callback(elem, hctl_jack_cb);
+	snd_hctl_elem_set_callback_private(elem, jack);
 
-		snd_hctl_elem_set_callback(elem, hctl_jack_cb);
-		snd_hctl_elem_set_callback_private(elem, jack);
+	if (jack_list->direction == CRAS_STREAM_OUTPUT)
+		jack->mixer_output =
+			cras_alsa_mixer_get_output_matching_name(
+				jack_list->mixer,
+				name);
+	if (jack_list->ucm)
+		jack->ucm_device =
+			ucm_get_dev_for_jack(jack_list->ucm, name,
+					     jack_list->direction);
 
-		if (jack_list->direction == CRAS_STREAM_OUTPUT)
-			jack->mixer_output =
-				cras_alsa_mixer_get_output_matching_name(
+	if (jack->ucm_device && jack_list->direction == CRAS_STREAM_INPUT) {
+		char *control_name;
+		control_name = ucm_get_cap_control(jack->jack_list->ucm,
+					       jack->ucm_device);
+		if (control_name)
+			jack->mixer_input =
+				cras_alsa_mixer_get_input_matching_name(
 					jack_list->mixer,
-					name);
-		if (jack_list->ucm)
-			jack->ucm_device =
-				ucm_get_dev_for_jack(jack_list->ucm, name,
-						     jack_list->direction);
-
-		if (jack->ucm_device && jack_list->direction == CRAS_STREAM_INPUT) {
-			char *control_name;
-			control_name = ucm_get_cap_control(jack->jack_list->ucm,
-						       jack->ucm_device);
-			if (control_name)
-				jack->mixer_input =
-					cras_alsa_mixer_get_input_matching_name(
-						jack_list->mixer,
-						control_name);
+					control_name);
+	}
+
+	if (jack->ucm_device) {
+		jack->dsp_name = ucm_get_dsp_name(
+			jack->jack_list->ucm, jack->ucm_device,
+			jack_list->direction);
+		jack->override_type_name = ucm_get_override_type_name(
+			jack->jack_list->ucm, jack->ucm_device);
+	}
+	return 0;
+}
+
+/* Finds the ELD control for the device of this jack_list. */
+static snd_hctl_elem_t *find_eld_control(
+		const struct cras_alsa_jack_list *jack_list)
+{
+	snd_hctl_elem_t *elem;
+	size_t i;
+
+	if (jack_list->scan) {
+		for (i = 0; i < jack_list->scan->num_eld_elems; i++) {
+			elem = jack_list->scan->eld_elems[i];
+			if (snd_hctl_elem_get_device(elem)
+			    == jack_list->device_index)
+				return elem;
 		}
+		return NULL;
+	}
 
-		if (jack->ucm_device) {
-			jack->dsp_name = ucm_get_dsp_name(
-				jack->jack_list->ucm, jack->ucm_device,
-				jack_list->direction);
-			jack->override_type_name = ucm_get_override_type_name(
-				jack->jack_list->ucm, jack->ucm_device);
+	for (elem = snd_hctl_first_elem(jack_list->hctl); elem != NULL;
+	     elem = snd_hctl_elem_next(elem)) {
+		if (strcmp(snd_hctl_elem_get_name(elem), eld_control_name))
+			continue;
+		if (snd_hctl_elem_get_device(elem) != jack_list->device_index)
+			continue;
+		return elem;
+	}
+	return NULL;
+}
+
+/* Looks for any JACK controls.  Monitors any found controls for changes and
+ * decides to route based on plug/unlpug events. */
+static int find_jack_controls(struct cras_alsa_jack_list *jack_list)
+{
+	snd_hctl_elem_t *elem;
+	struct cras_alsa_jack *jack;
+	size_t i;
+	int rc;
+
+	if (!jack_list->hctl) {
+		syslog(LOG_WARNING, "Can't search hctl for jacks.");
+		return 0;
+	}
+
+	if (jack_list->scan) {
+		for (i = 0; i < jack_list->scan->num_jack_elems; i++) {
+			rc = add_jack_control(jack_list,
+					      jack_list->scan->jack_elems[i]);
+			if (rc)
+				return rc;
+		}
+	} else {
+		for (elem = snd_hctl_first_elem(jack_list->hctl); elem != NULL;
+		     elem = snd_hctl_elem_next(elem)) {
+			rc = add_jack_control(jack_list, elem);
+			if (rc)
+				return rc;
 		}
 	}
 
@@ -969,22 +1082,49 @@ static int find_jack_controls(struct cras_alsa_jack_list *jack_list)
 	DL_FOREACH(jack_list->jacks, jack) {
 		if (jack->is_gpio || jack->eld_control)
 			continue;
-		name = snd_hctl_elem_get_name(jack->elem);
-		if (!is_jack_hdmi_dp(name))
+		if (!is_jack_hdmi_dp(snd_hctl_elem_get_name(jack->elem)))
 			continue;
-		for (elem = snd_hctl_first_elem(jack_list->hctl); elem != NULL;
-		     elem = snd_hctl_elem_next(elem)) {
-			if (strcmp(snd_hctl_elem_get_name(elem),
-				   eld_control_name))
-				continue;
-			if (snd_hctl_elem_get_device(elem)
-			    != jack_list->device_index)
-				continue;
-			jack->eld_control = elem;
-			break;
-		}
+		jack->eld_control = find_eld_control(jack_list);
+	}
+
+	return 0;
+}
+
+/* Called for each input device while scanning a card.  Keeps the devices
+ * named after the card along with the switches they support. */
+static int jack_scan_add_switch(const char *dev_path,
+				const char *dev_name,
+				void *arg)
+{
+	struct jack_scan_data *data = (struct jack_scan_data *)arg;
+	struct jack_scan_switch *sw;
+	int fd;
+	int rc;
+
+	if (!strstr(dev_name, data->card_name))
+		return 0;
+
+	sw = (struct jack_scan_switch *)calloc(1, sizeof(*sw));
+	if (!sw)
+		return 0;
+
+	fd = gpio_switch_open(dev_path);
+	if (fd == -1) {
+		free(sw);
+		return 0;
 	}
+	rc = gpio_switch_eviocgbit(fd, sw->bits, sizeof(sw->bits));
+	close(fd);
 
+	sw->dev_path = strdup(dev_path);
+	sw->dev_name = strdup(dev_name);
+	if (rc < 0 || !sw->dev_path || !sw->dev_name) {
+		free(sw->dev_path);
+		free(sw->dev_name);
+		free(sw);
+		return 0;
+	}
+	DL_APPEND(data->scan->switches, sw);
 	return 0;
 }
 
@@ -1009,7 +1149,6 @@ static int find_hctl_jack_for_section(
 		struct ucm_section *section,
 		struct cras_alsa_jack **result_jack)
 {
-	static const char eld_control_name[] = "ELD";
 	snd_hctl_elem_t *elem;
 	snd_ctl_elem_id_t *elem_id;
 	struct cras_alsa_jack *jack;
@@ -1158,6 +1297,96 @@ void cras_alsa_jack_list_destroy(struct cras_alsa_jack_list *jack_list)
 	free(jack_list);
 }
 
+struct cras_alsa_jack_scan *cras_alsa_jack_scan_create(const char *card_name,
+						       snd_hctl_t *hctl)
+{
+	struct cras_alsa_jack_scan *scan;
+	struct jack_scan_data data;
+	snd_hctl_elem_t *elem;
+	const char *name;
+	size_t num_elems = 0;
+	int rc;
+
+	scan = (struct cras_alsa_jack_scan *)calloc(1, sizeof(*scan));
+	if (!scan)
+		return NULL;
+
+	if (hctl) {
+		for (elem = snd_hctl_first_elem(hctl); elem != NULL;
+		     elem = snd_hctl_elem_next(elem))
+			num_elems++;
+		scan->jack_elems = (snd_hctl_elem_t **)calloc(
+				num_elems + 1, sizeof(*scan->jack_elems));
+		scan->eld_elems = (snd_hctl_elem_t **)calloc(
+				num_elems + 1, sizeof(*scan->eld_elems));
+		if (!scan->jack_elems || !scan->eld_elems) {
+			cras_alsa_jack_scan_destroy(scan);
+			return NULL;
+		}
+
+		for (elem = snd_hctl_first_elem(hctl); elem != NULL;
+		     elem = snd_hctl_elem_next(elem)) {
+			name = snd_hctl_elem_get_name(elem);
+			if (!strcmp(name, eld_control_name)) {
+				scan->eld_elems[scan->num_eld_elems++] = elem;
+				continue;
+			}
+			if (snd_hctl_elem_get_interface(elem) !=
+					SND_CTL_ELEM_IFACE_CARD)
+				continue;
+			if (is_jack_control_in_list(
+					output_jack_base_names,
+					ARRAY_SIZE(output_jack_base_names),
+					name) ||
+			    is_jack_control_in_list(
+					input_jack_base_names,
+					ARRAY_SIZE(input_jack_base_names),
+					name) ||
+			    is_jack_uac2(name, CRAS_STREAM_OUTPUT) ||
+			    is_jack_uac2(name, CRAS_STREAM_INPUT))
+				scan->jack_elems[scan->num_jack_elems++] = elem;
+		}
+	}
+
+	/* GPIO switches are on Arm-based machines, and are
+	 * only associated with on-board devices.
+	 */
+	rc = wait_for_dev_input_access();
+	if (rc != 0) {
+		syslog(LOG_WARNING, "Could not access /dev/input/event0: %s",
+		       strerror(rc));
+		return scan;
+	}
+
+	data.scan = scan;
+	data.card_name = card_name;
+	gpio_switch_list_for_each(jack_scan_add_switch, &data);
+	return scan;
+}
+
+void cras_alsa_jack_scan_destroy(struct cras_alsa_jack_scan *scan)
+{
+	struct jack_scan_switch *sw;
+
+	if (!scan)
+		return;
+	DL_FOREACH(scan->switches, sw) {
+		DL_DELETE(scan->switches, sw);
+		free(sw->dev_path);
+		free(sw->dev_name);
+		free(sw);
+	}
+	free(scan->jack_elems);
+	free(scan->eld_elems);
+	free(scan);
+}
+
+void cras_alsa_jack_list_set_scan(struct cras_alsa_jack_list *jack_list,
+				  const struct cras_alsa_jack_scan *scan)
+{
+	jack_list->scan = scan;
+}
+
 int cras_alsa_jack_list_has_hctl_jacks(struct cras_alsa_jack_list *jack_list)
 {
 	struct cras_alsa_jack *jack;
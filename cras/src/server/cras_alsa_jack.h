@@ -14,6 +14,7 @@
 
 struct cras_alsa_jack;
 struct cras_alsa_jack_list;
+struct cras_alsa_jack_scan;
 struct cras_alsa_mixer;
 
 /* Callback type for users of jack_list to define, it will be called when the
@@ -87,6 +88,34 @@ int cras_alsa_jack_list_add_jack_for_section(
  */
 void cras_alsa_jack_list_destroy(struct cras_alsa_jack_list *jack_list);
 
+/* Scans a card for the hctl controls and GPIO switches that can be jacks.
+ * This walks every control and input device, so it is done once per card
+ * when the card is probed instead of once per device on the main thread.
+ * Args:
+ *    card_name - The name of the card, GPIO switches are named after it.
+ *    hctl - The hctl of the card, can be NULL.
+ * Returns:
+ *    The scan, or NULL on failure.
+ */
+struct cras_alsa_jack_scan *cras_alsa_jack_scan_create(const char *card_name,
+						       snd_hctl_t *hctl);
+
+/* Destroys a scan created with cras_alsa_jack_scan_create.
+ * Args:
+ *    scan - The scan to destroy.
+ */
+void cras_alsa_jack_scan_destroy(struct cras_alsa_jack_scan *scan);
+
+/* Makes a jack list find its jacks in the given scan. The scan must outlive
+ * the calls that find jacks, pass NULL to walk hctl and the input devices
+ * again.
+ * Args:
+ *    jack_list - The jack list.
+ *    scan - The scan of the card, or NULL.
+ */
+void cras_alsa_jack_list_set_scan(struct cras_alsa_jack_list *jack_list,
+				  const struct cras_alsa_jack_scan *scan);
+
 /* Returns non-zero if the jack list has hctl jacks.
  * Args:
  *    jack_list - The list check.
@@ -55,6 +55,8 @@ static const char hotword_model_prefix[] = "Hotword Model";
 static const char fully_specified_ucm_var[] = "FullySpecifiedUCM";
 static const char main_volume_names[] = "MainVolumeNames";
 static const char enable_htimestamp_var[] = "EnableHtimestamp";
+static const char dynamic_min_buffer_level_var[] = "DynamicMinBufferLevel";
+static const char min_buffer_level_floor_var[] = "MinBufferLevelFloor";
 
 /* Use case verbs corresponding to CRAS_STREAM_TYPE. */
 static const char *use_case_verbs[] = {
@@ -72,11 +74,37 @@ struct section_name {
 	struct section_name  *prev, *next;
 };
 
+/* A list returned by snd_use_case_get_list, kept until invalidated. */
+struct ucm_cached_list {
+	char *identifier;
+	const char **list;
+	int num_entries;
+	struct ucm_cached_list *prev, *next;
+};
+
+/* The result of a snd_use_case_get lookup, kept until the verb changes. */
+struct ucm_cached_value {
+	char *identifier;
+	char *value;
+	int rc;
+	struct ucm_cached_value *prev, *next;
+};
+
+/* Members:
+ *    mgr - The alsa use case manager.
+ *    name - Name of the card.
+ *    avail_use_cases - Bitmask of the verbs this card supports.
+ *    use_case - The use case (verb) currently set.
+ *    lists - Parsed lists of verbs, devices, modifiers and enabled sections.
+ *    values - Memoized variable lookups for the current verb.
+ */
 struct cras_use_case_mgr {
 	snd_use_case_mgr_t *mgr;
 	const char *name;
 	unsigned int avail_use_cases;
 	enum CRAS_STREAM_TYPE use_case;
+	struct ucm_cached_list *lists;
+	struct ucm_cached_value *values;
 };
 
 static inline const char *uc_verb(struct cras_use_case_mgr *mgr)
@@ -84,6 +112,116 @@ static inline const char *uc_verb(struct cras_use_case_mgr *mgr)
 	return use_case_verbs[mgr->use_case];
 }
 
+static void cache_drop_list(struct cras_use_case_mgr *mgr,
+			    struct ucm_cached_list *cached)
+{
+	DL_DELETE(mgr->lists, cached);
+	if (cached->num_entries > 0)
+		snd_use_case_free_list(cached->list, cached->num_entries);
+	free(cached->identifier);
+	free(cached);
+}
+
+/* Drops the cached list for identifier, if any. */
+static void cache_invalidate_list(struct cras_use_case_mgr *mgr,
+				  const char *identifier)
+{
+	struct ucm_cached_list *cached;
+
+	DL_FOREACH(mgr->lists, cached) {
+		if (!strcmp(cached->identifier, identifier)) {
+			cache_drop_list(mgr, cached);
+			return;
+		}
+	}
+}
+
+/* Drops every cached list and value that depends on the current verb. */
+static void cache_clear(struct cras_use_case_mgr *mgr)
+{
+	struct ucm_cached_list *list;
+	struct ucm_cached_value *value;
+
+	DL_FOREACH(mgr->lists, list)
+		if (strcmp(list->identifier, "_verbs"))
+			cache_drop_list(mgr, list);
+	DL_FOREACH(mgr->values, value) {
+		DL_DELETE(mgr->values, value);
+		free(value->identifier);
+		free(value->value);
+		free(value);
+	}
+}
+
+/* Drops everything in the cache, including the list of verbs. */
+static void cache_free(struct cras_use_case_mgr *mgr)
+{
+	cache_clear(mgr);
+	cache_invalidate_list(mgr, "_verbs");
+}
+
+/* Returns the list for identifier, reading it from UCM only the first time.
+ * The list stays owned by the cache and must not be freed by the caller.
+ * It remains valid until the next change of verb or enabled sections. */
+static int get_list(struct cras_use_case_mgr *mgr, const char *identifier,
+		    const char ***list)
+{
+	struct ucm_cached_list *cached;
+	int num_entries;
+
+	DL_FOREACH(mgr->lists, cached) {
+		if (!strcmp(cached->identifier, identifier)) {
+			*list = cached->list;
+			return cached->num_entries;
+		}
+	}
+
+	num_entries = snd_use_case_get_list(mgr->mgr, identifier, list);
+	if (num_entries < 0)
+		return num_entries;
+
+	cached = (struct ucm_cached_list *)calloc(1, sizeof(*cached));
+	if (cached)
+		cached->identifier = strdup(identifier);
+	if (!cached || !cached->identifier) {
+		free(cached);
+		if (num_entries > 0)
+			snd_use_case_free_list(*list, num_entries);
+		return -ENOMEM;
+	}
+	cached->list = *list;
+	cached->num_entries = num_entries;
+	DL_APPEND(mgr->lists, cached);
+	return num_entries;
+}
+
+/* Parses the device and modifier sections of the current verb so that later
+ * lookups while creating iodevs don't go back to UCM. */
+static void cache_fill(struct cras_use_case_mgr *mgr)
+{
+	const char **list;
+	char *identifier;
+
+	identifier = snd_use_case_identifier("_devices/%s", uc_verb(mgr));
+	if (identifier)
+		get_list(mgr, identifier, &list);
+	free(identifier);
+
+	identifier = snd_use_case_identifier("_modifiers/%s", uc_verb(mgr));
+	if (identifier)
+		get_list(mgr, identifier, &list);
+	free(identifier);
+}
+
+/* Sets a UCM state and drops the cached lists it makes stale. */
+static int set_state(struct cras_use_case_mgr *mgr, const char *identifier,
+		     const char *value)
+{
+	cache_invalidate_list(mgr, "_enadevs");
+	cache_invalidate_list(mgr, "_enamods");
+	return snd_use_case_set(mgr->mgr, identifier, value);
+}
+
 static int device_enabled(struct cras_use_case_mgr *mgr, const char *dev)
 {
 	const char **list;
@@ -91,7 +229,7 @@ static int device_enabled(struct cras_use_case_mgr *mgr, const char *dev)
 	int num_devs;
 	int enabled = 0;
 
-	num_devs = snd_use_case_get_list(mgr->mgr, "_enadevs", &list);
+	num_devs = get_list(mgr, "_enadevs", &list);
 	if (num_devs <= 0)
 		return 0;
 
@@ -101,7 +239,6 @@ static int device_enabled(struct cras_use_case_mgr *mgr, const char *dev)
 			break;
 		}
 
-	snd_use_case_free_list(list, num_devs);
 	return enabled;
 }
 
@@ -111,7 +248,7 @@ static int modifier_enabled(struct cras_use_case_mgr *mgr, const char *mod)
 	unsigned int mod_idx;
 	int num_mods;
 
-	num_mods = snd_use_case_get_list(mgr->mgr, "_enamods", &list);
+	num_mods = get_list(mgr, "_enamods", &list);
 	if (num_mods <= 0)
 		return 0;
 
@@ -119,13 +256,15 @@ static int modifier_enabled(struct cras_use_case_mgr *mgr, const char *mod)
 		if (!strcmp(mod, list[mod_idx]))
 			break;
 
-	snd_use_case_free_list(list, num_mods);
 	return (mod_idx < (unsigned int)num_mods);
 }
 
+/* Looks up a UCM variable. The lookup is memoized, and a copy of the value
+ * is returned which the caller must free. */
 static int get_var(struct cras_use_case_mgr *mgr, const char *var,
 		   const char *dev, const char *verb, const char **value)
 {
+	struct ucm_cached_value *cached;
 	char *id;
 	int rc;
 	size_t len = strlen(var) + strlen(dev) + strlen(verb) + 4;
@@ -134,9 +273,35 @@ static int get_var(struct cras_use_case_mgr *mgr, const char *var,
 	if (!id)
 		return -ENOMEM;
 	snprintf(id, len, "=%s/%s/%s", var, dev, verb);
+
+	DL_FOREACH(mgr->values, cached) {
+		if (!strcmp(cached->identifier, id)) {
+			free(id);
+			if (cached->rc)
+				return cached->rc;
+			*value = strdup(cached->value);
+			return *value ? 0 : -ENOMEM;
+		}
+	}
+
 	rc = snd_use_case_get(mgr->mgr, id, value);
 
-	free((void *)id);
+	cached = (struct ucm_cached_value *)calloc(1, sizeof(*cached));
+	if (!cached) {
+		free(id);
+		return rc;
+	}
+	cached->identifier = id;
+	cached->rc = rc;
+	if (!rc) {
+		cached->value = strdup(*value);
+		if (!cached->value) {
+			free(id);
+			free(cached);
+			return rc;
+		}
+	}
+	DL_APPEND(mgr->values, cached);
 	return rc;
 }
 
@@ -159,7 +324,7 @@ static int get_int(struct cras_use_case_mgr *mgr, const char *var,
 static int ucm_set_modifier_enabled(struct cras_use_case_mgr *mgr,
 				    const char *mod, int enable)
 {
-	return snd_use_case_set(mgr->mgr, enable ? "_enamod" : "_dismod", mod);
+	return set_state(mgr, enable ? "_enamod" : "_dismod", mod);
 }
 
 static int ucm_str_ends_with_suffix(const char *str, const char *suffix)
@@ -181,7 +346,7 @@ static int ucm_section_exists_with_name(struct cras_use_case_mgr *mgr,
 	int num_entries;
 	int exist = 0;
 
-	num_entries = snd_use_case_get_list(mgr->mgr, identifier, &list);
+	num_entries = get_list(mgr, identifier, &list);
 	if (num_entries <= 0)
 		return 0;
 
@@ -195,7 +360,6 @@ static int ucm_section_exists_with_name(struct cras_use_case_mgr *mgr,
 			break;
 		}
 	}
-	snd_use_case_free_list(list, num_entries);
 	return exist;
 }
 
@@ -207,7 +371,7 @@ static int ucm_section_exists_with_suffix(struct cras_use_case_mgr *mgr,
 	int num_entries;
 	int exist = 0;
 
-	num_entries = snd_use_case_get_list(mgr->mgr, identifier, &list);
+	num_entries = get_list(mgr, identifier, &list);
 	if (num_entries <= 0)
 		return 0;
 
@@ -221,7 +385,6 @@ static int ucm_section_exists_with_suffix(struct cras_use_case_mgr *mgr,
 			break;
 		}
 	}
-	snd_use_case_free_list(list, num_entries);
 	return exist;
 }
 
@@ -262,7 +425,7 @@ static struct section_name * ucm_get_sections_for_var(
 	int num_entries;
 	int rc;
 
-	num_entries = snd_use_case_get_list(mgr->mgr, identifier, &list);
+	num_entries = get_list(mgr, identifier, &list);
 	if (num_entries <= 0)
 		return NULL;
 
@@ -294,7 +457,6 @@ static struct section_name * ucm_get_sections_for_var(
 		free((void *)this_value);
 	}
 
-	snd_use_case_free_list(list, num_entries);
 	return section_names;
 }
 
@@ -385,6 +547,8 @@ struct cras_use_case_mgr *ucm_create(const char *name)
 	mgr = (struct cras_use_case_mgr *)malloc(sizeof(*mgr));
 	if (!mgr)
 		return NULL;
+	mgr->lists = NULL;
+	mgr->values = NULL;
 
 	rc = snd_use_case_mgr_open(&mgr->mgr, name);
 	if (rc) {
@@ -395,7 +559,7 @@ struct cras_use_case_mgr *ucm_create(const char *name)
 
 	mgr->name = name;
 	mgr->avail_use_cases = 0;
-	num_verbs = snd_use_case_get_list(mgr->mgr, "_verbs", &list);
+	num_verbs = get_list(mgr, "_verbs", &list);
 	for (i = 0; i < num_verbs; i += 2) {
 		for (j = 0; j < CRAS_STREAM_NUM_TYPES; ++j) {
 			if (strcmp(list[i], use_case_verbs[j]) == 0)
@@ -404,8 +568,6 @@ struct cras_use_case_mgr *ucm_create(const char *name)
 		if (j < CRAS_STREAM_NUM_TYPES)
 			mgr->avail_use_cases |= (1 << j);
 	}
-	if (num_verbs > 0)
-		snd_use_case_free_list(list, num_verbs);
 
 	rc = ucm_set_use_case(mgr, CRAS_STREAM_TYPE_DEFAULT);
 	if (rc)
@@ -414,6 +576,7 @@ struct cras_use_case_mgr *ucm_create(const char *name)
 	return mgr;
 
 cleanup_mgr:
+	cache_free(mgr);
 	snd_use_case_mgr_close(mgr->mgr);
 cleanup:
 	free(mgr);
@@ -422,6 +585,7 @@ cleanup:
 
 void ucm_destroy(struct cras_use_case_mgr *mgr)
 {
+	cache_free(mgr);
 	snd_use_case_mgr_close(mgr->mgr);
 	free(mgr);
 }
@@ -439,12 +603,15 @@ int ucm_set_use_case(struct cras_use_case_mgr *mgr,
 		return -1;
 	}
 
+	/* Everything but the list of verbs is specific to the verb. */
+	cache_clear(mgr);
 	rc = snd_use_case_set(mgr->mgr, "_verb", uc_verb(mgr));
 	if (rc) {
 		syslog(LOG_ERR, "Can not set verb %s for card %s, rc = %d",
 		       uc_verb(mgr), mgr->name, rc);
 		return rc;
 	}
+	cache_fill(mgr);
 
 	return 0;
 }
@@ -483,7 +650,7 @@ int ucm_set_enabled(struct cras_use_case_mgr *mgr, const char *dev, int enable)
 	if (device_enabled(mgr, dev) == !!enable)
 		return 0;
 	syslog(LOG_DEBUG, "UCM %s %s", enable ? "enable" : "disable", dev);
-	return snd_use_case_set(mgr->mgr, enable ? "_enadev" : "_disdev", dev);
+	return set_state(mgr, enable ? "_enadev" : "_disdev", dev);
 }
 
 char *ucm_get_flag(struct cras_use_case_mgr *mgr, const char *flag_name)
@@ -646,6 +813,21 @@ int ucm_get_min_buffer_level(struct cras_use_case_mgr *mgr,
 	return 0;
 }
 
+int ucm_get_min_buffer_level_floor(struct cras_use_case_mgr *mgr,
+				   unsigned int *level)
+{
+	int value;
+	int rc;
+
+	rc = get_int(mgr, min_buffer_level_floor_var, "", uc_verb(mgr),
+		     &value);
+	if (rc || value < 0)
+		return -ENOENT;
+	*level = value;
+
+	return 0;
+}
+
 unsigned int ucm_get_disable_software_volume(struct cras_use_case_mgr *mgr)
 {
 	int value;
@@ -812,7 +994,7 @@ struct ucm_section *ucm_get_sections(struct cras_use_case_mgr *mgr)
 	/* Find the list of all mixers using the control names defined in
 	 * the header definintion for this function.  */
 	identifier = snd_use_case_identifier("_devices/%s", uc_verb(mgr));
-	num_devs = snd_use_case_get_list(mgr->mgr, identifier, &list);
+	num_devs = get_list(mgr, identifier, &list);
 	free(identifier);
 
 	/* snd_use_case_get_list fills list with pairs of device name and
@@ -901,13 +1083,9 @@ struct ucm_section *ucm_get_sections(struct cras_use_case_mgr *mgr)
 		free((void *)dev_name);
 	}
 
-	if (num_devs > 0)
-		snd_use_case_free_list(list, num_devs);
 	return sections;
 
 error_cleanup:
-	if (num_devs > 0)
-		snd_use_case_free_list(list, num_devs);
 	ucm_section_free_list(sections);
 	free((void *)dev_name);
 	return NULL;
@@ -923,7 +1101,7 @@ char *ucm_get_hotword_models(struct cras_use_case_mgr *mgr)
 	char *identifier;
 
 	identifier = snd_use_case_identifier("_modifiers/%s", uc_verb(mgr));
-	num_entries = snd_use_case_get_list(mgr->mgr, identifier, &list);
+	num_entries = get_list(mgr, identifier, &list);
 	free(identifier);
 	if (num_entries <= 0)
 		return 0;
@@ -944,7 +1122,6 @@ char *ucm_get_hotword_models(struct cras_use_case_mgr *mgr)
 				models[models_len++] = ',';
 		}
 	}
-	snd_use_case_free_list(list, num_entries);
 
 	return models;
 }
@@ -966,7 +1143,8 @@ int ucm_set_hotword_model(struct cras_use_case_mgr *mgr, const char *model)
 		return -EINVAL;
 	}
 
-	/* Disable all currently enabled horword model modifiers. */
+	/* Disable all currently enabled horword model modifiers. Read the list
+	 * directly since disabling a modifier invalidates the cached one. */
 	num_enmods = snd_use_case_get_list(mgr->mgr, "_enamods", &list);
 	if (num_enmods <= 0)
 		goto enable_mod;
@@ -1117,3 +1295,16 @@ unsigned int ucm_get_enable_htimestamp_flag(struct cras_use_case_mgr *mgr)
 	free(flag);
 	return ret;
 }
+
+unsigned int ucm_get_dynamic_min_buffer_level_flag(
+		struct cras_use_case_mgr *mgr)
+{
+	char *flag;
+	int ret = 0;
+	flag = ucm_get_flag(mgr, dynamic_min_buffer_level_var);
+	if (!flag)
+		return 0;
+	ret = !strcmp(flag, "1");
+	free(flag);
+	return ret;
+}
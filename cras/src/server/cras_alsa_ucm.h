@@ -190,6 +190,17 @@ const char *ucm_get_dsp_name_default(struct cras_use_case_mgr *mgr,
 int ucm_get_min_buffer_level(struct cras_use_case_mgr *mgr,
 			     unsigned int *level);
 
+/* Gets the lowest level the minimum buffer level of an output may be lowered
+ * to at run time, for outputs with the DynamicMinBufferLevel flag.
+ * Args:
+ *    mgr - The cras_use_case_mgr pointer returned from alsa_ucm_create.
+ *    level - The pointer to the returned value.
+ * Returns:
+ *    0 on success, -ENOENT if the floor isn't set.
+ */
+int ucm_get_min_buffer_level_floor(struct cras_use_case_mgr *mgr,
+				   unsigned int *level);
+
 /* Gets the flag for disabling software volume.
  * Args:
  *    mgr - The cras_use_case_mgr pointer returned from alsa_ucm_create.
@@ -466,4 +477,14 @@ unsigned int ucm_get_optimize_no_stream_flag(struct cras_use_case_mgr *mgr);
  */
 unsigned int ucm_get_enable_htimestamp_flag(struct cras_use_case_mgr *mgr);
 
+/* Retrieve the flag that lets the min buffer level of playback devices be
+ * lowered at run time while they play without underruns.
+ * Args:
+ *    mgr - The cras_use_case_mgr pointer returned from alsa_ucm_create.
+ * Returns:
+ *    1 if the flag is enabled. 0 otherwise.
+ */
+unsigned int ucm_get_dynamic_min_buffer_level_flag(
+		struct cras_use_case_mgr *mgr);
+
 #endif /* _CRAS_ALSA_UCM_H */
@@ -59,6 +59,60 @@ unsigned int cras_audio_area_copy(const struct cras_audio_area *dst,
 	return ncopy;
 }
 
+unsigned int cras_audio_area_copy_scaled(const struct cras_audio_area *dst,
+					 unsigned int dst_offset,
+					 const struct cras_audio_format *dst_fmt,
+					 const struct cras_audio_area *src,
+					 unsigned int src_offset,
+					 float scaler,
+					 float increment)
+{
+	unsigned int src_idx, dst_idx;
+	unsigned int ncopy;
+	unsigned int dst_step, src_step;
+	float end_scaler;
+	uint8_t *schan, *dchan;
+	int written;
+
+	ncopy = MIN(src->frames - src_offset, dst->frames - dst_offset);
+	end_scaler = scaler + increment * ncopy;
+
+	for (dst_idx = 0; dst_idx < dst->num_channels; dst_idx++) {
+		dst_step = dst->channels[dst_idx].step_bytes;
+		dchan = dst->channels[dst_idx].buf + dst_offset * dst_step;
+		written = 0;
+
+		for (src_idx = 0; src_idx < src->num_channels; src_idx++) {
+			if (!(src->channels[src_idx].ch_set &
+			      dst->channels[dst_idx].ch_set))
+				continue;
+
+			src_step = src->channels[src_idx].step_bytes;
+			schan = src->channels[src_idx].buf +
+				src_offset * src_step;
+
+			if (written)
+				cras_mix_add_scale_stride(dst_fmt->format,
+							  dchan, schan, ncopy,
+							  dst_step, src_step,
+							  end_scaler);
+			else if (increment == 0.0f)
+				cras_mix_copy_scale_stride(dst_fmt->format,
+							   dchan, schan, ncopy,
+							   dst_step, src_step,
+							   scaler);
+			else
+				cras_mix_copy_scale_stride_increment(
+						dst_fmt->format, dchan, schan,
+						ncopy, dst_step, src_step,
+						scaler, increment);
+			written = 1;
+		}
+	}
+
+	return ncopy;
+}
+
 void cras_audio_area_destroy(struct cras_audio_area *area)
 {
 	free(area);
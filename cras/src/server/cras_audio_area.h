@@ -74,6 +74,31 @@ unsigned int cras_audio_area_copy(const struct cras_audio_area *dst,
 				  unsigned int src_offset,
 				  float software_gain_scaler);
 
+/*
+ * Copies a cras_audio_area to another cras_audio_area with given offset,
+ * overwriting the destination instead of mixing into it. The gain is applied
+ * in the same pass and can be ramped to avoid a step when it changes.
+ * Destination channels fed by more than one source channel (e.g. stereo into
+ * mono) take the first source ramped and mix the others in at the final gain.
+ * Destination channels with no matching source are left untouched.
+ * Args:
+ *    dst - The destination audio area.
+ *    dst_offset - The offset of dst audio area in frames.
+ *    format - The format of dst area.
+ *    src - The source audio area.
+ *    src_offset - The offset of src audio area in frames.
+ *    scaler - The gain scaler applied to the first frame.
+ *    increment - The change of scaler after each frame, 0 for constant gain.
+ * Returns the number of frames copied.
+ */
+unsigned int cras_audio_area_copy_scaled(const struct cras_audio_area *dst,
+					 unsigned int dst_offset,
+					 const struct cras_audio_format *dst_fmt,
+					 const struct cras_audio_area *src,
+					 unsigned int src_offset,
+					 float scaler,
+					 float increment);
+
 /*
  * Destroys a cras_audio_area.
  * Args:
@@ -812,13 +812,14 @@ static int bt_address(const char *str, struct sockaddr *addr)
 	return 0;
 }
 
-int cras_bt_device_sco_connect(struct cras_bt_device *device)
+int cras_bt_device_sco_connect(struct cras_bt_device *device, int codec)
 {
 	int sk = 0, err;
 	struct sockaddr addr;
 	struct cras_bt_adapter *adapter;
 	struct timespec timeout = { 1, 0 };
 	struct pollfd *pollfds;
+	struct bt_voice voice;
 
 	adapter = cras_bt_device_adapter(device);
 	if (!adapter) {
@@ -843,6 +844,18 @@ int cras_bt_device_sco_connect(struct cras_bt_device *device)
 		goto error;
 	}
 
+	/* mSBC frames go over the air as is, the controller must not
+	 * transcode them. */
+	if (codec == HFP_CODEC_ID_MSBC) {
+		voice.setting = BT_VOICE_TRANSPARENT;
+		if (setsockopt(sk, SOL_BLUETOOTH, BT_VOICE, &voice,
+			       sizeof(voice)) < 0) {
+			syslog(LOG_ERR, "Failed to set voice setting: %s (%d)",
+			       strerror(errno), errno);
+			goto error;
+		}
+	}
+
 	/* Connect to remote in nonblocking mode */
 	fcntl(sk, F_SETFL, O_NONBLOCK);
 	pollfds = (struct pollfd *)malloc(sizeof(*pollfds));
@@ -80,8 +80,10 @@ int cras_bt_device_disconnect(DBusConnection *conn,
 /* Gets the SCO socket for the device.
  * Args:
  *     device - The device object to get SCO socket for.
+ *     codec - The HFP codec id of the audio, mSBC needs a transparent
+ *         SCO link.
  */
-int cras_bt_device_sco_connect(struct cras_bt_device *device);
+int cras_bt_device_sco_connect(struct cras_bt_device *device, int codec);
 
 /* Queries the preffered mtu value for SCO socket. */
 int cras_bt_device_sco_mtu(struct cras_bt_device *device, int sco_socket);
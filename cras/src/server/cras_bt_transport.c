@@ -172,6 +172,11 @@ int cras_bt_transport_fd(const struct cras_bt_transport *transport)
 	return transport->fd;
 }
 
+uint16_t cras_bt_transport_read_mtu(const struct cras_bt_transport *transport)
+{
+	return transport->read_mtu;
+}
+
 uint16_t cras_bt_transport_write_mtu(const struct cras_bt_transport *transport)
 {
 	return transport->write_mtu;
@@ -44,6 +44,7 @@ enum cras_bt_transport_state cras_bt_transport_state(
 	const struct cras_bt_transport *transport);
 
 int cras_bt_transport_fd(const struct cras_bt_transport *transport);
+uint16_t cras_bt_transport_read_mtu(const struct cras_bt_transport *transport);
 uint16_t cras_bt_transport_write_mtu(const struct cras_bt_transport *transport);
 
 void cras_bt_transport_update_properties(
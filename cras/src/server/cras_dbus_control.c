@@ -737,10 +737,7 @@ static DBusHandlerResult handle_set_global_output_channel_remix(
 	for (i = 0; i < count; i++)
 		coefficient[i] = coeff_array[i];
 
-	audio_thread_config_global_remix(
-			cras_iodev_list_get_audio_thread(),
-			num_channels,
-			coefficient);
+	cras_iodev_list_config_global_remix(num_channels, coefficient);
 
 	send_empty_reply(conn, message);
 	free(coefficient);
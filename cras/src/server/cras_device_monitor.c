@@ -67,7 +67,8 @@ int cras_device_monitor_set_device_mute_state(struct cras_iodev *iodev)
 /* When device is in a bad state, e.g. severe underrun,
  * it might break how audio thread works and cause busy wake up loop.
  * Resetting the device can bring device back to normal state.
- * Let main thread follow the disable/enable sequence in iodev_list
+ * Let main thread reopen the device in place so its streams stay attached.
+ * If that fails, follow the disable/enable sequence in iodev_list
  * to properly close/open the device while enabling/disabling fallback
  * device.
  */
@@ -81,6 +82,8 @@ static void handle_device_message(struct cras_main_message *msg, void *arg)
 	case RESET_DEVICE:
 		syslog(LOG_ERR, "trying to recover device 0x%x by resetting it",
 		       iodev->info.idx);
+		if (cras_iodev_list_reopen_dev(iodev) == 0)
+			break;
 		cras_iodev_list_disable_dev(iodev, true);
 		cras_iodev_list_enable_dev(iodev);
 		break;
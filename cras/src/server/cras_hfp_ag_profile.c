@@ -25,6 +25,9 @@
 #define HFP_AG_PROFILE_NAME "Hands-Free Voice gateway"
 #define HFP_AG_PROFILE_PATH "/org/chromium/Cras/Bluetooth/HFPAG"
 #define HFP_VERSION_1_5 0x0105
+#define HFP_VERSION_1_6 0x0106
+/* Wide band speech bit of the AG supported features in the SDP record. */
+#define HFP_SDP_WIDE_BAND_SPEECH 0x0020
 #define HSP_AG_PROFILE_NAME "Headset Voice gateway"
 #define HSP_AG_PROFILE_PATH "/org/chromium/Cras/Bluetooth/HSPAG"
 #define HSP_VERSION_1_2 0x0102
@@ -271,6 +274,11 @@ static struct cras_bt_profile cras_hfp_ag_profile = {
 
 int cras_hfp_ag_profile_create(DBusConnection *conn)
 {
+	/* mSBC needs HFP 1.6 and codec negotiation. */
+	if (cras_system_get_hfp_wideband_speech()) {
+		cras_hfp_ag_profile.version = HFP_VERSION_1_6;
+		cras_hfp_ag_profile.features |= HFP_SDP_WIDE_BAND_SPEECH;
+	}
 	return cras_bt_add_profile(conn, &cras_hfp_ag_profile);
 }
 
@@ -7,12 +7,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <syslog.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "audio_thread.h"
 #include "byte_buffer.h"
+#include "cras_audio_codec.h"
 #include "cras_iodev_list.h"
 #include "cras_hfp_info.h"
+#include "cras_hfp_slc.h"
+#include "cras_sbc_codec.h"
 #include "utlist.h"
 
 /* The max buffer size. Note that the actual used size must set to multiple
@@ -23,6 +29,39 @@
 
 /* rate(8kHz) * sample_size(2 bytes) * channels(1) */
 #define HFP_BYTE_RATE 16000
+/* Transparent SCO carries a 60 byte mSBC packet every 7.5ms. */
+#define HFP_MSBC_BYTE_RATE 8000
+
+/* Most packets read from the SCO socket in one wake up. */
+#define HFP_MAX_READ_BATCH 8
+/* Most packets sent in one transmit tick to catch up missed ticks. */
+#define HFP_MAX_WRITE_BATCH 4
+/* Bounds of the capture jitter buffer, in SCO packets. */
+#define HFP_JB_MIN_PACKETS 1
+#define HFP_JB_MAX_PACKETS 8
+/* Ticks without late packets before the jitter buffer shrinks. */
+#define HFP_JB_DECAY_TICKS 2000
+
+/* An mSBC frame codes 7.5ms of 16kHz mono audio in 57 bytes. It goes over
+ * the SCO link in 60 bytes, behind a two byte H2 header which carries a
+ * sequence number, and followed by a padding byte.
+ */
+#define MSBC_PKT_SIZE 60
+#define MSBC_H2_HEADER_LEN 2
+#define MSBC_FRAME_SIZE 57
+#define MSBC_SYNC_WORD 0xad
+#define MSBC_CODE_SIZE 240
+#define MSBC_CODE_FRAMES 120
+/* Staging room for the SCO packets of mSBC, the SCO packet size must leave
+ * room for a whole mSBC packet besides it. */
+#define MSBC_PKT_BUF_SIZE 1024
+/* Number of consecutive lost frames concealed before going silent. */
+#define MSBC_PLC_MAX_LOST 4
+/* Samples over which a good frame fades in after concealed ones. */
+#define MSBC_PLC_FADE_FRAMES 32
+
+/* Second byte of the H2 header for the sequence numbers 0 to 3. */
+static const uint8_t h2_header_seq[4] = { 0x08, 0x38, 0xc8, 0xf8 };
 
 /* Structure to hold variables for a HFP connection. Since HFP supports
  * bi-direction audio, two iodevs should share one hfp_info if they
@@ -39,6 +78,35 @@
  *     odev - The output iodev using this hfp_info.
  *     packet_size_changed_cbs - The callbacks to trigger when SCO packet
  *         size changed.
+ *     codec - The HFP codec id of the SCO link.
+ *     msbc_read - The codec decoding mSBC frames read from the SCO socket.
+ *     msbc_write - The codec encoding mSBC frames to write to the socket.
+ *     read_pkt - Bytes read from the SCO socket but not decoded yet.
+ *     read_pkt_len - Number of bytes in read_pkt.
+ *     read_seq - The H2 sequence number expected next, -1 if unknown.
+ *     read_skipped - Bytes skipped searching for the next H2 header.
+ *     write_pkt - Encoded mSBC packets not written to the SCO socket yet.
+ *     write_pkt_off - Offset of the first unsent byte in write_pkt.
+ *     write_pkt_len - Number of bytes in write_pkt.
+ *     write_seq - The H2 sequence number of the next frame written.
+ *     plc_frame - The last good decoded frame, replayed for lost ones.
+ *     plc_lost - Number of consecutive frames concealed.
+ *     msbc_frames - Number of mSBC frames received since start.
+ *     msbc_frames_lost - Number of those concealed.
+ *     tx_timer_fd - Timer firing once per SCO packet interval to pace the
+ *         packets sent, independent of those received.
+ *     rx_started - Set once the first packet is received, the capture
+ *         jitter buffer runs from there.
+ *     rx_deficit - Bytes the receive side is behind the transmit ticks,
+ *         counting concealed packets as received.
+ *     jb_packets - Packets of lateness tolerated before a missing packet
+ *         is concealed, grows with late packets.
+ *     jb_quiet_ticks - Ticks since the last late packet.
+ *     conceal_credit - Concealed packets which may still arrive late.
+ *     rx_late - Packets dropped because they were already concealed.
+ *     rx_missing - Packets concealed because they didn't arrive in time.
+ *     rx_duplicated - Packets dropped because they were received twice.
+ *     rx_short - Reads shorter than the SCO packet size.
  */
 struct hfp_info {
 	int fd;
@@ -51,6 +119,33 @@ struct hfp_info {
 	struct cras_iodev *idev;
 	struct cras_iodev *odev;
 	struct hfp_packet_size_changed_callback *packet_size_changed_cbs;
+
+	int codec;
+	struct cras_audio_codec *msbc_read;
+	struct cras_audio_codec *msbc_write;
+	uint8_t read_pkt[MSBC_PKT_BUF_SIZE];
+	unsigned int read_pkt_len;
+	int read_seq;
+	unsigned int read_skipped;
+	uint8_t write_pkt[MSBC_PKT_BUF_SIZE];
+	unsigned int write_pkt_off;
+	unsigned int write_pkt_len;
+	unsigned int write_seq;
+	int16_t plc_frame[MSBC_CODE_FRAMES];
+	unsigned int plc_lost;
+	unsigned int msbc_frames;
+	unsigned int msbc_frames_lost;
+
+	int tx_timer_fd;
+	int rx_started;
+	int rx_deficit;
+	unsigned int jb_packets;
+	unsigned int jb_quiet_ticks;
+	unsigned int conceal_credit;
+	unsigned int rx_late;
+	unsigned int rx_missing;
+	unsigned int rx_duplicated;
+	unsigned int rx_short;
 };
 
 int hfp_info_add_iodev(struct hfp_info *info, struct cras_iodev *dev)
@@ -141,12 +236,81 @@ int hfp_buf_queued(struct hfp_info *info, const struct cras_iodev *dev)
 		return buf_queued(info->capture_buf) / format_bytes;
 }
 
+/* Encodes mSBC frames straight from the playback buffer into the packet
+ * staging buffer until it holds a whole SCO packet, then sends it. */
+static int hfp_write_msbc(struct hfp_info *info)
+{
+	unsigned int pcm_avail;
+	uint8_t *pcm, *pkt;
+	size_t encoded;
+	int err;
+
+	while (info->write_pkt_len - info->write_pkt_off < info->packet_size) {
+		pcm = buf_read_pointer_size(info->playback_buf, &pcm_avail);
+		if (pcm_avail < MSBC_CODE_SIZE)
+			return 0;
+
+		if (info->write_pkt_off) {
+			memmove(info->write_pkt,
+				info->write_pkt + info->write_pkt_off,
+				info->write_pkt_len - info->write_pkt_off);
+			info->write_pkt_len -= info->write_pkt_off;
+			info->write_pkt_off = 0;
+		}
+
+		pkt = info->write_pkt + info->write_pkt_len;
+		pkt[0] = 0x01;
+		pkt[1] = h2_header_seq[info->write_seq];
+		err = info->msbc_write->encode(info->msbc_write, pcm,
+					       MSBC_CODE_SIZE,
+					       pkt + MSBC_H2_HEADER_LEN,
+					       MSBC_FRAME_SIZE, &encoded);
+		if (err != MSBC_CODE_SIZE || encoded != MSBC_FRAME_SIZE) {
+			syslog(LOG_ERR, "mSBC encode error %d", err);
+			return -EIO;
+		}
+		pkt[MSBC_PKT_SIZE - 1] = 0;
+
+		info->write_seq = (info->write_seq + 1) % 4;
+		info->write_pkt_len += MSBC_PKT_SIZE;
+		buf_increment_read(info->playback_buf, MSBC_CODE_SIZE);
+	}
+
+send_sample:
+	err = send(info->fd, info->write_pkt + info->write_pkt_off,
+		   info->packet_size, 0);
+	if (err < 0) {
+		if (errno == EINTR)
+			goto send_sample;
+		if (errno == EAGAIN)
+			return 0;
+
+		return err;
+	}
+
+	if (err != (int)info->packet_size) {
+		syslog(LOG_ERR,
+		       "Partially write %d bytes for SCO packet size %u",
+		       err, info->packet_size);
+		return -1;
+	}
+
+	info->write_pkt_off += err;
+	if (info->write_pkt_off == info->write_pkt_len)
+		info->write_pkt_off = info->write_pkt_len = 0;
+
+	return err;
+}
+
 int hfp_write(struct hfp_info *info)
 {
 	int err = 0;
 	unsigned to_send;
 	uint8_t *samples;
 
+	if (info->codec == HFP_CODEC_ID_MSBC)
+		return hfp_write_msbc(info);
+
 	/* Write something */
 	samples = buf_read_pointer_size(info->playback_buf, &to_send);
 	if (to_send < info->packet_size)
@@ -158,6 +322,8 @@ send_sample:
 	if (err < 0) {
 		if (errno == EINTR)
 			goto send_sample;
+		if (errno == EAGAIN)
+			return 0;
 
 		return err;
 	}
@@ -175,15 +341,42 @@ send_sample:
 }
 
 
+/* Arms the transmit timer to fire once per SCO packet interval. */
+static void hfp_tx_timer_set(struct hfp_info *info)
+{
+	struct itimerspec its;
+	unsigned long long interval_ns;
+	unsigned int byte_rate = info->codec == HFP_CODEC_ID_MSBC ?
+				 HFP_MSBC_BYTE_RATE : HFP_BYTE_RATE;
+
+	if (info->tx_timer_fd < 0)
+		return;
+
+	interval_ns = 1000000000ULL * info->packet_size / byte_rate;
+	its.it_interval.tv_sec = interval_ns / 1000000000ULL;
+	its.it_interval.tv_nsec = interval_ns % 1000000000ULL;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(info->tx_timer_fd, 0, &its, NULL))
+		syslog(LOG_ERR, "Failed to set HFP tx timer: %s",
+		       strerror(errno));
+}
+
 static void hfp_info_set_packet_size(struct hfp_info *info,
 				     unsigned int packet_size)
 {
 	struct hfp_packet_size_changed_callback *callback;
 	unsigned int used_size =
 		MAX_HFP_BUF_SIZE_BYTES / packet_size * packet_size;
+
+	/* The PCM of mSBC moves in whole frames, which must not wrap
+	 * around the end of the buffers. */
+	if (info->codec == HFP_CODEC_ID_MSBC)
+		used_size = MAX_HFP_BUF_SIZE_BYTES / MSBC_CODE_SIZE *
+			    MSBC_CODE_SIZE;
 	info->packet_size = packet_size;
 	byte_buffer_set_used_size(info->playback_buf, used_size);
 	byte_buffer_set_used_size(info->capture_buf, used_size);
+	hfp_tx_timer_set(info);
 
 	DL_FOREACH(info->packet_size_changed_cbs, callback)
 		callback->cb(callback->data);
@@ -213,91 +406,369 @@ void hfp_unregister_packet_size_changed_callback(struct hfp_info *info,
 	}
 }
 
+/* Returns the capture buffer room for one PCM frame of mSBC, NULL if the
+ * buffer is full. */
+static int16_t *msbc_capture_frame(struct hfp_info *info)
+{
+	unsigned int avail;
+	uint8_t *buf;
+
+	buf = buf_write_pointer_size(info->capture_buf, &avail);
+	if (avail < MSBC_CODE_SIZE)
+		return NULL;
+	return (int16_t *)buf;
+}
+
+/* Conceals a lost frame by replaying the last good one, its gain halved
+ * for each consecutive loss until it goes silent. Returns -ENOSPC, without
+ * counting the frame, if the capture buffer is full. */
+static int msbc_conceal_frame(struct hfp_info *info)
+{
+	int16_t *out = msbc_capture_frame(info);
+	unsigned int i;
+
+	if (!out)
+		return -ENOSPC;
+
+	info->msbc_frames++;
+	info->msbc_frames_lost++;
+	if (info->plc_lost <= MSBC_PLC_MAX_LOST)
+		info->plc_lost++;
+
+	for (i = 0; i < MSBC_CODE_FRAMES; i++)
+		out[i] = info->plc_lost <= MSBC_PLC_MAX_LOST ?
+			 info->plc_frame[i] >> (info->plc_lost - 1) : 0;
+	buf_increment_write(info->capture_buf, MSBC_CODE_SIZE);
+	return 0;
+}
+
+/* Decodes the mSBC frame of a packet into the capture buffer, fading it in
+ * from the concealed audio after lost frames. Returns -ENOSPC, leaving the
+ * packet unread, if the capture buffer is full. */
+static int msbc_decode_frame(struct hfp_info *info, const uint8_t *pkt)
+{
+	int16_t *out = msbc_capture_frame(info);
+	size_t decoded;
+	int i, err, fade;
+
+	if (!out)
+		return -ENOSPC;
+
+	err = info->msbc_read->decode(info->msbc_read,
+				      pkt + MSBC_H2_HEADER_LEN,
+				      MSBC_FRAME_SIZE, out, MSBC_CODE_SIZE,
+				      &decoded);
+	if (err <= 0 || decoded != MSBC_CODE_SIZE)
+		return msbc_conceal_frame(info);
+	info->msbc_frames++;
+
+	if (info->plc_lost) {
+		for (i = 0; i < MSBC_PLC_FADE_FRAMES; i++) {
+			fade = info->plc_lost <= MSBC_PLC_MAX_LOST ?
+			       info->plc_frame[i] >> info->plc_lost : 0;
+			out[i] = (out[i] * i +
+				  fade * (MSBC_PLC_FADE_FRAMES - i)) /
+				 MSBC_PLC_FADE_FRAMES;
+		}
+		info->plc_lost = 0;
+	}
+	memcpy(info->plc_frame, out, MSBC_CODE_SIZE);
+	buf_increment_write(info->capture_buf, MSBC_CODE_SIZE);
+	return 0;
+}
+
+/* Returns the sequence number of the H2 header at pkt, or -1 if it isn't
+ * the start of an mSBC packet. */
+static int msbc_h2_seq(const uint8_t *pkt)
+{
+	int seq;
+
+	if (pkt[0] != 0x01 || pkt[MSBC_H2_HEADER_LEN] != MSBC_SYNC_WORD)
+		return -1;
+	for (seq = 0; seq < 4; seq++)
+		if (pkt[1] == h2_header_seq[seq])
+			return seq;
+	return -1;
+}
+
+/* Notes a packet which arrived after it was concealed, the jitter buffer
+ * grows to wait longer for the next ones. */
+static void hfp_jb_late_packet(struct hfp_info *info)
+{
+	info->rx_late++;
+	info->jb_quiet_ticks = 0;
+	if (info->jb_packets < HFP_JB_MAX_PACKETS)
+		info->jb_packets++;
+}
+
+/* Decodes the whole mSBC packets in read_pkt. Frames missing from the
+ * sequence, and bytes without a valid header, are concealed. A packet is
+ * left in read_pkt until the capture buffer has room for it and the frames
+ * concealed before it. */
+static void msbc_parse_packets(struct hfp_info *info)
+{
+	unsigned int off = 0, lost, skipped_frames;
+	int seq;
+
+	while (info->read_pkt_len - off >= MSBC_PKT_SIZE) {
+		seq = msbc_h2_seq(info->read_pkt + off);
+		if (seq < 0) {
+			off++;
+			info->read_skipped++;
+			continue;
+		}
+
+		/* The sequence number only tells the losses modulo 4,
+		 * skipped bytes tell about longer runs. */
+		skipped_frames = (info->read_skipped + MSBC_PKT_SIZE / 2) /
+				 MSBC_PKT_SIZE;
+		lost = info->read_seq < 0 ? 0 : (seq - info->read_seq + 4) % 4;
+
+		/* The frame just before the expected one was either received
+		 * already, or concealed by the jitter buffer, unless the
+		 * receive side is that far behind. */
+		if (lost == 3 && skipped_frames < 3 &&
+		    info->rx_deficit < 3 * MSBC_PKT_SIZE) {
+			if (info->conceal_credit) {
+				info->conceal_credit--;
+				hfp_jb_late_packet(info);
+			} else {
+				info->rx_duplicated++;
+			}
+			info->rx_deficit += MSBC_PKT_SIZE;
+			info->read_skipped = 0;
+			off += MSBC_PKT_SIZE;
+			continue;
+		}
+		while (lost < skipped_frames)
+			lost += 4;
+		if (buf_available(info->capture_buf) <
+		    (lost + 1) * MSBC_CODE_SIZE)
+			break;
+		while (lost--)
+			msbc_conceal_frame(info);
+
+		msbc_decode_frame(info, info->read_pkt + off);
+		info->read_seq = (seq + 1) % 4;
+		info->read_skipped = 0;
+		off += MSBC_PKT_SIZE;
+	}
+
+	info->read_pkt_len -= off;
+	memmove(info->read_pkt, info->read_pkt + off, info->read_pkt_len);
+}
+
 int hfp_read(struct hfp_info *info)
 {
 	int err = 0;
 	unsigned to_read;
 	uint8_t *capture_buf;
 
-	capture_buf = buf_write_pointer_size(info->capture_buf, &to_read);
+	if (info->codec == HFP_CODEC_ID_MSBC) {
+		/* Read behind the bytes left from the last packet, decoding
+		 * needs room for at least a frame. */
+		capture_buf = info->read_pkt + info->read_pkt_len;
+		to_read = buf_available(info->capture_buf) < MSBC_CODE_SIZE ?
+			  0 : MSBC_PKT_BUF_SIZE - info->read_pkt_len;
+	} else {
+		capture_buf = buf_write_pointer_size(info->capture_buf,
+						     &to_read);
+	}
 
 	if (to_read < info->packet_size)
 		return 0;
 	to_read = info->packet_size;
 
 recv_sample:
-	err = recv(info->fd, capture_buf, to_read, 0);
+	err = recv(info->fd, capture_buf, to_read, MSG_DONTWAIT);
 	if (err < 0) {
-		syslog(LOG_ERR, "Read error %s", strerror(errno));
 		if (errno == EINTR)
 			goto recv_sample;
+		if (errno == EAGAIN)
+			return 0;
 
+		syslog(LOG_ERR, "Read error %s", strerror(errno));
 		return err;
 	}
+	if (err == 0) {
+		syslog(LOG_ERR, "SCO socket closed");
+		return -EPIPE;
+	}
 
 	if (err != (int)info->packet_size) {
 		/* Allow the SCO packet size be modified from the default MTU
 		 * value to the size of SCO data we first read. This is for
 		 * some adapters who prefers a different value than MTU for
-		 * transmitting SCO packet.
+		 * transmitting SCO packet. Later short packets are kept, the
+		 * jitter buffer makes up for the missing bytes.
 		 */
-		if (err && (info->packet_size == info->mtu)) {
+		if (info->packet_size == info->mtu)
 			hfp_info_set_packet_size(info, err);
-		} else {
-			syslog(LOG_ERR, "Partially read %d bytes for %u size SCO packet",
-			       err, info->packet_size);
-			return -1;
-		}
+		else
+			info->rx_short++;
 	}
 
-	buf_increment_write(info->capture_buf, err);
+	info->rx_started = 1;
+	info->rx_deficit -= err;
+	if (info->codec != HFP_CODEC_ID_MSBC) {
+		/* Without sequence numbers a packet is taken as late when it
+		 * puts the receive side ahead of the ticks after packets were
+		 * concealed. */
+		if (info->conceal_credit &&
+		    info->rx_deficit < -(int)info->packet_size) {
+			info->conceal_credit--;
+			info->rx_deficit += err;
+			hfp_jb_late_packet(info);
+			return err;
+		}
+		err &= ~1;
+	}
+	/* Absorb the drift of the SCO clock against the tick timer. */
+	if (info->rx_deficit < -HFP_JB_MAX_PACKETS * (int)info->packet_size)
+		info->rx_deficit =
+			-HFP_JB_MAX_PACKETS * (int)info->packet_size;
+
+	if (info->codec == HFP_CODEC_ID_MSBC) {
+		info->read_pkt_len += err;
+		msbc_parse_packets(info);
+	} else {
+		buf_increment_write(info->capture_buf, err);
+	}
 
 	return err;
 }
 
-/* Callback function to handle sample read and write.
- * Note that we poll the SCO socket for read sample, since it reflects
- * there is actual some sample to read while the socket always reports
- * writable even when device buffer is full.
- * The strategy is to synchronize read & write operations:
- * 1. Read one chunk of MTU bytes of data.
- * 2. When input device not attached, ignore the data just read.
- * 3. When output device attached, write one chunk of MTU bytes of data.
- */
-static int hfp_info_callback(void *arg)
+/* Conceals a packet the jitter buffer gave up waiting for. */
+static void hfp_jb_conceal_packet(struct hfp_info *info)
 {
-	struct hfp_info *info = (struct hfp_info *)arg;
-	int err;
+	unsigned int avail;
+	uint8_t *buf;
+
+	if (info->codec == HFP_CODEC_ID_MSBC) {
+		/* Nothing is concealed into a full buffer, the packet is
+		 * still expected and taken as lost once a later one comes. */
+		info->rx_deficit -= MSBC_PKT_SIZE;
+		if (msbc_conceal_frame(info))
+			return;
+		info->rx_missing++;
+		if (info->conceal_credit < HFP_JB_MAX_PACKETS)
+			info->conceal_credit++;
+		if (info->read_seq >= 0)
+			info->read_seq = (info->read_seq + 1) % 4;
+		return;
+	}
 
-	if (!info->started)
-		goto read_write_error;
+	info->rx_missing++;
+	if (info->conceal_credit < HFP_JB_MAX_PACKETS)
+		info->conceal_credit++;
 
-	err = hfp_read(info);
-	if (err < 0) {
-		syslog(LOG_ERR, "Read error");
-		goto read_write_error;
+	buf = buf_write_pointer_size(info->capture_buf, &avail);
+	if (avail > info->packet_size)
+		avail = info->packet_size;
+	memset(buf, 0, avail);
+	buf_increment_write(info->capture_buf, avail);
+	info->rx_deficit -= info->packet_size;
+}
+
+/* Advances the receive side by one packet interval, concealing a packet
+ * when it is later than the jitter buffer tolerates. */
+static void hfp_jb_tick(struct hfp_info *info)
+{
+	if (!info->rx_started)
+		return;
+
+	info->rx_deficit += info->packet_size;
+	if (info->rx_deficit > (int)(info->jb_packets * info->packet_size))
+		hfp_jb_conceal_packet(info);
+
+	if (++info->jb_quiet_ticks >= HFP_JB_DECAY_TICKS) {
+		info->jb_quiet_ticks = 0;
+		if (info->jb_packets > HFP_JB_MIN_PACKETS)
+			info->jb_packets--;
 	}
+}
 
-	/* Ignore the MTU bytes just read if input dev not in present */
-	if (!info->idev)
-		buf_increment_read(info->capture_buf, info->packet_size);
+/* Runs |ticks| transmit intervals, sending one packet per interval when
+ * an output device is attached. */
+static int hfp_tx_ticks(struct hfp_info *info, unsigned int ticks)
+{
+	int err;
 
-	if (info->odev) {
+	if (ticks > HFP_MAX_WRITE_BATCH)
+		ticks = HFP_MAX_WRITE_BATCH;
+
+	while (ticks--) {
+		hfp_jb_tick(info);
+		if (!info->odev)
+			continue;
 		err = hfp_write(info);
+		if (err < 0)
+			return err;
+	}
+	return 0;
+}
+
+/* Callback function to read samples when the SCO socket is readable.
+ * All the pending packets are read in one go, up to HFP_MAX_READ_BATCH.
+ * Writing is paced separately by hfp_tx_callback, so a stalled receive
+ * side doesn't stall playback.
+ */
+static int hfp_info_callback(void *arg)
+{
+	struct hfp_info *info = (struct hfp_info *)arg;
+	int err, i;
+
+	if (!info->started)
+		goto read_error;
+
+	for (i = 0; i < HFP_MAX_READ_BATCH; i++) {
+		err = hfp_read(info);
 		if (err < 0) {
-			syslog(LOG_ERR, "Write error");
-			goto read_write_error;
+			syslog(LOG_ERR, "Read error");
+			goto read_error;
 		}
+		if (err == 0)
+			break;
 	}
 
+	/* Ignore the samples just read if input dev not in present */
+	if (!info->idev)
+		buf_increment_read(info->capture_buf,
+				   buf_queued(info->capture_buf));
+
 	return 0;
 
-read_write_error:
+read_error:
 	hfp_info_stop(info);
 
 	return 0;
 }
 
+/* Callback function of the transmit timer, writes a packet per expired
+ * SCO packet interval.
+ */
+static int hfp_tx_callback(void *arg)
+{
+	struct hfp_info *info = (struct hfp_info *)arg;
+	uint64_t expirations;
+	int err;
+
+	if (!info->started)
+		return 0;
+
+	if (read(info->tx_timer_fd, &expirations, sizeof(expirations)) !=
+	    sizeof(expirations))
+		return 0;
+
+	err = hfp_tx_ticks(info, expirations);
+	if (err < 0) {
+		syslog(LOG_ERR, "Write error");
+		hfp_info_stop(info);
+	}
+
+	return 0;
+}
+
 struct hfp_info *hfp_info_create()
 {
 	struct hfp_info *info;
@@ -305,6 +776,8 @@ struct hfp_info *hfp_info_create()
 	if (!info)
 		goto error;
 
+	info->tx_timer_fd = -1;
+
 	info->capture_buf = byte_buffer_create(MAX_HFP_BUF_SIZE_BYTES);
 	if (!info->capture_buf)
 		goto error;
@@ -331,10 +804,53 @@ int hfp_info_running(struct hfp_info *info)
 	return info->started;
 }
 
-int hfp_info_start(int fd, unsigned int mtu, struct hfp_info *info)
+int hfp_info_start(int fd, unsigned int mtu, int codec,
+		   struct hfp_info *info)
 {
+	int err = -ENOMEM;
+
 	info->fd = fd;
 	info->mtu = mtu;
+	info->codec = codec;
+
+	if (codec == HFP_CODEC_ID_MSBC) {
+		if (mtu + MSBC_PKT_SIZE > MSBC_PKT_BUF_SIZE) {
+			syslog(LOG_ERR, "SCO mtu %u too large for mSBC", mtu);
+			return -EINVAL;
+		}
+		info->msbc_read = cras_msbc_codec_create();
+		info->msbc_write = cras_msbc_codec_create();
+		if (!info->msbc_read || !info->msbc_write)
+			goto start_error;
+		info->read_pkt_len = 0;
+		info->read_seq = -1;
+		info->read_skipped = 0;
+		info->write_pkt_off = 0;
+		info->write_pkt_len = 0;
+		info->write_seq = 0;
+		memset(info->plc_frame, 0, sizeof(info->plc_frame));
+		info->plc_lost = 0;
+		info->msbc_frames = 0;
+		info->msbc_frames_lost = 0;
+	}
+
+	info->tx_timer_fd = timerfd_create(CLOCK_MONOTONIC,
+					   TFD_NONBLOCK | TFD_CLOEXEC);
+	if (info->tx_timer_fd < 0) {
+		err = -errno;
+		syslog(LOG_ERR, "Failed to create HFP tx timer: %s",
+		       strerror(errno));
+		goto start_error;
+	}
+	info->rx_started = 0;
+	info->rx_deficit = 0;
+	info->jb_packets = HFP_JB_MIN_PACKETS;
+	info->jb_quiet_ticks = 0;
+	info->conceal_credit = 0;
+	info->rx_late = 0;
+	info->rx_missing = 0;
+	info->rx_duplicated = 0;
+	info->rx_short = 0;
 
 	/* Make sure buffer size is multiple of packet size, which initially
 	 * set to MTU. */
@@ -343,10 +859,20 @@ int hfp_info_start(int fd, unsigned int mtu, struct hfp_info *info)
 	buf_reset(info->capture_buf);
 
 	audio_thread_add_callback(info->fd, hfp_info_callback, info);
+	audio_thread_add_callback(info->tx_timer_fd, hfp_tx_callback, info);
 
 	info->started = 1;
 
 	return 0;
+
+start_error:
+	if (info->msbc_read)
+		cras_sbc_codec_destroy(info->msbc_read);
+	if (info->msbc_write)
+		cras_sbc_codec_destroy(info->msbc_write);
+	info->msbc_read = NULL;
+	info->msbc_write = NULL;
+	return err;
 }
 
 int hfp_info_stop(struct hfp_info *info)
@@ -357,11 +883,30 @@ int hfp_info_stop(struct hfp_info *info)
 	audio_thread_rm_callback_sync(
 		cras_iodev_list_get_audio_thread(),
 		info->fd);
+	audio_thread_rm_callback_sync(
+		cras_iodev_list_get_audio_thread(),
+		info->tx_timer_fd);
 
 	close(info->fd);
 	info->fd = 0;
+	close(info->tx_timer_fd);
+	info->tx_timer_fd = -1;
 	info->started = 0;
 
+	syslog(LOG_INFO,
+	       "SCO packets late %u missing %u duplicated %u short %u",
+	       info->rx_late, info->rx_missing, info->rx_duplicated,
+	       info->rx_short);
+
+	if (info->codec == HFP_CODEC_ID_MSBC) {
+		syslog(LOG_INFO, "mSBC frames concealed %u of %u",
+		       info->msbc_frames_lost, info->msbc_frames);
+		cras_sbc_codec_destroy(info->msbc_read);
+		cras_sbc_codec_destroy(info->msbc_write);
+		info->msbc_read = NULL;
+		info->msbc_write = NULL;
+	}
+
 	return 0;
 }
 
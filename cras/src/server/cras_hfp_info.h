@@ -35,8 +35,15 @@ int hfp_info_running(struct hfp_info *info);
 
 /* Starts the hfp_info to transmit and reveice samples to and from the file
  * descriptor of a SCO socket.
+ * Args:
+ *    fd - The SCO socket.
+ *    mtu - The MTU of the SCO socket.
+ *    codec - The HFP codec id. CVSD moves 8kHz PCM as is, mSBC codes 16kHz
+ *        PCM into H2 framed packets.
+ *    info - The hfp_info to start.
  */
-int hfp_info_start(int fd, unsigned int mtu, struct hfp_info *info);
+int hfp_info_start(int fd, unsigned int mtu, int codec,
+		   struct hfp_info *info);
 
 /* Stops given hfp_info. This implies sample transmission will
  * stop and socket be closed.
@@ -6,6 +6,7 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <syslog.h>
+#include <unistd.h>
 
 #include "cras_audio_area.h"
 #include "cras_hfp_iodev.h"
@@ -27,12 +28,16 @@ struct hfp_io {
 
 static int update_supported_formats(struct cras_iodev *iodev)
 {
-	// 16 bit, mono, 8kHz
+	struct hfp_io *hfpio = (struct hfp_io *)iodev;
+
+	// 16 bit, mono, 8kHz, or 16kHz when the HF agreed to mSBC
 	iodev->format->format = SND_PCM_FORMAT_S16_LE;
 
 	free(iodev->supported_rates);
 	iodev->supported_rates = (size_t *)malloc(2 * sizeof(size_t));
-	iodev->supported_rates[0] = 8000;
+	iodev->supported_rates[0] =
+		hfp_slc_get_selected_codec(hfpio->slc) == HFP_CODEC_ID_MSBC ?
+		16000 : 8000;
 	iodev->supported_rates[1] = 0;
 
 	free(iodev->supported_channel_counts);
@@ -78,7 +83,7 @@ static void hfp_packet_size_changed(void *data)
 static int configure_dev(struct cras_iodev *iodev)
 {
 	struct hfp_io *hfpio = (struct hfp_io *)iodev;
-	int sk, err, mtu;
+	int sk, err, mtu, codec;
 
 	/* Assert format is set before opening device. */
 	if (iodev->format == NULL)
@@ -89,16 +94,19 @@ static int configure_dev(struct cras_iodev *iodev)
 	if (hfp_info_running(hfpio->info))
 		goto add_dev;
 
-	sk = cras_bt_device_sco_connect(hfpio->device);
+	codec = hfp_slc_get_selected_codec(hfpio->slc);
+	sk = cras_bt_device_sco_connect(hfpio->device, codec);
 	if (sk < 0)
 		goto error;
 
 	mtu = cras_bt_device_sco_mtu(hfpio->device, sk);
 
 	/* Start hfp_info */
-	err = hfp_info_start(sk, mtu, hfpio->info);
-	if (err)
+	err = hfp_info_start(sk, mtu, codec, hfpio->info);
+	if (err) {
+		close(sk);
 		goto error;
+	}
 
 add_dev:
 	hfp_info_add_iodev(hfpio->info, iodev);
@@ -36,6 +36,8 @@
 /* Mode values for standard event reporting activation/deactivation AT
  * command AT+CMER. Used for indicator events reporting in HFP. */
 #define FORWARD_UNSOLICIT_RESULT_CODE	3
+/* Codec negotiation bit of the HF supported features. */
+#define HF_CODEC_NEGOTIATION		0x0080
 
 /* Handle object to hold required info to initialize and maintain
  * an HFP service level connection.
@@ -52,6 +54,9 @@
  *    service - Current service availability of AG stored in SLC.
  *    callheld - Current callheld status of AG stored in SLC.
  *    ind_event_report - Activate status of indicator events reporting.
+ *    hf_supported_features - The features the HF reported in AT+BRSF.
+ *    msbc_supported - The HF listed mSBC in its available codecs.
+ *    selected_codec - The codec the HF confirmed for audio connections.
  *    telephony - A reference of current telephony handle.
  *    device - The associated bt device.
  */
@@ -71,6 +76,9 @@ struct hfp_slc_handle {
 	int service;
 	int callheld;
 	int ind_event_report;
+	int hf_supported_features;
+	int msbc_supported;
+	int selected_codec;
 	struct cras_bt_device *device;
 
 	struct cras_telephony_handle *telephony;
@@ -145,6 +153,29 @@ static int hfp_send_calling_line_identification(struct hfp_slc_handle *handle,
 	return hfp_send(handle, cmd);
 }
 
+/* Returns the AG supported features. Codec negotiation is only offered when
+ * the board enables wideband speech. */
+static int ag_supported_features()
+{
+	int features = HFP_SUPPORTED_FEATURE;
+
+	if (cras_system_get_hfp_wideband_speech())
+		features |= HFP_CODEC_NEGOTIATION;
+	return features;
+}
+
+/* Starts the codec connection, asks the HF to use mSBC when both sides
+ * support it. The HF confirms with AT+BCS. */
+static int select_codec(struct hfp_slc_handle *handle)
+{
+	if (!(ag_supported_features() & HFP_CODEC_NEGOTIATION) ||
+	    !(handle->hf_supported_features & HF_CODEC_NEGOTIATION) ||
+	    !handle->msbc_supported)
+		return 0;
+
+	return hfp_send(handle, "+BCS:2");
+}
+
 /* ATA command to accept an incoming call. Mandatory support per spec 4.13. */
 static int answer_call(struct hfp_slc_handle *handle, const char *cmd)
 {
@@ -256,6 +287,7 @@ static int event_reporting(struct hfp_slc_handle *handle, const char *cmd)
 		handle->initialized = 1;
 		if (handle->init_cb)
 			handle->init_cb(handle);
+		err = select_codec(handle);
 	}
 
 event_reporting_err:
@@ -263,6 +295,44 @@ event_reporting_err:
 	return err;
 }
 
+/* AT+BAC command to notify the codecs the HF supports. Mandatory when both
+ * sides support codec negotiation, per spec 4.34.
+ */
+static int available_codecs(struct hfp_slc_handle *handle, const char *cmd)
+{
+	char *tokens, *id;
+
+	/* AT+BAC=<codec id 1>[,<codec id 2>[,...]] */
+	tokens = strdup(cmd);
+	strtok(tokens, "=");
+	handle->msbc_supported = 0;
+	while ((id = strtok(NULL, ",")))
+		if (atoi(id) == HFP_CODEC_ID_MSBC)
+			handle->msbc_supported = 1;
+	free(tokens);
+
+	return hfp_send(handle, "OK");
+}
+
+/* AT+BCS command to confirm the codec the AG selected with +BCS. Mandatory
+ * when both sides support codec negotiation, per spec 4.11.3.
+ */
+static int codec_selection(struct hfp_slc_handle *handle, const char *cmd)
+{
+	int id;
+
+	if (strlen(cmd) < 8)
+		return hfp_send(handle, "ERROR");
+
+	id = atoi(cmd + 7);
+	if (id != HFP_CODEC_ID_CVSD &&
+	    (id != HFP_CODEC_ID_MSBC || !handle->msbc_supported))
+		return hfp_send(handle, "ERROR");
+
+	handle->selected_codec = id;
+	return hfp_send(handle, "OK");
+}
+
 /* AT+CMEE command to set the "Extended Audio Gateway Error Result Code".
  * Mandatory per spec 4.9.
  */
@@ -451,11 +521,12 @@ static int supported_features(struct hfp_slc_handle *handle, const char *cmd)
 	if (strlen(cmd) < 9)
 		return -EINVAL;
 
-	/* AT+BRSF=<feature> command received, ignore the HF supported feature
-	 * for now. Respond with +BRSF:<feature> to notify mandatory supported
-	 * features in AG(audio gateway).
+	/* AT+BRSF=<feature> command received, keep the HF supported feature
+	 * for codec negotiation. Respond with +BRSF:<feature> to notify
+	 * mandatory supported features in AG(audio gateway).
 	 */
-	snprintf(response, 128, "+BRSF: %u", HFP_SUPPORTED_FEATURE);
+	handle->hf_supported_features = atoi(cmd + 8);
+	snprintf(response, 128, "+BRSF: %u", ag_supported_features());
 	err = hfp_send(handle, response);
 	if (err < 0)
 		return err;
@@ -522,10 +593,20 @@ static int terminate_call(struct hfp_slc_handle *handle, const char *cmd)
  * HF(hands-free)                             AG(audio gateway)
  *                     AT+CMER= -->
  *                 <-- OK
+ *
+ * When both sides support codec negotiation, the HF lists its codecs with
+ * AT+BAC after AT+BRSF, and once the SLC is up the AG picks mSBC:
+ *
+ * HF(hands-free)                             AG(audio gateway)
+ *                 <-- +BCS:2
+ *                     AT+BCS=2 -->
+ *                 <-- OK
  */
 static struct at_command at_commands[] = {
 	{ "ATA", answer_call },
 	{ "ATD", dial_number },
+	{ "AT+BAC", available_codecs },
+	{ "AT+BCS", codec_selection },
 	{ "AT+BIA", indicator_activation },
 	{ "AT+BLDN", last_dialed_number },
 	{ "AT+BRSF", supported_features },
@@ -636,6 +717,7 @@ struct hfp_slc_handle *hfp_slc_create(int fd,
 	handle->signal = 5;
 	handle->service = 1;
 	handle->ind_event_report = 0;
+	handle->selected_codec = HFP_CODEC_ID_CVSD;
 	handle->telephony = cras_telephony_get();
 
 	cras_system_add_select_fd(handle->rfcomm_fd,
@@ -651,6 +733,11 @@ void hfp_slc_destroy(struct hfp_slc_handle *slc_handle)
 	free(slc_handle);
 }
 
+int hfp_slc_get_selected_codec(struct hfp_slc_handle *handle)
+{
+	return handle->selected_codec;
+}
+
 int hfp_set_call_status(struct hfp_slc_handle *handle, int call)
 {
 	int old_call = handle->telephony->call;
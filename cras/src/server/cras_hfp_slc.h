@@ -6,6 +6,10 @@
 #ifndef CRAS_HFP_SLC_H_
 #define CRAS_HFP_SLC_H_
 
+/* Codec ids of the HFP specification. */
+#define HFP_CODEC_ID_CVSD 1
+#define HFP_CODEC_ID_MSBC 2
+
 struct hfp_slc_handle;
 
 /* Callback to call when service level connection initialized. */
@@ -33,6 +37,10 @@ struct hfp_slc_handle *hfp_slc_create(int fd, int is_hsp,
 /* Destroys an hfp_slc_handle. */
 void hfp_slc_destroy(struct hfp_slc_handle *handle);
 
+/* Gets the codec the HF confirmed for audio connections, HFP_CODEC_ID_CVSD
+ * unless it agreed to mSBC. */
+int hfp_slc_get_selected_codec(struct hfp_slc_handle *handle);
+
 /* Sets the call status to notify handsfree device. */
 int hfp_set_call_status(struct hfp_slc_handle *handle, int call);
 
@@ -22,13 +22,17 @@
 #include "cras_fmt_conv.h"
 #include "cras_iodev.h"
 #include "cras_iodev_list.h"
+#include "cras_level_meter.h"
 #include "cras_mix.h"
+#include "cras_observer.h"
 #include "cras_ramp.h"
 #include "cras_rstream.h"
 #include "cras_system_state.h"
+#include "cras_underrun_log.h"
 #include "cras_util.h"
 #include "dev_stream.h"
 #include "input_data.h"
+#include "preroll_buffer.h"
 #include "utlist.h"
 #include "rate_estimator.h"
 #include "softvol_curve.h"
@@ -36,6 +40,7 @@
 static const float RAMP_UNMUTE_DURATION_SECS = 0.5;
 static const float RAMP_NEW_STREAM_DURATION_SECS = 0.01;
 static const float RAMP_MUTE_DURATION_SECS = 0.1;
+static const float RAMP_REOPEN_DURATION_SECS = 0.02;
 
 /*
  * Check issu b/72496547 and commit message for the history of
@@ -46,8 +51,28 @@ static const struct timespec rate_estimation_window_sz = {
 };
 static const double rate_estimation_smooth_factor = 0.3f;
 
+/* How long an output device with dynamic_min_buffer_level must play without
+ * underrun before its min_buffer_level is lowered by one step. */
+static const struct timespec min_buffer_level_stable_ts = {
+	5, 0 /* 5 sec. */
+};
+/* Size of one min_buffer_level step, in milliseconds of frames. */
+static const unsigned int MIN_BUFFER_LEVEL_STEP_MS = 1;
+
 static void cras_iodev_alloc_dsp(struct cras_iodev *iodev);
 
+/* Keeps the last wake ups of an output device for the snapshot that the
+ * underrun being handled triggers. */
+static void freeze_underrun_log(struct cras_iodev *odev)
+{
+	struct timespec now;
+
+	if (!odev->underrun_log)
+		return;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	cras_underrun_log_freeze(odev->underrun_log, &now);
+}
+
 static int default_no_stream_playback(struct cras_iodev *odev)
 {
 	int rc;
@@ -95,6 +120,9 @@ static int cras_iodev_start(struct cras_iodev *iodev)
 		       iodev->info.name);
 		return -EINVAL;
 	}
+	/* Device ops other than get/put_buffer move the buffer pointers
+	 * behind the level snapshot. */
+	iodev->hw_status.valid = 0;
 	rc = iodev->start(iodev);
 	if (rc)
 		return rc;
@@ -167,6 +195,7 @@ static int cras_iodev_no_stream_playback_transition(struct cras_iodev *odev,
 		      odev->info.idx, 0, 0);
 	}
 
+	odev->hw_status.valid = 0;
 	rc = odev->no_stream(odev, enable);
 	if (rc < 0)
 		return rc;
@@ -185,6 +214,11 @@ static int output_should_mute(struct cras_iodev *odev)
 	if (cras_system_get_mute())
 		return 1;
 
+	/* A device waiting to be reset has faded out or stopped playing, keep
+	 * it silent until it is reopened. */
+	if (odev->reset_request_pending)
+		return 1;
+
 	/* consider system volume and active node volume. */
 	return cras_iodev_is_zero_volume(odev);
 }
@@ -629,6 +663,8 @@ void cras_iodev_free_resources(struct cras_iodev *iodev)
 	rate_estimator_destroy(iodev->rate_est);
 	if (iodev->ramp)
 		cras_ramp_destroy(iodev->ramp);
+	cras_underrun_log_destroy(iodev->underrun_log);
+	iodev->underrun_log = NULL;
 }
 
 static void cras_iodev_alloc_dsp(struct cras_iodev *iodev)
@@ -789,6 +825,22 @@ float cras_iodev_get_software_gain_scaler(const struct cras_iodev *iodev) {
 	return scaler;
 }
 
+/* Lowers low_latency_level of an output device for a LOW_LATENCY stream.
+ * Other streams are fetched at their own cadence, their samples wait in
+ * their buffers until the device has room. */
+static void add_low_latency_level(struct cras_iodev *iodev,
+				  const struct dev_stream *stream,
+				  unsigned int cb_threshold)
+{
+	unsigned int level = 2 * cb_threshold;
+
+	if (iodev->direction != CRAS_STREAM_OUTPUT ||
+	    !(stream->stream->flags & LOW_LATENCY))
+		return;
+	if (!iodev->low_latency_level || level < iodev->low_latency_level)
+		iodev->low_latency_level = level;
+}
+
 int cras_iodev_add_stream(struct cras_iodev *iodev,
 			  struct dev_stream *stream)
 {
@@ -801,12 +853,33 @@ int cras_iodev_add_stream(struct cras_iodev *iodev,
 	 * TRIGGER_ONLY streams do not want to receive data, so do not add them
 	 * to buffer_share, otherwise they'll affect other streams to receive.
 	 */
-	if (!(stream->stream->flags & TRIGGER_ONLY))
-		buffer_share_add_id(iodev->buf_state, stream->stream->stream_id,
-				    NULL);
+	stream->share_slot = -1;
+	if (!(stream->stream->flags & TRIGGER_ONLY) &&
+	    buffer_share_add_id(iodev->buf_state, stream->stream->stream_id,
+				NULL) == 0)
+		stream->share_slot = buffer_share_id_slot(
+				iodev->buf_state, stream->stream->stream_id);
+
+	/*
+	 * Streams asking for pre-roll on a warm device start from the oldest
+	 * frame kept, up to preroll_ms back. Streams using APM always read
+	 * live data as the APM works on the device's input_data.
+	 */
+	if (iodev->preroll && (stream->stream->flags & PREROLL_AUDIO) &&
+	    !stream->stream->apm_list) {
+		unsigned int frames = MIN(
+			preroll_buffer_queued(iodev->preroll),
+			cras_frames_at_rate(1000, iodev->preroll_ms,
+					    iodev->ext_format->frame_rate));
+
+		stream->reading_preroll = 1;
+		stream->preroll_pos =
+			preroll_buffer_write_pos(iodev->preroll) - frames;
+	}
 
 	iodev->min_cb_level = MIN(iodev->min_cb_level, cb_threshold);
 	iodev->max_cb_level = MAX(iodev->max_cb_level, cb_threshold);
+	add_low_latency_level(iodev, stream, cb_threshold);
 	return 0;
 }
 
@@ -819,6 +892,7 @@ struct dev_stream *cras_iodev_rm_stream(struct cras_iodev *iodev,
 
 	iodev->min_cb_level = iodev->buffer_size / 2;
 	iodev->max_cb_level = 0;
+	iodev->low_latency_level = 0;
 	DL_FOREACH(iodev->streams, out) {
 		if (out->stream == rstream) {
 			buffer_share_rm_id(iodev->buf_state,
@@ -830,6 +904,7 @@ struct dev_stream *cras_iodev_rm_stream(struct cras_iodev *iodev,
 		cb_threshold = dev_stream_cb_threshold(out);
 		iodev->min_cb_level = MIN(iodev->min_cb_level, cb_threshold);
 		iodev->max_cb_level = MAX(iodev->max_cb_level, cb_threshold);
+		add_low_latency_level(iodev, out, cb_threshold);
 	}
 
 	if (!iodev->streams) {
@@ -849,16 +924,19 @@ struct dev_stream *cras_iodev_rm_stream(struct cras_iodev *iodev,
 unsigned int cras_iodev_stream_offset(struct cras_iodev *iodev,
 				      struct dev_stream *stream)
 {
-	return buffer_share_id_offset(iodev->buf_state,
-				      stream->stream->stream_id);
+	if (stream->share_slot < 0)
+		return 0;
+	return buffer_share_slot_offset(iodev->buf_state, stream->share_slot);
 }
 
 void cras_iodev_stream_written(struct cras_iodev *iodev,
 			       struct dev_stream *stream,
 			       unsigned int nwritten)
 {
-	buffer_share_offset_update(iodev->buf_state,
-				   stream->stream->stream_id, nwritten);
+	if (stream->share_slot < 0)
+		return;
+	buffer_share_slot_offset_update(iodev->buf_state, stream->share_slot,
+					nwritten);
 }
 
 unsigned int cras_iodev_all_streams_written(struct cras_iodev *iodev)
@@ -870,16 +948,9 @@ unsigned int cras_iodev_all_streams_written(struct cras_iodev *iodev)
 
 unsigned int cras_iodev_max_stream_offset(const struct cras_iodev *iodev)
 {
-	unsigned int max = 0;
-	struct dev_stream *curr;
-
-	DL_FOREACH(iodev->streams, curr) {
-		max = MAX(max,
-			  buffer_share_id_offset(iodev->buf_state,
-						 curr->stream->stream_id));
-	}
-
-	return max;
+	if (!iodev->buf_state)
+		return 0;
+	return buffer_share_max_offset(iodev->buf_state);
 }
 
 int cras_iodev_open(struct cras_iodev *iodev, unsigned int cb_level,
@@ -910,6 +981,30 @@ int cras_iodev_open(struct cras_iodev *iodev, unsigned int cb_level,
 		return rc;
 	}
 
+	if (iodev->direction == CRAS_STREAM_OUTPUT) {
+		iodev->level_meter = cras_level_meter_create(iodev->format);
+		if (!iodev->level_meter) {
+			iodev->close_dev(iodev);
+			return -ENOMEM;
+		}
+
+		if (!iodev->underrun_log)
+			iodev->underrun_log = cras_underrun_log_create();
+
+		if (iodev->dynamic_min_buffer_level) {
+			struct cras_iodev_latency_ctl *ctl =
+				&iodev->latency_ctl;
+
+			memset(ctl, 0, sizeof(*ctl));
+			ctl->configured = iodev->min_buffer_level;
+			ctl->lowest = iodev->min_buffer_level;
+			ctl->floor = iodev->min_buffer_level;
+			if (iodev->min_buffer_level_floor)
+				ctl->floor = MIN(iodev->min_buffer_level_floor,
+						 ctl->floor);
+		}
+	}
+
 	/*
 	 * Convert cb_level from input format to device format
 	 */
@@ -923,6 +1018,8 @@ int cras_iodev_open(struct cras_iodev *iodev, unsigned int cb_level,
 	iodev->reset_request_pending = 0;
 	iodev->state = CRAS_IODEV_STATE_OPEN;
 	iodev->highest_hw_level = 0;
+	memset(&iodev->hw_status, 0, sizeof(iodev->hw_status));
+	iodev->num_hw_calls = 0;
 
 	if (iodev->direction == CRAS_STREAM_OUTPUT) {
 		/* If device supports start ops, device can be in open state.
@@ -945,6 +1042,16 @@ int cras_iodev_open(struct cras_iodev *iodev, unsigned int cb_level,
 		iodev->state = CRAS_IODEV_STATE_NORMAL_RUN;
 		/* Initialize the input_streaming flag to zero.*/
 		iodev->input_streaming = 0;
+
+		/* Keep a buffer size of slack on top of the pre-roll so
+		 * streams reading behind the writer don't lose samples. */
+		if (iodev->preroll_ms)
+			iodev->preroll = preroll_buffer_create(
+				cras_frames_at_rate(
+					1000, iodev->preroll_ms,
+					iodev->ext_format->frame_rate) +
+				iodev->buffer_size,
+				iodev->ext_format);
 	}
 
 	add_ext_dsp_module_to_pipeline(iodev);
@@ -969,6 +1076,13 @@ int cras_iodev_close(struct cras_iodev *iodev)
 			iodev->ext_dsp_module = NULL;
 		input_data_destroy(&iodev->input_data);
 	}
+	preroll_buffer_destroy(&iodev->preroll);
+	cras_level_meter_destroy(iodev->level_meter);
+	iodev->level_meter = NULL;
+	if (iodev->direction == CRAS_STREAM_OUTPUT &&
+	    iodev->dynamic_min_buffer_level)
+		iodev->min_buffer_level = iodev->latency_ctl.configured;
+	memset(&iodev->hw_status, 0, sizeof(iodev->hw_status));
 
 	rc = iodev->close_dev(iodev);
 	if (rc)
@@ -982,6 +1096,64 @@ int cras_iodev_close(struct cras_iodev *iodev)
 	return 0;
 }
 
+int cras_iodev_reopen(struct cras_iodev *iodev)
+{
+	struct cras_audio_format fmt, ext_fmt;
+	unsigned int cb_level;
+	int restored = 0;
+	int rc;
+
+	if (!cras_iodev_is_open(iodev) || !iodev->format ||
+	    !iodev->ext_format)
+		return -EINVAL;
+
+	fmt = *iodev->format;
+	ext_fmt = *iodev->ext_format;
+	cb_level = iodev->min_cb_level;
+
+	rc = cras_iodev_close(iodev);
+	if (rc)
+		return rc;
+
+	/* close_dev usually frees the format. */
+	if (!iodev->format) {
+		iodev->format = malloc(sizeof(*iodev->format));
+		iodev->ext_format = malloc(sizeof(*iodev->ext_format));
+		if (!iodev->format || !iodev->ext_format) {
+			cras_iodev_free_format(iodev);
+			return -ENOMEM;
+		}
+		*iodev->format = fmt;
+		*iodev->ext_format = ext_fmt;
+		restored = 1;
+	}
+	if (iodev->rate_est)
+		rate_estimator_reset_rate(iodev->rate_est, ext_fmt.frame_rate);
+
+	rc = cras_iodev_open(iodev, cb_level, &ext_fmt);
+	/* Leave a closed device without format, as close_dev did. */
+	if (rc && restored)
+		cras_iodev_free_format(iodev);
+	return rc;
+}
+
+/* Commits nframes to the device and keeps the level snapshot of this wake
+ * up in line with it. An output device kept playing while the frames were
+ * mixed and processed, so its level is read again after the write. That is
+ * the level the underrun check and the next wake up are based on. */
+static int put_hw_buffer(struct cras_iodev *iodev, unsigned int nframes)
+{
+	struct cras_iodev_hw_status *status = &iodev->hw_status;
+	int rc;
+
+	rc = iodev->put_buffer(iodev, nframes);
+	if (rc < 0 || iodev->direction == CRAS_STREAM_OUTPUT)
+		status->valid = 0;
+	else if (status->valid)
+		status->level -= MIN((int)nframes, status->level);
+	return rc;
+}
+
 int cras_iodev_put_input_buffer(struct cras_iodev *iodev)
 {
 	unsigned int min_frames;
@@ -999,7 +1171,27 @@ int cras_iodev_put_input_buffer(struct cras_iodev *iodev)
 
 	input_data_set_all_streams_read(data, min_frames);
 	rate_estimator_add_frames(iodev->rate_est, -min_frames);
-	return iodev->put_buffer(iodev, min_frames);
+	if (iodev->preroll)
+		preroll_buffer_write(iodev->preroll,
+				     data->area->channels[0].buf, min_frames);
+	return put_hw_buffer(iodev, min_frames);
+}
+
+/* Feeds a block of output to the level meter and passes completed windows
+ * on to observers. scaler is the gain still to be applied to buf.
+ * Returns non-zero if buf holds a non-zero sample. */
+static int measure_output(struct cras_iodev *iodev, const uint8_t *buf,
+			  unsigned int nframes, float scaler)
+{
+	int non_empty;
+
+	non_empty = cras_level_meter_measure(iodev->level_meter, buf,
+					     nframes, scaler);
+	if (cras_level_meter_updated(iodev->level_meter) &&
+	    cras_observer_output_levels_wanted())
+		cras_level_meter_send_msg(iodev->level_meter,
+					  iodev->info.idx);
+	return non_empty;
 }
 
 int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
@@ -1024,7 +1216,17 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 		ramp_action = cras_ramp_get_current_action(iodev->ramp);
 	}
 
-	rc = apply_dsp(iodev, frames, nframes);
+	if (iodev->underrun_log && iodev->dsp_context) {
+		struct timespec start, end, elapsed;
+
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+		rc = apply_dsp(iodev, frames, nframes);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+		subtract_timespecs(&end, &start, &elapsed);
+		cras_underrun_log_add_dsp(iodev->underrun_log, &elapsed);
+	} else {
+		rc = apply_dsp(iodev, frames, nframes);
+	}
 	if (rc)
 		return rc;
 
@@ -1080,18 +1282,16 @@ int cras_iodev_put_output_buffer(struct cras_iodev *iodev, uint8_t *frames,
 				   nframes);
 	rate_estimator_add_frames(iodev->rate_est, nframes);
 
-	// Calculate whether the final output was non-empty, if requested.
-	if (is_non_empty) {
-		unsigned int i;
-		for (i = 0; i < nframes * cras_get_format_bytes(fmt); i++) {
-			if (frames[i]) {
-				*is_non_empty = 1;
-				break;
-			}
-		}
+	// Measure the final output if its levels or whether it was
+	// non-empty are requested.
+	if (iodev->level_meter &&
+	    (is_non_empty || cras_observer_output_levels_wanted())) {
+		if (measure_output(iodev, frames, nframes, 1.0f) &&
+		    is_non_empty)
+			*is_non_empty = 1;
 	}
 
-	return iodev->put_buffer(iodev, nframes);
+	return put_hw_buffer(iodev, nframes);
 }
 
 int cras_iodev_get_input_buffer(struct cras_iodev *iodev, unsigned int *frames)
@@ -1206,14 +1406,29 @@ int cras_iodev_get_dsp_delay(const struct cras_iodev *iodev)
 int cras_iodev_frames_queued(struct cras_iodev *iodev,
 			     struct timespec *hw_tstamp)
 {
+	struct cras_iodev_hw_status *status = &iodev->hw_status;
 	int rc;
 
-	rc = iodev->frames_queued(iodev, hw_tstamp);
-	if(rc == -EPIPE)
-		cras_audio_thread_severe_underrun();
+	if (status->valid) {
+		status->num_cached++;
+		*hw_tstamp = status->tstamp;
+		rc = status->level;
+	} else {
+		rc = iodev->frames_queued(iodev, hw_tstamp);
+		if(rc == -EPIPE) {
+			freeze_underrun_log(iodev);
+			cras_audio_thread_severe_underrun();
+		}
 
-	if (rc < 0)
-		return rc;
+		if (rc < 0)
+			return rc;
+
+		if (iodev->cache_hw_status && status->in_cycle) {
+			status->valid = 1;
+			status->level = rc;
+			status->tstamp = *hw_tstamp;
+		}
+	}
 
 	if (iodev->direction == CRAS_STREAM_INPUT) {
 		if (rc > 0)
@@ -1235,9 +1450,63 @@ int cras_iodev_buffer_avail(struct cras_iodev *iodev, unsigned hw_level)
 	if (hw_level + iodev->min_buffer_level > iodev->buffer_size)
 		return 0;
 
+	/* hw_level doesn't count min_buffer_level, the frames queued in the
+	 * device are capped at min_buffer_level + low_latency_level. */
+	if (iodev->low_latency_level) {
+		unsigned int queued = hw_level + iodev->min_buffer_level;
+		unsigned int cap = iodev->min_buffer_level +
+				   iodev->low_latency_level;
+
+		if (queued >= cap)
+			return 0;
+		return MIN(cap - queued,
+			   iodev->buffer_size - iodev->min_buffer_level -
+				   hw_level);
+	}
+
 	return iodev->buffer_size - iodev->min_buffer_level - hw_level;
 }
 
+void cras_iodev_begin_io_cycle(struct cras_iodev *iodev,
+			       const struct timespec *wake_ts)
+{
+	iodev->hw_status.in_cycle = 1;
+	iodev->hw_status.valid = 0;
+	if (iodev->underrun_log)
+		cras_underrun_log_begin_cycle(iodev->underrun_log, wake_ts);
+}
+
+void cras_iodev_end_io_cycle(struct cras_iodev *iodev)
+{
+	iodev->hw_status.in_cycle = 0;
+	iodev->hw_status.valid = 0;
+	if (iodev->underrun_log)
+		cras_underrun_log_end_cycle(iodev->underrun_log);
+}
+
+void cras_iodev_log_stream_fetch(struct cras_iodev *odev,
+				 cras_stream_id_t stream_id,
+				 const struct timespec *pending)
+{
+	if (odev->underrun_log)
+		cras_underrun_log_fetch(odev->underrun_log, stream_id,
+					pending);
+}
+
+void cras_iodev_log_output_write(struct cras_iodev *odev,
+				 unsigned int hw_level, unsigned int frames)
+{
+	if (odev->underrun_log)
+		cras_underrun_log_write(odev->underrun_log, hw_level, frames);
+}
+
+void cras_iodev_log_output_level(struct cras_iodev *odev,
+				 unsigned int hw_level)
+{
+	if (odev->underrun_log)
+		cras_underrun_log_level_after(odev->underrun_log, hw_level);
+}
+
 void cras_iodev_register_pre_dsp_hook(struct cras_iodev *iodev,
 				      loopback_hook_t loop_cb,
 				      void *cb_data)
@@ -1286,8 +1555,70 @@ int cras_iodev_fill_odev_zeros(struct cras_iodev *odev, unsigned int frames)
 	return 0;
 }
 
+static unsigned int min_buffer_level_step(const struct cras_iodev *odev)
+{
+	return odev->format->frame_rate * MIN_BUFFER_LEVEL_STEP_MS / 1000;
+}
+
+void cras_iodev_update_min_buffer_level(struct cras_iodev *odev,
+					const struct timespec *now)
+{
+	struct cras_iodev_latency_ctl *ctl = &odev->latency_ctl;
+	struct timespec elapsed;
+	unsigned int level;
+
+	if (!odev->dynamic_min_buffer_level || !odev->format)
+		return;
+
+	/* Only time spent playing streams counts as stable. */
+	if (odev->state != CRAS_IODEV_STATE_NORMAL_RUN) {
+		ctl->stable_since.tv_sec = 0;
+		ctl->stable_since.tv_nsec = 0;
+		return;
+	}
+	if (!timespec_is_nonzero(&ctl->stable_since)) {
+		ctl->stable_since = *now;
+		return;
+	}
+
+	subtract_timespecs(now, &ctl->stable_since, &elapsed);
+	if (timespec_after(&min_buffer_level_stable_ts, &elapsed))
+		return;
+	ctl->stable_since = *now;
+	if (odev->min_buffer_level <= ctl->floor)
+		return;
+
+	level = odev->min_buffer_level - MIN(min_buffer_level_step(odev),
+					     odev->min_buffer_level -
+						     ctl->floor);
+	ATLOG(atlog, AUDIO_THREAD_MIN_BUFFER_LEVEL, odev->info.idx,
+	      odev->min_buffer_level, level);
+	odev->min_buffer_level = level;
+	ctl->lowest = MIN(ctl->lowest, level);
+}
+
 int cras_iodev_output_underrun(struct cras_iodev *odev) {
+	freeze_underrun_log(odev);
 	cras_audio_thread_underrun();
+	if (odev->dynamic_min_buffer_level && odev->format) {
+		struct cras_iodev_latency_ctl *ctl = &odev->latency_ctl;
+
+		/* The level that underran isn't tried again while the
+		 * device stays open. */
+		if (odev->min_buffer_level < ctl->configured) {
+			ctl->floor = MIN(odev->min_buffer_level +
+						 min_buffer_level_step(odev),
+					 ctl->configured);
+			ATLOG(atlog, AUDIO_THREAD_MIN_BUFFER_LEVEL,
+			      odev->info.idx, odev->min_buffer_level,
+			      ctl->configured);
+			odev->min_buffer_level = ctl->configured;
+			ctl->num_backoffs++;
+		}
+		ctl->stable_since.tv_sec = 0;
+		ctl->stable_since.tv_nsec = 0;
+	}
+	odev->hw_status.valid = 0;
 	if (odev->output_underrun)
 		return odev->output_underrun(odev);
 	else
@@ -1404,6 +1735,12 @@ static void ramp_mute_callback(void *data)
 	cras_device_monitor_set_device_mute_state(odev);
 }
 
+static void ramp_reopen_callback(void *data)
+{
+	struct cras_iodev *odev = (struct cras_iodev *)data;
+	cras_iodev_reset_request(odev);
+}
+
 /* Used in audio thread. Check the docstrings of CRAS_IODEV_RAMP_REQUEST. */
 int cras_iodev_start_ramp(struct cras_iodev *odev,
 			  enum CRAS_IODEV_RAMP_REQUEST request)
@@ -1434,6 +1771,13 @@ int cras_iodev_start_ramp(struct cras_iodev *odev,
 		cb = ramp_mute_callback;
 		cb_data = (void*)odev;
 		break;
+	/* Playing -> reopen. The device asks to be reset once it is silent. */
+	case CRAS_IODEV_RAMP_REQUEST_DOWN_REOPEN:
+		up = 0;
+		duration_secs = RAMP_REOPEN_DURATION_SECS;
+		cb = ramp_reopen_callback;
+		cb_data = (void*)odev;
+		break;
 	default:
 		return -EINVAL;
 	}
@@ -27,6 +27,8 @@ struct cras_audio_format;
 struct audio_thread;
 struct cras_iodev;
 struct rate_estimator;
+struct preroll_buffer;
+struct cras_underrun_log;
 
 /* Callback type for loopback listeners.  When enabled, this is called from the
  * playback path of an iodev with the samples that are being played back.
@@ -98,6 +100,46 @@ struct cras_ionode {
 	struct cras_ionode *prev, *next;
 };
 
+/* Controller that lowers min_buffer_level of an output device step by step
+ * while it plays without underruns, and raises it back on an underrun.
+ * Members:
+ *    configured - The min_buffer_level set by the device, never exceeded.
+ *    floor - min_buffer_level isn't lowered below this. Starts at the
+ *        min_buffer_level_floor of the device, or at configured if it has
+ *        none, and is raised above the level of each underrun so that level
+ *        isn't tried again.
+ *    stable_since - Last time min_buffer_level changed or the device
+ *        entered normal run, zero while it doesn't play streams.
+ *    lowest - The lowest min_buffer_level reached since the device opened.
+ *    num_backoffs - Number of times an underrun raised min_buffer_level.
+ */
+struct cras_iodev_latency_ctl {
+	unsigned int configured;
+	unsigned int floor;
+	struct timespec stable_since;
+	unsigned int lowest;
+	unsigned int num_backoffs;
+};
+
+/* Level of a device read once per audio thread wake up. Reads after the
+ * first one in the same wake up are served from it, frames put to or taken
+ * from the device since are accounted without asking the hardware again.
+ * Members:
+ *    in_cycle - Set while the audio thread runs I/O on the device.
+ *    valid - Set once level and tstamp hold a read from this wake up.
+ *    level - Frames queued (output) or available (input), as returned by
+ *        the frames_queued callback.
+ *    tstamp - Time stamp returned with level.
+ *    num_cached - Reads served from the snapshot since last logged.
+ */
+struct cras_iodev_hw_status {
+	int in_cycle;
+	int valid;
+	int level;
+	struct timespec tstamp;
+	unsigned int num_cached;
+};
+
 /* An input or output device, that can have audio routed to/from it.
  * set_volume - Function to call if the system volume changes.
  * set_mute - Function to call if the system mute state changes.
@@ -190,6 +232,32 @@ struct cras_ionode {
  *                    been processed by the input DSP.
  * input_data - Used to pass audio input data to streams with or without
  *              stream side processing.
+ * preroll_ms - For capture only. When non-zero the device is kept running
+ *              while enabled even without streams, and the last preroll_ms
+ *              of captured audio are kept for streams asking for pre-roll.
+ * preroll - The ring holding the pre-roll audio while the device is open.
+ * level_meter - For playback only. Peak and RMS levels of the output, fed
+ *     when observers want levels or the non-empty state is checked.
+ * hw_timestamps - Set by devices whose frames_queued timestamp is taken when
+ *     the hardware pointer was read, e.g. ALSA htimestamps. The audio thread
+ *     then corrects its output wake up predictions from the levels seen.
+ * low_latency_level - For playback only. While LOW_LATENCY streams are
+ *     attached, frames queued on top of min_buffer_level are kept below twice
+ *     the smallest callback of these streams. Zero when there are none.
+ * dynamic_min_buffer_level - For playback only. Set by devices that let
+ *     min_buffer_level be lowered at run time while no underruns occur.
+ * min_buffer_level_floor - With dynamic_min_buffer_level, the lowest
+ *     min_buffer_level in frames the device may run at. Zero if the device
+ *     doesn't give one, which keeps min_buffer_level at its configured value.
+ * latency_ctl - State of the min_buffer_level controller while the device
+ *     is open with dynamic_min_buffer_level set.
+ * cache_hw_status - Set by devices whose level is costly to read, e.g. a
+ *     system call per read. Levels are then read once per wake up.
+ * hw_status - The level snapshot used when cache_hw_status is set.
+ * num_hw_calls - Calls into the driver made by the device since last
+ *     logged, counted by devices that set cache_hw_status.
+ * underrun_log - For playback only. The last wake ups of the device, frozen
+ *     on underrun. Kept while the device is closed so it survives resets.
  */
 struct cras_iodev {
 	void (*set_volume)(struct cras_iodev *iodev);
@@ -261,6 +329,18 @@ struct cras_iodev {
 	unsigned int input_dsp_offset;
 	unsigned int highest_hw_level;
 	struct input_data *input_data;
+	unsigned int preroll_ms;
+	struct preroll_buffer *preroll;
+	struct cras_level_meter *level_meter;
+	int hw_timestamps;
+	unsigned int low_latency_level;
+	int dynamic_min_buffer_level;
+	unsigned int min_buffer_level_floor;
+	struct cras_iodev_latency_ctl latency_ctl;
+	int cache_hw_status;
+	struct cras_iodev_hw_status hw_status;
+	unsigned int num_hw_calls;
+	struct cras_underrun_log *underrun_log;
 	struct cras_iodev *prev, *next;
 };
 
@@ -288,12 +368,23 @@ struct cras_iodev {
  * - CRAS_IODEV_RAMP_REQUEST_UP_START_PLAYBACK: Ramping is requested because
  *   first sample of new stream is ready, there is no need to change mute/unmute
  *   state.
+ *
+ * - CRAS_IODEV_RAMP_REQUEST_DOWN_REOPEN: Playing->reopen.
+ *   Request a reset of the device after ramping is done, that is, (c) in the
+ *   plot. The device stays silent until it is reopened, after which it ramps
+ *   up again like for a new stream.
+ *
+ *                      _____
+ *                           \....
+ *                                \____
+ *                                (c)
  */
 
 enum CRAS_IODEV_RAMP_REQUEST {
 	CRAS_IODEV_RAMP_REQUEST_UP_UNMUTE = 0,
 	CRAS_IODEV_RAMP_REQUEST_DOWN_MUTE  = 1,
 	CRAS_IODEV_RAMP_REQUEST_UP_START_PLAYBACK = 2,
+	CRAS_IODEV_RAMP_REQUEST_DOWN_REOPEN = 3,
 };
 
 /*
@@ -527,7 +618,20 @@ int cras_iodev_open(struct cras_iodev *iodev, unsigned int cb_level,
 /* Open an iodev, does teardown and invokes the close_dev callback. */
 int cras_iodev_close(struct cras_iodev *iodev);
 
-/* Gets the available buffer to write/read audio.*/
+/* Closes an open iodev and opens it again with the format and callback level
+ * it has. The format negotiated when the device was first opened is put back
+ * before opening, so supported formats aren't probed again and the DSP isn't
+ * reloaded. Only the device itself is set up again.
+ * Returns:
+ *    0 on success, negative error if the device wasn't open or couldn't be
+ *    opened again, in which case it is left closed.
+ */
+int cras_iodev_reopen(struct cras_iodev *iodev);
+
+/* Gets the available buffer to write/read audio. For output devices hw_level
+ * is the level returned by cras_iodev_frames_queued, without
+ * min_buffer_level, and the frames queued are capped at min_buffer_level +
+ * low_latency_level if a LOW_LATENCY stream is attached. */
 int cras_iodev_buffer_avail(struct cras_iodev *iodev, unsigned hw_level);
 
 /* Marks a buffer from get_buffer as read. */
@@ -705,7 +809,60 @@ unsigned int cras_iodev_get_num_severe_underruns(
  */
 int cras_iodev_reset_request(struct cras_iodev* iodev);
 
-/* Handle output underrun.
+/* Lowers min_buffer_level of an output device with dynamic_min_buffer_level
+ * by one step once it has played without underrun for long enough. Called
+ * by the audio thread after writing to the device.
+ * Args:
+ *    odev[in] - The output device.
+ *    now[in] - The current time.
+ */
+void cras_iodev_update_min_buffer_level(struct cras_iodev *odev,
+					const struct timespec *now);
+
+/* Marks the start of an audio thread wake up running I/O on the device.
+ * Devices with cache_hw_status read their level again on the next
+ * frames_queued.
+ * Args:
+ *    iodev[in] - The device.
+ *    wake_ts[in] - Time the audio thread woke up.
+ */
+void cras_iodev_begin_io_cycle(struct cras_iodev *iodev,
+			       const struct timespec *wake_ts);
+
+/* Marks the end of the I/O started by cras_iodev_begin_io_cycle. Levels are
+ * read from the device until the next one begins.
+ * Args:
+ *    iodev[in] - The device.
+ */
+void cras_iodev_end_io_cycle(struct cras_iodev *iodev);
+
+/* Records in the underrun log of an output device a stream fetch that is
+ * still pending in this wake up.
+ * Args:
+ *    odev[in] - The output device.
+ *    stream_id[in] - The stream asked for samples.
+ *    pending[in] - How long ago the stream was asked.
+ */
+void cras_iodev_log_stream_fetch(struct cras_iodev *odev,
+				 cras_stream_id_t stream_id,
+				 const struct timespec *pending);
+
+/* Records in the underrun log of an output device the write of this wake up.
+ * Args:
+ *    odev[in] - The output device.
+ *    hw_level[in] - Frames queued before writing.
+ *    frames[in] - Frames written.
+ */
+void cras_iodev_log_output_write(struct cras_iodev *odev,
+				 unsigned int hw_level, unsigned int frames);
+
+/* Records in the underrun log of an output device the frames queued after
+ * the write of this wake up. */
+void cras_iodev_log_output_level(struct cras_iodev *odev,
+				 unsigned int hw_level);
+
+/* Handle output underrun. Devices with dynamic_min_buffer_level go back to
+ * their configured min_buffer_level.
  * Args:
  *    odev[in] - The output device.
  * Returns:
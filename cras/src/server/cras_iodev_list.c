@@ -3,7 +3,9 @@
  * found in the LICENSE file.
  */
 
+#include <sys/param.h>
 #include <syslog.h>
+#include <unistd.h>
 
 #include "audio_thread.h"
 #include "cras_empty_iodev.h"
@@ -48,6 +50,27 @@ struct dev_init_retry {
 	struct dev_init_retry *next, *prev;
 };
 
+/* An output device fading out before it is reopened.
+ *    dev_idx - Index of the device.
+ *    timer - Timer reopening the device if the fade doesn't finish.
+ */
+struct dev_reopen {
+	int dev_idx;
+	struct cras_timer *timer;
+	struct dev_reopen *next, *prev;
+};
+
+/* Audio thread running a group of devices that share no streams with the
+ * devices of other audio threads. For now a group is a single device, a
+ * non-enabled output playing only the streams pinned to it.
+ *    thread - The worker thread.
+ *    dev - The device the worker services, NULL if the worker is idle.
+ */
+struct device_group_worker {
+	struct audio_thread *thread;
+	struct cras_iodev *dev;
+};
+
 struct device_enabled_cb {
 	device_enabled_callback_t enabled_cb;
 	device_disabled_callback_t disabled_cb;
@@ -70,6 +93,8 @@ static struct cras_iodev *loopdev_post_mix;
 static struct cras_iodev *loopdev_post_dsp;
 /* List of pending device init retries. */
 static struct dev_init_retry *init_retries;
+/* List of output devices fading out to be reopened. */
+static struct dev_reopen *pending_reopens;
 
 /* Keep a constantly increasing index for iodevs. Index 0 is reserved
  * to mean "no device". */
@@ -80,6 +105,11 @@ struct device_enabled_cb *device_enable_cbs;
 
 /* Thread that handles audio input and output. */
 static struct audio_thread *audio_thread;
+/* The most device group workers to run besides the main audio thread. */
+#define MAX_DEVICE_GROUP_WORKERS 4
+/* Threads that run devices sharing no streams with others. */
+static struct device_group_worker workers[MAX_DEVICE_GROUP_WORKERS];
+static unsigned int num_workers;
 /* List of all streams. */
 static struct stream_list *stream_list;
 /* Idle device timer. */
@@ -88,11 +118,90 @@ static struct cras_timer *idle_timer;
 static int stream_list_suspended = 0;
 /* If init device failed, retry after 1 second. */
 static const unsigned int INIT_DEV_DELAY_MS = 1000;
+/* How long a device fading out to be reopened may take to ask for it. */
+static const unsigned int REOPEN_FADE_TIMEOUT_MS = 200;
 /* Flag to indicate that hotword streams are suspended. */
 static int hotword_suspended = 0;
+/* The longest pre-roll a warm input device can keep. */
+static const unsigned int MAX_INPUT_PREROLL_MS = 2000;
+/* Callback level and preferred format to open a warm input device with when
+ * there is no stream to take them from. */
+static const unsigned int WARM_INPUT_CB_LEVEL = 480;
+static const struct cras_audio_format warm_input_format = {
+	SND_PCM_FORMAT_S16_LE,
+	48000,
+	2,
+};
 
 static void idle_dev_check(struct cras_timer *timer, void *data);
 
+/* Returns the audio thread servicing dev. */
+static struct audio_thread *dev_audio_thread(const struct cras_iodev *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_workers; i++)
+		if (workers[i].dev == dev)
+			return workers[i].thread;
+	return audio_thread;
+}
+
+/*
+ * Checks if dev can be serviced by a device group worker. Default-routed
+ * devices stay on the main audio thread: the enabled devices of a direction
+ * share all default streams, whose shm is read up to the lowest offset in
+ * their buffer_share across those devices, and the first enabled output
+ * carries the loopback hooks and the APM echo reference read by input
+ * devices on the main audio thread. Bluetooth and test devices rely on
+ * callbacks polled by the main audio thread. That leaves output devices
+ * opened only for the streams pinned to them.
+ */
+static int dev_can_use_worker(const struct cras_iodev *dev)
+{
+	if (dev->direction != CRAS_STREAM_OUTPUT)
+		return 0;
+	if (dev->is_enabled || dev->echo_reference_dev || !dev->active_node)
+		return 0;
+
+	switch (dev->active_node->type) {
+	case CRAS_NODE_TYPE_INTERNAL_SPEAKER:
+	case CRAS_NODE_TYPE_HEADPHONE:
+	case CRAS_NODE_TYPE_HDMI:
+	case CRAS_NODE_TYPE_LINEOUT:
+	case CRAS_NODE_TYPE_USB:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Picks the audio thread to run dev on when it is opened. */
+static struct audio_thread *assign_audio_thread(struct cras_iodev *dev)
+{
+	unsigned int i;
+
+	if (!dev_can_use_worker(dev))
+		return audio_thread;
+
+	for (i = 0; i < num_workers; i++) {
+		if (workers[i].dev)
+			continue;
+		workers[i].dev = dev;
+		return workers[i].thread;
+	}
+	return audio_thread;
+}
+
+/* Frees the worker of dev after it is closed. */
+static void release_audio_thread(const struct cras_iodev *dev)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_workers; i++)
+		if (workers[i].dev == dev)
+			workers[i].dev = NULL;
+}
+
 static struct cras_iodev *find_dev(size_t dev_index)
 {
 	struct cras_iodev *dev;
@@ -360,7 +469,7 @@ static void sys_mute_change(void *context, int muted, int user_muted,
 			 * cras_iodev_ramp_start.
 			 */
 			audio_thread_dev_start_ramp(
-					audio_thread,
+					dev_audio_thread(dev),
 					dev,
 					(should_mute ?
 					 CRAS_IODEV_RAMP_REQUEST_DOWN_MUTE :
@@ -377,7 +486,7 @@ static void remove_all_streams_from_dev(struct cras_iodev *dev)
 {
 	struct cras_rstream *rstream;
 
-	audio_thread_rm_open_dev(audio_thread, dev);
+	audio_thread_rm_open_dev(dev_audio_thread(dev), dev);
 
 	DL_FOREACH(stream_list_get(stream_list), rstream) {
 		if (rstream->apm_list == NULL)
@@ -413,6 +522,21 @@ static void possibly_disable_echo_reference(struct cras_iodev *dev)
 	server_stream_destroy(stream_list, dev->echo_reference_dev->info.idx);
 }
 
+/* Cancels the pending fade out and timer of a device being reopened. */
+static void cancel_pending_reopen(unsigned int dev_idx)
+{
+	struct dev_reopen *reopen;
+
+	DL_FOREACH(pending_reopens, reopen) {
+		if (reopen->dev_idx != dev_idx)
+			continue;
+		cras_tm_cancel_timer(cras_system_state_get_tm(),
+				     reopen->timer);
+		DL_DELETE(pending_reopens, reopen);
+		free(reopen);
+	}
+}
+
 /*
  * Close dev if it's opened, without the extra call to idle_dev_check.
  * This is useful for closing a dev inside idle_dev_check function to
@@ -428,9 +552,11 @@ static int close_dev_without_idle_check(struct cras_iodev *dev)
 	if (cras_iodev_has_pinned_stream(dev))
 		syslog(LOG_ERR, "Closing device with pinned streams.");
 
+	cancel_pending_reopen(dev->info.idx);
 	remove_all_streams_from_dev(dev);
 	dev->idle_timeout.tv_sec = 0;
 	cras_iodev_close(dev);
+	release_audio_thread(dev);
 	possibly_disable_echo_reference(dev);
 	return 0;
 }
@@ -522,15 +648,98 @@ static int init_device(struct cras_iodev *dev,
 	if (rc)
 		return rc;
 
-	rc = audio_thread_add_open_dev(audio_thread, dev);
-	if (rc)
+	rc = audio_thread_add_open_dev(assign_audio_thread(dev), dev);
+	if (rc) {
 		cras_iodev_close(dev);
+		release_audio_thread(dev);
+	}
 
 	possibly_enable_echo_reference(dev);
 
 	return rc;
 }
 
+/* Returns the preferred value if it is in the 0-terminated list of
+ * supported values, otherwise the first one listed. */
+static size_t supported_or_first(const size_t *supported, size_t preferred)
+{
+	size_t i;
+
+	for (i = 0; supported[i]; i++)
+		if (supported[i] == preferred)
+			return preferred;
+	return supported[0];
+}
+
+/*
+ * Picks the format to open a warm input device in from the ones it
+ * supports, warm_input_format where possible. The pre-roll ring holds
+ * frames in this format until a stream brings its own.
+ */
+static int get_warm_input_format(struct cras_iodev *dev,
+				 struct cras_audio_format *fmt)
+{
+	size_t i;
+	int rc;
+
+	*fmt = warm_input_format;
+	if (!dev->update_supported_formats)
+		return 0;
+
+	rc = dev->update_supported_formats(dev);
+	if (rc)
+		return rc;
+	if (!dev->supported_rates || !dev->supported_rates[0] ||
+	    !dev->supported_channel_counts ||
+	    !dev->supported_channel_counts[0] ||
+	    !dev->supported_formats || !dev->supported_formats[0])
+		return -EINVAL;
+
+	fmt->frame_rate = supported_or_first(dev->supported_rates,
+					     warm_input_format.frame_rate);
+	fmt->num_channels = supported_or_first(
+			dev->supported_channel_counts,
+			warm_input_format.num_channels);
+	fmt->format = dev->supported_formats[0];
+	for (i = 0; dev->supported_formats[i]; i++)
+		if (dev->supported_formats[i] == warm_input_format.format)
+			fmt->format = warm_input_format.format;
+	return 0;
+}
+
+/*
+ * Opens an enabled input device configured with a pre-roll, so it keeps
+ * capturing into its pre-roll ring while no stream is attached. Streams
+ * added later attach to the running device right away.
+ */
+static int possibly_open_warm_input(struct cras_iodev *dev)
+{
+	struct cras_audio_format fmt;
+	int rc;
+
+	if (dev->direction != CRAS_STREAM_INPUT || !dev->preroll_ms)
+		return 0;
+	if (stream_list_suspended || !cras_iodev_list_dev_is_enabled(dev))
+		return 0;
+	if (cras_iodev_is_open(dev))
+		return 0;
+
+	rc = get_warm_input_format(dev, &fmt);
+	if (rc == 0)
+		rc = cras_iodev_open(dev, WARM_INPUT_CB_LEVEL, &fmt);
+	if (rc) {
+		syslog(LOG_ERR, "Open warm input %s failed, rc = %d",
+		       dev->info.name, rc);
+		return rc;
+	}
+
+	rc = audio_thread_add_open_dev(audio_thread, dev);
+	if (rc)
+		cras_iodev_close(dev);
+
+	return rc;
+}
+
 static void suspend_devs()
 {
 	struct enabled_dev *edev;
@@ -545,8 +754,9 @@ static void suspend_devs()
 
 			dev = find_dev(rstream->pinned_dev_idx);
 			if (dev) {
-				audio_thread_disconnect_stream(audio_thread,
-							       rstream, dev);
+				audio_thread_disconnect_stream(
+						dev_audio_thread(dev),
+						rstream, dev);
 				if (!cras_iodev_list_dev_is_enabled(dev))
 					close_dev(dev);
 			}
@@ -569,6 +779,7 @@ static int stream_added_cb(struct cras_rstream *rstream);
 
 static void resume_devs()
 {
+	struct enabled_dev *edev;
 	struct cras_rstream *rstream;
 
 	stream_list_suspended = 0;
@@ -577,6 +788,8 @@ static void resume_devs()
 			continue;
 		stream_added_cb(rstream);
 	}
+	DL_FOREACH(enabled_devs[CRAS_STREAM_INPUT], edev)
+		possibly_open_warm_input(edev->dev);
 }
 
 /* Called when the system audio is suspended or resumed. */
@@ -649,7 +862,8 @@ static int add_stream_to_open_devs(struct cras_rstream *stream,
 					  iodevs[i],
 					  iodevs[i]->ext_format);
 	}
-	return audio_thread_add_stream(audio_thread,
+	/* A stream is only ever attached to devices of the same thread. */
+	return audio_thread_add_stream(dev_audio_thread(iodevs[0]),
 				       stream, iodevs, num_iodevs);
 }
 
@@ -737,7 +951,7 @@ static int init_pinned_device(struct cras_iodev *dev,
 {
 	int rc;
 
-	if (audio_thread_is_dev_open(audio_thread, dev))
+	if (audio_thread_is_dev_open(dev_audio_thread(dev), dev))
 		return 0;
 
 	/* Make sure the active node is configured properly, it could be
@@ -779,6 +993,15 @@ static struct cras_iodev *find_pinned_device(struct cras_rstream *rstream)
 	return hotword_suspended ? empty_hotword_dev : dev;
 }
 
+/* Returns the audio thread rstream is attached to. Default streams are
+ * attached to the enabled devices, which all run on the main audio thread. */
+static struct audio_thread *stream_audio_thread(struct cras_rstream *rstream)
+{
+	struct cras_iodev *dev = find_pinned_device(rstream);
+
+	return dev ? dev_audio_thread(dev) : audio_thread;
+}
+
 static int pinned_stream_added(struct cras_rstream *rstream)
 {
 	struct cras_iodev *dev;
@@ -872,7 +1095,13 @@ static int possibly_close_enabled_devs(enum CRAS_STREAM_DIRECTION dir)
 		if (cras_iodev_has_pinned_stream(edev->dev))
 			continue;
 		if (dir == CRAS_STREAM_INPUT) {
+			/* Warm devices keep capturing into their pre-roll.
+			 * Reopen those whose pre-roll was enabled while
+			 * streams were using them. */
+			if (edev->dev->preroll_ms && edev->dev->preroll)
+				continue;
 			close_dev(edev->dev);
+			possibly_open_warm_input(edev->dev);
 			continue;
 		}
 		/* Allow output devs to drain before closing. */
@@ -903,7 +1132,7 @@ static int stream_removed_cb(struct cras_rstream *rstream)
 	enum CRAS_STREAM_DIRECTION direction = rstream->direction;
 	int rc;
 
-	rc = audio_thread_drain_stream(audio_thread, rstream);
+	rc = audio_thread_drain_stream(stream_audio_thread(rstream), rstream);
 	if (rc)
 		return rc;
 
@@ -915,6 +1144,28 @@ static int stream_removed_cb(struct cras_rstream *rstream)
 	return 0;
 }
 
+/*
+ * Moves a device running on a device group worker to the main audio thread,
+ * where the default streams it is about to be given run. The device is closed
+ * here and reopened once enabled, taking its pinned streams along.
+ */
+static void move_dev_to_main_thread(struct cras_iodev *dev)
+{
+	struct audio_thread *thread = dev_audio_thread(dev);
+	struct cras_rstream *rstream;
+
+	if (thread == audio_thread)
+		return;
+
+	DL_FOREACH(stream_list_get(stream_list), rstream) {
+		if (!rstream->is_pinned ||
+		    rstream->pinned_dev_idx != dev->info.idx)
+			continue;
+		audio_thread_disconnect_stream(thread, rstream, dev);
+	}
+	close_dev(dev);
+}
+
 static int enable_device(struct cras_iodev *dev)
 {
 	int rc;
@@ -927,6 +1178,8 @@ static int enable_device(struct cras_iodev *dev)
 			return -EEXIST;
 	}
 
+	move_dev_to_main_thread(dev);
+
 	edev = calloc(1, sizeof(*edev));
 	edev->dev = dev;
 	DL_APPEND(enabled_devs[dir], edev);
@@ -938,6 +1191,7 @@ static int enable_device(struct cras_iodev *dev)
 		schedule_init_device_retry(dev);
 		return rc;
 	}
+	possibly_open_warm_input(dev);
 
 	DL_FOREACH(device_enable_cbs, callback)
 		callback->enabled_cb(dev, callback->cb_data);
@@ -972,7 +1226,8 @@ static int disable_device(struct enabled_dev *edev, bool force)
 			continue;
 		if (stream->is_pinned && !force)
 			continue;
-		audio_thread_disconnect_stream(audio_thread, stream, dev);
+		audio_thread_disconnect_stream(dev_audio_thread(dev),
+					       stream, dev);
 	}
 	if (cras_iodev_has_pinned_stream(dev))
 		return 0;
@@ -1003,7 +1258,8 @@ static int force_close_pinned_only_device(struct cras_iodev *dev)
 			continue;
 		if (dev->info.idx != rstream->pinned_dev_idx)
 			continue;
-		audio_thread_disconnect_stream(audio_thread, rstream, dev);
+		audio_thread_disconnect_stream(dev_audio_thread(dev),
+					       rstream, dev);
 	}
 	if (cras_iodev_has_pinned_stream(dev))
 		return -EEXIST;
@@ -1016,6 +1272,32 @@ static int force_close_pinned_only_device(struct cras_iodev *dev)
  * Exported Interface.
  */
 
+/*
+ * Starts the device group workers configured for the board. The main audio
+ * thread is left unpinned, each worker is pinned to a CPU of its own starting
+ * from CPU 1.
+ */
+static void start_device_group_workers()
+{
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int num = cras_system_get_device_group_workers();
+	struct audio_thread *thread;
+	int cpu;
+
+	num = MIN(MAX(num, 0), MAX_DEVICE_GROUP_WORKERS);
+	for (num_workers = 0; num_workers < num; num_workers++) {
+		cpu = num_cpus > 1 ? (num_workers + 1) % num_cpus : -1;
+		thread = audio_thread_create_worker(num_workers, cpu);
+		if (!thread) {
+			syslog(LOG_ERR, "Failed to create device group worker");
+			break;
+		}
+		audio_thread_start(thread);
+		workers[num_workers].thread = thread;
+		workers[num_workers].dev = NULL;
+	}
+}
+
 void cras_iodev_list_init()
 {
 	struct cras_observer_ops observer_ops;
@@ -1060,12 +1342,23 @@ void cras_iodev_list_init()
 		exit(-ENOMEM);
 	}
 	audio_thread_start(audio_thread);
+	start_device_group_workers();
 
 	cras_iodev_list_update_device_list();
 }
 
 void cras_iodev_list_deinit()
 {
+	unsigned int i;
+
+	for (i = 0; i < num_workers; i++) {
+		audio_thread_destroy(workers[i].thread);
+		workers[i].thread = NULL;
+		workers[i].dev = NULL;
+	}
+	num_workers = 0;
+	while (pending_reopens)
+		cancel_pending_reopen(pending_reopens->dev_idx);
 	audio_thread_destroy(audio_thread);
 	loopback_iodev_destroy(loopdev_post_dsp);
 	loopback_iodev_destroy(loopdev_post_mix);
@@ -1163,6 +1456,107 @@ void cras_iodev_list_disable_dev(struct cras_iodev *dev, bool force_close)
 	return;
 }
 
+/* Reopens dev right away, keeping its streams attached. */
+static int reopen_dev(struct cras_iodev *dev)
+{
+	struct timespec start, now, gap;
+	int rc;
+
+	cancel_pending_reopen(dev->info.idx);
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+	/* Keep the audio thread and echo reference of the device, only the
+	 * device and its streams' dev_streams are recreated. */
+	remove_all_streams_from_dev(dev);
+	rc = cras_iodev_reopen(dev);
+	if (rc == 0) {
+		rc = audio_thread_add_open_dev(dev_audio_thread(dev), dev);
+		if (rc)
+			cras_iodev_close(dev);
+	}
+	if (rc) {
+		syslog(LOG_ERR, "Failed to reopen %s, rc = %d",
+		       dev->info.name, rc);
+		release_audio_thread(dev);
+		possibly_disable_echo_reference(dev);
+		return rc;
+	}
+
+	rc = init_and_attach_streams(dev);
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	subtract_timespecs(&now, &start, &gap);
+	syslog(LOG_INFO, "Reopened %s in %u ms", dev->info.name,
+	       timespec_to_ms(&gap));
+	return rc;
+}
+
+static void reopen_dev_cb(struct cras_timer *timer, void *arg)
+{
+	struct dev_reopen *reopen = (struct dev_reopen *)arg;
+	struct cras_iodev *dev = find_dev(reopen->dev_idx);
+
+	DL_DELETE(pending_reopens, reopen);
+	free(reopen);
+
+	if (!dev || !cras_iodev_is_open(dev))
+		return;
+
+	syslog(LOG_WARNING, "%s didn't fade out in time", dev->info.name);
+	reopen_dev(dev);
+}
+
+/*
+ * Fades out an output device that is still playing before it is reopened.
+ * When the ramp is done the device asks to be reset, which reopens it. A
+ * timer reopens it anyway in case the ramp doesn't finish, e.g. because its
+ * streams drained meanwhile. Returns 0 if the fade out is in progress.
+ */
+static int fade_out_to_reopen(struct cras_iodev *dev)
+{
+	struct dev_reopen *reopen;
+	int rc;
+
+	if (dev->direction != CRAS_STREAM_OUTPUT || !dev->ramp ||
+	    dev->reset_request_pending ||
+	    cras_iodev_state(dev) != CRAS_IODEV_STATE_NORMAL_RUN ||
+	    cras_iodev_is_zero_volume(dev))
+		return -EINVAL;
+
+	DL_FOREACH(pending_reopens, reopen)
+		if (reopen->dev_idx == dev->info.idx)
+			return 0;
+
+	reopen = (struct dev_reopen *)calloc(1, sizeof(*reopen));
+	if (!reopen)
+		return -ENOMEM;
+
+	rc = audio_thread_dev_start_ramp(dev_audio_thread(dev), dev,
+					 CRAS_IODEV_RAMP_REQUEST_DOWN_REOPEN);
+	if (rc) {
+		free(reopen);
+		return rc;
+	}
+
+	reopen->dev_idx = dev->info.idx;
+	reopen->timer = cras_tm_create_timer(cras_system_state_get_tm(),
+					     REOPEN_FADE_TIMEOUT_MS,
+					     reopen_dev_cb, reopen);
+	DL_APPEND(pending_reopens, reopen);
+	return 0;
+}
+
+int cras_iodev_list_reopen_dev(struct cras_iodev *dev)
+{
+	if (!cras_iodev_is_open(dev) || !dev->ext_format)
+		return -EINVAL;
+
+	if (fade_out_to_reopen(dev) == 0)
+		return 0;
+
+	return reopen_dev(dev);
+}
+
 void cras_iodev_list_rm_active_node(enum CRAS_STREAM_DIRECTION dir,
 				    cras_node_id_t node_id)
 {
@@ -1479,6 +1873,21 @@ void cras_iodev_list_select_node(enum CRAS_STREAM_DIRECTION direction,
 	cras_iodev_list_notify_active_node_changed(direction);
 }
 
+/*
+ * Sets the pre-roll of an input device. A device with a pre-roll is kept
+ * open while enabled. A new length applies the next time the device opens.
+ */
+static int set_input_preroll(struct cras_iodev *dev, int preroll_ms)
+{
+	if (dev->direction != CRAS_STREAM_INPUT || preroll_ms < 0)
+		return -EINVAL;
+
+	dev->preroll_ms = MIN(preroll_ms, MAX_INPUT_PREROLL_MS);
+	if (cras_iodev_list_dev_is_enabled(dev))
+		possibly_close_enabled_devs(CRAS_STREAM_INPUT);
+	return 0;
+}
+
 int cras_iodev_list_set_node_attr(cras_node_id_t node_id,
 				  enum ionode_attr attr, int value)
 {
@@ -1489,6 +1898,9 @@ int cras_iodev_list_set_node_attr(cras_node_id_t node_id,
 	if (!node)
 		return -EINVAL;
 
+	if (attr == IONODE_ATTR_PREROLL_MS)
+		return set_input_preroll(node->dev, value);
+
 	rc = cras_iodev_set_node_attr(node, attr, value);
 	return rc;
 }
@@ -1540,6 +1952,46 @@ struct audio_thread *cras_iodev_list_get_audio_thread()
 	return audio_thread;
 }
 
+int cras_iodev_list_dump_audio_thread_info(struct audio_debug_info *info)
+{
+	unsigned int i;
+	int rc;
+
+	info->num_devs = 0;
+	info->num_streams = 0;
+	info->num_threads = 0;
+	info->wakeups_per_sec = 0;
+	rc = audio_thread_dump_thread_info(audio_thread, info);
+	if (rc < 0)
+		return rc;
+	for (i = 0; i < num_workers; i++) {
+		rc = audio_thread_dump_thread_info(workers[i].thread, info);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
+int cras_iodev_list_config_global_remix(unsigned int num_channels,
+					const float *coefficient)
+{
+	unsigned int i;
+	int rc;
+
+	rc = audio_thread_config_global_remix(audio_thread, num_channels,
+					      coefficient);
+	if (rc < 0)
+		return rc;
+	for (i = 0; i < num_workers; i++) {
+		rc = audio_thread_config_global_remix(workers[i].thread,
+						      num_channels,
+						      coefficient);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
 struct stream_list *cras_iodev_list_get_stream_list()
 {
 	return stream_list;
@@ -164,6 +164,21 @@ void cras_iodev_list_enable_dev(struct cras_iodev *dev);
  */
 void cras_iodev_list_disable_dev(struct cras_iodev *dev, bool force_close);
 
+/*
+ * Closes an open iodev and opens it again with the format it had, keeping
+ * it enabled and on the same audio thread. The streams it played or
+ * captured are attached back to it and keep the samples queued in their
+ * shm. Unlike a disable/enable cycle, streams are not moved to the fallback
+ * device meanwhile. An output that is still playing is ramped down first
+ * and reopened once the ramp is done, it ramps up again when its streams
+ * have samples.
+ * Returns:
+ *    0 on success or if the reopen waits for the ramp down, negative error
+ *    if the device wasn't open or couldn't be opened again, in which case it
+ *    is left closed.
+ */
+int cras_iodev_list_reopen_dev(struct cras_iodev *dev);
+
 /* Adds a node to the active devices list.
  * Args:
  *    direction - Playback or capture.
@@ -201,9 +216,24 @@ void cras_iodev_list_test_dev_command(unsigned int iodev_idx,
 				      unsigned int data_len,
 				      const uint8_t *data);
 
-/* Gets the audio thread used by the devices. */
+/* Gets the main audio thread used by the devices. Callbacks added with
+ * audio_thread_add_callback() are polled by this thread. */
 struct audio_thread *cras_iodev_list_get_audio_thread();
 
+/* Dumps the devices and streams of all audio threads.
+ * Args:
+ *    info - Filled with the debug info of every audio thread.
+ */
+int cras_iodev_list_dump_audio_thread_info(struct audio_debug_info *info);
+
+/* Configures the global converter for output remixing on all audio threads.
+ * Args:
+ *    num_channels - Number of channels of the remix matrix.
+ *    coefficient - The num_channels by num_channels remix matrix.
+ */
+int cras_iodev_list_config_global_remix(unsigned int num_channels,
+					const float *coefficient);
+
 /* Gets the list of all active audio streams attached to devices. */
 struct stream_list *cras_iodev_list_get_stream_list();
 
@@ -0,0 +1,194 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <syslog.h>
+
+#include "cras_level_meter.h"
+#include "cras_main_message.h"
+#include "cras_mix.h"
+#include "cras_observer.h"
+#include "cras_util.h"
+
+/* Members:
+ *    format - Sample format of the measured blocks.
+ *    num_channels - Channels in a frame.
+ *    window_frames - Frames in a metering window.
+ *    frames - Frames measured in the current window.
+ *    peak, sum_squares - Accumulated levels of the current window, one entry
+ *        per channel.
+ *    block_peak, block_sum - Levels of a block that is scaled before it is
+ *        added to the window, one entry per channel.
+ *    last_peak, last_rms - Levels of the last completed window.
+ *    updated - Set when a window completes, cleared when read.
+ */
+struct cras_level_meter {
+	snd_pcm_format_t format;
+	unsigned int num_channels;
+	unsigned int window_frames;
+	unsigned int frames;
+	float *peak;
+	float *sum_squares;
+	float *block_peak;
+	float *block_sum;
+	float last_peak[CRAS_CH_MAX];
+	float last_rms[CRAS_CH_MAX];
+	int updated;
+};
+
+struct output_levels_msg {
+	struct cras_main_message header;
+	uint32_t dev_idx;
+	uint32_t num_channels;
+	float peak[CRAS_CH_MAX];
+	float rms[CRAS_CH_MAX];
+};
+
+static void finish_window(struct cras_level_meter *meter)
+{
+	unsigned int c;
+
+	for (c = 0; c < meter->num_channels && c < CRAS_CH_MAX; c++) {
+		meter->last_peak[c] = MIN(meter->peak[c], 1.0f);
+		meter->last_rms[c] = MIN(sqrtf(meter->sum_squares[c] /
+					       meter->frames), 1.0f);
+	}
+	memset(meter->peak, 0, 2 * meter->num_channels * sizeof(float));
+	meter->frames = 0;
+	meter->updated = 1;
+}
+
+/*
+ * Exported Interface.
+ */
+
+struct cras_level_meter *cras_level_meter_create(
+		const struct cras_audio_format *fmt)
+{
+	struct cras_level_meter *meter;
+
+	meter = (struct cras_level_meter *)calloc(1, sizeof(*meter));
+	if (!meter)
+		return NULL;
+	meter->format = fmt->format;
+	meter->num_channels = fmt->num_channels;
+	meter->window_frames = MAX(fmt->frame_rate *
+				   CRAS_LEVEL_METER_WINDOW_MS / 1000, 1);
+	/* One allocation holds the four per channel arrays. */
+	meter->peak = (float *)calloc(4 * fmt->num_channels, sizeof(float));
+	if (!meter->peak) {
+		free(meter);
+		return NULL;
+	}
+	meter->sum_squares = meter->peak + fmt->num_channels;
+	meter->block_peak = meter->sum_squares + fmt->num_channels;
+	meter->block_sum = meter->block_peak + fmt->num_channels;
+	return meter;
+}
+
+void cras_level_meter_destroy(struct cras_level_meter *meter)
+{
+	if (!meter)
+		return;
+	free(meter->peak);
+	free(meter);
+}
+
+int cras_level_meter_measure(struct cras_level_meter *meter,
+			     const uint8_t *buf, unsigned int frames,
+			     float scaler)
+{
+	unsigned int c;
+	int non_empty;
+
+	if (scaler == 1.0f) {
+		non_empty = cras_mix_measure_levels(meter->format, buf, frames,
+						    meter->num_channels,
+						    meter->peak,
+						    meter->sum_squares);
+	} else {
+		/* Measure the block on its own, then fold it into the
+		 * window with the gain applied. */
+		memset(meter->block_peak, 0,
+		       2 * meter->num_channels * sizeof(float));
+		non_empty = cras_mix_measure_levels(meter->format, buf, frames,
+						    meter->num_channels,
+						    meter->block_peak,
+						    meter->block_sum);
+		scaler = fabsf(scaler);
+		for (c = 0; c < meter->num_channels; c++) {
+			meter->peak[c] = MAX(meter->peak[c],
+					     meter->block_peak[c] * scaler);
+			meter->sum_squares[c] += meter->block_sum[c] *
+						 scaler * scaler;
+		}
+		non_empty = non_empty && scaler > 0.0f;
+	}
+
+	meter->frames += frames;
+	if (meter->frames >= meter->window_frames)
+		finish_window(meter);
+	return non_empty;
+}
+
+int cras_level_meter_updated(struct cras_level_meter *meter)
+{
+	int updated = meter->updated;
+
+	meter->updated = 0;
+	return updated;
+}
+
+unsigned int cras_level_meter_get(const struct cras_level_meter *meter,
+				  float *peak, float *rms)
+{
+	unsigned int n = MIN(meter->num_channels, CRAS_CH_MAX);
+
+	memcpy(peak, meter->last_peak, n * sizeof(*peak));
+	memcpy(rms, meter->last_rms, n * sizeof(*rms));
+	return n;
+}
+
+/* The following functions are called from audio thread. */
+
+int cras_level_meter_send_msg(const struct cras_level_meter *meter,
+			      uint32_t dev_idx)
+{
+	struct output_levels_msg msg;
+	int rc;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.header.type = CRAS_MAIN_OUTPUT_LEVELS;
+	msg.header.length = sizeof(msg);
+	msg.dev_idx = dev_idx;
+	msg.num_channels = cras_level_meter_get(meter, msg.peak, msg.rms);
+
+	rc = cras_main_message_send((struct cras_main_message *)&msg);
+	if (rc < 0)
+		syslog(LOG_ERR, "Failed to send output levels message");
+	return rc;
+}
+
+/* The following functions are called from main thread. */
+
+static void handle_output_levels_message(struct cras_main_message *msg,
+					 void *arg)
+{
+	struct output_levels_msg *levels_msg = (struct output_levels_msg *)msg;
+
+	cras_observer_notify_output_levels(levels_msg->dev_idx,
+					   levels_msg->num_channels,
+					   levels_msg->peak, levels_msg->rms);
+}
+
+int cras_level_meter_handler_init()
+{
+	cras_main_message_add_handler(CRAS_MAIN_OUTPUT_LEVELS,
+				      handle_output_levels_message, NULL);
+	return 0;
+}
@@ -0,0 +1,72 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Per device level meter. The audio thread feeds every block it writes to
+ * the meter, which keeps the peak and RMS level of each channel over fixed
+ * windows of frames. Completed windows are reported to the main thread so
+ * observers can show a VU meter without opening a loopback stream.
+ */
+#ifndef CRAS_LEVEL_METER_H_
+#define CRAS_LEVEL_METER_H_
+
+#include <stdint.h>
+
+#include "cras_audio_format.h"
+
+/* Length of a metering window. */
+#define CRAS_LEVEL_METER_WINDOW_MS 100
+
+struct cras_level_meter;
+
+/* Creates a meter for blocks of the given format.
+ * Args:
+ *    fmt - The format of the blocks that will be measured.
+ * Returns:
+ *    The new meter or NULL on failure.
+ */
+struct cras_level_meter *cras_level_meter_create(
+		const struct cras_audio_format *fmt);
+
+/* Destroys a meter created with cras_level_meter_create. */
+void cras_level_meter_destroy(struct cras_level_meter *meter);
+
+/* Adds a block of interleaved frames to the current window.
+ * Args:
+ *    meter - The meter.
+ *    buf - The frames to measure.
+ *    frames - The number of frames in buf.
+ *    scaler - Gain that will be applied to buf after measuring it, 1.0 if
+ *        buf is already final.
+ * Returns:
+ *    Non-zero if any sample in buf is non-zero.
+ */
+int cras_level_meter_measure(struct cras_level_meter *meter,
+			     const uint8_t *buf, unsigned int frames,
+			     float scaler);
+
+/* Returns non-zero once for each window completed since the last call. */
+int cras_level_meter_updated(struct cras_level_meter *meter);
+
+/* Gets the levels of the last completed window, zero if there is none.
+ * Args:
+ *    meter - The meter.
+ *    peak - Filled with the peak level of each channel, 1.0 is full scale.
+ *    rms - Filled with the RMS level of each channel, 1.0 is full scale.
+ * Returns:
+ *    The number of channels filled, at most CRAS_CH_MAX.
+ */
+unsigned int cras_level_meter_get(const struct cras_level_meter *meter,
+				  float *peak, float *rms);
+
+/* Sends the last completed levels of the device at dev_idx to the main
+ * thread, which notifies observers. Called from the audio thread. */
+int cras_level_meter_send_msg(const struct cras_level_meter *meter,
+			      uint32_t dev_idx);
+
+/* Registers the main thread handler for level messages. */
+int cras_level_meter_handler_init();
+
+#endif /* CRAS_LEVEL_METER_H_ */
@@ -20,6 +20,9 @@ enum CRAS_MAIN_MESSAGE_TYPE {
 	CRAS_MAIN_MONITOR_DEVICE,
 	CRAS_MAIN_HOTWORD_TRIGGERED,
 	CRAS_MAIN_NON_EMPTY_AUDIO_STATE,
+	CRAS_MAIN_OUTPUT_LEVELS,
+	/* Card probe worker -> main thread */
+	CRAS_MAIN_ALSA_CARD_PROBED,
 };
 
 /* Structure of the header of the message handled by main thread.
@@ -72,6 +72,33 @@ void cras_mix_add_scale_stride(snd_pcm_format_t fmt, uint8_t *dst, uint8_t *src,
 			      scaler);
 }
 
+void cras_mix_copy_scale_stride(snd_pcm_format_t fmt, uint8_t *dst,
+				uint8_t *src, unsigned int count,
+				unsigned int dst_stride,
+				unsigned int src_stride, float scaler)
+{
+	ops->copy_scale_stride(fmt, dst, src, count, dst_stride, src_stride,
+			       scaler);
+}
+
+void cras_mix_copy_scale_stride_increment(snd_pcm_format_t fmt, uint8_t *dst,
+					  uint8_t *src, unsigned int count,
+					  unsigned int dst_stride,
+					  unsigned int src_stride,
+					  float scaler, float increment)
+{
+	ops->copy_scale_stride_increment(fmt, dst, src, count, dst_stride,
+					 src_stride, scaler, increment);
+}
+
+int cras_mix_measure_levels(snd_pcm_format_t fmt, const uint8_t *buf,
+			    unsigned int frame, unsigned int channel,
+			    float *peak, float *sum_squares)
+{
+	return ops->measure_levels(fmt, buf, frame, channel, peak,
+				   sum_squares);
+}
+
 size_t cras_mix_mute_buffer(uint8_t *dst,
 			    size_t frame_bytes,
 			    size_t count)
@@ -69,6 +69,60 @@ void cras_mix_add_scale_stride(snd_pcm_format_t fmt, uint8_t *dst, uint8_t *src,
 			 unsigned int count, unsigned int dst_stride,
 			 unsigned int src_stride, float scaler);
 
+/* Copies src buffer to dst with independent channel strides, scaling and
+ * clipping each sample. Unlike cras_mix_add_scale_stride the previous contents
+ * of dst are ignored, which saves reading the destination.
+ * Args:
+ *    fmt - The format (SND_PCM_FORMAT_*)
+ *    dst - Buffer of samples to copy to.
+ *    src - Buffer of samples to copy from.
+ *    count - The number of samples to copy.
+ *    dst_stride - Stride between channel samples in dst in bytes.
+ *    src_stride - Stride between channel samples in src in bytes.
+ *    scaler - Amount to scale samples.
+ */
+void cras_mix_copy_scale_stride(snd_pcm_format_t fmt, uint8_t *dst,
+				uint8_t *src, unsigned int count,
+				unsigned int dst_stride,
+				unsigned int src_stride, float scaler);
+
+/* Same as cras_mix_copy_scale_stride but ramps the scaler, used to change
+ * gain without a discontinuity.
+ * Args:
+ *    fmt - The format (SND_PCM_FORMAT_*)
+ *    dst - Buffer of samples to copy to.
+ *    src - Buffer of samples to copy from.
+ *    count - The number of samples to copy.
+ *    dst_stride - Stride between channel samples in dst in bytes.
+ *    src_stride - Stride between channel samples in src in bytes.
+ *    scaler - Amount to scale the first sample.
+ *    increment - The increment(+/-) of scaler after each sample.
+ */
+void cras_mix_copy_scale_stride_increment(snd_pcm_format_t fmt, uint8_t *dst,
+					  uint8_t *src, unsigned int count,
+					  unsigned int dst_stride,
+					  unsigned int src_stride,
+					  float scaler, float increment);
+
+/* Measures the level of each channel of an interleaved buffer. Levels are
+ * relative to full scale, a full scale square wave has a peak and a mean
+ * square of 1.0.
+ * Args:
+ *    fmt - Format of the samples.
+ *    buf - The buffer to measure.
+ *    frame - The number of frames in buf.
+ *    channel - Number of channels in a frame.
+ *    peak - Array of channel entries, each raised to the largest absolute
+ *        sample of its channel if that is larger.
+ *    sum_squares - Array of channel entries, each increased by the sum of
+ *        the squared samples of its channel.
+ * Returns:
+ *    Non-zero if any sample in buf is non-zero.
+ */
+int cras_mix_measure_levels(snd_pcm_format_t fmt, const uint8_t *buf,
+			    unsigned int frame, unsigned int channel,
+			    float *peak, float *sum_squares);
+
 /* Mutes the given buffer.
  * Args:
  *    num_channel - Number of channels in data.
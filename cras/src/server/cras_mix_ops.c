@@ -32,6 +32,22 @@ static inline int need_to_scale(float scaler) {
 	return (scaler < 0.99 || scaler > 1.01);
 }
 
+/* Folds the extremes and the sum of squares measured on one channel into the
+ * levels of that channel. Samples are normalized by full_scale, squares were
+ * summed from samples shifted right by square_shift bits. */
+static inline void update_channel_levels(float *peak, float *sum_squares,
+					 int32_t max, int32_t min,
+					 int64_t sum, float full_scale,
+					 unsigned int square_shift)
+{
+	float p = (max > -(float)min ? max : -(float)min) / full_scale;
+	float s = full_scale / (1 << square_shift);
+
+	if (p > *peak)
+		*peak = p;
+	*sum_squares += sum / (s * s);
+}
+
 /*
  * Signed 16 bit little endian functions.
  */
@@ -221,6 +237,143 @@ static void cras_mix_add_scale_stride_s16_le(uint8_t *dst, uint8_t *src,
 	}
 }
 
+/* Copies src to dst with independent strides, scaling by scaler.  Unlike
+ * cras_mix_add_scale_stride_s16_le, dst is overwritten and never read. */
+static void cras_mix_copy_scale_stride_s16_le(uint8_t *dst, uint8_t *src,
+				unsigned int dst_stride,
+				unsigned int src_stride,
+				unsigned int count,
+				float scaler)
+{
+	unsigned int i;
+
+	if (!need_to_scale(scaler)) {
+		if (dst_stride == src_stride && dst_stride == 2) {
+			memcpy(dst, src, count * 2);
+			return;
+		}
+		for (i = 0; i < count; i++) {
+			*(int16_t *)dst = *(int16_t *)src;
+			dst += dst_stride;
+			src += src_stride;
+		}
+		return;
+	}
+
+	if (dst_stride == src_stride && dst_stride == 2) {
+		int16_t *out = (int16_t *)dst;
+		const int16_t *in = (const int16_t *)src;
+
+		/* optimise the loop for vectorization */
+		for (i = 0; i < count; i++) {
+			int32_t val = in[i] * scaler;
+			if (val > INT16_MAX)
+				val = INT16_MAX;
+			else if (val < INT16_MIN)
+				val = INT16_MIN;
+			out[i] = val;
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		int32_t val = *(int16_t *)src * scaler;
+		if (val > INT16_MAX)
+			val = INT16_MAX;
+		else if (val < INT16_MIN)
+			val = INT16_MIN;
+		*(int16_t *)dst = val;
+		dst += dst_stride;
+		src += src_stride;
+	}
+}
+
+/* Same as cras_mix_copy_scale_stride_s16_le but the scaler changes by
+ * increment after each sample. */
+static void cras_mix_copy_scale_stride_inc_s16_le(uint8_t *dst, uint8_t *src,
+				unsigned int dst_stride,
+				unsigned int src_stride,
+				unsigned int count,
+				float scaler,
+				float increment)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		int32_t val = *(int16_t *)src * scaler;
+		if (val > INT16_MAX)
+			val = INT16_MAX;
+		else if (val < INT16_MIN)
+			val = INT16_MIN;
+		*(int16_t *)dst = val;
+		dst += dst_stride;
+		src += src_stride;
+		scaler += increment;
+	}
+}
+
+/* Stereo case of cras_measure_levels_s16_le. Both channels are reduced in
+ * the same pass over the frames so the compiler can vectorize the loop
+ * with the left and right samples in alternate lanes. */
+static int measure_levels_stereo_s16_le(const int16_t *in, unsigned int frame,
+					float *peak, float *sum_squares)
+{
+	int32_t max_l = 0, min_l = 0, max_r = 0, min_r = 0;
+	int64_t sum_l = 0, sum_r = 0;
+	size_t i;
+
+	for (i = 0; i < frame; i++) {
+		int32_t l = in[2 * i];
+		int32_t r = in[2 * i + 1];
+
+		max_l = l > max_l ? l : max_l;
+		min_l = l < min_l ? l : min_l;
+		max_r = r > max_r ? r : max_r;
+		min_r = r < min_r ? r : min_r;
+		sum_l += (int64_t)l * l;
+		sum_r += (int64_t)r * r;
+	}
+	update_channel_levels(&peak[0], &sum_squares[0], max_l, min_l, sum_l,
+			      32768.0f, 0);
+	update_channel_levels(&peak[1], &sum_squares[1], max_r, min_r, sum_r,
+			      32768.0f, 0);
+	return (max_l | min_l | max_r | min_r) != 0;
+}
+
+/* Accumulates the peak and the sum of squares of each channel. Extremes are
+ * kept as a separate max and min and squares are summed as integers, which
+ * keeps the reductions free of branches and rounding.
+ * Returns non-zero if any sample is non-zero. */
+static int cras_measure_levels_s16_le(const uint8_t *buf, unsigned int frame,
+				      unsigned int channel, float *peak,
+				      float *sum_squares)
+{
+	const int16_t *in = (const int16_t *)buf;
+	int32_t non_zero = 0;
+	unsigned int c, i;
+
+	if (channel == 2)
+		return measure_levels_stereo_s16_le(in, frame, peak,
+						    sum_squares);
+
+	for (c = 0; c < channel; c++) {
+		int32_t max = 0, min = 0;
+		int64_t sum = 0;
+
+		for (i = c; i < frame * channel; i += channel) {
+			int32_t sample = in[i];
+
+			max = sample > max ? sample : max;
+			min = sample < min ? sample : min;
+			sum += (int64_t)sample * sample;
+		}
+		non_zero |= max | min;
+		update_channel_levels(&peak[c], &sum_squares[c], max, min,
+				      sum, 32768.0f, 0);
+	}
+	return non_zero != 0;
+}
+
 /*
  * Signed 24 bit little endian functions.
  */
@@ -394,6 +547,81 @@ static void cras_mix_add_scale_stride_s24_le(uint8_t *dst, uint8_t *src,
 	}
 }
 
+/* Copies src to dst with independent strides, scaling by scaler.  Unlike
+ * cras_mix_add_scale_stride_s24_le, dst is overwritten and never read. */
+static void cras_mix_copy_scale_stride_s24_le(uint8_t *dst, uint8_t *src,
+				unsigned int dst_stride,
+				unsigned int src_stride,
+				unsigned int count,
+				float scaler)
+{
+	unsigned int i;
+
+	if (!need_to_scale(scaler)) {
+		if (dst_stride == src_stride && dst_stride == 4) {
+			memcpy(dst, src, count * 4);
+			return;
+		}
+		for (i = 0; i < count; i++) {
+			*(int32_t *)dst = *(int32_t *)src;
+			dst += dst_stride;
+			src += src_stride;
+		}
+		return;
+	}
+
+	if (dst_stride == src_stride && dst_stride == 4) {
+		int32_t *out = (int32_t *)dst;
+		const int32_t *in = (const int32_t *)src;
+
+		/* optimise the loop for vectorization */
+		for (i = 0; i < count; i++) {
+			int32_t val = in[i] * scaler;
+			if (val > 0x007fffff)
+				val = 0x007fffff;
+			else if (val < (int32_t)0xff800000)
+				val = (int32_t)0xff800000;
+			out[i] = val;
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		int32_t val = *(int32_t *)src * scaler;
+		if (val > 0x007fffff)
+			val = 0x007fffff;
+		else if (val < (int32_t)0xff800000)
+			val = (int32_t)0xff800000;
+		*(int32_t *)dst = val;
+		dst += dst_stride;
+		src += src_stride;
+	}
+}
+
+/* Same as cras_mix_copy_scale_stride_s24_le but the scaler changes by
+ * increment after each sample. */
+static void cras_mix_copy_scale_stride_inc_s24_le(uint8_t *dst, uint8_t *src,
+				unsigned int dst_stride,
+				unsigned int src_stride,
+				unsigned int count,
+				float scaler,
+				float increment)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		int32_t val = *(int32_t *)src * scaler;
+		if (val > 0x007fffff)
+			val = 0x007fffff;
+		else if (val < (int32_t)0xff800000)
+			val = (int32_t)0xff800000;
+		*(int32_t *)dst = val;
+		dst += dst_stride;
+		src += src_stride;
+		scaler += increment;
+	}
+}
+
 /*
  * Signed 32 bit little endian functions.
  */
@@ -567,6 +795,112 @@ static void cras_mix_add_scale_stride_s32_le(uint8_t *dst, uint8_t *src,
 	}
 }
 
+/* Copies src to dst with independent strides, scaling by scaler.  Unlike
+ * cras_mix_add_scale_stride_s32_le, dst is overwritten and never read. */
+static void cras_mix_copy_scale_stride_s32_le(uint8_t *dst, uint8_t *src,
+				unsigned int dst_stride,
+				unsigned int src_stride,
+				unsigned int count,
+				float scaler)
+{
+	unsigned int i;
+
+	if (!need_to_scale(scaler)) {
+		if (dst_stride == src_stride && dst_stride == 4) {
+			memcpy(dst, src, count * 4);
+			return;
+		}
+		for (i = 0; i < count; i++) {
+			*(int32_t *)dst = *(int32_t *)src;
+			dst += dst_stride;
+			src += src_stride;
+		}
+		return;
+	}
+
+	if (dst_stride == src_stride && dst_stride == 4) {
+		int32_t *out = (int32_t *)dst;
+		const int32_t *in = (const int32_t *)src;
+
+		/* optimise the loop for vectorization */
+		for (i = 0; i < count; i++) {
+			int64_t val = in[i] * scaler;
+			if (val > INT32_MAX)
+				val = INT32_MAX;
+			else if (val < INT32_MIN)
+				val = INT32_MIN;
+			out[i] = val;
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		int64_t val = *(int32_t *)src * scaler;
+		if (val > INT32_MAX)
+			val = INT32_MAX;
+		else if (val < INT32_MIN)
+			val = INT32_MIN;
+		*(int32_t *)dst = val;
+		dst += dst_stride;
+		src += src_stride;
+	}
+}
+
+/* Same as cras_mix_copy_scale_stride_s32_le but the scaler changes by
+ * increment after each sample. */
+static void cras_mix_copy_scale_stride_inc_s32_le(uint8_t *dst, uint8_t *src,
+				unsigned int dst_stride,
+				unsigned int src_stride,
+				unsigned int count,
+				float scaler,
+				float increment)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		int64_t val = *(int32_t *)src * scaler;
+		if (val > INT32_MAX)
+			val = INT32_MAX;
+		else if (val < INT32_MIN)
+			val = INT32_MIN;
+		*(int32_t *)dst = val;
+		dst += dst_stride;
+		src += src_stride;
+		scaler += increment;
+	}
+}
+
+/* Measures S32_LE, or S24_LE when full_scale is 2^23. Squares are summed
+ * from the top 16 bits of the samples so they fit in the sum. See
+ * cras_measure_levels_s16_le. */
+static int cras_measure_levels_s32_le(const uint8_t *buf, unsigned int frame,
+				      unsigned int channel, float *peak,
+				      float *sum_squares, float full_scale)
+{
+	const int32_t *in = (const int32_t *)buf;
+	const unsigned int shift = full_scale > 8388608.0f ? 16 : 8;
+	int32_t non_zero = 0;
+	unsigned int c, i;
+
+	for (c = 0; c < channel; c++) {
+		int32_t max = 0, min = 0;
+		int64_t sum = 0;
+
+		for (i = c; i < frame * channel; i += channel) {
+			int32_t sample = in[i];
+			int64_t top = sample >> shift;
+
+			max = sample > max ? sample : max;
+			min = sample < min ? sample : min;
+			sum += top * top;
+		}
+		non_zero |= max | min;
+		update_channel_levels(&peak[c], &sum_squares[c], max, min,
+				      sum, full_scale, shift);
+	}
+	return non_zero != 0;
+}
+
 /*
  * Signed 24 bit little endian in three bytes functions.
  */
@@ -761,6 +1095,103 @@ static void cras_mix_add_scale_stride_s24_3le(uint8_t *dst, uint8_t *src,
 	}
 }
 
+/* Copies src to dst with independent strides, scaling by scaler.  Unlike
+ * cras_mix_add_scale_stride_s24_3le, dst is overwritten and never read. */
+static void cras_mix_copy_scale_stride_s24_3le(uint8_t *dst, uint8_t *src,
+				 unsigned int dst_stride,
+				 unsigned int src_stride,
+				 unsigned int count,
+				 float scaler)
+{
+	unsigned int i;
+	int64_t val;
+	int32_t frame;
+
+	if (!need_to_scale(scaler)) {
+		if (dst_stride == src_stride && dst_stride == 3) {
+			memcpy(dst, src, 3 * count);
+			return;
+		}
+		for (i = 0; i < count; i++) {
+			memcpy(dst, src, 3);
+			dst += dst_stride;
+			src += src_stride;
+		}
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		convert_single_s243le_to_s32le(&frame, src);
+		val = (int64_t)frame * scaler;
+		if (val > INT32_MAX)
+			val = INT32_MAX;
+		else if (val < INT32_MIN)
+			val = INT32_MIN;
+		frame = (int32_t)val;
+		convert_single_s32le_to_s243le(dst, &frame);
+		dst += dst_stride;
+		src += src_stride;
+	}
+}
+
+/* Same as cras_mix_copy_scale_stride_s24_3le but the scaler changes by
+ * increment after each sample. */
+static void cras_mix_copy_scale_stride_inc_s24_3le(uint8_t *dst, uint8_t *src,
+				 unsigned int dst_stride,
+				 unsigned int src_stride,
+				 unsigned int count,
+				 float scaler,
+				 float increment)
+{
+	unsigned int i;
+	int64_t val;
+	int32_t frame;
+
+	for (i = 0; i < count; i++) {
+		convert_single_s243le_to_s32le(&frame, src);
+		val = (int64_t)frame * scaler;
+		if (val > INT32_MAX)
+			val = INT32_MAX;
+		else if (val < INT32_MIN)
+			val = INT32_MIN;
+		frame = (int32_t)val;
+		convert_single_s32le_to_s243le(dst, &frame);
+		dst += dst_stride;
+		src += src_stride;
+		scaler += increment;
+	}
+}
+
+/* See cras_measure_levels_s16_le. */
+static int cras_measure_levels_s24_3le(const uint8_t *buf, unsigned int frame,
+				       unsigned int channel, float *peak,
+				       float *sum_squares)
+{
+	int32_t non_zero = 0;
+	unsigned int c, i;
+
+	for (c = 0; c < channel; c++) {
+		int32_t max = 0, min = 0;
+		int64_t sum = 0;
+
+		for (i = 0; i < frame; i++) {
+			int32_t sample;
+			int64_t top;
+
+			convert_single_s243le_to_s32le(
+					&sample, buf + 3 * (i * channel + c));
+			top = sample >> 16;
+			max = sample > max ? sample : max;
+			min = sample < min ? sample : min;
+			sum += top * top;
+		}
+		non_zero |= max | min;
+		update_channel_levels(&peak[c], &sum_squares[c], max, min,
+				      sum, 2147483648.0f, 16);
+	}
+	return non_zero != 0;
+}
+
 static void scale_buffer_increment(snd_pcm_format_t fmt, uint8_t *buff,
 				   unsigned int count, float scaler,
 				   float increment, int step)
@@ -845,6 +1276,79 @@ static void mix_add_scale_stride(snd_pcm_format_t fmt, uint8_t *dst,
 	}
 }
 
+static void mix_copy_scale_stride(snd_pcm_format_t fmt, uint8_t *dst,
+			uint8_t *src, unsigned int count,
+			unsigned int dst_stride, unsigned int src_stride,
+			float scaler)
+{
+	switch (fmt) {
+	case SND_PCM_FORMAT_S16_LE:
+		return cras_mix_copy_scale_stride_s16_le(dst, src, dst_stride,
+						  src_stride, count, scaler);
+	case SND_PCM_FORMAT_S24_LE:
+		return cras_mix_copy_scale_stride_s24_le(dst, src, dst_stride,
+						  src_stride, count, scaler);
+	case SND_PCM_FORMAT_S32_LE:
+		return cras_mix_copy_scale_stride_s32_le(dst, src, dst_stride,
+						  src_stride, count, scaler);
+	case SND_PCM_FORMAT_S24_3LE:
+		return cras_mix_copy_scale_stride_s24_3le(dst, src, dst_stride,
+						   src_stride, count, scaler);
+	default:
+		break;
+	}
+}
+
+static void mix_copy_scale_stride_increment(snd_pcm_format_t fmt,
+			uint8_t *dst, uint8_t *src, unsigned int count,
+			unsigned int dst_stride, unsigned int src_stride,
+			float scaler, float increment)
+{
+	switch (fmt) {
+	case SND_PCM_FORMAT_S16_LE:
+		return cras_mix_copy_scale_stride_inc_s16_le(dst, src,
+				dst_stride, src_stride, count, scaler,
+				increment);
+	case SND_PCM_FORMAT_S24_LE:
+		return cras_mix_copy_scale_stride_inc_s24_le(dst, src,
+				dst_stride, src_stride, count, scaler,
+				increment);
+	case SND_PCM_FORMAT_S32_LE:
+		return cras_mix_copy_scale_stride_inc_s32_le(dst, src,
+				dst_stride, src_stride, count, scaler,
+				increment);
+	case SND_PCM_FORMAT_S24_3LE:
+		return cras_mix_copy_scale_stride_inc_s24_3le(dst, src,
+				dst_stride, src_stride, count, scaler,
+				increment);
+	default:
+		break;
+	}
+}
+
+static int measure_levels(snd_pcm_format_t fmt, const uint8_t *buf,
+			  unsigned int frame, unsigned int channel,
+			  float *peak, float *sum_squares)
+{
+	switch (fmt) {
+	case SND_PCM_FORMAT_S16_LE:
+		return cras_measure_levels_s16_le(buf, frame, channel, peak,
+						  sum_squares);
+	case SND_PCM_FORMAT_S24_LE:
+		return cras_measure_levels_s32_le(buf, frame, channel, peak,
+						  sum_squares, 8388608.0f);
+	case SND_PCM_FORMAT_S32_LE:
+		return cras_measure_levels_s32_le(buf, frame, channel, peak,
+						  sum_squares, 2147483648.0f);
+	case SND_PCM_FORMAT_S24_3LE:
+		return cras_measure_levels_s24_3le(buf, frame, channel, peak,
+						   sum_squares);
+	default:
+		break;
+	}
+	return 0;
+}
+
 static size_t mix_mute_buffer(uint8_t *dst,
 			    size_t frame_bytes,
 			    size_t count)
@@ -858,5 +1362,8 @@ const struct cras_mix_ops OPS(mixer_ops) = {
 	.scale_buffer_increment = scale_buffer_increment,
 	.add = mix_add,
 	.add_scale_stride = mix_add_scale_stride,
+	.copy_scale_stride = mix_copy_scale_stride,
+	.copy_scale_stride_increment = mix_copy_scale_stride_increment,
+	.measure_levels = measure_levels,
 	.mute_buffer = mix_mute_buffer,
 };
@@ -27,6 +27,9 @@ extern const struct cras_mix_ops mixer_ops_fma;
  *   scale_buffer: See cras_scale_buffer.
  *   add: See cras_mix_add.
  *   add_scale_stride: See cras_mix_add_scale_stride.
+ *   copy_scale_stride: See cras_mix_copy_scale_stride.
+ *   copy_scale_stride_increment: See cras_mix_copy_scale_stride_increment.
+ *   measure_levels: See cras_mix_measure_levels.
  *   mute_buffer: cras_mix_mute_buffer.
  */
 struct cras_mix_ops {
@@ -42,6 +45,17 @@ struct cras_mix_ops {
 			uint8_t *src, unsigned int count,
 			unsigned int dst_stride, unsigned int src_stride,
 			float scaler);
+	void (*copy_scale_stride)(snd_pcm_format_t fmt, uint8_t *dst,
+			uint8_t *src, unsigned int count,
+			unsigned int dst_stride, unsigned int src_stride,
+			float scaler);
+	void (*copy_scale_stride_increment)(snd_pcm_format_t fmt,
+			uint8_t *dst, uint8_t *src, unsigned int count,
+			unsigned int dst_stride, unsigned int src_stride,
+			float scaler, float increment);
+	int (*measure_levels)(snd_pcm_format_t fmt, const uint8_t *buf,
+			unsigned int frame, unsigned int channel,
+			float *peak, float *sum_squares);
 	size_t (*mute_buffer)(uint8_t *dst,
 			    size_t frame_bytes,
 			    size_t count);
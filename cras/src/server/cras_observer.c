@@ -3,6 +3,8 @@
  * found in the LICENSE file.
  */
 
+#include <sys/param.h>
+
 #include "cras_observer.h"
 
 #include "cras_alert.h"
@@ -34,6 +36,7 @@ struct cras_observer_alerts {
          * per-direciton. */
 	struct cras_alert *num_active_streams[CRAS_NUM_DIRECTIONS];
 	struct cras_alert *non_empty_audio_state_changed;
+	struct cras_alert *output_levels;
 };
 
 struct cras_observer_server {
@@ -84,12 +87,24 @@ struct cras_observer_non_empty_audio_state {
 	int non_empty;
 };
 
+struct cras_observer_alert_data_output_levels {
+	uint32_t dev_idx;
+	uint32_t num_channels;
+	float peak[CRAS_CH_MAX];
+	float rms[CRAS_CH_MAX];
+};
+
 /* Global observer instance. */
 static struct cras_observer_server *g_observer;
 
 /* Empty observer ops. */
 static struct cras_observer_ops g_empty_ops;
 
+/* Number of clients observing output levels. Written by the main thread and
+ * read by the audio threads to skip metering when nobody listens, so it is
+ * only accessed atomically. */
+static int g_num_output_levels_clients;
+
 /*
  * Alert handlers for delayed callbacks.
  */
@@ -287,6 +302,34 @@ static void non_empty_audio_state_changed_alert(void *arg, void *data)
 	}
 }
 
+static void output_levels_alert(void *arg, void *data)
+{
+	struct cras_observer_client *client;
+	struct cras_observer_alert_data_output_levels *levels_data =
+		(struct cras_observer_alert_data_output_levels *)data;
+
+	DL_FOREACH(g_observer->clients, client) {
+		if (client->ops.output_levels_changed)
+			client->ops.output_levels_changed(
+					client->context,
+					levels_data->dev_idx,
+					levels_data->num_channels,
+					levels_data->peak,
+					levels_data->rms);
+	}
+}
+
+static void update_output_levels_clients()
+{
+	struct cras_observer_client *client;
+	int count = 0;
+
+	DL_FOREACH(g_observer->clients, client)
+		if (client->ops.output_levels_changed)
+			count++;
+	__atomic_store_n(&g_num_output_levels_clients, count, __ATOMIC_RELAXED);
+}
+
 static int cras_observer_server_set_alert(struct cras_alert **alert,
 					  cras_alert_cb cb,
 					  cras_alert_prepare prepare,
@@ -343,6 +386,10 @@ int cras_observer_server_init()
 	CRAS_OBSERVER_SET_ALERT(suspend_changed, NULL, 0);
 	CRAS_OBSERVER_SET_ALERT(hotword_triggered, NULL, 0);
 	CRAS_OBSERVER_SET_ALERT(non_empty_audio_state_changed, NULL, 0);
+	/* Keep the levels of every device that reported since the last
+	 * alert. */
+	CRAS_OBSERVER_SET_ALERT(output_levels, NULL,
+				CRAS_ALERT_FLAG_KEEP_ALL_DATA);
 
 	CRAS_OBSERVER_SET_ALERT_WITH_DIRECTION(
 		num_active_streams, CRAS_STREAM_OUTPUT);
@@ -374,6 +421,7 @@ void cras_observer_server_free()
 	cras_alert_destroy(g_observer->alerts.suspend_changed);
 	cras_alert_destroy(g_observer->alerts.hotword_triggered);
 	cras_alert_destroy(g_observer->alerts.non_empty_audio_state_changed);
+	cras_alert_destroy(g_observer->alerts.output_levels);
 	cras_alert_destroy(g_observer->alerts.num_active_streams[
 							CRAS_STREAM_OUTPUT]);
 	cras_alert_destroy(g_observer->alerts.num_active_streams[
@@ -382,6 +430,7 @@ void cras_observer_server_free()
 						CRAS_STREAM_POST_MIX_PRE_DSP]);
 	free(g_observer);
 	g_observer = NULL;
+	__atomic_store_n(&g_num_output_levels_clients, 0, __ATOMIC_RELAXED);
 }
 
 int cras_observer_ops_are_empty(const struct cras_observer_ops *ops)
@@ -409,6 +458,7 @@ void cras_observer_set_ops(struct cras_observer_client *client,
 		memset(&client->ops, 0, sizeof(client->ops));
 	else
 		memcpy(&client->ops, ops, sizeof(client->ops));
+	update_output_levels_clients();
 }
 
 struct cras_observer_client *cras_observer_add(
@@ -432,6 +482,7 @@ void cras_observer_remove(struct cras_observer_client *client)
 		return;
 	DL_DELETE(g_observer->clients, client);
 	free(client);
+	update_output_levels_clients();
 }
 
 /*
@@ -570,4 +621,25 @@ void cras_observer_notify_non_empty_audio_state_changed(int non_empty)
 
 	cras_alert_pending_data(g_observer->alerts.non_empty_audio_state_changed,
 				&data, sizeof(data));
-}
\ No newline at end of file
+}
+
+void cras_observer_notify_output_levels(uint32_t dev_idx,
+					uint32_t num_channels,
+					const float *peak, const float *rms)
+{
+	struct cras_observer_alert_data_output_levels data;
+
+	memset(&data, 0, sizeof(data));
+	data.dev_idx = dev_idx;
+	data.num_channels = MIN(num_channels, CRAS_CH_MAX);
+	memcpy(data.peak, peak, data.num_channels * sizeof(*peak));
+	memcpy(data.rms, rms, data.num_channels * sizeof(*rms));
+	cras_alert_pending_data(g_observer->alerts.output_levels,
+				&data, sizeof(data));
+}
+
+int cras_observer_output_levels_wanted()
+{
+	return __atomic_load_n(&g_num_output_levels_clients,
+			       __ATOMIC_RELAXED) > 0;
+}
@@ -100,4 +100,13 @@ void cras_observer_notify_hotword_triggered(int64_t tv_sec, int64_t tv_nsec);
 /* Notify observers the non-empty audio state changed. */
 void cras_observer_notify_non_empty_audio_state_changed(int active);
 
+/* Notify observers of the levels of an output device. */
+void cras_observer_notify_output_levels(uint32_t dev_idx,
+					uint32_t num_channels,
+					const float *peak, const float *rms);
+
+/* Returns non-zero if any observer wants output levels. Safe to call from
+ * the audio threads. */
+int cras_observer_output_levels_wanted();
+
 #endif /* CRAS_OBSERVER_H */
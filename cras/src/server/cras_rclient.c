@@ -152,8 +152,7 @@ static void dump_audio_thread_info(struct cras_rclient *client)
 
 	cras_fill_client_audio_debug_info_ready(&msg);
 	state = cras_system_state_get_no_lock();
-	audio_thread_dump_thread_info(cras_iodev_list_get_audio_thread(),
-				      &state->audio_debug_info);
+	cras_iodev_list_dump_audio_thread_info(&state->audio_debug_info);
 	cras_rclient_send_message(client, &msg.header, NULL, 0);
 }
 
@@ -302,6 +301,18 @@ static void send_num_active_streams_changed(void *context,
 	cras_rclient_send_message(client, &msg.header, NULL, 0);
 }
 
+static void send_output_levels_changed(void *context, uint32_t dev_idx,
+				       uint32_t num_channels,
+				       const float *peak, const float *rms)
+{
+	struct cras_client_output_levels_changed msg;
+	struct cras_rclient *client = (struct cras_rclient *)context;
+
+	cras_fill_client_output_levels_changed(&msg, dev_idx, num_channels,
+					       peak, rms);
+	cras_rclient_send_message(client, &msg.header, NULL, 0);
+}
+
 static void register_for_notification(struct cras_rclient *client,
 				      enum CRAS_CLIENT_MESSAGE_ID msg_id,
 				      int do_register)
@@ -352,6 +363,10 @@ static void register_for_notification(struct cras_rclient *client,
 		observer_ops.num_active_streams_changed =
 			do_register ? send_num_active_streams_changed : NULL;
 		break;
+	case CRAS_CLIENT_OUTPUT_LEVELS_CHANGED:
+		observer_ops.output_levels_changed =
+			do_register ? send_output_levels_changed : NULL;
+		break;
 	default:
 		syslog(LOG_ERR,
 		       "Invalid client notification message ID: %u", msg_id);
@@ -624,10 +639,8 @@ int cras_rclient_message_from_client(struct cras_rclient *client,
 			sizeof(m->coefficient[0]);
 		if (size_with_coefficients != msg->length)
 			return -EINVAL;
-		audio_thread_config_global_remix(
-				cras_iodev_list_get_audio_thread(),
-				m->num_channels,
-				m->coefficient);
+		cras_iodev_list_config_global_remix(m->num_channels,
+						    m->coefficient);
 		break;
 	}
 	case CRAS_SERVER_GET_HOTWORD_MODELS: {
@@ -8,6 +8,7 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <syslog.h>
+#include <time.h>
 
 #include "cras_audio_area.h"
 #include "cras_config.h"
@@ -169,6 +170,26 @@ static int get_audio_request_reply(
 	return rc;
 }
 
+/*
+ * Records how long the client took to answer the pending playback request,
+ * and whether the samples came after the stream's next callback time.
+ */
+static void record_fetch_response(struct cras_rstream *stream)
+{
+	struct timespec now, response;
+
+	if (!cras_rstream_is_pending_reply(stream))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	subtract_timespecs(&now, &stream->last_fetch_ts, &response);
+	fetch_predictor_add(&stream->fetch_pred, &response);
+	if ((stream->fetch_deadline_ts.tv_sec ||
+	     stream->fetch_deadline_ts.tv_nsec) &&
+	    timespec_after(&now, &stream->fetch_deadline_ts))
+		stream->num_late_fetches++;
+}
+
 /*
  * Reads and handles one audio message from client.
  * Returns:
@@ -201,6 +222,7 @@ static int read_and_handle_client_message(struct cras_rstream *stream) {
 	 */
 	if (stream->direction == CRAS_STREAM_OUTPUT &&
 	    msg.id == AUDIO_MESSAGE_DATA_READY) {
+		record_fetch_response(stream);
 		clear_pending_reply(stream);
 	}
 
@@ -241,6 +263,7 @@ int cras_rstream_create(struct cras_rstream_config *config,
 	stream->is_pinned = (config->dev_idx != NO_DEVICE);
 	stream->pinned_dev_idx = config->dev_idx;
 	stream->fd = config->audio_fd;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &stream->start_ts);
 
 	rc = setup_shm_area(stream);
 	if (rc < 0) {
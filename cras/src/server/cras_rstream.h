@@ -12,6 +12,7 @@
 #include "cras_apm_list.h"
 #include "cras_shm.h"
 #include "cras_types.h"
+#include "fetch_predictor.h"
 
 struct cras_rclient;
 struct dev_mix;
@@ -66,6 +67,17 @@ struct master_dev_info {
  *    is_pinned - True if the stream is a pinned stream, false otherwise.
  *    pinned_dev_idx - device the stream is pinned, 0 if none.
  *    triggered - True if already notified TRIGGER_ONLY stream, false otherwise.
+ *    start_ts - The time the stream was created.
+ *    first_capture_logged - True once the time to the first captured samples
+ *        has been logged, for capture streams.
+ *    delay_frames - Frames between the client and the device when the
+ *        stream last fetched or read samples, at the stream rate. This is
+ *        the delay in the direction of the stream only, not a round trip.
+ *    fetch_pred - Response time of the client to playback requests.
+ *    fetch_deadline_ts - Time the samples of the pending playback request
+ *        are needed by, the callback time following the request.
+ *    num_late_fetches - Number of playback requests answered after their
+ *        deadline.
  */
 struct cras_rstream {
 	cras_stream_id_t stream_id;
@@ -93,6 +105,12 @@ struct cras_rstream {
 	int is_pinned;
 	uint32_t pinned_dev_idx;
 	int triggered;
+	struct timespec start_ts;
+	int first_capture_logged;
+	unsigned int delay_frames;
+	struct fetch_predictor fetch_pred;
+	struct timespec fetch_deadline_ts;
+	unsigned int num_late_fetches;
 	struct cras_rstream *prev, *next;
 };
 
@@ -39,6 +39,7 @@
 #include "cras_device_monitor.h"
 #include "cras_hotword_handler.h"
 #include "cras_iodev_list.h"
+#include "cras_level_meter.h"
 #include "cras_main_message.h"
 #include "cras_messages.h"
 #include "cras_metrics.h"
@@ -469,6 +470,8 @@ int cras_server_run(unsigned int profile_disable_mask)
 
 	cras_non_empty_audio_handler_init();
 
+	cras_level_meter_handler_init();
+
 	cras_audio_thread_monitor_init();
 
 #ifdef CRAS_DBUS
@@ -14,6 +14,7 @@
 
 const char kHighestInputHardwareLevel[] = "Cras.HighestInputHardwareLevel";
 const char kHighestOutputHardwareLevel[] = "Cras.HighestOutputHardwareLevel";
+const char kInputTimeToFirstSample[] = "Cras.InputTimeToFirstSample";
 const char kNoCodecsFoundMetric[] = "Cras.NoCodecsFoundAtBoot";
 const char kStreamTimeoutMilliSeconds[] = "Cras.StreamTimeoutMilliSeconds";
 const char kStreamCallbackThreshold[] = "Cras.StreamCallbackThreshold";
@@ -28,7 +29,8 @@ enum CRAS_SERVER_METRICS_TYPE {
 	HIGHEST_OUTPUT_HW_LEVEL,
 	LONGEST_FETCH_DELAY,
 	NUM_UNDERRUNS,
-	STREAM_CONFIG
+	STREAM_CONFIG,
+	TIME_TO_FIRST_SAMPLE
 };
 
 struct cras_server_metrics_stream_config {
@@ -127,6 +129,24 @@ int cras_server_metrics_num_underruns(unsigned num_underruns)
 	return 0;
 }
 
+int cras_server_metrics_time_to_first_sample(unsigned delay_msec)
+{
+	struct cras_server_metrics_message msg;
+	union cras_server_metrics_data data;
+	int err;
+
+	data.value = delay_msec;
+	init_server_metrics_msg(&msg, TIME_TO_FIRST_SAMPLE, data);
+	err = cras_main_message_send((struct cras_main_message *)&msg);
+	if (err < 0) {
+		syslog(LOG_ERR,
+		       "Failed to send metrics message: TIME_TO_FIRST_SAMPLE");
+		return err;
+	}
+
+	return 0;
+}
+
 int cras_server_metrics_stream_config(struct cras_rstream_config *config)
 {
 	struct cras_server_metrics_message msg;
@@ -193,6 +213,10 @@ static void handle_metrics_message(struct cras_main_message *msg, void *arg)
 	case STREAM_CONFIG:
 		metrics_stream_config(metrics_msg->data.stream_config);
 		break;
+	case TIME_TO_FIRST_SAMPLE:
+		cras_metrics_log_histogram(kInputTimeToFirstSample,
+				metrics_msg->data.value, 1, 10000, 20);
+		break;
 	default:
 		syslog(LOG_ERR, "Unknown metrics type %u",
 		       metrics_msg->metrics_type);
@@ -11,6 +11,7 @@
 extern const char kNoCodecsFoundMetric[];
 extern const char kHighestInputHardwareLevel[];
 extern const char kHighestOutputHardwareLevel[];
+extern const char kInputTimeToFirstSample[];
 extern const char kStreamTimeoutMilliSeconds[];
 extern const char kStreamCallbackThreshold[];
 extern const char kStreamFlags[];
@@ -28,6 +29,9 @@ int cras_server_metrics_longest_fetch_delay(int delay_msec);
 /* Logs the number of underruns of a device. */
 int cras_server_metrics_num_underruns(unsigned num_underruns);
 
+/* Logs the time from creating a capture stream to its first samples. */
+int cras_server_metrics_time_to_first_sample(unsigned delay_msec);
+
 /* Logs the stream configurations from clients. */
 int cras_server_metrics_stream_config(struct cras_rstream_config *config);
 
@@ -16,6 +16,7 @@
 #include "cras_board_config.h"
 #include "cras_config.h"
 #include "cras_device_blacklist.h"
+#include "cras_main_message.h"
 #include "cras_observer.h"
 #include "cras_shm.h"
 #include "cras_system_state.h"
@@ -26,9 +27,37 @@
 
 struct card_list {
 	struct cras_alsa_card *card;
+	unsigned int probe_ms;
+	unsigned int complete_ms;
+	unsigned int ready_ms;
 	struct card_list *prev, *next;
 };
 
+/* A card queued for, or being probed on, a probe worker thread.
+ * Members:
+ *    info - Info about the card.
+ *    delay_us - Time to give ALSA to set up the card before opening it.
+ *    queued_ts - When the card was queued.
+ *    card - The probed card, NULL until probed or if probing failed.
+ *    running - Set once a worker has picked the card up.
+ *    cancelled - Set when the card is removed before it's ready.
+ */
+struct card_probe {
+	struct cras_alsa_card_info info;
+	unsigned int delay_us;
+	struct timespec queued_ts;
+	struct cras_alsa_card *card;
+	int running;
+	int cancelled;
+	struct card_probe *prev, *next;
+};
+
+/* Sent to the main thread when a worker is done probing a card. */
+struct card_probed_msg {
+	struct cras_main_message header;
+	struct card_probe *probe;
+};
+
 /* The system state.
  * Members:
  *    exp_state - The exported system state shared with clients.
@@ -47,6 +76,28 @@ struct card_list {
  *    tm - The system-wide timer manager.
  *    add_task - Function to handle adding a task for main thread to execute.
  *    task_data - Data to be passed to add_task handler function.
+ *    device_group_workers - Number of audio threads to run device groups
+ *      on, besides the main audio thread. Each worker runs one output
+ *      device which only plays the streams pinned to it.
+ *    wake_tolerance_us - How early the audio threads may service streams to
+ *      share a wake up between streams due close together.
+ *    sched_deadline - Non-zero to run the audio threads with SCHED_DEADLINE
+ *      rather than SCHED_RR when the kernel allows it.
+ *    a2dp_encoder_worker - Non-zero to encode A2DP audio on a worker thread
+ *      rather than on the audio thread.
+ *    a2dp_adaptive_rate - Non-zero to adapt the A2DP bitpool to congestion
+ *      of the link and pace the packets sent.
+ *    hfp_wideband_speech - Non-zero to offer mSBC to HFP headsets.
+ *    a2dp_sink - Non-zero to register an A2DP sink endpoint, so phones can
+ *      stream audio to a capture device.
+ *    card_probe_workers - Number of threads to probe ALSA cards on, 0 to
+ *      probe them on the main thread.
+ *    probe_threads - The card probe workers, started on first use.
+ *    num_probe_threads - Number of threads in probe_threads.
+ *    probe_lock - Protects probes and probe_stop.
+ *    probe_cond - Signaled when a probe is queued or the workers must stop.
+ *    probes - Cards being probed that aren't ready yet.
+ *    probe_stop - Set to make the probe workers exit.
  */
 static struct {
 	struct cras_server_state *exp_state;
@@ -70,6 +121,20 @@ static struct {
 					 void *task_data);
 	void *task_data;
 	struct cras_audio_thread_snapshot_buffer snapshot_buffer;
+	int device_group_workers;
+	unsigned int wake_tolerance_us;
+	int sched_deadline;
+	int a2dp_encoder_worker;
+	int a2dp_adaptive_rate;
+	int hfp_wideband_speech;
+	int a2dp_sink;
+	int card_probe_workers;
+	pthread_t *probe_threads;
+	int num_probe_threads;
+	pthread_mutex_t probe_lock;
+	pthread_cond_t probe_cond;
+	struct card_probe *probes;
+	int probe_stop;
 } state;
 
 /*
@@ -117,11 +182,25 @@ void cras_system_state_init(const char *device_config_dir,
 		board_config.default_output_buffer_size;
 	exp_state->aec_supported =
 		board_config.aec_supported;
+	state.device_group_workers = board_config.device_group_workers;
+	state.wake_tolerance_us = MAX(board_config.wake_tolerance_us, 0);
+	state.sched_deadline = board_config.sched_deadline;
+	state.a2dp_encoder_worker = board_config.a2dp_encoder_worker;
+	state.a2dp_adaptive_rate = board_config.a2dp_adaptive_rate;
+	state.hfp_wideband_speech = board_config.hfp_wideband_speech;
+	state.a2dp_sink = board_config.a2dp_sink;
+	state.card_probe_workers = MAX(board_config.card_probe_workers, 0);
+	state.probe_threads = NULL;
+	state.num_probe_threads = 0;
+	state.probes = NULL;
+	state.probe_stop = 0;
 
 	if ((rc = pthread_mutex_init(&state.update_lock, 0) != 0)) {
 		syslog(LOG_ERR, "Fatal: system state mutex init");
 		exit(rc);
 	}
+	pthread_mutex_init(&state.probe_lock, NULL);
+	pthread_cond_init(&state.probe_cond, NULL);
 
 	state.exp_state = exp_state;
 
@@ -152,10 +231,37 @@ void cras_system_state_set_internal_ucm_suffix(const char *internal_ucm_suffix)
 	state.internal_ucm_suffix = internal_ucm_suffix;
 }
 
+static void stop_card_probe_workers()
+{
+	struct card_probe *probe;
+	int i;
+
+	pthread_mutex_lock(&state.probe_lock);
+	state.probe_stop = 1;
+	pthread_cond_broadcast(&state.probe_cond);
+	pthread_mutex_unlock(&state.probe_lock);
+
+	for (i = 0; i < state.num_probe_threads; i++)
+		pthread_join(state.probe_threads[i], NULL);
+	free(state.probe_threads);
+	state.probe_threads = NULL;
+	state.num_probe_threads = 0;
+
+	/* Messages for these may still be in the main message pipe, but the
+	 * main loop is gone by now. */
+	DL_FOREACH(state.probes, probe) {
+		DL_DELETE(state.probes, probe);
+		cras_alsa_card_destroy(probe->card);
+		free(probe);
+	}
+}
+
 void cras_system_state_deinit()
 {
 	/* Free any resources used.  This prevents unit tests from leaking. */
 
+	stop_card_probe_workers();
+
 	cras_device_blacklist_destroy(state.device_blacklist);
 
 	cras_tm_deinit(state.tm);
@@ -168,6 +274,8 @@ void cras_system_state_deinit()
 	}
 
 	pthread_mutex_destroy(&state.update_lock);
+	pthread_cond_destroy(&state.probe_cond);
+	pthread_mutex_destroy(&state.probe_lock);
 }
 
 void cras_system_set_volume(size_t volume)
@@ -353,62 +461,314 @@ int cras_system_get_aec_supported()
 	return state.exp_state->aec_supported;
 }
 
-int cras_system_add_alsa_card(struct cras_alsa_card_info *alsa_card_info)
+int cras_system_get_device_group_workers()
+{
+	return state.device_group_workers;
+}
+
+unsigned int cras_system_get_wake_tolerance_us()
+{
+	return state.wake_tolerance_us;
+}
+
+int cras_system_get_sched_deadline()
+{
+	return state.sched_deadline;
+}
+
+int cras_system_get_a2dp_encoder_worker()
+{
+	return state.a2dp_encoder_worker;
+}
+
+int cras_system_get_a2dp_adaptive_rate()
+{
+	return state.a2dp_adaptive_rate;
+}
+
+int cras_system_get_hfp_wideband_speech()
+{
+	return state.hfp_wideband_speech;
+}
+
+int cras_system_get_a2dp_sink()
+{
+	return state.a2dp_sink;
+}
+
+/* Publishes how long each card took to come up in the server state. */
+static void export_card_ready_info()
+{
+	struct cras_server_state *s;
+	struct card_list *card;
+	unsigned int i = 0;
+
+	s = cras_system_state_update_begin();
+	if (!s)
+		return;
+
+	DL_FOREACH(state.cards, card) {
+		if (i == CRAS_MAX_ALSA_CARDS)
+			break;
+		s->alsa_cards[i].card_index =
+			cras_alsa_card_get_index(card->card);
+		s->alsa_cards[i].probe_ms = card->probe_ms;
+		s->alsa_cards[i].complete_ms = card->complete_ms;
+		s->alsa_cards[i].ready_ms = card->ready_ms;
+		i++;
+	}
+	s->num_alsa_cards = i;
+
+	cras_system_state_update_complete();
+}
+
+static int add_card(struct cras_alsa_card *alsa_card,
+		    const struct timespec *found_ts)
 {
 	struct card_list *card;
+	struct timespec now, elapsed;
+
+	card = calloc(1, sizeof(*card));
+	if (card == NULL) {
+		cras_alsa_card_destroy(alsa_card);
+		return -ENOMEM;
+	}
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	subtract_timespecs(&now, found_ts, &elapsed);
+	card->card = alsa_card;
+	card->probe_ms = cras_alsa_card_get_probe_ms(alsa_card);
+	card->complete_ms = cras_alsa_card_get_complete_ms(alsa_card);
+	card->ready_ms = timespec_to_ms(&elapsed);
+	DL_APPEND(state.cards, card);
+	syslog(LOG_INFO, "Card %zu ready in %u ms",
+	       cras_alsa_card_get_index(alsa_card), card->ready_ms);
+	export_card_ready_info();
+	return 0;
+}
+
+static const char *ucm_suffix_for(const struct cras_alsa_card_info *info)
+{
+	return (info->card_type == ALSA_CARD_TYPE_INTERNAL)
+			? state.internal_ucm_suffix
+			: NULL;
+}
+
+/* Returns the probe in flight for a card, ignoring cancelled ones. Must be
+ * called with probe_lock held. */
+static struct card_probe *find_probe(unsigned card_index)
+{
+	struct card_probe *probe;
+
+	DL_FOREACH(state.probes, probe)
+		if (probe->info.card_index == card_index && !probe->cancelled)
+			return probe;
+	return NULL;
+}
+
+int cras_system_add_alsa_card(struct cras_alsa_card_info *alsa_card_info)
+{
 	struct cras_alsa_card *alsa_card;
-	unsigned card_index;
+	struct timespec found_ts;
 
 	if (alsa_card_info == NULL)
 		return -EINVAL;
 
-	card_index = alsa_card_info->card_index;
-
-	DL_FOREACH(state.cards, card) {
-		if (card_index == cras_alsa_card_get_index(card->card))
-			return -EEXIST;
-	}
+	if (cras_system_alsa_card_exists(alsa_card_info->card_index))
+		return -EEXIST;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &found_ts);
 	alsa_card = cras_alsa_card_create(
 			alsa_card_info,
 			state.device_config_dir,
 			state.device_blacklist,
-			(alsa_card_info->card_type == ALSA_CARD_TYPE_INTERNAL)
-				? state.internal_ucm_suffix
-				: NULL);
+			ucm_suffix_for(alsa_card_info));
 	if (alsa_card == NULL)
 		return -ENOMEM;
-	card = calloc(1, sizeof(*card));
-	if (card == NULL)
+	return add_card(alsa_card, &found_ts);
+}
+
+/* Finishes a card a worker probed, on the main thread. */
+static void handle_card_probed(struct cras_main_message *msg, void *arg)
+{
+	struct card_probed_msg *probed_msg = (struct card_probed_msg *)msg;
+	struct card_probe *probe = probed_msg->probe;
+	struct cras_alsa_card *alsa_card = probe->card;
+	int cancelled;
+
+	pthread_mutex_lock(&state.probe_lock);
+	DL_DELETE(state.probes, probe);
+	cancelled = probe->cancelled;
+	pthread_mutex_unlock(&state.probe_lock);
+
+	if (alsa_card == NULL) {
+		syslog(LOG_ERR, "Failed to probe card %u",
+		       probe->info.card_index);
+	} else if (cancelled) {
+		cras_alsa_card_destroy(alsa_card);
+	} else if (cras_alsa_card_complete(alsa_card, &probe->info,
+					   state.device_blacklist)) {
+		syslog(LOG_ERR, "Failed to add devices of card %u",
+		       probe->info.card_index);
+		cras_alsa_card_destroy(alsa_card);
+	} else {
+		add_card(alsa_card, &probe->queued_ts);
+	}
+	free(probe);
+}
+
+static void *card_probe_worker(void *arg)
+{
+	struct card_probed_msg msg;
+	struct card_probe *probe;
+	int cancelled;
+
+	pthread_mutex_lock(&state.probe_lock);
+	while (!state.probe_stop) {
+		struct card_probe *next = NULL;
+
+		DL_FOREACH(state.probes, probe) {
+			if (!probe->running) {
+				next = probe;
+				break;
+			}
+		}
+		if (next == NULL) {
+			pthread_cond_wait(&state.probe_cond, &state.probe_lock);
+			continue;
+		}
+		next->running = 1;
+		pthread_mutex_unlock(&state.probe_lock);
+
+		/* Each card waits for ALSA on its own worker, rather than
+		 * the main thread sleeping once per card. */
+		if (next->delay_us)
+			usleep(next->delay_us);
+		pthread_mutex_lock(&state.probe_lock);
+		cancelled = next->cancelled;
+		pthread_mutex_unlock(&state.probe_lock);
+		if (!cancelled)
+			next->card = cras_alsa_card_probe(
+					&next->info, state.device_config_dir,
+					ucm_suffix_for(&next->info));
+
+		msg.header.type = CRAS_MAIN_ALSA_CARD_PROBED;
+		msg.header.length = sizeof(msg);
+		msg.probe = next;
+		if (cras_main_message_send((struct cras_main_message *)&msg))
+			syslog(LOG_ERR, "Failed to send probed card %u",
+			       next->info.card_index);
+
+		pthread_mutex_lock(&state.probe_lock);
+	}
+	pthread_mutex_unlock(&state.probe_lock);
+	return NULL;
+}
+
+static int start_card_probe_workers()
+{
+	int i, rc;
+
+	state.probe_threads = (pthread_t *)calloc(state.card_probe_workers,
+						  sizeof(pthread_t));
+	if (state.probe_threads == NULL)
 		return -ENOMEM;
-	card->card = alsa_card;
-	DL_APPEND(state.cards, card);
+
+	rc = cras_main_message_add_handler(CRAS_MAIN_ALSA_CARD_PROBED,
+					   handle_card_probed, NULL);
+	if (rc && rc != -EEXIST)
+		goto fail;
+
+	state.probe_stop = 0;
+	for (i = 0; i < state.card_probe_workers; i++) {
+		rc = pthread_create(&state.probe_threads[i], NULL,
+				    card_probe_worker, NULL);
+		if (rc) {
+			syslog(LOG_ERR, "Failed to start card probe worker");
+			break;
+		}
+		state.num_probe_threads++;
+	}
+	if (state.num_probe_threads)
+		return 0;
+fail:
+	free(state.probe_threads);
+	state.probe_threads = NULL;
+	return rc ? -rc : -EINVAL;
+}
+
+int cras_system_probe_alsa_card(struct cras_alsa_card_info *alsa_card_info,
+				unsigned int delay_us)
+{
+	struct card_probe *probe;
+
+	if (alsa_card_info == NULL)
+		return -EINVAL;
+
+	if (state.card_probe_workers && state.probe_threads == NULL &&
+	    start_card_probe_workers())
+		syslog(LOG_ERR, "Probing cards on the main thread");
+
+	if (state.probe_threads == NULL) {
+		if (delay_us)
+			usleep(delay_us);
+		return cras_system_add_alsa_card(alsa_card_info);
+	}
+
+	if (cras_system_alsa_card_exists(alsa_card_info->card_index))
+		return -EEXIST;
+
+	probe = (struct card_probe *)calloc(1, sizeof(*probe));
+	if (probe == NULL)
+		return -ENOMEM;
+	probe->info = *alsa_card_info;
+	probe->delay_us = delay_us;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &probe->queued_ts);
+
+	pthread_mutex_lock(&state.probe_lock);
+	DL_APPEND(state.probes, probe);
+	pthread_cond_signal(&state.probe_cond);
+	pthread_mutex_unlock(&state.probe_lock);
 	return 0;
 }
 
 int cras_system_remove_alsa_card(size_t alsa_card_index)
 {
 	struct card_list *card;
+	struct card_probe *probe;
 
 	DL_FOREACH(state.cards, card) {
 		if (alsa_card_index == cras_alsa_card_get_index(card->card))
 			break;
 	}
-	if (card == NULL)
-		return -EINVAL;
+	if (card == NULL) {
+		/* The card may still be probing, have it dropped when the
+		 * worker is done with it. */
+		pthread_mutex_lock(&state.probe_lock);
+		probe = find_probe(alsa_card_index);
+		if (probe)
+			probe->cancelled = 1;
+		pthread_mutex_unlock(&state.probe_lock);
+		return probe ? 0 : -EINVAL;
+	}
 	DL_DELETE(state.cards, card);
 	cras_alsa_card_destroy(card->card);
 	free(card);
+	export_card_ready_info();
 	return 0;
 }
 
 int cras_system_alsa_card_exists(unsigned alsa_card_index)
 {
 	struct card_list *card;
+	struct card_probe *probe;
 
 	DL_FOREACH(state.cards, card)
 		if (alsa_card_index == cras_alsa_card_get_index(card->card))
 			return 1;
-	return 0;
+
+	pthread_mutex_lock(&state.probe_lock);
+	probe = find_probe(alsa_card_index);
+	pthread_mutex_unlock(&state.probe_lock);
+	return probe != NULL;
 }
 
 int cras_system_set_select_handler(int (*add)(int fd,
@@ -123,6 +123,29 @@ int cras_system_get_default_output_buffer_size();
 /* Returns if system aec is supported. */
 int cras_system_get_aec_supported();
 
+/* Returns the number of device group worker threads to run besides the main
+ * audio thread. */
+int cras_system_get_device_group_workers();
+
+/* Returns how early in microseconds the audio threads may service a stream so
+ * that streams due close together share a wake up. */
+unsigned int cras_system_get_wake_tolerance_us();
+
+/* Returns if the audio threads should try to run with SCHED_DEADLINE. */
+int cras_system_get_sched_deadline();
+
+/* Returns if A2DP audio should be encoded on a worker thread. */
+int cras_system_get_a2dp_encoder_worker();
+
+/* Returns if the A2DP bitpool should adapt to congestion of the link. */
+int cras_system_get_a2dp_adaptive_rate();
+
+/* Returns if HFP should negotiate mSBC wideband speech with headsets. */
+int cras_system_get_hfp_wideband_speech();
+
+/* Returns if an A2DP sink endpoint should be offered to receive audio. */
+int cras_system_get_a2dp_sink();
+
 /* Adds a card at the given index to the system.  When a new card is found
  * (through a udev event notification) this will add the card to the system,
  * causing its devices to become available for playback/capture.
@@ -134,8 +157,23 @@ int cras_system_get_aec_supported();
  */
 int cras_system_add_alsa_card(struct cras_alsa_card_info *alsa_card_info);
 
+/* Adds a card like cras_system_add_alsa_card(), but opens and probes it on a
+ * card probe worker thread when the board enables them, so several cards can
+ * come up at once. The devices of the card are added from the main thread
+ * once probing is done.
+ * Args:
+ *    alsa_card_info - Info about the alsa card (Index, type, etc.).
+ *    delay_us - Time to give ALSA to set up the card before opening it.
+ * Returns:
+ *    0 if the card was queued or added, negative error on failure.
+ */
+int cras_system_probe_alsa_card(struct cras_alsa_card_info *alsa_card_info,
+				unsigned int delay_us);
+
 /* Removes a card.  When a device is removed this will do the cleanup.  Device
- * at index must have been added using cras_system_add_alsa_card().
+ * at index must have been added using cras_system_add_alsa_card() or
+ * cras_system_probe_alsa_card(). A card still being probed is dropped once
+ * its worker is done with it.
  * Args:
  *    alsa_card_index - Index ALSA uses to refer to the card.  The X in "hw:X".
  * Returns:
@@ -144,7 +182,7 @@ int cras_system_add_alsa_card(struct cras_alsa_card_info *alsa_card_info);
  */
 int cras_system_remove_alsa_card(size_t alsa_card_index);
 
-/* Checks if an alsa card has been added to the system.
+/* Checks if an alsa card has been added to the system, or is being probed.
  * Args:
  *    alsa_card_index - Index ALSA uses to refer to the card.  The X in "hw:X".
  * Returns:
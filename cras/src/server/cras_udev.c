@@ -167,18 +167,20 @@ static void set_factory_default(unsigned card_number)
 	}
 }
 
+/* Provide a small delay so that the udev message can
+ * propogate throughout the whole system, and Alsa can set up
+ * the new device.  Without a small delay, an error of the
+ * form:
+ *
+ *    Fail opening control hw:?
+ *
+ * will be produced by cras_alsa_card_create().
+ */
+static const unsigned int alsa_setup_delay_us = 125000; /* 0.125 second */
+
 static inline void udev_delay_for_alsa()
 {
-	/* Provide a small delay so that the udev message can
-	 * propogate throughout the whole system, and Alsa can set up
-	 * the new device.  Without a small delay, an error of the
-	 * form:
-	 *
-	 *    Fail opening control hw:?
-	 *
-	 * will be produced by cras_alsa_card_create().
-	 */
-	usleep(125000);		/* 0.125 second */
+	usleep(alsa_setup_delay_us);
 }
 
 /* Reads the "descriptors" file of the usb device and returns the
@@ -289,7 +291,6 @@ static void device_add_alsa(struct udev_device *dev,
 	struct cras_alsa_card_info card_info;
 	memset(&card_info, 0, sizeof(card_info));
 
-	udev_delay_for_alsa();
 	card_info.card_index = card;
 	if (internal) {
 		card_info.card_type = ALSA_CARD_TYPE_INTERNAL;
@@ -298,7 +299,9 @@ static void device_add_alsa(struct udev_device *dev,
 		fill_usb_card_info(&card_info, dev);
 	}
 
-	cras_system_add_alsa_card(&card_info);
+	/* The delay for ALSA is taken on the probe worker when there is one,
+	 * so cards found together are set up in parallel. */
+	cras_system_probe_alsa_card(&card_info, alsa_setup_delay_us);
 }
 
 void device_remove_alsa(const char *sysname, unsigned card)
@@ -0,0 +1,136 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cras_underrun_log.h"
+
+/* Ring of the last wake ups and its copy taken at the last underrun.
+ * Members:
+ *    ring - The last completed wake ups.
+ *    write_pos - Next entry of ring to fill.
+ *    num - Number of valid entries in ring.
+ *    cur - The wake up being recorded.
+ *    in_cycle - Set while cur is being recorded.
+ *    frozen - Copy of the wake ups at the last underrun, oldest first.
+ *    num_frozen - Number of valid entries in frozen.
+ *    frozen_ts - Time of the last underrun.
+ */
+struct cras_underrun_log {
+	struct cras_dev_cycle_info ring[CRAS_UNDERRUN_LOG_CYCLES];
+	unsigned int write_pos;
+	unsigned int num;
+	struct cras_dev_cycle_info cur;
+	int in_cycle;
+	struct cras_dev_cycle_info frozen[CRAS_UNDERRUN_LOG_CYCLES];
+	unsigned int num_frozen;
+	struct timespec frozen_ts;
+};
+
+static uint32_t timespec_to_us(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+struct cras_underrun_log *cras_underrun_log_create()
+{
+	return (struct cras_underrun_log *)calloc(
+			1, sizeof(struct cras_underrun_log));
+}
+
+void cras_underrun_log_destroy(struct cras_underrun_log *log)
+{
+	free(log);
+}
+
+void cras_underrun_log_begin_cycle(struct cras_underrun_log *log,
+				   const struct timespec *wake_ts)
+{
+	cras_underrun_log_end_cycle(log);
+	memset(&log->cur, 0, sizeof(log->cur));
+	log->cur.wake_sec = wake_ts->tv_sec;
+	log->cur.wake_nsec = wake_ts->tv_nsec;
+	log->in_cycle = 1;
+}
+
+void cras_underrun_log_end_cycle(struct cras_underrun_log *log)
+{
+	if (!log->in_cycle)
+		return;
+	log->ring[log->write_pos] = log->cur;
+	log->write_pos = (log->write_pos + 1) % CRAS_UNDERRUN_LOG_CYCLES;
+	if (log->num < CRAS_UNDERRUN_LOG_CYCLES)
+		log->num++;
+	log->in_cycle = 0;
+}
+
+void cras_underrun_log_fetch(struct cras_underrun_log *log,
+			     uint64_t stream_id,
+			     const struct timespec *pending)
+{
+	uint32_t pending_us = timespec_to_us(pending);
+
+	if (!log->in_cycle)
+		return;
+	if (log->cur.slowest_stream_id &&
+	    pending_us <= log->cur.slowest_fetch_us)
+		return;
+	log->cur.slowest_stream_id = stream_id;
+	log->cur.slowest_fetch_us = pending_us;
+}
+
+void cras_underrun_log_add_dsp(struct cras_underrun_log *log,
+			       const struct timespec *elapsed)
+{
+	if (log->in_cycle)
+		log->cur.dsp_us += timespec_to_us(elapsed);
+}
+
+void cras_underrun_log_write(struct cras_underrun_log *log,
+			     unsigned int hw_level, unsigned int frames)
+{
+	if (!log->in_cycle)
+		return;
+	log->cur.hw_level_before = hw_level;
+	log->cur.frames_written = frames;
+	log->cur.hw_level_after = hw_level + frames;
+}
+
+void cras_underrun_log_level_after(struct cras_underrun_log *log,
+				   unsigned int hw_level)
+{
+	if (log->in_cycle)
+		log->cur.hw_level_after = hw_level;
+}
+
+void cras_underrun_log_freeze(struct cras_underrun_log *log,
+			      const struct timespec *now)
+{
+	unsigned int i, pos;
+
+	/* Oldest first, the wake up being recorded last. It takes the place
+	 * of the oldest one if the ring is full. */
+	pos = (log->write_pos + CRAS_UNDERRUN_LOG_CYCLES - log->num) %
+	      CRAS_UNDERRUN_LOG_CYCLES;
+	i = (log->in_cycle && log->num == CRAS_UNDERRUN_LOG_CYCLES) ? 1 : 0;
+	log->num_frozen = 0;
+	for (; i < log->num; i++) {
+		log->frozen[log->num_frozen++] =
+			log->ring[(pos + i) % CRAS_UNDERRUN_LOG_CYCLES];
+	}
+	if (log->in_cycle)
+		log->frozen[log->num_frozen++] = log->cur;
+	log->frozen_ts = *now;
+}
+
+unsigned int cras_underrun_log_get(const struct cras_underrun_log *log,
+				   struct cras_dev_cycle_info *cycles,
+				   struct timespec *frozen_ts)
+{
+	memcpy(cycles, log->frozen, log->num_frozen * sizeof(*cycles));
+	*frozen_ts = log->frozen_ts;
+	return log->num_frozen;
+}
@@ -0,0 +1,91 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Per device log of the last audio thread wake ups of an output device. The
+ * audio thread records the levels, frames written, DSP time and slowest
+ * stream fetch of each wake up in a fixed ring. On underrun the ring is
+ * copied aside, so audio thread snapshots taken for the underrun show the
+ * wake ups that led to it.
+ */
+#ifndef CRAS_UNDERRUN_LOG_H_
+#define CRAS_UNDERRUN_LOG_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "cras_types.h"
+
+struct cras_underrun_log;
+
+/* Creates an empty log. Returns NULL on failure. */
+struct cras_underrun_log *cras_underrun_log_create();
+
+/* Destroys a log created with cras_underrun_log_create. */
+void cras_underrun_log_destroy(struct cras_underrun_log *log);
+
+/* Starts recording a wake up, ending the previous one if it is still open.
+ * Args:
+ *    log - The log.
+ *    wake_ts - Time the audio thread woke up.
+ */
+void cras_underrun_log_begin_cycle(struct cras_underrun_log *log,
+				   const struct timespec *wake_ts);
+
+/* Adds the wake up being recorded to the ring. */
+void cras_underrun_log_end_cycle(struct cras_underrun_log *log);
+
+/* Records a stream fetch still pending in this wake up, the longest one is
+ * kept.
+ * Args:
+ *    log - The log.
+ *    stream_id - The stream asked for samples.
+ *    pending - How long ago the stream was asked.
+ */
+void cras_underrun_log_fetch(struct cras_underrun_log *log,
+			     uint64_t stream_id,
+			     const struct timespec *pending);
+
+/* Adds time spent in the DSP pipeline to this wake up. */
+void cras_underrun_log_add_dsp(struct cras_underrun_log *log,
+			       const struct timespec *elapsed);
+
+/* Records the write to the device in this wake up.
+ * Args:
+ *    log - The log.
+ *    hw_level - Frames queued before writing.
+ *    frames - Frames written.
+ */
+void cras_underrun_log_write(struct cras_underrun_log *log,
+			     unsigned int hw_level, unsigned int frames);
+
+/* Records the frames queued after writing in this wake up. */
+void cras_underrun_log_level_after(struct cras_underrun_log *log,
+				   unsigned int hw_level);
+
+/* Copies the ring, including the wake up being recorded, aside. The copy is
+ * kept until the next call.
+ * Args:
+ *    log - The log.
+ *    now - Time of the underrun.
+ */
+void cras_underrun_log_freeze(struct cras_underrun_log *log,
+			      const struct timespec *now);
+
+/* Gets the wake ups copied by the last cras_underrun_log_freeze.
+ * Args:
+ *    log - The log.
+ *    cycles - Filled with up to CRAS_UNDERRUN_LOG_CYCLES wake ups, oldest
+ *        first.
+ *    frozen_ts - Filled with the time of the underrun, zero if there was
+ *        none.
+ * Returns:
+ *    The number of wake ups filled.
+ */
+unsigned int cras_underrun_log_get(const struct cras_underrun_log *log,
+				   struct cras_dev_cycle_info *cycles,
+				   struct timespec *frozen_ts);
+
+#endif /* CRAS_UNDERRUN_LOG_H_ */
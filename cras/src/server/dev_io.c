@@ -3,7 +3,9 @@
  * found in the LICENSE file.
  */
 
+#include <limits.h>
 #include <poll.h>
+#include <pthread.h>
 #include <syslog.h>
 
 #include "audio_thread_log.h"
@@ -15,6 +17,7 @@
 #include "dev_stream.h"
 #include "input_data.h"
 #include "polled_interval_checker.h"
+#include "preroll_buffer.h"
 #include "utlist.h"
 
 #include "dev_io.h"
@@ -32,8 +35,19 @@ static const int NON_EMPTY_UPDATE_INTERVAL_SEC = 5;
  */
 static const int MIN_EMPTY_PERIOD_SEC = 30;
 
-/* The number of devices playing/capturing non-empty stream(s). */
+/* The number of devices playing/capturing non-empty stream(s), summed over
+ * all audio threads, and the part of it counted by the calling thread. */
 static int non_empty_device_count = 0;
+static __thread int thread_non_empty_device_count = 0;
+static pthread_mutex_t non_empty_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* When the calling audio thread last woke up to run its devices. */
+static __thread struct timespec thread_wake_ts;
+
+/* How early the calling audio thread fetches playback streams. */
+static __thread struct timespec thread_fetch_window_ts = {
+	0, 500 * 1000 /* Same as playback_wake_fuzz_ts. */
+};
 
 /* Gets the master device which the stream is attached to. */
 static inline
@@ -81,7 +95,17 @@ static inline int count_non_empty_dev(struct open_dev *adevs) {
 }
 
 static void check_non_empty_state_transition(struct open_dev *adevs) {
-	int new_non_empty_dev_count = count_non_empty_dev(adevs);
+	int new_thread_count = count_non_empty_dev(adevs);
+	int new_non_empty_dev_count;
+
+	if (new_thread_count == thread_non_empty_device_count)
+		return;
+
+	// Each audio thread only sees its own devices, sum the counts so the
+	// system state reflects the devices of every thread.
+	pthread_mutex_lock(&non_empty_lock);
+	new_non_empty_dev_count = non_empty_device_count + new_thread_count -
+				  thread_non_empty_device_count;
 
 	// If we have transitioned to or from a state with 0 non-empty devices,
 	// notify the main thread to update system state.
@@ -90,6 +114,130 @@ static void check_non_empty_state_transition(struct open_dev *adevs) {
 			new_non_empty_dev_count > 0 ? 1 : 0);
 
 	non_empty_device_count = new_non_empty_dev_count;
+	pthread_mutex_unlock(&non_empty_lock);
+	thread_non_empty_device_count = new_thread_count;
+}
+
+/* Tracks the longest time from the thread waking up to the end of a write to
+ * the device of adev. */
+static void update_wake_to_write(struct open_dev *adev)
+{
+	struct timespec now, elapsed;
+
+	if (!timespec_is_nonzero(&thread_wake_ts))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	subtract_timespecs(&now, &thread_wake_ts, &elapsed);
+	if (timespec_after(&elapsed, &adev->longest_wake_to_write))
+		adev->longest_wake_to_write = elapsed;
+}
+
+static int input_adev_ignore_wake(const struct open_dev *adev)
+{
+	if (!cras_iodev_is_open(adev->dev))
+		return 1;
+
+	if (!adev->dev->active_node)
+		return 1;
+
+	if (adev->dev->active_node->type == CRAS_NODE_TYPE_HOTWORD &&
+	    !cras_iodev_input_streaming(adev->dev))
+		return 1;
+
+	return 0;
+}
+
+/* Records the slack of a device serviced with slack_frames to spare. */
+static void update_dev_slack(struct open_dev *adev, int slack_frames)
+{
+	if (slack_frames < adev->min_slack_frames)
+		adev->min_slack_frames = slack_frames;
+}
+
+/* Wake ups are scheduled to keep min_buffer_level queued, so what the
+ * predictor learned doesn't hold once that level has changed. */
+static void reset_wake_prediction_on_level_change(struct open_dev *adev)
+{
+	if (adev->wake_pred_min_buffer_level == adev->dev->min_buffer_level)
+		return;
+	wake_predictor_reset(&adev->wake_pred);
+	adev->wake_pred_min_buffer_level = adev->dev->min_buffer_level;
+}
+
+/* Compares the level of an output device about to be written with the level
+ * predicted when its wake up was scheduled. */
+static void check_wake_prediction(struct open_dev *adev, unsigned int hw_level,
+				  const struct timespec *hw_tstamp)
+{
+	int err;
+
+	reset_wake_prediction_on_level_change(adev);
+
+	if (!wake_predictor_check(&adev->wake_pred, hw_level, hw_tstamp, &err))
+		return;
+	ATLOG(atlog, AUDIO_THREAD_WAKE_PREDICTION, adev->dev->info.idx,
+	      err, (int)adev->wake_pred.correction);
+}
+
+/* Returns non-zero if adev's wake_ts is when it must next be serviced. */
+static int adev_has_deadline(const struct open_dev *adev)
+{
+	if (!timespec_is_nonzero(&adev->wake_ts))
+		return 0;
+	if (adev->dev->direction == CRAS_STREAM_OUTPUT)
+		return cras_iodev_odev_should_wake(adev->dev);
+	return !input_adev_ignore_wake(adev);
+}
+
+/*
+ * Counts a missed deadline for each device the thread woke up too late for.
+ * Waking up within the playback fuzz after wake_ts is on time, the device
+ * still has the frames scheduled for that margin.
+ */
+static void check_missed_deadlines(struct open_dev *adevs)
+{
+	struct open_dev *adev;
+	struct timespec deadline;
+
+	if (!timespec_is_nonzero(&thread_wake_ts))
+		return;
+
+	DL_FOREACH(adevs, adev) {
+		if (!adev_has_deadline(adev))
+			continue;
+		deadline = adev->wake_ts;
+		add_timespecs(&deadline, &playback_wake_fuzz_ts);
+		if (timespec_after(&thread_wake_ts, &deadline))
+			adev->missed_deadlines++;
+	}
+}
+
+/*
+ * Orders a list of open devices by deadline, earliest first, so the device
+ * closest to an xrun is serviced first. Devices without a deadline are kept
+ * at the end in their original order.
+ */
+static void sort_devs_by_deadline(struct open_dev **adevs)
+{
+	struct open_dev *sorted = NULL;
+	struct open_dev *adev, *pos;
+
+	if (!*adevs || !(*adevs)->next)
+		return;
+
+	DL_FOREACH(*adevs, adev) {
+		DL_DELETE(*adevs, adev);
+		DL_FOREACH(sorted, pos) {
+			if (!adev_has_deadline(adev))
+				continue;
+			if (!adev_has_deadline(pos) ||
+			    timespec_after(&pos->wake_ts, &adev->wake_ts))
+				break;
+		}
+		DL_INSERT(sorted, pos, adev);
+	}
+	*adevs = sorted;
 }
 
 /* Asks any stream with room for more data. Sets the time stamp for all streams.
@@ -114,15 +262,20 @@ static int fetch_streams(struct open_dev *adev)
 		struct cras_rstream *rstream = dev_stream->stream;
 		struct cras_audio_shm *shm =
 			cras_rstream_output_shm(rstream);
-		const struct timespec *next_cb_ts;
-		struct timespec now;
+		struct timespec now, fetch_ts, window_end;
 
 		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
 
 		if (dev_stream_is_pending_reply(dev_stream)) {
+			struct timespec pending;
+
 			dev_stream_flush_old_audio_messages(dev_stream);
 			cras_rstream_record_fetch_interval(dev_stream->stream,
 							   &now);
+			subtract_timespecs(&now, &rstream->last_fetch_ts,
+					   &pending);
+			cras_iodev_log_stream_fetch(odev, rstream->stream_id,
+						    &pending);
 		}
 
 		if (cras_shm_get_frames(shm) < 0)
@@ -131,14 +284,16 @@ static int fetch_streams(struct open_dev *adev)
 		if (cras_rstream_get_is_draining(dev_stream->stream))
 			continue;
 
-		next_cb_ts = dev_stream_next_cb_ts(dev_stream);
-		if (!next_cb_ts)
+		if (dev_stream_wake_time(dev_stream, 0, NULL, 0, 0, &fetch_ts))
 			continue;
 
 		/* Check if it's time to get more data from this stream.
-		 * Allow for waking up a little early. */
-		add_timespecs(&now, &playback_wake_fuzz_ts);
-		if (!timespec_after(&now, next_cb_ts))
+		 * Allow for waking up a little early, up to the wake
+		 * tolerance of the thread so that streams due soon are
+		 * fetched by this wake up. */
+		window_end = now;
+		add_timespecs(&window_end, &thread_fetch_window_ts);
+		if (!timespec_after(&window_end, &fetch_ts))
 			continue;
 
 		if (!dev_stream_can_fetch(dev_stream)) {
@@ -184,6 +339,16 @@ static int input_delay_frames(struct open_dev *adevs)
 	return max_delay;
 }
 
+/* Returns how many frames a stream reading from the pre-roll ring is behind
+ * the live capture position. */
+static unsigned int preroll_lag_frames(const struct cras_iodev *idev,
+				       const struct dev_stream *stream)
+{
+	if (!stream->reading_preroll || !idev->preroll)
+		return 0;
+	return preroll_buffer_write_pos(idev->preroll) - stream->preroll_pos;
+}
+
 /* Sets the stream delay.
  * Args:
  *    adev[in] - The device to capture from.
@@ -200,7 +365,9 @@ static unsigned int set_stream_delay(struct open_dev *adev)
 		if (stream->stream->flags & TRIGGER_ONLY)
 			continue;
 
-		dev_stream_set_delay(stream, delay);
+		dev_stream_set_delay(stream,
+				     delay + preroll_lag_frames(adev->dev,
+								stream));
 	}
 
 	return 0;
@@ -369,6 +536,69 @@ static int set_input_dev_wake_ts(struct open_dev *adev)
 	return rc;
 }
 
+/*
+ * Captures to a stream started with pre-roll from the device's pre-roll ring.
+ * The stream is called back faster than real time meanwhile, and switches
+ * back to the live buffer once it has caught up with the ring and has no
+ * pending offset into the live buffer.
+ * Args:
+ *    idev - The device to capture samples from.
+ *    stream - The stream to capture to.
+ *    area_offset - The stream's offset into the live buffer.
+ *    software_gain_scaler - The software gain scaler to apply.
+ * Returns:
+ *    Non-zero if the stream was served from the ring, 0 if it should read
+ *    from the live buffer.
+ */
+static int capture_preroll_to_stream(struct cras_iodev *idev,
+				     struct dev_stream *stream,
+				     unsigned int area_offset,
+				     float software_gain_scaler)
+{
+	struct cras_audio_area *area;
+	unsigned int frames, nread, total_read = 0;
+
+	if (!stream->reading_preroll)
+		return 0;
+
+	if (!idev->preroll ||
+	    (area_offset == 0 && preroll_lag_frames(idev, stream) == 0)) {
+		stream->reading_preroll = 0;
+		return 0;
+	}
+
+	do {
+		frames = preroll_buffer_read_area(idev->preroll,
+						  &stream->preroll_pos, &area);
+		if (frames == 0)
+			break;
+		nread = dev_stream_capture(stream, area, 0,
+					   software_gain_scaler);
+		stream->preroll_pos += nread;
+		total_read += nread;
+	} while (nread == frames);
+
+	ATLOG(atlog, AUDIO_THREAD_CAPTURE_PREROLL, stream->stream->stream_id,
+	      total_read, preroll_lag_frames(idev, stream));
+	return 1;
+}
+
+/* Logs the time from stream creation to its first captured samples. */
+static void check_first_capture(struct cras_rstream *rstream)
+{
+	struct timespec now, delay;
+
+	if (rstream->first_capture_logged || stream_is_server_only(rstream))
+		return;
+	if (cras_rstream_level(rstream) == 0)
+		return;
+
+	rstream->first_capture_logged = 1;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	subtract_timespecs(&now, &rstream->start_ts, &delay);
+	cras_server_metrics_time_to_first_sample(timespec_to_ms(&delay));
+}
+
 /* Read samples from an input device to the specified stream.
  * Args:
  *    adev - The device to capture samples from.
@@ -392,6 +622,8 @@ static int capture_to_streams(struct open_dev *adev)
 	hw_level = rc;
 
 	cras_iodev_update_highest_hw_level(idev, hw_level);
+	update_dev_slack(adev, (int)idev->buffer_size - (int)hw_level -
+			       (int)idev->min_cb_level);
 
 	ATLOG(atlog, AUDIO_THREAD_READ_AUDIO_TSTAMP, idev->info.idx,
 	      hw_tstamp.tv_sec, hw_tstamp.tv_nsec);
@@ -448,12 +680,22 @@ static int capture_to_streams(struct open_dev *adev)
 				? 1.0f
 				: cras_iodev_get_software_gain_scaler(idev);
 
-			this_read = dev_stream_capture(
-					stream, area, area_offset,
-					software_gain_scaler);
+			/*
+			 * A stream reading pre-roll lets go of the live frames
+			 * right away, they are kept in the pre-roll ring for
+			 * it to read later.
+			 */
+			if (capture_preroll_to_stream(idev, stream, area_offset,
+						      software_gain_scaler))
+				this_read = nread - MIN(area_offset, nread);
+			else
+				this_read = dev_stream_capture(
+						stream, area, area_offset,
+						software_gain_scaler);
 
 			input_data_put_for_stream(idev->input_data, stream->stream,
 						  idev->buf_state, this_read);
+			check_first_capture(stream->stream);
 		}
 
 		rc = cras_iodev_put_input_buffer(idev);
@@ -586,12 +828,25 @@ void update_dev_wakeup_time(struct open_dev *adev, unsigned int *hw_level)
 	if (!timespec_is_nonzero(&adev->wake_ts))
 		adev->wake_ts = now;
 
-	if (cras_iodev_state(adev->dev) == CRAS_IODEV_STATE_NORMAL_RUN)
-		cras_iodev_update_highest_hw_level(adev->dev, *hw_level);
-
 	est_rate = adev->dev->ext_format->frame_rate *
 			cras_iodev_get_est_rate_ratio(adev->dev);
 
+	if (cras_iodev_state(adev->dev) == CRAS_IODEV_STATE_NORMAL_RUN) {
+		cras_iodev_update_highest_hw_level(adev->dev, *hw_level);
+		if (adev->dev->hw_timestamps) {
+			reset_wake_prediction_on_level_change(adev);
+			wake_predictor_start(&adev->wake_pred, *hw_level,
+					     &adev->wake_ts, est_rate);
+			frames_to_play_in_sleep = wake_predictor_adjust(
+					&adev->wake_pred,
+					frames_to_play_in_sleep, *hw_level,
+					adev->dev->ext_format->frame_rate);
+		}
+	} else {
+		/* Zeros filled outside normal run aren't in the model. */
+		wake_predictor_cancel(&adev->wake_pred);
+	}
+
 	ATLOG(atlog, AUDIO_THREAD_SET_DEV_WAKE, adev->dev->info.idx,
 	      *hw_level, frames_to_play_in_sleep);
 
@@ -638,6 +893,7 @@ int write_output_samples(struct open_dev **odevs,
 	if (rc < 0)
 		return rc;
 	hw_level = rc;
+	update_dev_slack(adev, (int)hw_level - (int)odev->min_cb_level);
 
 	ATLOG(atlog, AUDIO_THREAD_FILL_AUDIO_TSTAMP, adev->dev->info.idx,
 	      hw_tstamp.tv_sec, hw_tstamp.tv_nsec);
@@ -651,6 +907,8 @@ int write_output_samples(struct open_dev **odevs,
 
 		if (cras_iodev_update_rate(odev, hw_level, &hw_tstamp))
 			update_estimated_rate(adev);
+		if (odev->hw_timestamps)
+			check_wake_prediction(adev, hw_level, &hw_tstamp);
 	}
 	ATLOG(atlog, AUDIO_THREAD_FILL_AUDIO, adev->dev->info.idx, hw_level, 0);
 
@@ -718,6 +976,7 @@ int write_output_samples(struct open_dev **odevs,
 
 	ATLOG(atlog, AUDIO_THREAD_FILL_AUDIO_DONE, hw_level,
 	      total_written, odev->min_cb_level);
+	cras_iodev_log_output_write(odev, hw_level, total_written);
 
 	return total_written;
 }
@@ -823,6 +1082,7 @@ int dev_io_playback_write(struct open_dev **odevs,
 			handle_dev_err(rc, odevs, adev);
 		} else {
 			total_written = rc;
+			update_wake_to_write(adev);
 
 			/*
 			 * Skip the underrun check and device wake up time update if
@@ -836,6 +1096,7 @@ int dev_io_playback_write(struct open_dev **odevs,
 			 * level.
 			 */
 			update_dev_wakeup_time(adev, &hw_level);
+			cras_iodev_log_output_level(adev->dev, hw_level);
 
 			/*
 			 * If new hardware level is less than or equal to the
@@ -858,6 +1119,14 @@ int dev_io_playback_write(struct open_dev **odevs,
 					update_dev_wakeup_time(adev, &hw_level);
 				}
 			}
+
+			if (adev->dev->dynamic_min_buffer_level) {
+				struct timespec now;
+
+				clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+				cras_iodev_update_min_buffer_level(adev->dev,
+								   &now);
+			}
 		}
 	}
 
@@ -874,32 +1143,72 @@ int dev_io_playback_write(struct open_dev **odevs,
 	return 0;
 }
 
+void dev_io_set_wake_ts(const struct timespec *wake_ts)
+{
+	thread_wake_ts = *wake_ts;
+}
+
+void dev_io_set_wake_tolerance(const struct timespec *tolerance)
+{
+	if (timespec_after(tolerance, &playback_wake_fuzz_ts))
+		thread_fetch_window_ts = *tolerance;
+	else
+		thread_fetch_window_ts = playback_wake_fuzz_ts;
+}
+
+/* Starts the I/O of this wake up on each device in adevs. */
+static void begin_io_cycle(struct open_dev *adevs,
+			   const struct timespec *wake_ts)
+{
+	struct open_dev *adev;
+
+	DL_FOREACH(adevs, adev)
+		cras_iodev_begin_io_cycle(adev->dev, wake_ts);
+}
+
+/* Ends the I/O of this wake up on each device in adevs, and logs how many
+ * driver calls it took for devices that count them. */
+static void end_io_cycle(struct open_dev *adevs)
+{
+	struct open_dev *adev;
+	struct cras_iodev *dev;
+
+	DL_FOREACH(adevs, adev) {
+		dev = adev->dev;
+		if (dev->cache_hw_status)
+			ATLOG(atlog, AUDIO_THREAD_DEV_HW_CALLS, dev->info.idx,
+			      dev->num_hw_calls, dev->hw_status.num_cached);
+		dev->num_hw_calls = 0;
+		dev->hw_status.num_cached = 0;
+		cras_iodev_end_io_cycle(dev);
+	}
+}
+
 void dev_io_run(struct open_dev **odevs, struct open_dev **idevs,
 		struct cras_fmt_conv *output_converter)
 {
+	struct timespec now;
+
 	pic_update_current_time();
 
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	begin_io_cycle(*odevs, &now);
+	begin_io_cycle(*idevs, &now);
+
+	check_missed_deadlines(*odevs);
+	check_missed_deadlines(*idevs);
+	sort_devs_by_deadline(odevs);
+	sort_devs_by_deadline(idevs);
+
 	dev_io_playback_fetch(*odevs);
 	dev_io_capture(idevs);
 	dev_io_send_captured_samples(*idevs);
 	dev_io_playback_write(odevs, output_converter);
 
-	check_non_empty_state_transition(*odevs);
-}
-
-static int input_adev_ignore_wake(const struct open_dev *adev)
-{
-	if (!cras_iodev_is_open(adev->dev))
-		return 1;
-
-	if (!adev->dev->active_node)
-		return 1;
+	end_io_cycle(*odevs);
+	end_io_cycle(*idevs);
 
-	if (adev->dev->active_node->type == CRAS_NODE_TYPE_HOTWORD &&
-	    !cras_iodev_input_streaming(adev->dev))
-		return 1;
-
-	return 0;
+	check_non_empty_state_transition(*odevs);
 }
 
 int dev_io_next_input_wake(struct open_dev **idevs, struct timespec *min_ts)
@@ -943,6 +1252,7 @@ void dev_io_rm_open_dev(struct open_dev **odev_list,
 
 
 	DL_DELETE(*odev_list, dev_to_rm);
+	cras_iodev_end_io_cycle(dev_to_rm->dev);
 
 	/* Metrics logs the number of underruns of this device. */
 	cras_server_metrics_num_underruns(
@@ -12,6 +12,7 @@
 #include "cras_iodev.h"
 #include "cras_types.h"
 #include "polled_interval_checker.h"
+#include "wake_predictor.h"
 
 /*
  * Open input/output devices.
@@ -20,6 +21,18 @@
  *    last_non_empty_ts - The last time we know the device played/captured
  *        non-empty (zero) audio.
  *    coarse_rate_adjust - Hack for when the sample rate needs heavy correction.
+ *    longest_wake_to_write - The longest time from the audio thread waking
+ *        up to finishing a write to this device, since the last debug dump.
+ *    min_slack_frames - The fewest frames the device had to spare over
+ *        min_cb_level when serviced since the last debug dump. For output
+ *        that is the hardware level, for input the room left in the buffer.
+ *        INT_MAX if the device hasn't been serviced.
+ *    missed_deadlines - Number of times the audio thread woke up too late
+ *        to service the device by wake_ts.
+ *    wake_pred - For output devices with hardware timestamps, feedback on
+ *        how far wake_ts was from the level the device actually reached.
+ *    wake_pred_min_buffer_level - The min_buffer_level of the device that
+ *        wake_pred was learned at.
  */
 struct open_dev {
 	struct cras_iodev *dev;
@@ -27,6 +40,11 @@ struct open_dev {
 	struct polled_interval *non_empty_check_pi;
 	struct polled_interval *empty_pi;
 	int coarse_rate_adjust;
+	struct timespec longest_wake_to_write;
+	int min_slack_frames;
+	unsigned int missed_deadlines;
+	struct wake_predictor wake_pred;
+	unsigned int wake_pred_min_buffer_level;
 	struct open_dev *prev, *next;
 };
 
@@ -61,7 +79,24 @@ int dev_io_capture(struct open_dev **list);
  */
 int dev_io_send_captured_samples(struct open_dev *idev_list);
 
-/* Reads and/or writes audio samples from/to the devices. */
+/*
+ * Records when the calling audio thread woke up, used to measure the time
+ * from the wake up to the end of writing each output device.
+ */
+void dev_io_set_wake_ts(const struct timespec *wake_ts);
+
+/*
+ * Sets how far ahead of their callback time the calling audio thread fetches
+ * playback streams, so that streams due within the tolerance are serviced
+ * by the same wake up instead of each waking the thread.
+ *    tolerance - Ignored if shorter than the default fuzz of 500 usec.
+ */
+void dev_io_set_wake_tolerance(const struct timespec *tolerance);
+
+/*
+ * Reads and/or writes audio samples from/to the devices. Devices are serviced
+ * in the order of their wake_ts, the one closest to an xrun first.
+ */
 void dev_io_run(struct open_dev **odevs, struct open_dev **idevs,
 		struct cras_fmt_conv *output_converter);
 
@@ -32,6 +32,13 @@ static const struct timespec capture_callback_fuzz_ts = {
 	.tv_nsec = 1000000, /* 1 ms. */
 };
 
+/*
+ * A capture stream reading from its device's pre-roll ring is called back
+ * this many times as often as its sleep interval, so that it drains the
+ * ring faster than real time and catches up with the live audio.
+ */
+static const unsigned int preroll_catch_up_rate = 2;
+
 /*
  * Returns the size in frames that a format converter must allocate for its
  * temporary buffers to be able to convert the specified number of stream
@@ -80,6 +87,7 @@ struct dev_stream *dev_stream_create(struct cras_rstream *stream,
 	out->dev_id = dev_id;
 	out->stream = stream;
 	out->dev_rate = dev_fmt->frame_rate;
+	out->gain_scaler = -1.0f;
 
 	max_frames = max_frames_for_conversion(stream->buffer_frames,
 					       stream_fmt->frame_rate,
@@ -292,6 +300,53 @@ static unsigned int capture_with_fmt_conv(struct dev_stream *dev_stream,
 	return total_read;
 }
 
+/* Computes the per frame gain increment to ramp from the gain applied in the
+ * last capture to software_gain_scaler over the next num_frames. The starting
+ * gain is returned in start_scaler. */
+static float capture_gain_ramp(struct dev_stream *dev_stream,
+			       float software_gain_scaler,
+			       unsigned int num_frames,
+			       float *start_scaler)
+{
+	float start = dev_stream->gain_scaler;
+
+	if (num_frames == 0) {
+		*start_scaler = software_gain_scaler;
+		return 0.0f;
+	}
+
+	dev_stream->gain_scaler = software_gain_scaler;
+	if (start < 0.0f || start == software_gain_scaler) {
+		*start_scaler = software_gain_scaler;
+		return 0.0f;
+	}
+
+	*start_scaler = start;
+	return (software_gain_scaler - start) / num_frames;
+}
+
+/* Writes captured samples from src to the stream's shm at offset, applying
+ * gain in the same pass. If other devices also feed this stream the samples
+ * are mixed with theirs at the final gain, otherwise they are copied. */
+static unsigned int capture_copy_area(struct dev_stream *dev_stream,
+				      unsigned int offset,
+				      const struct cras_audio_area *src,
+				      unsigned int src_offset,
+				      float scaler,
+				      float increment)
+{
+	struct cras_rstream *rstream = dev_stream->stream;
+
+	if (dev_stream_attached_devs(dev_stream) > 1)
+		return cras_audio_area_copy(rstream->audio_area, offset,
+					    &rstream->format, src, src_offset,
+					    dev_stream->gain_scaler);
+
+	return cras_audio_area_copy_scaled(rstream->audio_area, offset,
+					   &rstream->format, src, src_offset,
+					   scaler, increment);
+}
+
 /* Copy from the converted buffer to the stream shm.  These have the same format
  * at this point. */
 static unsigned int capture_copy_converted_to_stream(
@@ -308,6 +363,7 @@ static unsigned int capture_copy_converted_to_stream(
 	unsigned int frame_bytes;
 	unsigned int offset;
 	const struct cras_audio_format *fmt;
+	float scaler, increment;
 
 	shm = cras_rstream_input_shm(rstream);
 
@@ -329,6 +385,9 @@ static unsigned int capture_copy_converted_to_stream(
 				    rstream->audio_area->frames,
 				    offset);
 
+	increment = capture_gain_ramp(dev_stream, software_gain_scaler,
+				      num_frames, &scaler);
+
 	while (total_written < num_frames) {
 		converted_samples =
 			buf_read_pointer_size(dev_stream->conv_buffer,
@@ -346,10 +405,9 @@ static unsigned int capture_copy_converted_to_stream(
 						    &rstream->format,
 						    stream_samples);
 
-		cras_audio_area_copy(rstream->audio_area, offset,
-				     &rstream->format,
-				     dev_stream->conv_area, 0,
-				     software_gain_scaler);
+		capture_copy_area(dev_stream, offset, dev_stream->conv_area,
+				  0, scaler, increment);
+		scaler += increment * write_frames;
 
 		buf_increment_read(dev_stream->conv_buffer,
 				   write_frames * frame_bytes);
@@ -395,6 +453,8 @@ unsigned int dev_stream_capture(struct dev_stream *dev_stream,
 	} else {
 		unsigned int offset =
 			cras_rstream_dev_offset(rstream, dev_stream->dev_id);
+		unsigned int num_frames;
+		float scaler, increment;
 
 		/* Set up the shm area and copy to it. */
 		shm = cras_rstream_input_shm(rstream);
@@ -406,10 +466,12 @@ unsigned int dev_stream_capture(struct dev_stream *dev_stream,
 						    &rstream->format,
 						    stream_samples);
 
-		nread = cras_audio_area_copy(rstream->audio_area, offset,
-					     &rstream->format, area,
-					     area_offset,
-					     software_gain_scaler);
+		num_frames = MIN(area->frames - area_offset,
+				 rstream->audio_area->frames - offset);
+		increment = capture_gain_ramp(dev_stream, software_gain_scaler,
+					      num_frames, &scaler);
+		nread = capture_copy_area(dev_stream, offset, area,
+					  area_offset, scaler, increment);
 
 		ATLOG(atlog, AUDIO_THREAD_CAPTURE_WRITE,
 					    rstream->stream_id,
@@ -569,8 +631,17 @@ int dev_stream_capture_update_rstream(struct dev_stream *dev_stream)
 		rstream->triggered = 1;
 
 	/* Update next callback time according to perfect schedule. */
-	add_timespecs(&rstream->next_cb_ts,
-		      &rstream->sleep_interval_ts);
+	if (dev_stream->reading_preroll) {
+		struct timespec catch_up_ts;
+
+		cras_frames_to_time(cras_rstream_get_cb_threshold(rstream) /
+					    preroll_catch_up_rate,
+				    rstream->format.frame_rate, &catch_up_ts);
+		add_timespecs(&rstream->next_cb_ts, &catch_up_ts);
+	} else {
+		add_timespecs(&rstream->next_cb_ts,
+			      &rstream->sleep_interval_ts);
+	}
 	/* Reset schedule if the schedule is missed. */
 	check_next_wake_time(dev_stream);
 
@@ -629,14 +700,16 @@ void dev_stream_set_delay(const struct dev_stream *dev_stream,
 		shm = cras_rstream_output_shm(rstream);
 		stream_frames = cras_fmt_conv_out_frames_to_in(dev_stream->conv,
 							       delay_frames);
+		rstream->delay_frames = stream_frames +
+					  cras_shm_get_frames(shm);
 		cras_set_playback_timestamp(rstream->format.frame_rate,
-					    stream_frames +
-						cras_shm_get_frames(shm),
+					    rstream->delay_frames,
 					    &shm->area->ts);
 	} else {
 		shm = cras_rstream_input_shm(rstream);
 		stream_frames = cras_fmt_conv_in_frames_to_out(dev_stream->conv,
 							       delay_frames);
+		rstream->delay_frames = stream_frames;
 		if (cras_shm_frames_written(shm) == 0)
 			cras_set_capture_timestamp(
 					rstream->format.frame_rate,
@@ -670,6 +743,7 @@ int dev_stream_request_playback_samples(struct dev_stream *dev_stream,
 	add_timespecs(&rstream->next_cb_ts,
 		      &rstream->sleep_interval_ts);
 	check_next_wake_time(dev_stream);
+	rstream->fetch_deadline_ts = rstream->next_cb_ts;
 
 	return 0;
 }
@@ -783,6 +857,33 @@ static int get_input_wake_time(struct dev_stream *dev_stream,
 	return 0;
 }
 
+/*
+ * Gets the time to request samples from an output stream. The request is
+ * sent ahead of the callback time by the P99 response time of the client,
+ * at most half a callback interval, so slow clients answer in time.
+ * Returns:
+ *   0 on success. A positive value if there is no need to set wake up time
+ *   for this stream.
+ */
+static int get_output_wake_time(struct dev_stream *dev_stream,
+				struct timespec *wake_time_out)
+{
+	struct cras_rstream *rstream = dev_stream->stream;
+	struct timespec max_lead, lead;
+
+	if (rstream->flags & USE_DEV_TIMING)
+		return 1;
+
+	max_lead = rstream->sleep_interval_ts;
+	max_lead.tv_nsec = (max_lead.tv_sec % 2) * 500000000 +
+			   max_lead.tv_nsec / 2;
+	max_lead.tv_sec /= 2;
+	fetch_predictor_lead(&rstream->fetch_pred, &max_lead, &lead);
+	subtract_timespecs(&rstream->next_cb_ts, &lead, wake_time_out);
+
+	return 0;
+}
+
 int dev_stream_wake_time(struct dev_stream *dev_stream,
 			 unsigned int curr_level,
 			 struct timespec *level_tstamp,
@@ -790,14 +891,8 @@ int dev_stream_wake_time(struct dev_stream *dev_stream,
 			 int is_cap_limit_stream,
 			 struct timespec *wake_time_out)
 {
-	if (dev_stream->stream->direction == CRAS_STREAM_OUTPUT) {
-		/*
-                 * TODO(cychiang) Implement the method for output stream.
-		 * The logic should be similar to what
-		 * get_next_stream_wake_from_list in audio_thread.c is doing.
-		 */
-		return -EINVAL;
-	}
+	if (dev_stream->stream->direction == CRAS_STREAM_OUTPUT)
+		return get_output_wake_time(dev_stream, wake_time_out);
 
 	return get_input_wake_time(dev_stream, curr_level, level_tstamp,
 				   cap_limit, is_cap_limit_stream,
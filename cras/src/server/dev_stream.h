@@ -29,6 +29,18 @@ struct cras_iodev;
  *    conv_buffer_size_frames - Size of conv_buffer in frames.
  *    dev_rate - Sampling rate of device. This is set when dev_stream is
  *               created.
+ *    gain_scaler - The software gain applied to the last captured samples,
+ *                  used to ramp to a new gain. Negative until the first
+ *                  capture.
+ *    reading_preroll - Non-zero while the stream is captured from the
+ *                      device's pre-roll ring rather than the live buffer.
+ *                      The stream is called back faster than real time
+ *                      meanwhile, until it catches up with the live audio.
+ *    preroll_pos - Position in the pre-roll ring of the next frame to
+ *                  capture when reading_preroll is set.
+ *    share_slot - Slot of the stream in the device's buffer_share, set when
+ *                 the stream is added to the device. -1 if the stream
+ *                 doesn't share the device buffer.
  */
 struct dev_stream {
 	unsigned int dev_id;
@@ -38,6 +50,10 @@ struct dev_stream {
 	struct cras_audio_area *conv_area;
 	unsigned int conv_buffer_size_frames;
 	size_t dev_rate;
+	float gain_scaler;
+	int reading_preroll;
+	uint64_t preroll_pos;
+	int share_slot;
 	struct dev_stream *prev, *next;
 };
 
@@ -158,7 +174,9 @@ int dev_stream_request_playback_samples(struct dev_stream *dev_stream,
 /*
  * Gets the wake up time for a dev_stream.
  * For an input stream, it considers both needed samples and proper time
- * interval between each callbacks.
+ * interval between each callbacks. An output stream is woken ahead of its
+ * callback time by the response time of its client, see fetch_predictor.h.
+ * The level arguments are not used for output streams.
  * Args:
  *   dev_stream[in]: The dev_stream to check wake up time.
  *   curr_level[in]: The current level of device.
@@ -0,0 +1,52 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "cras_util.h"
+#include "fetch_predictor.h"
+
+/* Finds the k-th longest response, k counted from 1. */
+static uint32_t kth_longest(const struct fetch_predictor *fp, unsigned int k)
+{
+	uint32_t longest[FETCH_PREDICTOR_SAMPLES / 100 + 1];
+	unsigned int i, j, n = 0;
+
+	/* Keep the k longest sorted, longest first. k is at most two. */
+	for (i = 0; i < fp->num; i++) {
+		uint32_t us = fp->response_us[i];
+
+		if (n == k && us <= longest[n - 1])
+			continue;
+		if (n < k)
+			n++;
+		for (j = n - 1; j > 0 && longest[j - 1] < us; j--)
+			longest[j] = longest[j - 1];
+		longest[j] = us;
+	}
+	return longest[k - 1];
+}
+
+void fetch_predictor_add(struct fetch_predictor *fp,
+			 const struct timespec *response)
+{
+	fp->response_us[fp->write_pos] =
+		response->tv_sec * 1000000 + response->tv_nsec / 1000;
+	fp->write_pos = (fp->write_pos + 1) % FETCH_PREDICTOR_SAMPLES;
+	if (fp->num < FETCH_PREDICTOR_SAMPLES)
+		fp->num++;
+
+	if (fp->num < FETCH_PREDICTOR_MIN_SAMPLES)
+		return;
+	fp->p99_us = kth_longest(fp, fp->num / 100 + 1);
+}
+
+void fetch_predictor_lead(const struct fetch_predictor *fp,
+			  const struct timespec *max,
+			  struct timespec *lead)
+{
+	lead->tv_sec = fp->p99_us / 1000000;
+	lead->tv_nsec = (fp->p99_us % 1000000) * 1000;
+	if (timespec_after(lead, max))
+		*lead = *max;
+}
@@ -0,0 +1,49 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef FETCH_PREDICTOR_H_
+#define FETCH_PREDICTOR_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/* Number of client responses the predictor keeps. */
+#define FETCH_PREDICTOR_SAMPLES 128
+/* Responses needed before the predictor asks for an early fetch. */
+#define FETCH_PREDICTOR_MIN_SAMPLES 16
+
+/* Model of how long the client of a playback stream takes to answer a
+ * request for samples. The audio thread asks the stream that much ahead of
+ * its callback time, so that slow clients have the samples in shm by the
+ * time the device needs them.
+ * Members:
+ *    response_us - The last responses, from request to data ready, in usec.
+ *    write_pos - Next entry of response_us to fill.
+ *    num - Number of valid entries in response_us.
+ *    p99_us - 99th percentile of response_us, zero until there are
+ *        FETCH_PREDICTOR_MIN_SAMPLES.
+ */
+struct fetch_predictor {
+	uint32_t response_us[FETCH_PREDICTOR_SAMPLES];
+	unsigned int write_pos;
+	unsigned int num;
+	uint32_t p99_us;
+};
+
+/* Adds the time the client took to answer a request and updates p99_us. */
+void fetch_predictor_add(struct fetch_predictor *fp,
+			 const struct timespec *response);
+
+/* Gets how early the next request should be sent.
+ * Args:
+ *    fp - The predictor.
+ *    max - The longest lead allowed.
+ *    lead - Filled with the P99 response time, limited to max.
+ */
+void fetch_predictor_lead(const struct fetch_predictor *fp,
+			  const struct timespec *max,
+			  struct timespec *lead);
+
+#endif /* FETCH_PREDICTOR_H_ */
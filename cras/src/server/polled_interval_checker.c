@@ -11,7 +11,8 @@ struct polled_interval {
     int interval_sec;
 };
 
-static struct timespec now;
+/* Each audio thread updates and checks intervals against its own time. */
+static __thread struct timespec now;
 
 static inline int get_sec_since_last_active(
 	const struct timespec *last_active_ts) {
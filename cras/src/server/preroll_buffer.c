@@ -0,0 +1,94 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "cras_audio_area.h"
+#include "preroll_buffer.h"
+
+struct preroll_buffer *preroll_buffer_create(unsigned int max_frames,
+					     const struct cras_audio_format *fmt)
+{
+	struct preroll_buffer *buf;
+
+	if (max_frames == 0)
+		return NULL;
+
+	buf = (struct preroll_buffer *)calloc(1, sizeof(*buf));
+	if (!buf)
+		return NULL;
+
+	buf->fmt = *fmt;
+	buf->frame_bytes = cras_get_format_bytes(fmt);
+	buf->max_frames = max_frames;
+	buf->bytes = (uint8_t *)calloc(max_frames, buf->frame_bytes);
+	buf->area = cras_audio_area_create(fmt->num_channels);
+	if (!buf->bytes || !buf->area) {
+		preroll_buffer_destroy(&buf);
+		return NULL;
+	}
+	cras_audio_area_config_channels(buf->area, fmt);
+
+	return buf;
+}
+
+void preroll_buffer_destroy(struct preroll_buffer **buf)
+{
+	if (*buf == NULL)
+		return;
+	if ((*buf)->area)
+		cras_audio_area_destroy((*buf)->area);
+	free((*buf)->bytes);
+	free(*buf);
+	*buf = NULL;
+}
+
+void preroll_buffer_write(struct preroll_buffer *buf, const uint8_t *frames,
+			  unsigned int nframes)
+{
+	unsigned int idx, to_write;
+
+	/* Only the newest max_frames frames can be kept. */
+	if (nframes > buf->max_frames) {
+		buf->write_pos += nframes - buf->max_frames;
+		frames += (nframes - buf->max_frames) * buf->frame_bytes;
+		nframes = buf->max_frames;
+	}
+
+	while (nframes) {
+		idx = buf->write_pos % buf->max_frames;
+		to_write = MIN(nframes, buf->max_frames - idx);
+		memcpy(buf->bytes + idx * buf->frame_bytes, frames,
+		       to_write * buf->frame_bytes);
+		frames += to_write * buf->frame_bytes;
+		buf->write_pos += to_write;
+		nframes -= to_write;
+	}
+}
+
+unsigned int preroll_buffer_read_area(struct preroll_buffer *buf,
+				      uint64_t *pos,
+				      struct cras_audio_area **area)
+{
+	unsigned int idx, frames;
+	uint64_t oldest = buf->write_pos - preroll_buffer_queued(buf);
+
+	if (*pos < oldest)
+		*pos = oldest;
+	if (*pos >= buf->write_pos)
+		return 0;
+
+	idx = *pos % buf->max_frames;
+	frames = MIN(buf->write_pos - *pos, buf->max_frames - idx);
+
+	cras_audio_area_config_buf_pointers(buf->area, &buf->fmt,
+					    buf->bytes + idx * buf->frame_bytes);
+	buf->area->frames = frames;
+	*area = buf->area;
+
+	return frames;
+}
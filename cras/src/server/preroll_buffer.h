@@ -0,0 +1,92 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef PREROLL_BUFFER_H_
+#define PREROLL_BUFFER_H_
+
+#include <stdint.h>
+
+#include "cras_audio_format.h"
+
+struct cras_audio_area;
+
+/*
+ * Ring of the most recently captured frames of an input device. Unlike
+ * byte_buffer, writing to a full ring overwrites the oldest frames, so the
+ * ring always holds the latest audio. Frames are addressed by their absolute
+ * position since the ring was created so that readers can detect when the
+ * data they point to has been overwritten.
+ * Members:
+ *    bytes - Interleaved samples in the device format.
+ *    frame_bytes - Number of bytes in a frame.
+ *    max_frames - Capacity of the ring in frames.
+ *    write_pos - Absolute position of the next frame to be written.
+ *    fmt - Format of the frames stored.
+ *    area - Audio area handed to readers, pointing into |bytes|.
+ */
+struct preroll_buffer {
+	uint8_t *bytes;
+	unsigned int frame_bytes;
+	unsigned int max_frames;
+	uint64_t write_pos;
+	struct cras_audio_format fmt;
+	struct cras_audio_area *area;
+};
+
+/*
+ * Creates a pre-roll ring.
+ * Args:
+ *    max_frames - The number of frames the ring keeps.
+ *    fmt - The format of the frames written to the ring.
+ */
+struct preroll_buffer *preroll_buffer_create(unsigned int max_frames,
+					     const struct cras_audio_format *fmt);
+
+/* Destroys a pre-roll ring and sets the pointer to NULL. */
+void preroll_buffer_destroy(struct preroll_buffer **buf);
+
+/*
+ * Appends interleaved frames to the ring, overwriting the oldest frames if
+ * there isn't enough room.
+ * Args:
+ *    buf - The ring to write to.
+ *    frames - Interleaved samples in the format of the ring.
+ *    nframes - Number of frames in |frames|.
+ */
+void preroll_buffer_write(struct preroll_buffer *buf, const uint8_t *frames,
+			  unsigned int nframes);
+
+/*
+ * Gets an audio area to read frames from the ring.
+ * Args:
+ *    buf - The ring to read from.
+ *    pos - Absolute position of the first frame to read. Moved forward to the
+ *        oldest frame still held if the frames it points to were overwritten.
+ *    area - Filled with an area holding the contiguous frames from |pos|.
+ * Returns:
+ *    The number of frames readable from |area|, zero if |pos| has caught up
+ *    with the writer.
+ */
+unsigned int preroll_buffer_read_area(struct preroll_buffer *buf,
+				      uint64_t *pos,
+				      struct cras_audio_area **area);
+
+/* Returns the absolute position of the next frame to be written. */
+static inline uint64_t preroll_buffer_write_pos(
+		const struct preroll_buffer *buf)
+{
+	return buf->write_pos;
+}
+
+/* Returns the number of frames currently held in the ring. */
+static inline unsigned int preroll_buffer_queued(
+		const struct preroll_buffer *buf)
+{
+	if (buf->write_pos < buf->max_frames)
+		return buf->write_pos;
+	return buf->max_frames;
+}
+
+#endif /* PREROLL_BUFFER_H_ */
@@ -0,0 +1,98 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "cras_util.h"
+#include "wake_predictor.h"
+
+/* Weight of a new error in the smoothed correction. */
+static const double CORRECTION_SMOOTH_FACTOR = 0.125;
+
+/* Predictions older than this are dropped, the rate may have changed. */
+static const struct timespec max_prediction_ts = {
+	1, 0 /* 1 sec. */
+};
+
+/* Upper bounds in usec of the histogram buckets, the last one is open. */
+static const int err_hist_bounds_us[CRAS_WAKE_ERR_HIST_BUCKETS - 1] = {
+	-1000, -250, -50, 50, 250, 1000
+};
+
+static void add_to_hist(struct wake_predictor *wp, double err_us)
+{
+	unsigned int i;
+
+	for (i = 0; i < CRAS_WAKE_ERR_HIST_BUCKETS - 1; i++)
+		if (err_us < err_hist_bounds_us[i])
+			break;
+	wp->err_hist[i]++;
+}
+
+void wake_predictor_start(struct wake_predictor *wp, unsigned int level,
+			  const struct timespec *tstamp, double rate)
+{
+	wp->tstamp = *tstamp;
+	wp->level = level;
+	wp->rate = rate;
+}
+
+void wake_predictor_cancel(struct wake_predictor *wp)
+{
+	wp->tstamp.tv_sec = 0;
+	wp->tstamp.tv_nsec = 0;
+}
+
+void wake_predictor_reset(struct wake_predictor *wp)
+{
+	wake_predictor_cancel(wp);
+	wp->correction = 0;
+}
+
+int wake_predictor_check(struct wake_predictor *wp, unsigned int level,
+			 const struct timespec *tstamp, int *err)
+{
+	struct timespec elapsed;
+	double predicted;
+
+	if (!timespec_is_nonzero(&wp->tstamp))
+		return 0;
+
+	/* Nothing to learn if the hardware pointer hasn't moved, if the
+	 * device ran dry or if the prediction is stale. */
+	if (level == 0 || !timespec_after(tstamp, &wp->tstamp)) {
+		wake_predictor_cancel(wp);
+		return 0;
+	}
+	subtract_timespecs(tstamp, &wp->tstamp, &elapsed);
+	wake_predictor_cancel(wp);
+	if (timespec_after(&elapsed, &max_prediction_ts))
+		return 0;
+
+	predicted = wp->level - wp->rate * (elapsed.tv_sec +
+					    elapsed.tv_nsec / 1000000000.0);
+	*err = (int)lround(level - predicted);
+
+	wp->correction += (*err - wp->correction) * CORRECTION_SMOOTH_FACTOR;
+	add_to_hist(wp, *err * 1000000.0 / wp->rate);
+	return 1;
+}
+
+unsigned int wake_predictor_adjust(const struct wake_predictor *wp,
+				   unsigned int frames, unsigned int hw_level,
+				   unsigned int rate)
+{
+	int max_adjust = rate / 2000;
+	int adjust = (int)lround(wp->correction);
+	int adjusted;
+
+	adjust = MIN(MAX(adjust, -max_adjust), max_adjust);
+	adjusted = (int)frames + adjust;
+	if (adjusted < 0)
+		return 0;
+	return MIN((unsigned int)adjusted, hw_level);
+}
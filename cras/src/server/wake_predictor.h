@@ -0,0 +1,79 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef WAKE_PREDICTOR_H_
+#define WAKE_PREDICTOR_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "cras_types.h"
+
+/* Feedback on the wake up time predicted for an output device. When the
+ * audio thread schedules a wake up it assumes the device drains at the
+ * estimated rate from the level it just read. On the next write the level
+ * the hardware reports is compared with that assumption, and the smoothed
+ * error is used to correct the following predictions.
+ * Members:
+ *    tstamp - Time of the level the pending prediction starts from, zero if
+ *        no prediction is pending.
+ *    level - Frames queued at tstamp.
+ *    rate - Frame rate the pending prediction assumes.
+ *    correction - Smoothed prediction error in frames, positive when the
+ *        device drains slower than predicted.
+ *    err_hist - Number of prediction errors in each bucket, bounded by
+ *        +-50, +-250 and +-1000 usec. Bucket 0 counts the devices that
+ *        drained the fastest.
+ */
+struct wake_predictor {
+	struct timespec tstamp;
+	unsigned int level;
+	double rate;
+	double correction;
+	uint32_t err_hist[CRAS_WAKE_ERR_HIST_BUCKETS];
+};
+
+/* Starts a prediction. The device is expected to drain at rate from level
+ * frames queued at tstamp until it is next checked. */
+void wake_predictor_start(struct wake_predictor *wp, unsigned int level,
+			  const struct timespec *tstamp, double rate);
+
+/* Drops the pending prediction, used when frames are queued to the device
+ * in a way the prediction doesn't account for. */
+void wake_predictor_cancel(struct wake_predictor *wp);
+
+/* Drops the pending prediction and the correction learned so far, used when
+ * the device is serviced at a different level. The histogram is kept. */
+void wake_predictor_reset(struct wake_predictor *wp);
+
+/* Compares the level read from the device with the pending prediction and
+ * updates the correction and histogram.
+ * Args:
+ *    wp - The predictor.
+ *    level - Frames queued at tstamp, before writing to the device.
+ *    tstamp - Time the level was read by the hardware.
+ *    err - Filled with the prediction error in frames.
+ * Returns:
+ *    1 if a prediction was checked, 0 if there was none or the level can't
+ *    be compared, e.g. after an underrun.
+ */
+int wake_predictor_check(struct wake_predictor *wp, unsigned int level,
+			 const struct timespec *tstamp, int *err);
+
+/* Corrects the number of frames the device is expected to play before the
+ * audio thread must wake up. The correction is limited to half a
+ * millisecond so that most of the safety margin left by the caller is kept,
+ * and never lets the thread sleep past hw_level.
+ * Args:
+ *    wp - The predictor.
+ *    frames - Frames to play in sleep as computed from the estimated rate.
+ *    hw_level - Frames queued in the device.
+ *    rate - Frame rate of the device.
+ */
+unsigned int wake_predictor_adjust(const struct wake_predictor *wp,
+				   unsigned int frames, unsigned int hw_level,
+				   unsigned int rate);
+
+#endif /* WAKE_PREDICTOR_H_ */
@@ -2,6 +2,8 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <errno.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/socket.h>
@@ -31,6 +33,7 @@ static struct cras_audio_codec *sbc_codec;
 static int cras_sbc_codec_create_fail;
 static struct a2dp_info a2dp;
 static a2dp_sbc_t sbc;
+static int cras_sbc_set_bitpool_val;
 
 void ResetStubData() {
   cras_sbc_codec_create_called = 0;
@@ -56,7 +59,9 @@ void ResetStubData() {
   sbc.allocation_method = SBC_ALLOCATION_LOUDNESS;
   sbc.subbands = SBC_SUBBANDS_8;
   sbc.block_length = SBC_BLOCK_LENGTH_16;
+  sbc.min_bitpool = 2;
   sbc.max_bitpool = 50;
+  cras_sbc_set_bitpool_val = 0;
 
   a2dp.a2dp_buf_used = 0;
   a2dp.frame_count = 0;
@@ -151,6 +156,148 @@ TEST(A2dpEncode, WriteA2dp) {
   ASSERT_EQ(0, a2dp.seq_num);
 }
 
+TEST(A2dpEncode, TakePacket) {
+  uint8_t packet[A2DP_BUF_SIZE_BYTES];
+  size_t packet_len = 0;
+
+  ResetStubData();
+  init_a2dp(&a2dp, &sbc);
+
+  encode_out_encoded_return_val = 4;
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+
+  // Room for another SBC frame, nothing to take yet.
+  ASSERT_EQ(0, a2dp_take_packet(&a2dp, 40, packet, &packet_len));
+  ASSERT_EQ(17, a2dp.a2dp_buf_used);
+
+  encode_out_encoded_return_val = 15;
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+
+  ASSERT_EQ(10, a2dp_take_packet(&a2dp, 40, packet, &packet_len));
+  EXPECT_EQ(32, packet_len);
+  // RTP version 2 and the SBC frame count in the payload header.
+  EXPECT_EQ(0x80, packet[0]);
+  EXPECT_EQ(8, packet[12] & 0x0f);
+
+  EXPECT_EQ(13, a2dp.a2dp_buf_used);
+  EXPECT_EQ(0, a2dp.frame_count);
+  EXPECT_EQ(0, a2dp.samples);
+  EXPECT_EQ(1, a2dp.seq_num);
+
+  destroy_a2dp(&a2dp);
+}
+
+TEST(A2dpEncode, SetBitpool) {
+  uint8_t packet[A2DP_BUF_SIZE_BYTES];
+  size_t packet_len;
+
+  ResetStubData();
+  init_a2dp(&a2dp, &sbc);
+  ASSERT_EQ(50, a2dp.bitpool);
+
+  // Requests are clamped to the negotiated range.
+  EXPECT_EQ(50, a2dp_set_bitpool(&a2dp, 60));
+  EXPECT_EQ(2, a2dp_set_bitpool(&a2dp, 1));
+
+  // The new bitpool is used from the next SBC frame of an empty packet.
+  EXPECT_EQ(30, a2dp_set_bitpool(&a2dp, 30));
+  EXPECT_EQ(50, a2dp.bitpool);
+  encode_out_encoded_return_val = 4;
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+  EXPECT_EQ(30, a2dp.bitpool);
+  EXPECT_EQ(30, cras_sbc_set_bitpool_val);
+  EXPECT_EQ(30 / 2, a2dp.frame_length);
+
+  // Not in the middle of a packet.
+  a2dp_set_bitpool(&a2dp, 20);
+  encode_out_encoded_return_val = 15;
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+  EXPECT_EQ(30, a2dp.bitpool);
+
+  ASSERT_EQ(10, a2dp_take_packet(&a2dp, 40, packet, &packet_len));
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+  EXPECT_EQ(20, a2dp.bitpool);
+  EXPECT_EQ(20, cras_sbc_set_bitpool_val);
+
+  destroy_a2dp(&a2dp);
+}
+
+TEST(A2dpEncode, QueueAndSendPackets) {
+  uint8_t buf[A2DP_BUF_SIZE_BYTES];
+  int sock[2];
+  int i;
+
+  ResetStubData();
+  init_a2dp(&a2dp, &sbc);
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  // Each encode fills a packet, which is queued to encode the next one.
+  encode_out_encoded_return_val = 15;
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+  ASSERT_EQ(5, a2dp_queue_packet(&a2dp, 40));
+  EXPECT_EQ(13, a2dp.a2dp_buf_used);
+  EXPECT_EQ(5, a2dp_queued_frames(&a2dp));
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+  EXPECT_EQ(10, a2dp_queued_frames(&a2dp));
+
+  // The second packet would take the frames sent above max_frames.
+  EXPECT_EQ(5, a2dp_write(&a2dp, sock[0], 40, 7));
+  EXPECT_EQ(5, a2dp_queued_frames(&a2dp));
+
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+  EXPECT_EQ(10, a2dp_write(&a2dp, sock[0], 40, UINT_MAX));
+  EXPECT_EQ(0, a2dp_queued_frames(&a2dp));
+  EXPECT_EQ(0, a2dp_write(&a2dp, sock[0], 40, UINT_MAX));
+
+  // Packets are sent in order.
+  for (i = 0; i < 3; i++) {
+    ASSERT_EQ(28, recv(sock[1], buf, sizeof(buf), MSG_DONTWAIT));
+    EXPECT_EQ(i, buf[3]);
+  }
+
+  // No more than A2DP_NUM_QUEUED_PACKETS wait to be sent.
+  for (i = 0; i < A2DP_NUM_QUEUED_PACKETS; i++) {
+    a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+    ASSERT_EQ(5, a2dp_queue_packet(&a2dp, 40));
+  }
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+  EXPECT_EQ(0, a2dp_queue_packet(&a2dp, 40));
+  EXPECT_EQ(25, a2dp_queued_frames(&a2dp));
+
+  a2dp_drain(&a2dp);
+  EXPECT_EQ(0, a2dp_queued_frames(&a2dp));
+
+  close(sock[0]);
+  close(sock[1]);
+  destroy_a2dp(&a2dp);
+}
+
+TEST(A2dpEncode, WriteSocketFull) {
+  uint8_t junk[28] = { 0 };
+  uint8_t buf[A2DP_BUF_SIZE_BYTES];
+  int sock[2];
+
+  ResetStubData();
+  init_a2dp(&a2dp, &sbc);
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+  while (send(sock[0], junk, sizeof(junk), MSG_DONTWAIT) > 0)
+    ;
+
+  // The packet stays queued until the socket drains.
+  encode_out_encoded_return_val = 15;
+  a2dp_encode(&a2dp, NULL, 20, 4, (size_t)40);
+  EXPECT_EQ(-EAGAIN, a2dp_write(&a2dp, sock[0], 40, UINT_MAX));
+  EXPECT_EQ(5, a2dp_queued_frames(&a2dp));
+
+  while (recv(sock[1], buf, sizeof(buf), MSG_DONTWAIT) > 0)
+    ;
+  EXPECT_EQ(5, a2dp_write(&a2dp, sock[0], 40, UINT_MAX));
+
+  close(sock[0]);
+  close(sock[1]);
+  destroy_a2dp(&a2dp);
+}
+
 } // namespace
 
 int main(int argc, char **argv) {
@@ -209,3 +356,9 @@ int cras_sbc_get_frame_length(struct cras_audio_codec *codec)
 {
   return cras_sbc_get_frame_length_val;
 }
+
+int cras_sbc_set_bitpool(struct cras_audio_codec *codec, uint8_t bitpool)
+{
+  cras_sbc_set_bitpool_val = bitpool;
+  return bitpool / 2;
+}
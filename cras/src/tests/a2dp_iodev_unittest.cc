@@ -2,8 +2,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <linux/sockios.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 extern "C" {
@@ -16,6 +23,7 @@ extern "C" {
 #include "cras_iodev.h"
 
 #include "cras_a2dp_iodev.h"
+#include "cras_a2dp_rate_ctrl.h"
 }
 
 #define FAKE_OBJECT_PATH "/fake/obj/path"
@@ -45,13 +53,37 @@ static int pcm_buf_size_val[MAX_A2DP_ENCODE_CALLS];
 static unsigned int a2dp_encode_processed_bytes_val[MAX_A2DP_ENCODE_CALLS];
 static unsigned int a2dp_encode_index;
 static int a2dp_write_return_val[MAX_A2DP_WRITE_CALLS];
+static unsigned int a2dp_write_max_frames[MAX_A2DP_WRITE_CALLS];
 static unsigned int a2dp_write_index;
+static int a2dp_queue_packet_return_val[MAX_A2DP_ENCODE_CALLS];
+static unsigned int a2dp_queue_packet_index;
+static int getsockopt_sndbuf_val;
+static int ioctl_outq_val;
 static cras_audio_area *dummy_audio_area;
 static thread_callback write_callback;
 static void *write_callback_data;
 static const char *fake_device_name = "fake device name";
 static const char *cras_bt_device_name_ret;
 static unsigned int cras_bt_transport_write_mtu_ret;
+static int cras_system_get_a2dp_encoder_worker_ret;
+static struct a2dp_encoder *fake_encoder =
+    reinterpret_cast<struct a2dp_encoder *>(0x456);
+static uint8_t encoder_pcm[4096];
+static size_t a2dp_encoder_create_called;
+static unsigned int a2dp_encoder_create_pcm_bytes;
+static int a2dp_codesize_ret;
+static size_t a2dp_encoder_destroy_called;
+static unsigned int a2dp_encoder_pcm_commit_val;
+static unsigned int a2dp_encoder_queued_frames_val;
+static int a2dp_encoder_send_return_val;
+static unsigned int a2dp_encoder_send_min_frames;
+static thread_callback ready_callback;
+static int cras_system_get_a2dp_adaptive_rate_ret;
+static size_t a2dp_rate_ctrl_init_called;
+static unsigned int a2dp_rate_ctrl_frames_due_ret;
+static int a2dp_rate_ctrl_update_written;
+static int a2dp_rate_ctrl_update_ret;
+static int a2dp_set_bitpool_val;
 
 void ResetStubData() {
   cras_bt_device_append_iodev_called = 0;
@@ -74,7 +106,28 @@ void ResetStubData() {
          sizeof(a2dp_encode_processed_bytes_val));
   a2dp_encode_index = 0;
   a2dp_write_index = 0;
+  memset(a2dp_queue_packet_return_val, 0,
+         sizeof(a2dp_queue_packet_return_val));
+  a2dp_queue_packet_index = 0;
+  getsockopt_sndbuf_val = 0;
+  ioctl_outq_val = 0;
   cras_bt_transport_write_mtu_ret = 800;
+  cras_system_get_a2dp_encoder_worker_ret = 0;
+  a2dp_encoder_create_called = 0;
+  a2dp_encoder_create_pcm_bytes = 0;
+  a2dp_codesize_ret = 512;
+  a2dp_encoder_destroy_called = 0;
+  a2dp_encoder_pcm_commit_val = 0;
+  a2dp_encoder_queued_frames_val = 0;
+  a2dp_encoder_send_return_val = 0;
+  a2dp_encoder_send_min_frames = 0;
+  ready_callback = NULL;
+  cras_system_get_a2dp_adaptive_rate_ret = 0;
+  a2dp_rate_ctrl_init_called = 0;
+  a2dp_rate_ctrl_frames_due_ret = 0;
+  a2dp_rate_ctrl_update_written = 0;
+  a2dp_rate_ctrl_update_ret = 0;
+  a2dp_set_bitpool_val = 0;
 
   fake_transport = reinterpret_cast<struct cras_bt_transport *>(0x123);
 
@@ -244,6 +297,176 @@ TEST_F(A2dpIodev, GetPutBuffer) {
   a2dp_iodev_destroy(iodev);
 }
 
+TEST_F(A2dpIodev, EncoderWorker) {
+  struct cras_iodev *iodev;
+  struct cras_audio_area *area;
+  struct timespec tstamp;
+  unsigned frames, encode_calls;
+
+  cras_system_get_a2dp_encoder_worker_ret = 1;
+  iodev = a2dp_iodev_create(fake_transport);
+
+  iodev_set_format(iodev, &format);
+  time_now.tv_sec = 0;
+  time_now.tv_nsec = 0;
+  iodev->configure_dev(iodev);
+  ASSERT_EQ(1, a2dp_encoder_create_called);
+  ASSERT_NE(ready_callback, (void *)NULL);
+  ASSERT_NE(write_callback, (void *)NULL);
+
+  /* The socket is pre-filled before the worker takes over the a2dp state. */
+  EXPECT_EQ(1, drain_a2dp_called);
+  encode_calls = a2dp_encode_index;
+
+  frames = 4096;
+  iodev->get_buffer(iodev, &area, &frames);
+  EXPECT_EQ(1024, frames);
+  EXPECT_EQ(encoder_pcm, area->channels[0].buf);
+
+  /* Putting samples hands them to the worker and sends what it queued. */
+  a2dp_encoder_send_return_val = 128;
+  iodev->put_buffer(iodev, 100);
+  EXPECT_EQ(400, a2dp_encoder_pcm_commit_val);
+  EXPECT_EQ(iodev->min_buffer_level, a2dp_encoder_send_min_frames);
+  EXPECT_EQ(encode_calls, a2dp_encode_index);
+
+  a2dp_encoder_queued_frames_val = 300;
+  EXPECT_EQ(300, iodev->frames_queued(iodev, &tstamp));
+
+  iodev->close_dev(iodev);
+  EXPECT_EQ(1, a2dp_encoder_destroy_called);
+  a2dp_iodev_destroy(iodev);
+}
+
+TEST_F(A2dpIodev, EncoderRingHoldsWholeCodesizeBlocks) {
+  struct cras_iodev *iodev;
+
+  cras_system_get_a2dp_encoder_worker_ret = 1;
+  iodev = a2dp_iodev_create(fake_transport);
+  iodev_set_format(iodev, &format);
+
+  // 12 blocks, 8 subbands, stereo. 65536 isn't a multiple of it, the ring
+  // is cut to 170 whole blocks so the worker never meets a partial one.
+  a2dp_codesize_ret = 384;
+  iodev->configure_dev(iodev);
+  ASSERT_EQ(1, a2dp_encoder_create_called);
+  EXPECT_EQ(65280, a2dp_encoder_create_pcm_bytes);
+  EXPECT_EQ(65280 / 4, iodev->buffer_size);
+  iodev->close_dev(iodev);
+
+  a2dp_codesize_ret = 512;
+  iodev->configure_dev(iodev);
+  EXPECT_EQ(65536, a2dp_encoder_create_pcm_bytes);
+  EXPECT_EQ(16384, iodev->buffer_size);
+  iodev->close_dev(iodev);
+  a2dp_iodev_destroy(iodev);
+}
+
+TEST_F(A2dpIodev, AdaptiveRate) {
+  struct cras_iodev *iodev;
+  struct cras_audio_area *area;
+  unsigned frames;
+
+  cras_system_get_a2dp_adaptive_rate_ret = 1;
+  iodev = a2dp_iodev_create(fake_transport);
+
+  iodev_set_format(iodev, &format);
+  iodev->configure_dev(iodev);
+  frames = 256;
+  iodev->get_buffer(iodev, &area, &frames);
+
+  /* The controller starts once the socket is pre-filled. */
+  a2dp_rate_ctrl_update_ret = 53;
+  a2dp_queued_frames_val = 200;
+  a2dp_rate_ctrl_frames_due_ret = 100;
+  a2dp_write_index = 0;
+  a2dp_write_return_val[0] = 0;
+  iodev->put_buffer(iodev, 100);
+  EXPECT_EQ(1, a2dp_rate_ctrl_init_called);
+  EXPECT_EQ(53, a2dp_set_bitpool_val);
+
+  /* Packets are only sent as they are due. */
+  EXPECT_EQ(1, a2dp_write_index);
+  EXPECT_EQ(100, a2dp_write_max_frames[0]);
+  EXPECT_EQ(0, a2dp_rate_ctrl_update_written);
+
+  /* Congestion reported by a write lowers the bitpool. */
+  a2dp_rate_ctrl_frames_due_ret = 300;
+  a2dp_rate_ctrl_update_ret = 49;
+  a2dp_write_return_val[1] = -EAGAIN;
+  write_callback(write_callback_data);
+  EXPECT_EQ(2, a2dp_write_index);
+  EXPECT_EQ(300, a2dp_write_max_frames[1]);
+  EXPECT_EQ(-EAGAIN, a2dp_rate_ctrl_update_written);
+  EXPECT_EQ(49, a2dp_set_bitpool_val);
+
+  iodev->close_dev(iodev);
+  a2dp_iodev_destroy(iodev);
+}
+
+TEST_F(A2dpIodev, BatchPackets) {
+  struct cras_iodev *iodev;
+  struct cras_audio_area *area;
+  unsigned frames;
+
+  iodev = a2dp_iodev_create(fake_transport);
+
+  iodev_set_format(iodev, &format);
+  iodev->configure_dev(iodev);
+  frames = 2000;
+  iodev->get_buffer(iodev, &area, &frames);
+  ASSERT_EQ(2000, frames);
+
+  /* Nothing to pre-fill. Then each full packet is queued and encoding goes
+   * on with the next one, both are sent together. */
+  a2dp_encode_processed_bytes_val[0] = 0;
+  a2dp_encode_processed_bytes_val[1] = 800;
+  a2dp_encode_processed_bytes_val[3] = 800;
+  a2dp_queue_packet_return_val[0] = 200;
+  a2dp_queue_packet_return_val[1] = 200;
+  a2dp_write_index = 0;
+  a2dp_write_return_val[0] = 400;
+  a2dp_write_return_val[1] = -EAGAIN;
+  iodev->put_buffer(iodev, 2000);
+
+  EXPECT_EQ(8000, pcm_buf_size_val[1]);
+  EXPECT_EQ(7200, pcm_buf_size_val[3]);
+  EXPECT_EQ(UINT_MAX, a2dp_write_max_frames[0]);
+  EXPECT_EQ(2, a2dp_write_index);
+
+  iodev->close_dev(iodev);
+  a2dp_iodev_destroy(iodev);
+}
+
+TEST_F(A2dpIodev, DelayCountsSocketQueue) {
+  struct cras_iodev *iodev;
+  struct timespec tstamp;
+
+  iodev = a2dp_iodev_create(fake_transport);
+
+  /* Without the send buffer size, the socket is assumed full. */
+  iodev_set_format(iodev, &format);
+  time_now.tv_sec = 0;
+  time_now.tv_nsec = 0;
+  iodev->configure_dev(iodev);
+  a2dp_queued_frames_val = 50;
+  EXPECT_EQ(50, iodev->frames_queued(iodev, &tstamp));
+  EXPECT_EQ(450, iodev->delay_frames(iodev));
+  iodev->close_dev(iodev);
+
+  /* Bluetooth sockets report the free space. Half of the send buffer
+   * holds half the socket depth of 400 frames. */
+  getsockopt_sndbuf_val = 3200;
+  ioctl_outq_val = 1600;
+  iodev_set_format(iodev, &format);
+  iodev->configure_dev(iodev);
+  EXPECT_EQ(250, iodev->frames_queued(iodev, &tstamp));
+  EXPECT_EQ(250, iodev->delay_frames(iodev));
+
+  iodev->close_dev(iodev);
+  a2dp_iodev_destroy(iodev);
+}
+
 TEST_F(A2dpIodev, FramesQueued) {
   struct cras_iodev *iodev;
   struct cras_audio_area *area;
@@ -509,7 +732,7 @@ void destroy_a2dp(struct a2dp_info *a2dp)
 
 int a2dp_codesize(struct a2dp_info *a2dp)
 {
-  return 512;
+  return a2dp_codesize_ret;
 }
 
 int a2dp_block_size(struct a2dp_info *a2dp, int encoded_bytes)
@@ -542,10 +765,48 @@ int a2dp_encode(struct a2dp_info *a2dp, const void *pcm_buf, int pcm_buf_size,
   return processed;
 }
 
-int a2dp_write(struct a2dp_info *a2dp, int stream_fd, size_t link_mtu) {
+int a2dp_queue_packet(struct a2dp_info *a2dp, size_t link_mtu) {
+  if (a2dp_queue_packet_index == MAX_A2DP_ENCODE_CALLS)
+    return 0;
+  return a2dp_queue_packet_return_val[a2dp_queue_packet_index++];
+}
+
+int a2dp_write(struct a2dp_info *a2dp, int stream_fd, size_t link_mtu,
+               unsigned int max_frames) {
+  a2dp_write_max_frames[a2dp_write_index] = max_frames;
   return a2dp_write_return_val[a2dp_write_index++];;
 }
 
+// The transport fd is 0, other calls go to the kernel.
+int getsockopt(int fd, int level, int optname, void *optval,
+               socklen_t *optlen) {
+  if (fd != 0)
+    return syscall(SYS_getsockopt, fd, level, optname, optval, optlen);
+  if (getsockopt_sndbuf_val <= 0) {
+    errno = ENOTSOCK;
+    return -1;
+  }
+  *(int *)optval = getsockopt_sndbuf_val;
+  return 0;
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+  va_list ap;
+  void *arg;
+
+  va_start(ap, request);
+  arg = va_arg(ap, void *);
+  va_end(ap);
+  if (fd != 0)
+    return syscall(SYS_ioctl, fd, request, arg);
+  if (request != SIOCOUTQ) {
+    errno = ENOTTY;
+    return -1;
+  }
+  *(int *)arg = ioctl_outq_val;
+  return 0;
+}
+
 int clock_gettime(clockid_t clk_id, struct timespec *tp) {
   *tp = time_now;
   return 0;
@@ -573,6 +834,10 @@ struct audio_thread *cras_iodev_list_get_audio_thread()
 // From audio_thread
 struct audio_thread_event_log *atlog;
 
+void audio_thread_add_callback(int fd, thread_callback cb, void *data) {
+  ready_callback = cb;
+}
+
 void audio_thread_add_write_callback(int fd, thread_callback cb, void *data) {
   write_callback = cb;
   write_callback_data = data;
@@ -585,4 +850,94 @@ int audio_thread_rm_callback_sync(struct audio_thread *thread, int fd) {
 void audio_thread_enable_callback(int fd, int enabled) {
 }
 
+
+// From cras_system_state
+int cras_system_get_a2dp_encoder_worker()
+{
+  return cras_system_get_a2dp_encoder_worker_ret;
+}
+
+// From cras_a2dp_encoder
+struct a2dp_encoder *a2dp_encoder_create(struct a2dp_info *a2dp,
+                                         unsigned int format_bytes,
+                                         size_t link_mtu,
+                                         unsigned int pcm_bytes)
+{
+  a2dp_encoder_create_called++;
+  a2dp_encoder_create_pcm_bytes = pcm_bytes;
+  return fake_encoder;
+}
+
+void a2dp_encoder_destroy(struct a2dp_encoder **enc)
+{
+  a2dp_encoder_destroy_called++;
+  *enc = NULL;
+}
+
+int a2dp_encoder_ready_fd(const struct a2dp_encoder *enc)
+{
+  return 7;
+}
+
+uint8_t *a2dp_encoder_pcm_write_pointer(struct a2dp_encoder *enc,
+                                        unsigned int *writable)
+{
+  *writable = sizeof(encoder_pcm);
+  return encoder_pcm;
+}
+
+int a2dp_encoder_pcm_commit(struct a2dp_encoder *enc, unsigned int nbytes)
+{
+  a2dp_encoder_pcm_commit_val = nbytes;
+  return 0;
+}
+
+unsigned int a2dp_encoder_queued_frames(const struct a2dp_encoder *enc)
+{
+  return a2dp_encoder_queued_frames_val;
+}
+
+int a2dp_encoder_send(struct a2dp_encoder *enc, int fd,
+                      unsigned int min_frames, unsigned int max_frames)
+{
+  a2dp_encoder_send_min_frames = min_frames;
+  return a2dp_encoder_send_return_val;
+}
+
+
+int cras_system_get_a2dp_adaptive_rate()
+{
+  return cras_system_get_a2dp_adaptive_rate_ret;
+}
+
+int a2dp_set_bitpool(struct a2dp_info *a2dp, int bitpool)
+{
+  a2dp_set_bitpool_val = bitpool;
+  return bitpool;
+}
+
+// From cras_a2dp_rate_ctrl
+void a2dp_rate_ctrl_init(struct a2dp_rate_ctrl *ctrl, unsigned int rate,
+                         unsigned int pace_window, int min_bitpool,
+                         int max_bitpool, size_t congested_bytes,
+                         const struct timespec *now)
+{
+  a2dp_rate_ctrl_init_called++;
+  ctrl->bitpool = max_bitpool;
+}
+
+unsigned int a2dp_rate_ctrl_frames_due(const struct a2dp_rate_ctrl *ctrl,
+                                       const struct timespec *now)
+{
+  return a2dp_rate_ctrl_frames_due_ret;
+}
+
+int a2dp_rate_ctrl_update(struct a2dp_rate_ctrl *ctrl,
+                          const struct timespec *now, int written,
+                          size_t queued_bytes)
+{
+  a2dp_rate_ctrl_update_written = written;
+  return a2dp_rate_ctrl_update_ret;
+}
+
 }
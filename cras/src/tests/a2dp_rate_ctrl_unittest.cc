@@ -0,0 +1,296 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "cras_a2dp_rate_ctrl.h"
+}
+
+namespace {
+
+static void AddMs(struct timespec *ts, unsigned int ms) {
+  ts->tv_nsec += (long)(ms % 1000) * 1000000;
+  ts->tv_sec += ms / 1000 + ts->tv_nsec / 1000000000;
+  ts->tv_nsec %= 1000000000;
+}
+
+class A2dpRateCtrlTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      now_.tv_sec = 100;
+      now_.tv_nsec = 0;
+      a2dp_rate_ctrl_init(&ctrl_, 48000, 256, 2, 53, 2000, &now_);
+    }
+
+    struct a2dp_rate_ctrl ctrl_;
+    struct timespec now_;
+};
+
+TEST_F(A2dpRateCtrlTestSuite, StartAtMaxBitpool) {
+  EXPECT_EQ(53, ctrl_.bitpool);
+  EXPECT_EQ(53, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 0));
+}
+
+TEST_F(A2dpRateCtrlTestSuite, FramesDue) {
+  // Only the pacing window can be sent right away.
+  EXPECT_EQ(256, a2dp_rate_ctrl_frames_due(&ctrl_, &now_));
+  a2dp_rate_ctrl_update(&ctrl_, &now_, 200, 0);
+  EXPECT_EQ(56, a2dp_rate_ctrl_frames_due(&ctrl_, &now_));
+  a2dp_rate_ctrl_update(&ctrl_, &now_, 100, 0);
+  EXPECT_EQ(0, a2dp_rate_ctrl_frames_due(&ctrl_, &now_));
+
+  // Then as fast as the frames are played.
+  AddMs(&now_, 10);
+  EXPECT_EQ(436, a2dp_rate_ctrl_frames_due(&ctrl_, &now_));
+}
+
+TEST_F(A2dpRateCtrlTestSuite, EagainLowersBitpool) {
+  EXPECT_EQ(53, a2dp_rate_ctrl_update(&ctrl_, &now_, -EAGAIN, 0));
+
+  AddMs(&now_, 200);
+  EXPECT_EQ(49, a2dp_rate_ctrl_update(&ctrl_, &now_, -EAGAIN, 0));
+
+  // The last change needs time to take effect.
+  AddMs(&now_, 100);
+  EXPECT_EQ(49, a2dp_rate_ctrl_update(&ctrl_, &now_, -EAGAIN, 0));
+  AddMs(&now_, 100);
+  EXPECT_EQ(45, a2dp_rate_ctrl_update(&ctrl_, &now_, -EAGAIN, 0));
+  EXPECT_EQ(4, ctrl_.num_eagain);
+  EXPECT_EQ(2, ctrl_.num_decreases);
+
+  // Not below the negotiated minimum.
+  for (int i = 0; i < 20; i++) {
+    AddMs(&now_, 200);
+    a2dp_rate_ctrl_update(&ctrl_, &now_, -EAGAIN, 0);
+  }
+  EXPECT_EQ(2, ctrl_.bitpool);
+}
+
+TEST_F(A2dpRateCtrlTestSuite, QueueDepthMustPersist) {
+  AddMs(&now_, 1000);
+  EXPECT_EQ(53, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 3000));
+
+  // A burst which drains doesn't count.
+  AddMs(&now_, 100);
+  EXPECT_EQ(53, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 1000));
+  AddMs(&now_, 100);
+  EXPECT_EQ(53, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 3000));
+
+  // A queue staying high does.
+  AddMs(&now_, 100);
+  EXPECT_EQ(53, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 3000));
+  AddMs(&now_, 100);
+  EXPECT_EQ(49, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 3000));
+}
+
+TEST_F(A2dpRateCtrlTestSuite, RaiseAfterClearLink) {
+  AddMs(&now_, 200);
+  ASSERT_EQ(49, a2dp_rate_ctrl_update(&ctrl_, &now_, -EAGAIN, 0));
+
+  AddMs(&now_, 2900);
+  EXPECT_EQ(49, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 0));
+  AddMs(&now_, 100);
+  EXPECT_EQ(51, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 0));
+  EXPECT_EQ(1, ctrl_.num_increases);
+
+  // Slowly, and not above the negotiated maximum.
+  AddMs(&now_, 100);
+  EXPECT_EQ(51, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 0));
+  AddMs(&now_, 3000);
+  EXPECT_EQ(53, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 0));
+  AddMs(&now_, 3000);
+  EXPECT_EQ(53, a2dp_rate_ctrl_update(&ctrl_, &now_, 128, 0));
+}
+
+// Simulated link: a socketpair stands in for the L2CAP socket, and a reader
+// throttled to the link throughput feeds a sink playing in real time. Time
+// is simulated in ticks so the results don't depend on the machine.
+#define SIM_RATE 48000
+#define SIM_TICK_MS 5
+#define SIM_TICK_FRAMES (SIM_RATE * SIM_TICK_MS / 1000)
+#define SIM_MTU 895
+#define SIM_MAX_BITPOOL 53
+#define SBC_FRAME_PCM_FRAMES 128
+#define RTP_HEADER_BYTES 13
+
+struct SimPhase {
+  unsigned int duration_ms;
+  unsigned int link_bytes_per_sec;
+};
+
+struct SimResult {
+  unsigned int underruns;
+  double avg_latency_ms;
+  unsigned int max_latency_ms;
+  int final_bitpool;
+};
+
+// Length of a joint stereo, 8 subbands, 16 blocks SBC frame.
+static unsigned int SbcFrameLength(int bitpool) {
+  return 4 + 8 + (8 + 16 * bitpool + 7) / 8;
+}
+
+static unsigned int SbcFramesPerPacket(int bitpool) {
+  return (SIM_MTU - RTP_HEADER_BYTES) / SbcFrameLength(bitpool);
+}
+
+static SimResult RunSimulatedLink(bool adaptive, const SimPhase *phases,
+                                  unsigned int num_phases) {
+  struct a2dp_rate_ctrl ctrl;
+  struct timespec now = {100, 0};
+  SimResult result = {0, 0, 0, SIM_MAX_BITPOOL};
+  uint8_t packet[SIM_MTU];
+  int sock[2];
+  int sndbuf = 4 * SIM_MTU;
+  socklen_t optlen = sizeof(sndbuf);
+  uint64_t latency_sum = 0, ticks = 0;
+  unsigned int pending = 0, in_socket = 0, sink_buffered = 0;
+  unsigned int link_budget = 0, latency_ms;
+  int bitpool = SIM_MAX_BITPOOL;
+  bool sink_started = false;
+
+  memset(packet, 0, sizeof(packet));
+  EXPECT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+  setsockopt(sock[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+  getsockopt(sock[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen);
+  fcntl(sock[0], F_SETFL, O_NONBLOCK);
+
+  a2dp_rate_ctrl_init(&ctrl, SIM_RATE,
+                      2 * SbcFramesPerPacket(SIM_MAX_BITPOOL) *
+                          SBC_FRAME_PCM_FRAMES,
+                      2, SIM_MAX_BITPOOL, sndbuf / 2, &now);
+
+  for (unsigned int p = 0; p < num_phases; p++) {
+    for (unsigned int t = 0; t < phases[p].duration_ms; t += SIM_TICK_MS) {
+      unsigned int sbc_frames = SbcFramesPerPacket(bitpool);
+      unsigned int packet_frames = sbc_frames * SBC_FRAME_PCM_FRAMES;
+      unsigned int packet_bytes =
+          RTP_HEADER_BYTES + sbc_frames * SbcFrameLength(bitpool);
+      int outq, rc;
+
+      // Packets carry their bitpool so the sink can tell the frame size.
+      packet[0] = bitpool;
+      // The source renders a tick of audio and sends what it can.
+      pending += SIM_TICK_FRAMES;
+      while (pending >= packet_frames) {
+        if (adaptive &&
+            a2dp_rate_ctrl_frames_due(&ctrl, &now) < packet_frames)
+          break;
+        rc = send(sock[0], packet, packet_bytes, MSG_DONTWAIT);
+        rc = rc < 0 ? -errno : packet_frames;
+        if (adaptive) {
+          // Unlike Bluetooth sockets, unix sockets report the bytes
+          // queued for SIOCOUTQ.
+          if (ioctl(sock[0], SIOCOUTQ, &outq) < 0)
+            outq = 0;
+          bitpool = a2dp_rate_ctrl_update(&ctrl, &now, rc, outq);
+        }
+        if (rc < 0)
+          break;
+        pending -= packet_frames;
+        in_socket += packet_frames;
+      }
+
+      // The link carries what its throughput allows.
+      link_budget += phases[p].link_bytes_per_sec * SIM_TICK_MS / 1000;
+      for (;;) {
+        uint8_t buf[SIM_MTU];
+        int len = recv(sock[1], buf, sizeof(buf),
+                       MSG_DONTWAIT | MSG_PEEK | MSG_TRUNC);
+        if (len <= 0 || (unsigned int)len > link_budget)
+          break;
+        recv(sock[1], buf, sizeof(buf), MSG_DONTWAIT);
+        link_budget -= len;
+        len = (len - RTP_HEADER_BYTES) / SbcFrameLength(buf[0]) *
+              SBC_FRAME_PCM_FRAMES;
+        in_socket -= len;
+        sink_buffered += len;
+      }
+      // Nothing is sent to the link, unused throughput can't be saved.
+      if (link_budget > SIM_MTU)
+        link_budget = SIM_MTU;
+
+      // The sink plays a tick of audio once it buffered two packets.
+      if (!sink_started && sink_buffered >= 2 * packet_frames)
+        sink_started = true;
+      if (sink_started) {
+        if (sink_buffered < SIM_TICK_FRAMES) {
+          result.underruns++;
+          sink_buffered = 0;
+        } else {
+          sink_buffered -= SIM_TICK_FRAMES;
+        }
+      }
+
+      // Time a frame rendered now takes to be played.
+      latency_ms = (uint64_t)(pending + in_socket + sink_buffered) * 1000 /
+                   SIM_RATE;
+      latency_sum += latency_ms;
+      result.max_latency_ms = std::max(result.max_latency_ms, latency_ms);
+      ticks++;
+      AddMs(&now, SIM_TICK_MS);
+    }
+  }
+
+  close(sock[0]);
+  close(sock[1]);
+  result.avg_latency_ms = (double)latency_sum / ticks;
+  result.final_bitpool = bitpool;
+  return result;
+}
+
+TEST(A2dpRateCtrlSimulatedLink, CongestedLink) {
+  static const SimPhase phases[] = {
+    {5000, 60000},
+    {10000, 25000},
+    {5000, 60000},
+  };
+  SimResult fixed, adaptive;
+
+  fixed = RunSimulatedLink(false, phases, 3);
+  adaptive = RunSimulatedLink(true, phases, 3);
+
+  printf("link  fixed bitpool: underruns %u, latency avg %.0f ms max %u ms\n",
+         fixed.underruns, fixed.avg_latency_ms, fixed.max_latency_ms);
+  printf("link  adaptive:      underruns %u, latency avg %.0f ms max %u ms, "
+         "final bitpool %d\n", adaptive.underruns, adaptive.avg_latency_ms,
+         adaptive.max_latency_ms, adaptive.final_bitpool);
+
+  EXPECT_LT(adaptive.underruns, fixed.underruns);
+  EXPECT_LT(adaptive.avg_latency_ms, fixed.avg_latency_ms);
+}
+
+TEST(A2dpRateCtrlSimulatedLink, ClearLink) {
+  static const SimPhase phases[] = {
+    {10000, 60000},
+  };
+  SimResult adaptive;
+
+  adaptive = RunSimulatedLink(true, phases, 1);
+
+  printf("clear link  adaptive: underruns %u, latency avg %.0f ms max %u ms, "
+         "final bitpool %d\n", adaptive.underruns, adaptive.avg_latency_ms,
+         adaptive.max_latency_ms, adaptive.final_bitpool);
+
+  // Paced packets don't congest a link which can carry them.
+  EXPECT_EQ(0, adaptive.underruns);
+  EXPECT_EQ(SIM_MAX_BITPOOL, adaptive.final_bitpool);
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
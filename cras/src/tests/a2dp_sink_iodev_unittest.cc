@@ -0,0 +1,576 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+
+#include "a2dp-codecs.h"
+#include "audio_thread.h"
+#include "cras_audio_area.h"
+#include "cras_audio_codec.h"
+#include "cras_bt_transport.h"
+#include "cras_iodev.h"
+#include "rtp.h"
+
+#include "cras_a2dp_sink_iodev.h"
+}
+
+#define FAKE_OBJECT_PATH "/fake/obj/path"
+// The fake decoder turns each 8 byte frame into FAKE_CODESIZE bytes, 128
+// stereo frames, all samples set to the first byte of the frame.
+#define FAKE_FRAME_LEN 8
+#define FAKE_CODESIZE 512
+#define FAKE_CODE_FRAMES 128
+#define FRAMES_PER_PACKET 4
+#define PACKET_FRAMES (FRAMES_PER_PACKET * FAKE_CODE_FRAMES)
+
+static struct cras_bt_transport *fake_transport;
+static cras_audio_format format;
+static size_t cras_iodev_add_node_called;
+static size_t cras_iodev_rm_node_called;
+static size_t cras_iodev_set_active_node_called;
+static size_t cras_iodev_list_add_input_called;
+static size_t cras_iodev_list_rm_input_called;
+static size_t cras_iodev_free_resources_called;
+static size_t cras_bt_transport_acquire_called;
+static size_t cras_bt_transport_release_called;
+static size_t a2dp_create_decoder_called;
+static size_t cras_sbc_codec_destroy_called;
+static cras_audio_area *dummy_audio_area;
+static thread_callback read_callback;
+static void *read_callback_data;
+static const char *fake_device_name = "fake device name";
+static const char *cras_bt_device_name_ret;
+static int sock[2];
+static struct timespec time_now;
+
+void ResetStubData() {
+  cras_iodev_add_node_called = 0;
+  cras_iodev_rm_node_called = 0;
+  cras_iodev_set_active_node_called = 0;
+  cras_iodev_list_add_input_called = 0;
+  cras_iodev_list_rm_input_called = 0;
+  cras_iodev_free_resources_called = 0;
+  cras_bt_transport_acquire_called = 0;
+  cras_bt_transport_release_called = 0;
+  a2dp_create_decoder_called = 0;
+  cras_sbc_codec_destroy_called = 0;
+  cras_bt_device_name_ret = NULL;
+  read_callback = NULL;
+  read_callback_data = NULL;
+  time_now.tv_sec = 100;
+  time_now.tv_nsec = 0;
+
+  fake_transport = reinterpret_cast<struct cras_bt_transport *>(0x123);
+
+  if (!dummy_audio_area) {
+    dummy_audio_area = (cras_audio_area*)calloc(1,
+        sizeof(*dummy_audio_area) + sizeof(cras_channel_area) * 2);
+  }
+}
+
+int iodev_set_format(struct cras_iodev *iodev,
+                     struct cras_audio_format *fmt)
+{
+  fmt->format = SND_PCM_FORMAT_S16_LE;
+  fmt->num_channels = 2;
+  fmt->frame_rate = 48000;
+  iodev->format = fmt;
+  return 0;
+}
+
+namespace {
+
+// Sends an RTP packet of FRAMES_PER_PACKET fake SBC frames, each coding
+// the given value.
+void SendPacket(uint16_t seq, uint8_t value) {
+  uint8_t packet[sizeof(struct rtp_header) + sizeof(struct rtp_payload) +
+                 FRAMES_PER_PACKET * FAKE_FRAME_LEN];
+  struct rtp_header *header = (struct rtp_header *)packet;
+  struct rtp_payload *payload =
+      (struct rtp_payload *)(packet + sizeof(*header));
+
+  memset(packet, 0, sizeof(packet));
+  header->v = 2;
+  header->pt = 0x60;
+  header->sequence_number = htons(seq);
+  payload->frame_count = FRAMES_PER_PACKET;
+  memset(packet + sizeof(*header) + sizeof(*payload), value,
+         FRAMES_PER_PACKET * FAKE_FRAME_LEN);
+  ASSERT_EQ(sizeof(packet), send(sock[1], packet, sizeof(packet), 0));
+}
+
+void AdvanceMs(unsigned int ms) {
+  time_now.tv_nsec += ms * 1000000;
+  while (time_now.tv_nsec >= 1000000000) {
+    time_now.tv_nsec -= 1000000000;
+    time_now.tv_sec++;
+  }
+}
+
+int FramesQueued(struct cras_iodev *iodev) {
+  struct timespec tstamp;
+  return iodev->frames_queued(iodev, &tstamp);
+}
+
+// Reads frames from the device and returns the first sample of the first
+// frame read.
+int16_t ReadFrames(struct cras_iodev *iodev, unsigned int frames) {
+  struct cras_audio_area *area;
+  int16_t sample;
+
+  EXPECT_EQ(0, iodev->get_buffer(iodev, &area, &frames));
+  sample = *(int16_t *)area->channels[0].buf;
+  EXPECT_EQ(0, iodev->put_buffer(iodev, frames));
+  return sample;
+}
+
+class A2dpSinkIodev: public testing::Test {
+  protected:
+    virtual void SetUp() {
+      ResetStubData();
+      ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+    }
+
+    virtual void TearDown() {
+      close(sock[0]);
+      close(sock[1]);
+      free(dummy_audio_area);
+      dummy_audio_area = NULL;
+    }
+
+    struct cras_iodev *CreateAndOpen() {
+      struct cras_iodev *iodev = a2dp_sink_iodev_create(fake_transport);
+
+      iodev_set_format(iodev, &format);
+      EXPECT_EQ(0, iodev->configure_dev(iodev));
+      return iodev;
+    }
+
+    void CloseAndDestroy(struct cras_iodev *iodev) {
+      iodev->close_dev(iodev);
+      a2dp_sink_iodev_destroy(iodev);
+    }
+};
+
+TEST_F(A2dpSinkIodev, InitializeA2dpSinkIodev) {
+  struct cras_iodev *iodev;
+
+  iodev = a2dp_sink_iodev_create(fake_transport);
+
+  ASSERT_NE(iodev, (void *)NULL);
+  EXPECT_EQ(CRAS_STREAM_INPUT, iodev->direction);
+  EXPECT_EQ(1, cras_iodev_list_add_input_called);
+  EXPECT_EQ(1, cras_iodev_add_node_called);
+  EXPECT_EQ(1, cras_iodev_set_active_node_called);
+  EXPECT_STREQ(FAKE_OBJECT_PATH, iodev->info.name);
+
+  a2dp_sink_iodev_destroy(iodev);
+  EXPECT_EQ(1, cras_iodev_list_rm_input_called);
+  EXPECT_EQ(1, cras_iodev_rm_node_called);
+  EXPECT_EQ(1, cras_iodev_free_resources_called);
+
+  cras_bt_device_name_ret = fake_device_name;
+  iodev = a2dp_sink_iodev_create(fake_transport);
+  EXPECT_STREQ(fake_device_name, iodev->info.name);
+  a2dp_sink_iodev_destroy(iodev);
+}
+
+TEST_F(A2dpSinkIodev, OpenAndClose) {
+  struct cras_iodev *iodev = CreateAndOpen();
+
+  EXPECT_EQ(1, cras_bt_transport_acquire_called);
+  EXPECT_EQ(1, a2dp_create_decoder_called);
+  ASSERT_NE(read_callback, (void *)NULL);
+  EXPECT_EQ(iodev, read_callback_data);
+  EXPECT_EQ(0, iodev->buffer_size % FAKE_CODE_FRAMES);
+
+  // Nothing to read isn't an error.
+  EXPECT_EQ(0, read_callback(read_callback_data));
+
+  CloseAndDestroy(iodev);
+  EXPECT_EQ(1, cras_bt_transport_release_called);
+  EXPECT_EQ(1, cras_sbc_codec_destroy_called);
+}
+
+TEST_F(A2dpSinkIodev, BufferToTargetThenPlayOut) {
+  struct cras_iodev *iodev = CreateAndOpen();
+  int queued;
+
+  // 40ms at 48kHz is 1920 frames, four packets.
+  SendPacket(0, 1);
+  SendPacket(1, 2);
+  SendPacket(2, 3);
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(3 * PACKET_FRAMES, iodev->delay_frames(iodev));
+  EXPECT_EQ(0, FramesQueued(iodev));
+  AdvanceMs(10);
+  EXPECT_EQ(0, FramesQueued(iodev));
+
+  SendPacket(3, 4);
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(0, FramesQueued(iodev));
+
+  // Played out at the nominal rate while the level is near the target.
+  AdvanceMs(10);
+  EXPECT_EQ(480, FramesQueued(iodev));
+  EXPECT_EQ(1, ReadFrames(iodev, 480));
+  EXPECT_EQ(0, FramesQueued(iodev));
+  AdvanceMs(10);
+  queued = FramesQueued(iodev);
+  EXPECT_NEAR(480, queued, 1);
+  EXPECT_EQ(1, ReadFrames(iodev, 32));
+  EXPECT_EQ(2, ReadFrames(iodev, queued - 32));
+  EXPECT_EQ(4 * PACKET_FRAMES - 480 - queued, iodev->delay_frames(iodev));
+
+  CloseAndDestroy(iodev);
+}
+
+TEST_F(A2dpSinkIodev, BatchedReads) {
+  struct cras_iodev *iodev = CreateAndOpen();
+  int i;
+
+  for (i = 0; i < 10; i++)
+    SendPacket(i, i);
+
+  // At most eight packets are read in one wake up.
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(8 * PACKET_FRAMES, iodev->delay_frames(iodev));
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(10 * PACKET_FRAMES, iodev->delay_frames(iodev));
+
+  CloseAndDestroy(iodev);
+}
+
+TEST_F(A2dpSinkIodev, LostPacketsBecomeSilence) {
+  struct cras_iodev *iodev = CreateAndOpen();
+
+  SendPacket(0, 1);
+  SendPacket(1, 2);
+  SendPacket(3, 4);
+  // Already replaced by silence, dropped.
+  SendPacket(2, 3);
+  SendPacket(4, 5);
+  SendPacket(5, 6);
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(6 * PACKET_FRAMES, iodev->delay_frames(iodev));
+
+  EXPECT_EQ(0, FramesQueued(iodev));
+  AdvanceMs(40);
+  EXPECT_EQ(1922, FramesQueued(iodev));
+  EXPECT_EQ(1, ReadFrames(iodev, PACKET_FRAMES));
+  EXPECT_EQ(2, ReadFrames(iodev, PACKET_FRAMES));
+  EXPECT_EQ(0, ReadFrames(iodev, PACKET_FRAMES));
+  EXPECT_EQ(4, ReadFrames(iodev, 1922 - 3 * PACKET_FRAMES));
+
+  CloseAndDestroy(iodev);
+}
+
+TEST_F(A2dpSinkIodev, SequenceRestartIsNotLoss) {
+  struct cras_iodev *iodev = CreateAndOpen();
+
+  SendPacket(100, 1);
+  SendPacket(101, 2);
+  // The source restarted the stream from another sequence number.
+  SendPacket(5000, 3);
+  SendPacket(5001, 4);
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(4 * PACKET_FRAMES, iodev->delay_frames(iodev));
+
+  CloseAndDestroy(iodev);
+}
+
+TEST_F(A2dpSinkIodev, ParseHeaderExtensions) {
+  struct cras_iodev *iodev = CreateAndOpen();
+  uint8_t packet[128];
+  struct rtp_header *header = (struct rtp_header *)packet;
+  unsigned int len;
+
+  // A CSRC, a one word header extension and four bytes of padding around
+  // one frame.
+  memset(packet, 0, sizeof(packet));
+  header->v = 2;
+  header->cc = 1;
+  header->x = 1;
+  header->p = 1;
+  header->sequence_number = htons(7);
+  len = sizeof(*header) + 4;
+  packet[len + 3] = 1;
+  len += 8;
+  packet[len++] = 1;
+  memset(packet + len, 9, FAKE_FRAME_LEN);
+  len += FAKE_FRAME_LEN;
+  packet[len + 3] = 4;
+  len += 4;
+  ASSERT_EQ(len, send(sock[1], packet, len, 0));
+
+  // Not RTP version 2.
+  header->v = 1;
+  ASSERT_EQ(len, send(sock[1], packet, len, 0));
+
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(FAKE_CODE_FRAMES, iodev->delay_frames(iodev));
+  iodev->flush_buffer(iodev);
+  EXPECT_EQ(0, iodev->delay_frames(iodev));
+
+  // A frame cut by the padding isn't decoded.
+  header->v = 2;
+  header->sequence_number = htons(8);
+  packet[len - 1] = 8;
+  ASSERT_EQ(len, send(sock[1], packet, len, 0));
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(0, iodev->delay_frames(iodev));
+
+  CloseAndDestroy(iodev);
+}
+
+TEST_F(A2dpSinkIodev, UnderrunRaisesTarget) {
+  struct cras_iodev *iodev = CreateAndOpen();
+  int i;
+
+  for (i = 0; i < 4; i++)
+    SendPacket(i, i);
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(0, FramesQueued(iodev));
+
+  // The source stalls, what is left is handed out and buffering starts
+  // over.
+  AdvanceMs(100);
+  EXPECT_EQ(4 * PACKET_FRAMES, FramesQueued(iodev));
+  ReadFrames(iodev, 4 * PACKET_FRAMES);
+  EXPECT_EQ(0, FramesQueued(iodev));
+
+  // The target is 60ms now, 2880 frames.
+  for (i = 4; i < 9; i++)
+    SendPacket(i, i);
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(0, FramesQueued(iodev));
+  AdvanceMs(10);
+  EXPECT_EQ(0, FramesQueued(iodev));
+  SendPacket(9, 9);
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(0, FramesQueued(iodev));
+  AdvanceMs(10);
+  EXPECT_EQ(480, FramesQueued(iodev));
+
+  CloseAndDestroy(iodev);
+}
+
+TEST_F(A2dpSinkIodev, FastSourcePlaysOutFaster) {
+  struct cras_iodev *iodev = CreateAndOpen();
+  int i;
+
+  // Over twice the target buffered, the playout runs at the max skew.
+  for (i = 0; i < 12; i++)
+    SendPacket(i, i);
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(0, read_callback(read_callback_data));
+  EXPECT_EQ(0, FramesQueued(iodev));
+  AdvanceMs(50);
+  EXPECT_EQ(2404, FramesQueued(iodev));
+
+  CloseAndDestroy(iodev);
+}
+
+TEST_F(A2dpSinkIodev, SourceClosed) {
+  struct cras_iodev *iodev = CreateAndOpen();
+
+  close(sock[1]);
+  sock[1] = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  EXPECT_EQ(-EPIPE, read_callback(read_callback_data));
+
+  CloseAndDestroy(iodev);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+extern "C" {
+
+// From cras_bt_transport
+int cras_bt_transport_configuration(const struct cras_bt_transport *transport,
+                                    void *configuration, int len)
+{
+  a2dp_sbc_t *sbc = (a2dp_sbc_t *)configuration;
+
+  memset(sbc, 0, len);
+  sbc->channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
+  sbc->frequency = SBC_SAMPLING_FREQ_48000;
+  return 0;
+}
+
+int cras_bt_transport_acquire(struct cras_bt_transport *transport)
+{
+  cras_bt_transport_acquire_called++;
+  return 0;
+}
+
+int cras_bt_transport_release(struct cras_bt_transport *transport,
+    unsigned int blocking)
+{
+  cras_bt_transport_release_called++;
+  return 0;
+}
+
+int cras_bt_transport_fd(const struct cras_bt_transport *transport)
+{
+  return sock[0];
+}
+
+uint16_t cras_bt_transport_read_mtu(const struct cras_bt_transport *transport)
+{
+  return 672;
+}
+
+const char *cras_bt_transport_object_path(
+		const struct cras_bt_transport *transport)
+{
+  return FAKE_OBJECT_PATH;
+}
+
+struct cras_bt_device *cras_bt_transport_device(
+	const struct cras_bt_transport *transport)
+{
+  return reinterpret_cast<struct cras_bt_device *>(0x456);
+}
+
+// From cras_bt_device
+const char *cras_bt_device_name(const struct cras_bt_device *device)
+{
+  return cras_bt_device_name_ret;
+}
+
+const char *cras_bt_device_object_path(const struct cras_bt_device *device) {
+  return "/org/bluez/hci0/dev_1A_2B_3C_4D_5E_6F";
+}
+
+// From cras_iodev
+void cras_iodev_add_node(struct cras_iodev *iodev, struct cras_ionode *node)
+{
+  cras_iodev_add_node_called++;
+  iodev->nodes = node;
+}
+
+void cras_iodev_rm_node(struct cras_iodev *iodev, struct cras_ionode *node)
+{
+  cras_iodev_rm_node_called++;
+  iodev->nodes = NULL;
+}
+
+void cras_iodev_set_active_node(struct cras_iodev *iodev,
+				struct cras_ionode *node)
+{
+  cras_iodev_set_active_node_called++;
+  iodev->active_node = node;
+}
+
+void cras_iodev_free_format(struct cras_iodev *iodev)
+{
+}
+
+void cras_iodev_free_resources(struct cras_iodev *iodev)
+{
+  cras_iodev_free_resources_called++;
+}
+
+void cras_iodev_init_audio_area(struct cras_iodev *iodev,
+                                int num_channels) {
+  iodev->area = dummy_audio_area;
+}
+
+void cras_iodev_free_audio_area(struct cras_iodev *iodev) {
+}
+
+void cras_audio_area_config_buf_pointers(struct cras_audio_area *area,
+					 const struct cras_audio_format *fmt,
+					 uint8_t *base_buffer)
+{
+  dummy_audio_area->channels[0].buf = base_buffer;
+}
+
+// From cras_iodev_list
+int cras_iodev_list_add_input(struct cras_iodev *input)
+{
+  cras_iodev_list_add_input_called++;
+  return 0;
+}
+
+int cras_iodev_list_rm_input(struct cras_iodev *input)
+{
+  cras_iodev_list_rm_input_called++;
+  return 0;
+}
+
+struct audio_thread *cras_iodev_list_get_audio_thread()
+{
+  return NULL;
+}
+
+// From audio_thread
+void audio_thread_add_callback(int fd, thread_callback cb, void *data) {
+  read_callback = cb;
+  read_callback_data = data;
+}
+
+int audio_thread_rm_callback_sync(struct audio_thread *thread, int fd) {
+  return 0;
+}
+
+// From the codecs
+static int fake_decode(struct cras_audio_codec *codec, const void *input,
+                       size_t input_len, void *output, size_t output_len,
+                       size_t *count)
+{
+  const uint8_t *in = (const uint8_t *)input;
+  int16_t *out = (int16_t *)output;
+  size_t processed = 0;
+  unsigned int i;
+
+  *count = 0;
+  while (input_len - processed >= FAKE_FRAME_LEN &&
+         output_len - *count >= FAKE_CODESIZE) {
+    for (i = 0; i < FAKE_CODESIZE / 2; i++)
+      *out++ = in[processed];
+    processed += FAKE_FRAME_LEN;
+    *count += FAKE_CODESIZE;
+  }
+  return processed;
+}
+
+static struct cras_audio_codec fake_decoder = {
+  fake_decode,
+};
+
+struct cras_audio_codec *a2dp_create_decoder(const a2dp_sbc_t *sbc)
+{
+  a2dp_create_decoder_called++;
+  return &fake_decoder;
+}
+
+void cras_sbc_codec_destroy(struct cras_audio_codec *codec)
+{
+  cras_sbc_codec_destroy_called++;
+}
+
+int cras_sbc_get_codesize(struct cras_audio_codec *codec)
+{
+  return FAKE_CODESIZE;
+}
+
+int clock_gettime(clockid_t clk_id, struct timespec *tp) {
+  *tp = time_now;
+  return 0;
+}
+
+}  // extern "C"
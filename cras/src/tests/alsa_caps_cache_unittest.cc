@@ -0,0 +1,160 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+extern "C" {
+#include "cras_alsa_caps_cache.h"
+}
+
+namespace {
+
+static const size_t rates[] = { 44100, 48000, 0 };
+static const size_t channel_counts[] = { 1, 2, 0 };
+static const snd_pcm_format_t formats[] = {
+  SND_PCM_FORMAT_S16_LE,
+  SND_PCM_FORMAT_S32_LE,
+  (snd_pcm_format_t)0,
+};
+
+class AlsaCapsCacheTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      int fd;
+
+      strcpy(path_, "/tmp/alsa_caps_cache.XXXXXX");
+      fd = mkstemp(path_);
+      ASSERT_LE(0, fd);
+      close(fd);
+      cras_alsa_caps_cache_init(path_);
+    }
+
+    virtual void TearDown() {
+      cras_alsa_caps_cache_deinit();
+      unlink(path_);
+    }
+
+    void Restart() {
+      cras_alsa_caps_cache_deinit();
+      cras_alsa_caps_cache_init(path_);
+    }
+
+    int Get(uint32_t key) {
+      size_t *r = NULL, *c = NULL;
+      snd_pcm_format_t *f = NULL;
+      int rc;
+
+      rc = cras_alsa_caps_cache_get(key, &r, &c, &f);
+      if (rc == 0) {
+        EXPECT_EQ(44100, r[0]);
+        EXPECT_EQ(48000, r[1]);
+        EXPECT_EQ(0, r[2]);
+        EXPECT_EQ(1, c[0]);
+        EXPECT_EQ(2, c[1]);
+        EXPECT_EQ(0, c[2]);
+        EXPECT_EQ(SND_PCM_FORMAT_S16_LE, f[0]);
+        EXPECT_EQ(SND_PCM_FORMAT_S32_LE, f[1]);
+        EXPECT_EQ(0, f[2]);
+      }
+      free(r);
+      free(c);
+      free(f);
+      return rc;
+    }
+
+    void WriteFile(const char *contents) {
+      FILE *f = fopen(path_, "w");
+      ASSERT_NE((FILE *)NULL, f);
+      fputs(contents, f);
+      fclose(f);
+    }
+
+    char path_[32];
+};
+
+TEST_F(AlsaCapsCacheTestSuite, KeyDependsOnIdentity) {
+  uint32_t key = cras_alsa_caps_cache_key("Card", "Dev", 0,
+                                          CRAS_STREAM_OUTPUT, 1, 2, "s", 3);
+
+  EXPECT_EQ(key, cras_alsa_caps_cache_key("Card", "Dev", 0,
+                                          CRAS_STREAM_OUTPUT, 1, 2, "s", 3));
+  EXPECT_NE(key, cras_alsa_caps_cache_key("Card", "Dev", 0,
+                                          CRAS_STREAM_INPUT, 1, 2, "s", 3));
+  EXPECT_NE(key, cras_alsa_caps_cache_key("Card", "Dev", 1,
+                                          CRAS_STREAM_OUTPUT, 1, 2, "s", 3));
+  EXPECT_NE(key, cras_alsa_caps_cache_key("Card", "Dev", 0,
+                                          CRAS_STREAM_OUTPUT, 1, 2, "s", 4));
+  EXPECT_NE(key, cras_alsa_caps_cache_key("Card", "Dev", 0,
+                                          CRAS_STREAM_OUTPUT, 1, 2, NULL, 3));
+}
+
+TEST_F(AlsaCapsCacheTestSuite, PutGetAcrossRestart) {
+  EXPECT_EQ(-ENOENT, Get(1));
+  EXPECT_EQ(0, cras_alsa_caps_cache_put(1, rates, channel_counts, formats));
+  EXPECT_EQ(0, Get(1));
+
+  Restart();
+  EXPECT_EQ(0, Get(1));
+  EXPECT_EQ(-ENOENT, Get(2));
+
+  cras_alsa_caps_cache_invalidate(1);
+  EXPECT_EQ(-ENOENT, Get(1));
+  Restart();
+  EXPECT_EQ(-ENOENT, Get(1));
+}
+
+TEST_F(AlsaCapsCacheTestSuite, RejectEmptyCaps) {
+  static const size_t empty[] = { 0 };
+
+  EXPECT_EQ(-EINVAL, cras_alsa_caps_cache_put(1, empty, channel_counts,
+                                              formats));
+  EXPECT_EQ(-ENOENT, Get(1));
+}
+
+TEST_F(AlsaCapsCacheTestSuite, SkipMalformedLines) {
+  WriteFile("00000001 rates=44100,48000 channels=1,2 formats=2,10\n"
+            "00000002 rates=44100,48000 channels=1,2\n"
+            "00000003 rates=44100,x channels=1,2 formats=2,10\n"
+            "garbage\n"
+            "00000004 rates=44100,48000 channels=1,2 formats=2,10\n");
+  EXPECT_EQ(0, Get(1));
+  EXPECT_EQ(-ENOENT, Get(2));
+  EXPECT_EQ(-ENOENT, Get(3));
+  EXPECT_EQ(0, Get(4));
+}
+
+TEST_F(AlsaCapsCacheTestSuite, DropLeastRecentlyUsed) {
+  uint32_t key;
+
+  for (key = 1; key <= 64; key++)
+    ASSERT_EQ(0, cras_alsa_caps_cache_put(key, rates, channel_counts,
+                                          formats));
+  // Using the oldest entry keeps it, the next oldest is dropped instead.
+  EXPECT_EQ(0, Get(1));
+  ASSERT_EQ(0, cras_alsa_caps_cache_put(65, rates, channel_counts, formats));
+  EXPECT_EQ(0, Get(1));
+  EXPECT_EQ(-ENOENT, Get(2));
+
+  Restart();
+  EXPECT_EQ(0, Get(1));
+  EXPECT_EQ(-ENOENT, Get(2));
+  EXPECT_EQ(0, Get(65));
+}
+
+TEST_F(AlsaCapsCacheTestSuite, Disabled) {
+  cras_alsa_caps_cache_deinit();
+  EXPECT_EQ(-ENOENT, cras_alsa_caps_cache_put(1, rates, channel_counts,
+                                              formats));
+  EXPECT_EQ(-ENOENT, Get(1));
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
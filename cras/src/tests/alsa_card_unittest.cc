@@ -12,6 +12,7 @@
 extern "C" {
 #include "cras_alsa_card.h"
 #include "cras_alsa_io.h"
+#include "cras_alsa_jack.h"
 #include "cras_alsa_mixer.h"
 #include "cras_alsa_ucm.h"
 #include "cras_iodev.h"
@@ -894,7 +895,8 @@ struct cras_iodev *alsa_iodev_create(size_t card_index,
 				     enum CRAS_STREAM_DIRECTION direction,
 				     size_t usb_vid,
 				     size_t usb_pid,
-				     char *usb_serial_number) {
+				     char *usb_serial_number,
+				     uint32_t usb_desc_checksum) {
   struct cras_iodev *result = NULL;
   if (cras_alsa_iodev_create_called < cras_alsa_iodev_create_return_size)
     result = cras_alsa_iodev_create_return[cras_alsa_iodev_create_called];
@@ -928,6 +930,16 @@ unsigned alsa_iodev_index(struct cras_iodev *iodev) {
 int alsa_iodev_has_hctl_jacks(struct cras_iodev *iodev) {
   return alsa_iodev_has_hctl_jacks_return;
 }
+void alsa_iodev_set_jack_scan(struct cras_iodev *iodev,
+                              const struct cras_alsa_jack_scan *scan) {
+}
+
+struct cras_alsa_jack_scan *cras_alsa_jack_scan_create(const char *card_name,
+                                                       snd_hctl_t *hctl) {
+  return reinterpret_cast<struct cras_alsa_jack_scan *>(0x33);
+}
+void cras_alsa_jack_scan_destroy(struct cras_alsa_jack_scan *scan) {
+}
 
 size_t snd_pcm_info_sizeof() {
   return 10;
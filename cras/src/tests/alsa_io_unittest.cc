@@ -6,6 +6,8 @@
 #include <map>
 #include <stdio.h>
 #include <syslog.h>
+#include <time.h>
+#include <unistd.h>
 #include <vector>
 
 extern "C" {
@@ -31,6 +33,8 @@ static int cras_alsa_start_called;
 static uint8_t *cras_alsa_mmap_begin_buffer;
 static size_t cras_alsa_mmap_begin_frames;
 static size_t cras_alsa_fill_properties_called;
+static unsigned int cras_alsa_fill_properties_delay_us;
+static int cras_alsa_set_hwparams_ret;
 static size_t alsa_mixer_set_dBFS_called;
 static int alsa_mixer_set_dBFS_value;
 static const struct mixer_control *alsa_mixer_set_dBFS_output;
@@ -147,6 +151,10 @@ static int cras_iodev_buffer_avail_ret;
 static int cras_alsa_resume_appl_ptr_called;
 static int cras_alsa_resume_appl_ptr_ahead;
 static int ucm_get_enable_htimestamp_flag_ret;
+static unsigned int ucm_get_dynamic_min_buffer_level_flag_ret;
+static int ucm_get_min_buffer_level_floor_ret;
+static unsigned int ucm_get_min_buffer_level_floor_value;
+static int cras_alsa_set_swparams_htimestamp_unsupported;
 static const struct cras_volume_curve *fake_get_dBFS_volume_curve_val;
 static int cras_iodev_dsp_set_swap_mode_for_node_called;
 static std::map<std::string, long> ucm_get_default_node_gain_values;
@@ -161,6 +169,8 @@ void ResetStubData() {
   cras_alsa_get_avail_frames_avail = 0;
   cras_alsa_start_called = 0;
   cras_alsa_fill_properties_called = 0;
+  cras_alsa_fill_properties_delay_us = 0;
+  cras_alsa_set_hwparams_ret = 0;
   sys_get_volume_called = 0;
   sys_get_capture_gain_called = 0;
   alsa_mixer_set_dBFS_called = 0;
@@ -239,6 +249,10 @@ void ResetStubData() {
   cras_alsa_resume_appl_ptr_called = 0;
   cras_alsa_resume_appl_ptr_ahead = 0;
   ucm_get_enable_htimestamp_flag_ret = 0;
+  ucm_get_dynamic_min_buffer_level_flag_ret = 0;
+  ucm_get_min_buffer_level_floor_ret = -ENOENT;
+  ucm_get_min_buffer_level_floor_value = 0;
+  cras_alsa_set_swparams_htimestamp_unsupported = 0;
   fake_get_dBFS_volume_curve_val = NULL;
   cras_iodev_dsp_set_swap_mode_for_node_called = 0;
   ucm_get_default_node_gain_values.clear();
@@ -265,7 +279,7 @@ static struct cras_iodev *alsa_iodev_create_with_default_parameters(
   return alsa_iodev_create(card_index, test_card_name, 0, test_dev_name,
                            dev_id, card_type, is_first,
                            mixer, config, ucm, fake_hctl,
-                           direction, 0, 0, (char *)"123");
+                           direction, 0, 0, (char *)"123", 0);
 }
 
 namespace {
@@ -302,6 +316,7 @@ TEST(AlsaIoInit, InitializePlayback) {
   EXPECT_EQ(0, strcmp(test_dev_name, aio->dev_name));
   ASSERT_NE(reinterpret_cast<const char *>(NULL), aio->dev_id);
   EXPECT_EQ(0, strcmp(test_dev_id, aio->dev_id));
+  EXPECT_EQ(1, aio->base.cache_hw_status);
 
   alsa_iodev_destroy((struct cras_iodev *)aio);
   EXPECT_EQ(1, cras_iodev_free_resources_called);
@@ -425,6 +440,37 @@ TEST(AlsaIoInit, OpenPlayback) {
   free(fake_format);
 }
 
+TEST(AlsaIoInit, OpenPlaybackHwTimestamps) {
+  struct cras_iodev *iodev;
+  struct cras_audio_format format;
+  struct alsa_io *aio;
+
+  ResetStubData();
+  iodev = alsa_iodev_create_with_default_parameters(0, NULL,
+                                                    ALSA_CARD_TYPE_INTERNAL, 0,
+                                                    fake_mixer, fake_config,
+                                                    NULL, CRAS_STREAM_OUTPUT);
+  ASSERT_EQ(0, alsa_iodev_legacy_complete_init(iodev));
+  aio = (struct alsa_io *)iodev;
+  format.frame_rate = 48000;
+  format.num_channels = 1;
+  cras_iodev_set_format(iodev, &format);
+
+  // The audio thread learns from the timestamps once htimestamp is set up.
+  aio->enable_htimestamp = 1;
+  iodev->open_dev(iodev);
+  iodev->configure_dev(iodev);
+  EXPECT_EQ(1, iodev->hw_timestamps);
+
+  // Not when the driver doesn't support it.
+  cras_alsa_set_swparams_htimestamp_unsupported = 1;
+  iodev->configure_dev(iodev);
+  EXPECT_EQ(0, iodev->hw_timestamps);
+
+  alsa_iodev_destroy(iodev);
+  free(fake_format);
+}
+
 TEST(AlsaIoInit, UsbCardAutoPlug) {
   struct cras_iodev *iodev;
 
@@ -490,6 +536,41 @@ TEST(AlsaIoInit, UsbCardUseSoftwareVolume) {
   alsa_iodev_destroy(iodev);
 }
 
+TEST(AlsaIoInit, DynamicMinBufferLevelFromUcm) {
+  struct cras_iodev *iodev;
+  struct cras_use_case_mgr * const fake_ucm = (struct cras_use_case_mgr*)3;
+
+  ResetStubData();
+  ucm_get_dynamic_min_buffer_level_flag_ret = 1;
+  iodev = alsa_iodev_create_with_default_parameters(0, NULL,
+                                                    ALSA_CARD_TYPE_INTERNAL, 1,
+                                                    fake_mixer, fake_config,
+                                                    fake_ucm,
+                                                    CRAS_STREAM_OUTPUT);
+  EXPECT_EQ(1, iodev->dynamic_min_buffer_level);
+  EXPECT_EQ(0, iodev->min_buffer_level_floor);
+  alsa_iodev_destroy(iodev);
+
+  ucm_get_min_buffer_level_floor_ret = 0;
+  ucm_get_min_buffer_level_floor_value = 96;
+  iodev = alsa_iodev_create_with_default_parameters(0, NULL,
+                                                    ALSA_CARD_TYPE_INTERNAL, 1,
+                                                    fake_mixer, fake_config,
+                                                    fake_ucm,
+                                                    CRAS_STREAM_OUTPUT);
+  EXPECT_EQ(96, iodev->min_buffer_level_floor);
+  alsa_iodev_destroy(iodev);
+
+  /* Capture devices have no min buffer level to lower. */
+  iodev = alsa_iodev_create_with_default_parameters(0, NULL,
+                                                    ALSA_CARD_TYPE_INTERNAL, 1,
+                                                    fake_mixer, fake_config,
+                                                    fake_ucm,
+                                                    CRAS_STREAM_INPUT);
+  EXPECT_EQ(0, iodev->dynamic_min_buffer_level);
+  alsa_iodev_destroy(iodev);
+}
+
 TEST(AlsaIoInit, UseSoftwareGain) {
   struct cras_iodev *iodev;
   struct cras_use_case_mgr * const fake_ucm = (struct cras_use_case_mgr*)3;
@@ -2042,6 +2123,17 @@ TEST_F(AlsaFreeRunTestSuite, FillWholeBufferWithZeros) {
   free(zeros);
 }
 
+TEST_F(AlsaFreeRunTestSuite, CountHwCalls) {
+  struct timespec hw_tstamp;
+
+  // A level read is snd_pcm_avail and snd_pcm_htimestamp.
+  aio.base.frames_queued(&aio.base, &hw_tstamp);
+  EXPECT_EQ(2, aio.base.num_hw_calls);
+  aio.base.delay_frames = delay_frames;
+  aio.base.delay_frames(&aio.base);
+  EXPECT_EQ(3, aio.base.num_hw_calls);
+}
+
 TEST_F(AlsaFreeRunTestSuite, EnterFreeRunAlreadyFreeRunning) {
   int rc;
 
@@ -2269,6 +2361,144 @@ TEST(AlsaHotwordNode, HotwordTriggeredSendMessage) {
   alsa_iodev_destroy(iodev);
 }
 
+class AlsaCapsCacheSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      int fd;
+
+      ResetStubData();
+      strcpy(cache_path_, "/tmp/alsa_caps_cache.XXXXXX");
+      fd = mkstemp(cache_path_);
+      ASSERT_LE(0, fd);
+      close(fd);
+      cras_alsa_caps_cache_init(cache_path_);
+    }
+
+    virtual void TearDown() {
+      cras_alsa_caps_cache_deinit();
+      unlink(cache_path_);
+    }
+
+    struct cras_iodev *CreateDev(size_t card_index, const char *dev_name) {
+      struct cras_iodev *iodev;
+      char card_name[32];
+
+      snprintf(card_name, sizeof(card_name), "Card%zu", card_index);
+      iodev = alsa_iodev_create(card_index, card_name, 0, dev_name,
+                                NULL, ALSA_CARD_TYPE_USB, 1,
+                                fake_mixer, fake_config, NULL, fake_hctl,
+                                CRAS_STREAM_OUTPUT, 0x1234, 0x5678,
+                                (char *)"123", 0xabcd);
+      alsa_iodev_legacy_complete_init(iodev);
+      return iodev;
+    }
+
+    // Restarting the server drops everything but the file.
+    void Restart() {
+      cras_alsa_caps_cache_deinit();
+      cras_alsa_caps_cache_init(cache_path_);
+    }
+
+    char cache_path_[32];
+};
+
+TEST_F(AlsaCapsCacheSuite, ReuseAcrossRestart) {
+  struct cras_iodev *iodev;
+
+  iodev = CreateDev(0, test_dev_name);
+  ASSERT_EQ(0, iodev->update_supported_formats(iodev));
+  EXPECT_EQ(1, cras_alsa_fill_properties_called);
+  EXPECT_EQ(0, ((struct alsa_io *)iodev)->caps_from_cache);
+  alsa_iodev_destroy(iodev);
+
+  Restart();
+  iodev = CreateDev(0, test_dev_name);
+  ASSERT_EQ(0, iodev->update_supported_formats(iodev));
+  EXPECT_EQ(1, cras_alsa_fill_properties_called);
+  EXPECT_EQ(1, ((struct alsa_io *)iodev)->caps_from_cache);
+  EXPECT_EQ(44100, iodev->supported_rates[0]);
+  EXPECT_EQ(48000, iodev->supported_rates[1]);
+  EXPECT_EQ(0, iodev->supported_rates[2]);
+  EXPECT_EQ(2, iodev->supported_channel_counts[0]);
+  EXPECT_EQ(0, iodev->supported_channel_counts[1]);
+  EXPECT_EQ(SND_PCM_FORMAT_S16_LE, iodev->supported_formats[0]);
+  EXPECT_EQ(0, iodev->supported_formats[1]);
+  alsa_iodev_destroy(iodev);
+
+  // A different card with the same device name is probed.
+  iodev = CreateDev(1, test_dev_name);
+  ASSERT_EQ(0, iodev->update_supported_formats(iodev));
+  EXPECT_EQ(2, cras_alsa_fill_properties_called);
+  alsa_iodev_destroy(iodev);
+}
+
+TEST_F(AlsaCapsCacheSuite, InvalidateOnRejectedFormat) {
+  struct cras_iodev *iodev;
+  struct cras_audio_format format;
+
+  iodev = CreateDev(0, test_dev_name);
+  ASSERT_EQ(0, iodev->update_supported_formats(iodev));
+  ASSERT_EQ(0, iodev->update_supported_formats(iodev));
+  EXPECT_EQ(1, cras_alsa_fill_properties_called);
+  EXPECT_EQ(1, ((struct alsa_io *)iodev)->caps_from_cache);
+
+  memset(&format, 0, sizeof(format));
+  format.frame_rate = 48000;
+  format.num_channels = 2;
+  cras_iodev_set_format(iodev, &format);
+  iodev->open_dev(iodev);
+  cras_alsa_set_hwparams_ret = -EINVAL;
+  EXPECT_EQ(-EINVAL, iodev->configure_dev(iodev));
+  free(fake_format);
+  iodev->format = NULL;
+
+  // The device is probed again on the next open.
+  ASSERT_EQ(0, iodev->update_supported_formats(iodev));
+  EXPECT_EQ(2, cras_alsa_fill_properties_called);
+  EXPECT_EQ(0, ((struct alsa_io *)iodev)->caps_from_cache);
+  alsa_iodev_destroy(iodev);
+}
+
+TEST_F(AlsaCapsCacheSuite, HDMINotCached) {
+  struct cras_iodev *iodev;
+
+  iodev = CreateDev(0, "HDMI 0");
+  ASSERT_EQ(0, iodev->update_supported_formats(iodev));
+  ASSERT_EQ(0, iodev->update_supported_formats(iodev));
+  EXPECT_EQ(2, cras_alsa_fill_properties_called);
+  alsa_iodev_destroy(iodev);
+}
+
+// Benchmark of probing at server start, not run automatically. Run with
+// --gtest_also_run_disabled_tests --gtest_filter=*ServerStart*.
+TEST_F(AlsaCapsCacheSuite, DISABLED_ServerStartBenchmark) {
+  static const size_t num_cards = 16;
+  static const unsigned int probe_us = 5000;
+  struct cras_iodev *iodevs[num_cards];
+  struct timespec start, end;
+  double ms[2];
+  size_t i;
+  int run;
+
+  cras_alsa_fill_properties_delay_us = probe_us;
+  for (run = 0; run < 2; run++) {
+    Restart();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_cards; i++) {
+      iodevs[i] = CreateDev(i, test_dev_name);
+      ASSERT_EQ(0, iodevs[i]->update_supported_formats(iodevs[i]));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ms[run] = (end.tv_sec - start.tv_sec) * 1000.0 +
+              (end.tv_nsec - start.tv_nsec) / 1000000.0;
+    for (i = 0; i < num_cards; i++)
+      alsa_iodev_destroy(iodevs[i]);
+  }
+  printf("%zu cards, %u us per probe: cold start %.1f ms, "
+         "cached start %.1f ms\n", num_cards, probe_us, ms[0], ms[1]);
+  EXPECT_EQ(num_cards, cras_alsa_fill_properties_called);
+}
+
 }  //  namespace
 
 int main(int argc, char **argv) {
@@ -2373,6 +2603,8 @@ int cras_alsa_fill_properties(snd_pcm_t *handle,
   (*formats)[0] = SND_PCM_FORMAT_S16_LE;
   (*formats)[1] = (snd_pcm_format_t)0;
 
+  if (cras_alsa_fill_properties_delay_us)
+    usleep(cras_alsa_fill_properties_delay_us);
   cras_alsa_fill_properties_called++;
   return 0;
 }
@@ -2380,10 +2612,12 @@ int cras_alsa_set_hwparams(snd_pcm_t *handle, struct cras_audio_format *format,
 			   snd_pcm_uframes_t *buffer_size, int period_wakeup,
 			   unsigned int dma_period_time)
 {
-  return 0;
+  return cras_alsa_set_hwparams_ret;
 }
 int cras_alsa_set_swparams(snd_pcm_t *handle, int *enable_htimestamp)
 {
+  if (cras_alsa_set_swparams_htimestamp_unsupported)
+    *enable_htimestamp = 0;
   return 0;
 }
 int cras_alsa_get_avail_frames(snd_pcm_t *handle, snd_pcm_uframes_t buf_size,
@@ -2648,6 +2882,11 @@ int cras_alsa_jack_list_has_hctl_jacks(struct cras_alsa_jack_list *jack_list)
   return cras_alsa_jack_list_has_hctl_jacks_return_val;
 }
 
+void cras_alsa_jack_list_set_scan(struct cras_alsa_jack_list *jack_list,
+                                  const struct cras_alsa_jack_scan *scan)
+{
+}
+
 void cras_alsa_jack_list_report(const struct cras_alsa_jack_list *jack_list)
 {
 }
@@ -2732,11 +2971,24 @@ int ucm_get_min_buffer_level(struct cras_use_case_mgr *mgr,
   return 0;
 }
 
+int ucm_get_min_buffer_level_floor(struct cras_use_case_mgr *mgr,
+				   unsigned int *level)
+{
+  *level = ucm_get_min_buffer_level_floor_value;
+  return ucm_get_min_buffer_level_floor_ret;
+}
+
 unsigned int ucm_get_enable_htimestamp_flag(struct cras_use_case_mgr *mgr)
 {
   return ucm_get_enable_htimestamp_flag_ret;
 }
 
+unsigned int ucm_get_dynamic_min_buffer_level_flag(
+    struct cras_use_case_mgr *mgr)
+{
+  return ucm_get_dynamic_min_buffer_level_flag_ret;
+}
+
 unsigned int ucm_get_disable_software_volume(struct cras_use_case_mgr *mgr)
 {
   return 0;
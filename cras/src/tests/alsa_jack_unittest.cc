@@ -348,6 +348,44 @@ TEST(AlsaJacks, CreateGPIOHp) {
   EXPECT_EQ(1, cras_system_rm_select_fd_called);
 }
 
+TEST(AlsaJacks, CreateGPIOHpFromScan) {
+  struct cras_alsa_jack_scan *scan;
+  struct cras_alsa_jack_list *jack_list;
+
+  ResetStubData();
+  gpio_switch_list_for_each_dev_names.push_back("some-other-device");
+  gpio_switch_list_for_each_dev_names.push_back("c1 Headphone Jack");
+  eviocbit_ret[LONG(SW_HEADPHONE_INSERT)] |= 1 << OFF(SW_HEADPHONE_INSERT);
+  gpio_switch_eviocgbit_fd = 2;
+  snd_hctl_first_elem_return_val = NULL;
+
+  // Only the device named after the card is opened by the scan.
+  scan = cras_alsa_jack_scan_create("c1", fake_hctl);
+  ASSERT_NE(static_cast<struct cras_alsa_jack_scan *>(NULL), scan);
+  EXPECT_EQ(1, gpio_switch_list_for_each_called);
+  EXPECT_EQ(1, gpio_switch_open_called);
+  EXPECT_EQ(1, gpio_switch_eviocgbit_called);
+
+  jack_list = cras_alsa_jack_list_create(0, "c1", 0, 1,
+                                         fake_mixer,
+                                         NULL, fake_hctl,
+                                         CRAS_STREAM_OUTPUT,
+                                         fake_jack_cb,
+                                         fake_jack_cb_arg);
+  ASSERT_NE(static_cast<struct cras_alsa_jack_list *>(NULL), jack_list);
+  cras_alsa_jack_list_set_scan(jack_list, scan);
+  EXPECT_EQ(0, cras_alsa_jack_list_find_jacks_by_name_matching(jack_list));
+
+  // The jack is found without listing the input devices again.
+  EXPECT_EQ(1, gpio_switch_list_for_each_called);
+  EXPECT_EQ(2, gpio_switch_open_called);
+  EXPECT_EQ(1, gpio_switch_eviocgsw_called);
+  EXPECT_EQ(1, cras_system_add_select_fd_called);
+  cras_alsa_jack_list_destroy(jack_list);
+  cras_alsa_jack_scan_destroy(scan);
+  EXPECT_EQ(1, cras_system_rm_select_fd_called);
+}
+
 TEST(AlsaJacks, CreateGPIOMic) {
   struct cras_alsa_jack_list *jack_list;
   ResetStubData();
@@ -769,6 +807,50 @@ TEST(AlsaJacks, CreateHDMIJacksWithELD) {
   cras_alsa_jack_list_destroy(jack_list);
 }
 
+TEST(AlsaJacks, CreateHDMIJacksWithELDFromScan) {
+  std::string elem_names[] = {
+    "asdf",
+    "HDMI/DP,pcm=3 Jack",
+    "ELD",
+    "Headphone Jack",
+    "Mic Jack",
+  };
+  struct cras_alsa_jack_scan *scan;
+  struct cras_alsa_jack_list *jack_list;
+
+  ResetStubData();
+  snd_hctl_elem_get_device_return_val = 3;
+  snd_hctl_first_elem_return_val =
+      reinterpret_cast<snd_hctl_elem_t *>(&elem_names[0]);
+  for (unsigned int i = 1; i < ARRAY_SIZE(elem_names); i++)
+    snd_hctl_elem_next_ret_vals.push_front(
+        reinterpret_cast<snd_hctl_elem_t *>(&elem_names[i]));
+
+  scan = cras_alsa_jack_scan_create("card_name", fake_hctl);
+  ASSERT_NE(static_cast<struct cras_alsa_jack_scan *>(NULL), scan);
+  snd_hctl_first_elem_called = 0;
+  snd_hctl_elem_next_called = 0;
+
+  jack_list = cras_alsa_jack_list_create(0, "card_name", 3, 1,
+                                         fake_mixer,
+                                         NULL, fake_hctl,
+                                         CRAS_STREAM_OUTPUT,
+                                         fake_jack_cb,
+                                         fake_jack_cb_arg);
+  ASSERT_NE(static_cast<struct cras_alsa_jack_list *>(NULL), jack_list);
+  cras_alsa_jack_list_set_scan(jack_list, scan);
+  EXPECT_EQ(0, cras_alsa_jack_list_find_jacks_by_name_matching(jack_list));
+
+  // The jack and its ELD control come from the scan, not from hctl.
+  EXPECT_EQ(0, snd_hctl_first_elem_called);
+  EXPECT_EQ(0, snd_hctl_elem_next_called);
+  EXPECT_EQ(1, snd_hctl_elem_set_callback_called);
+  EXPECT_EQ(1, snd_hctl_elem_get_device_called);
+  EXPECT_EQ(1, gpio_switch_list_for_each_called);
+  cras_alsa_jack_list_destroy(jack_list);
+  cras_alsa_jack_scan_destroy(scan);
+}
+
 TEST(AlsaJacks, CreateOneHpTwoHDMIJacks) {
   std::string elem_names[] = {
     "asdf",
@@ -33,6 +33,7 @@ static unsigned snd_use_case_set_called;
 static std::vector<std::pair<std::string, std::string> > snd_use_case_set_param;
 static std::map<std::string, const char **> fake_list;
 static std::map<std::string, unsigned> fake_list_size;
+static unsigned snd_use_case_get_list_called;
 static unsigned snd_use_case_free_list_called;
 static std::vector<std::string> list_devices_callback_names;
 static std::vector<void*> list_devices_callback_args;
@@ -40,6 +41,7 @@ static struct cras_use_case_mgr cras_ucm_mgr;
 static const char *avail_verbs[] = { "HiFi", "Comment for Verb1" };
 
 static void ResetStubData() {
+  cache_free(&cras_ucm_mgr);
   snd_use_case_mgr_open_called = 0;
   snd_use_case_mgr_open_return = 0;
   snd_use_case_mgr_close_called = 0;
@@ -47,6 +49,7 @@ static void ResetStubData() {
   snd_use_case_get_called = 0;
   snd_use_case_set_called = 0;
   snd_use_case_set_param.clear();
+  snd_use_case_get_list_called = 0;
   snd_use_case_free_list_called = 0;
   snd_use_case_get_id.clear();
   snd_use_case_get_value.clear();
@@ -159,7 +162,8 @@ TEST(AlsaUcm, CheckEnabledAlready) {
   EXPECT_EQ(0, ucm_set_enabled(mgr, "Dev1", 0));
   EXPECT_EQ(1, snd_use_case_set_called);
 
-  EXPECT_EQ(2, snd_use_case_free_list_called);
+  /* The list is read once and dropped when the device is disabled. */
+  EXPECT_EQ(1, snd_use_case_free_list_called);
 }
 
 TEST(AlsaUcm, GetEdidForDev) {
@@ -547,6 +551,8 @@ TEST(AlsaUcm, SwapModeExists) {
   rc = ucm_swap_mode_exists(mgr);
   EXPECT_EQ(1, rc);
 
+  /* Drop the parsed lists to load the new config. */
+  cache_free(mgr);
   fake_list["_modifiers/HiFi"] = modifiers_2;
   fake_list_size["_modifiers/HiFi"] = 4;
   rc = ucm_swap_mode_exists(mgr);
@@ -867,11 +873,13 @@ TEST(AlsaUcm, UseFullySpecifiedUCMConfig) {
   ASSERT_FALSE(fully_specified_flag);
 
   /* Flag is set to "1". */
+  cache_free(mgr);
   snd_use_case_get_value[id] = std::string("1");
   fully_specified_flag = ucm_has_fully_specified_ucm_flag(mgr);
   ASSERT_TRUE(fully_specified_flag);
 
   /* Flag is set to "0". */
+  cache_free(mgr);
   snd_use_case_get_value[id] = std::string("0");
   fully_specified_flag = ucm_has_fully_specified_ucm_flag(mgr);
   ASSERT_FALSE(fully_specified_flag);
@@ -889,16 +897,48 @@ TEST(AlsaUcm, EnableHtimestampFlag) {
   ASSERT_FALSE(enable_htimestamp_flag);
 
   /* Flag is set to "1". */
+  cache_free(mgr);
   snd_use_case_get_value[id] = std::string("1");
   enable_htimestamp_flag = ucm_get_enable_htimestamp_flag(mgr);
   ASSERT_TRUE(enable_htimestamp_flag);
 
   /* Flag is set to "0". */
+  cache_free(mgr);
   snd_use_case_get_value[id] = std::string("0");
   enable_htimestamp_flag = ucm_get_enable_htimestamp_flag(mgr);
   ASSERT_FALSE(enable_htimestamp_flag);
 }
 
+TEST(AlsaUcm, DynamicMinBufferLevelFlag) {
+  struct cras_use_case_mgr *mgr = &cras_ucm_mgr;
+  std::string id = "=DynamicMinBufferLevel//HiFi";
+
+  ResetStubData();
+  EXPECT_EQ(0, ucm_get_dynamic_min_buffer_level_flag(mgr));
+
+  cache_free(mgr);
+  snd_use_case_get_value[id] = std::string("1");
+  EXPECT_EQ(1, ucm_get_dynamic_min_buffer_level_flag(mgr));
+
+  cache_free(mgr);
+  snd_use_case_get_value[id] = std::string("0");
+  EXPECT_EQ(0, ucm_get_dynamic_min_buffer_level_flag(mgr));
+}
+
+TEST(AlsaUcm, MinBufferLevelFloor) {
+  struct cras_use_case_mgr *mgr = &cras_ucm_mgr;
+  std::string id = "=MinBufferLevelFloor//HiFi";
+  unsigned int level = 0;
+
+  ResetStubData();
+  EXPECT_EQ(-ENOENT, ucm_get_min_buffer_level_floor(mgr, &level));
+
+  cache_free(mgr);
+  snd_use_case_get_value[id] = std::string("96");
+  EXPECT_EQ(0, ucm_get_min_buffer_level_floor(mgr, &level));
+  EXPECT_EQ(96, level);
+}
+
 TEST(AlsaUcm, GetMixerNameForDevice) {
   struct cras_use_case_mgr *mgr = &cras_ucm_mgr;
   const char *mixer_name_1, *mixer_name_2;
@@ -1447,6 +1487,54 @@ TEST(AlsaUcm, SetUseCase) {
   ucm_destroy(mgr);
 }
 
+TEST(AlsaUcm, CacheLookups) {
+  struct cras_use_case_mgr *mgr;
+  const char *verbs[] = { "HiFi", "Comment for Verb1",
+                          "Voice Call", "Comment for Verb2" };
+  const char *modifiers[] = { "Speaker Swap Mode",
+                              "Comment for Speaker Swap Mode" };
+  const char *jack_name;
+
+  ResetStubData();
+
+  fake_list["_verbs"] = verbs;
+  fake_list_size["_verbs"] = 4;
+  fake_list["_modifiers/HiFi"] = modifiers;
+  fake_list_size["_modifiers/HiFi"] = 2;
+  snd_use_case_get_value["=JackName/Headphone/HiFi"] = "Headphone Jack";
+
+  /* Verbs, devices and modifiers are parsed once at creation. */
+  mgr = ucm_create("foo");
+  ASSERT_NE(static_cast<struct cras_use_case_mgr *>(NULL), mgr);
+  EXPECT_EQ(3, snd_use_case_get_list_called);
+  EXPECT_EQ(1, ucm_swap_mode_exists(mgr));
+  EXPECT_EQ(1, ucm_swap_mode_exists(mgr));
+  EXPECT_EQ(3, snd_use_case_get_list_called);
+
+  /* Values are read from UCM only on the first lookup. */
+  jack_name = ucm_get_jack_name_for_dev(mgr, "Headphone");
+  EXPECT_EQ(0, strcmp(jack_name, "Headphone Jack"));
+  free((void *)jack_name);
+  jack_name = ucm_get_jack_name_for_dev(mgr, "Headphone");
+  EXPECT_EQ(0, strcmp(jack_name, "Headphone Jack"));
+  free((void *)jack_name);
+  EXPECT_EQ(NULL, ucm_get_jack_name_for_dev(mgr, "Speaker"));
+  EXPECT_EQ(NULL, ucm_get_jack_name_for_dev(mgr, "Speaker"));
+  EXPECT_EQ(2, snd_use_case_get_called);
+
+  /* Changing the verb drops everything but the list of verbs. */
+  EXPECT_EQ(0, ucm_set_use_case(mgr, CRAS_STREAM_TYPE_VOICE_COMMUNICATION));
+  EXPECT_EQ(0, ucm_set_use_case(mgr, CRAS_STREAM_TYPE_DEFAULT));
+  EXPECT_EQ(7, snd_use_case_get_list_called);
+  jack_name = ucm_get_jack_name_for_dev(mgr, "Headphone");
+  free((void *)jack_name);
+  EXPECT_EQ(3, snd_use_case_get_called);
+
+  /* Every non-empty list read is freed exactly once. */
+  ucm_destroy(mgr);
+  EXPECT_EQ(3, snd_use_case_free_list_called);
+}
+
 /* Stubs */
 
 extern "C" {
@@ -1487,6 +1575,7 @@ int snd_use_case_set(snd_use_case_mgr_t* uc_mgr,
 int snd_use_case_get_list(snd_use_case_mgr_t *uc_mgr,
                           const char *identifier,
                           const char **list[]) {
+  snd_use_case_get_list_called++;
   *list = fake_list[identifier];
   return fake_list_size[identifier];
 }
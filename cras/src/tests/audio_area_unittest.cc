@@ -306,6 +306,105 @@ TEST(AudioArea, KeyboardMicCopyFrontCenter) {
   cras_audio_area_destroy(a2);
 }
 
+TEST(AudioArea, CopyScaledAudioAreaOverwrites) {
+  struct cras_audio_format fmt;
+  int i;
+
+  fmt.num_channels = 2;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  for (i = 0; i < CRAS_CH_MAX; i++)
+    fmt.channel_layout[i] = stereo[i];
+
+  a1 = cras_audio_area_create(2);
+  a2 = cras_audio_area_create(2);
+  cras_audio_area_config_channels(a1, &fmt);
+  cras_audio_area_config_channels(a2, &fmt);
+  cras_audio_area_config_buf_pointers(a1, &fmt, (uint8_t *)buf1);
+  cras_audio_area_config_buf_pointers(a2, &fmt, (uint8_t *)buf2);
+  a1->frames = 16;
+  a2->frames = 16;
+
+  /* Garbage in dst must not leak into the result. */
+  for (i = 0; i < 32; i++) {
+    buf1[i] = rand();
+    buf2[i] = rand() % 1000;
+  }
+  EXPECT_EQ(16, cras_audio_area_copy_scaled(a1, 0, &fmt, a2, 0, 2.0f, 0));
+  for (i = 0; i < 32; i++)
+    EXPECT_EQ(buf1[i], buf2[i] * 2);
+
+  cras_audio_area_destroy(a1);
+  cras_audio_area_destroy(a2);
+}
+
+TEST(AudioArea, CopyScaledAudioAreaRamp) {
+  struct cras_audio_format fmt;
+  float scaler = 0.5f;
+  float increment = 0.1f;
+  int i;
+
+  fmt.num_channels = 2;
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  for (i = 0; i < CRAS_CH_MAX; i++)
+    fmt.channel_layout[i] = stereo[i];
+
+  a1 = cras_audio_area_create(2);
+  a2 = cras_audio_area_create(2);
+  cras_audio_area_config_channels(a1, &fmt);
+  cras_audio_area_config_channels(a2, &fmt);
+  cras_audio_area_config_buf_pointers(a1, &fmt, (uint8_t *)buf1);
+  cras_audio_area_config_buf_pointers(a2, &fmt, (uint8_t *)buf2);
+  a1->frames = 16;
+  a2->frames = 16;
+
+  for (i = 0; i < 32; i++)
+    buf2[i] = 1000;
+  cras_audio_area_copy_scaled(a1, 0, &fmt, a2, 0, scaler, increment);
+  for (i = 0; i < 16; i++) {
+    int16_t expected_value = (int16_t)(1000 * scaler);
+    EXPECT_EQ(expected_value, (int16_t)buf1[i * 2]);
+    EXPECT_EQ(expected_value, (int16_t)buf1[i * 2 + 1]);
+    scaler += increment;
+  }
+
+  cras_audio_area_destroy(a1);
+  cras_audio_area_destroy(a2);
+}
+
+TEST(AudioArea, CopyScaledStereoToMono) {
+  struct cras_audio_format src_fmt, dst_fmt;
+  int i;
+
+  dst_fmt.num_channels = 1;
+  dst_fmt.format = SND_PCM_FORMAT_S16_LE;
+  for (i = 0; i < CRAS_CH_MAX; i++)
+    dst_fmt.channel_layout[i] = mono[i];
+  src_fmt.num_channels = 2;
+  src_fmt.format = SND_PCM_FORMAT_S16_LE;
+  for (i = 0; i < CRAS_CH_MAX; i++)
+    src_fmt.channel_layout[i] = stereo[i];
+
+  a1 = cras_audio_area_create(1);
+  a2 = cras_audio_area_create(2);
+  cras_audio_area_config_channels(a1, &dst_fmt);
+  cras_audio_area_config_channels(a2, &src_fmt);
+  cras_audio_area_config_buf_pointers(a1, &dst_fmt, (uint8_t *)buf1);
+  cras_audio_area_config_buf_pointers(a2, &src_fmt, (uint8_t *)buf2);
+  a1->frames = 16;
+  a2->frames = 16;
+
+  for (i = 0; i < 32; i++) {
+    buf1[i] = rand();
+    buf2[i] = rand() % 10000;
+  }
+  cras_audio_area_copy_scaled(a1, 0, &dst_fmt, a2, 0, 1.0, 0);
+  for (i = 0; i < 16; i++)
+    EXPECT_EQ(buf1[i], buf2[i * 2] + buf2[i * 2 + 1]);
+
+  cras_audio_area_destroy(a1);
+  cras_audio_area_destroy(a2);
+}
+
 }  //  namespace
 
 extern "C" {
@@ -329,6 +428,37 @@ void cras_mix_add_scale_stride(snd_pcm_format_t fmt, uint8_t *dst, uint8_t *src,
 	}
 }
 
+void cras_mix_copy_scale_stride_increment(snd_pcm_format_t fmt, uint8_t *dst,
+					  uint8_t *src, unsigned int count,
+					  unsigned int dst_stride,
+					  unsigned int src_stride,
+					  float scaler, float increment)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		int32_t val;
+		val = *(int16_t *)src * scaler;
+		if (val > INT16_MAX)
+			val = INT16_MAX;
+		else if (val < INT16_MIN)
+			val = INT16_MIN;
+		*(int16_t*)dst = val;
+		dst += dst_stride;
+		src += src_stride;
+		scaler += increment;
+	}
+}
+
+void cras_mix_copy_scale_stride(snd_pcm_format_t fmt, uint8_t *dst,
+				uint8_t *src, unsigned int count,
+				unsigned int dst_stride,
+				unsigned int src_stride, float scaler)
+{
+	cras_mix_copy_scale_stride_increment(fmt, dst, src, count, dst_stride,
+					     src_stride, scaler, 0);
+}
+
 }  //  extern "C"
 
 int main(int argc, char **argv) {
@@ -96,12 +96,7 @@ void cras_system_state_add_snapshot(
   cras_system_state_add_snapshot_called ++;
 }
 
-struct audio_thread* cras_iodev_list_get_audio_thread() {
-  return reinterpret_cast <struct audio_thread*>(0xff);
-}
-
-int audio_thread_dump_thread_info(struct audio_thread *thread,
-                                  struct audio_debug_info *info) {
+int cras_iodev_list_dump_audio_thread_info(struct audio_debug_info *info) {
   audio_thread_dump_thread_info_called ++;
   return 0;
 }
@@ -42,6 +42,11 @@ static struct cras_iodev *cras_device_monitor_reset_device_iodev;
 static struct cras_iodev *cras_iodev_start_ramp_odev;
 static enum CRAS_IODEV_RAMP_REQUEST cras_iodev_start_ramp_request;
 static std::map<const struct dev_stream*, struct timespec> dev_stream_wake_time_val;
+static int cras_set_thread_priority_called;
+static int cras_set_thread_deadline_called;
+static int cras_set_thread_deadline_ret;
+static uint64_t cras_set_thread_deadline_runtime_ns;
+static uint64_t cras_set_thread_deadline_period_ns;
 
 void ResetGlobalStubData() {
   cras_rstream_dev_offset_called = 0;
@@ -77,6 +82,11 @@ void ResetGlobalStubData() {
   cras_iodev_start_ramp_odev = NULL;
   cras_iodev_start_ramp_request = CRAS_IODEV_RAMP_REQUEST_UP_START_PLAYBACK;
   dev_stream_wake_time_val.clear();
+  cras_set_thread_priority_called = 0;
+  cras_set_thread_deadline_called = 0;
+  cras_set_thread_deadline_ret = 0;
+  cras_set_thread_deadline_runtime_ns = 0;
+  cras_set_thread_deadline_period_ns = 0;
 }
 
 // Test streams and devices manipulation.
@@ -227,6 +237,63 @@ TEST_F(StreamDeviceSuite, AddRemoveOpenOutputDevice) {
   EXPECT_EQ(NULL, adev);
 }
 
+TEST_F(StreamDeviceSuite, SchedDeadlineFollowsCallbackInterval) {
+  struct cras_iodev iodev, iodev2;
+
+  format_.frame_rate = 48000;
+  SetupDevice(&iodev, CRAS_STREAM_OUTPUT);
+  SetupDevice(&iodev2, CRAS_STREAM_INPUT);
+  iodev2.min_cb_level = FIRST_CB_LEVEL / 2;
+  thread_->sched_deadline = 1;
+
+  // 480 frames at 48kHz, with the minimum runtime.
+  thread_add_open_dev(thread_, &iodev);
+  EXPECT_EQ(1, cras_set_thread_deadline_called);
+  EXPECT_EQ(10000000, cras_set_thread_deadline_period_ns);
+  EXPECT_EQ(200000, cras_set_thread_deadline_runtime_ns);
+
+  thread_add_open_dev(thread_, &iodev2);
+  EXPECT_EQ(2, cras_set_thread_deadline_called);
+  EXPECT_EQ(5000000, cras_set_thread_deadline_period_ns);
+
+  // The runtime covers twice the longest wake up.
+  thread_->longest_wake.tv_sec = 0;
+  thread_->longest_wake.tv_nsec = 1000000;
+  thread_rm_open_dev(thread_, &iodev2);
+  EXPECT_EQ(3, cras_set_thread_deadline_called);
+  EXPECT_EQ(10000000, cras_set_thread_deadline_period_ns);
+  EXPECT_EQ(2000000, cras_set_thread_deadline_runtime_ns);
+  EXPECT_EQ(2000000, thread_->dl_runtime_ns);
+
+  // Up to half of the period.
+  thread_->longest_wake.tv_nsec = 8000000;
+  thread_rm_open_dev(thread_, &iodev);
+  EXPECT_EQ(4, cras_set_thread_deadline_called);
+  EXPECT_EQ(5000000, cras_set_thread_deadline_runtime_ns);
+  EXPECT_EQ(0, cras_set_thread_priority_called);
+  format_.frame_rate = 0;
+}
+
+TEST_F(StreamDeviceSuite, SchedDeadlineFallsBackToRR) {
+  struct cras_iodev iodev;
+
+  format_.frame_rate = 48000;
+  SetupDevice(&iodev, CRAS_STREAM_OUTPUT);
+  thread_->sched_deadline = 1;
+  cras_set_thread_deadline_ret = -EBUSY;
+
+  thread_add_open_dev(thread_, &iodev);
+  EXPECT_EQ(1, cras_set_thread_deadline_called);
+  EXPECT_EQ(1, cras_set_thread_priority_called);
+  EXPECT_EQ(0, thread_->sched_deadline);
+  EXPECT_EQ(0, thread_->dl_runtime_ns);
+
+  // Not tried again.
+  thread_rm_open_dev(thread_, &iodev);
+  EXPECT_EQ(1, cras_set_thread_deadline_called);
+  format_.frame_rate = 0;
+}
+
 TEST_F(StreamDeviceSuite, StartRamp) {
   struct cras_iodev iodev;
   struct open_dev *adev;
@@ -727,28 +794,54 @@ TEST(AUdioThreadStreams, DrainStream) {
 }
 
 TEST(BusyloopDetectSuite, CheckerTest) {
-  continuous_zero_sleep_count = 0;
+  struct audio_thread thread;
+
+  memset(&thread, 0, sizeof(thread));
   cras_audio_thread_busyloop_called = 0;
   timespec wait_ts;
   wait_ts.tv_sec = 0;
   wait_ts.tv_nsec = 0;
 
-  check_busyloop(&wait_ts);
-  EXPECT_EQ(continuous_zero_sleep_count, 1);
+  check_busyloop(&thread, &wait_ts);
+  EXPECT_EQ(thread.continuous_zero_sleep_count, 1);
   EXPECT_EQ(cras_audio_thread_busyloop_called, 0);
-  check_busyloop(&wait_ts);
-  EXPECT_EQ(continuous_zero_sleep_count, 2);
+  check_busyloop(&thread, &wait_ts);
+  EXPECT_EQ(thread.continuous_zero_sleep_count, 2);
   EXPECT_EQ(cras_audio_thread_busyloop_called, 1);
-  check_busyloop(&wait_ts);
-  EXPECT_EQ(continuous_zero_sleep_count, 3);
+  check_busyloop(&thread, &wait_ts);
+  EXPECT_EQ(thread.continuous_zero_sleep_count, 3);
   EXPECT_EQ(cras_audio_thread_busyloop_called, 1);
 
   wait_ts.tv_sec = 1;
-  check_busyloop(&wait_ts);
-  EXPECT_EQ(continuous_zero_sleep_count, 0);
+  check_busyloop(&thread, &wait_ts);
+  EXPECT_EQ(thread.continuous_zero_sleep_count, 0);
   EXPECT_EQ(cras_audio_thread_busyloop_called, 1);
 }
 
+TEST(AudioThreadWorker, CreateWorkerSharesLog) {
+  struct audio_thread *thread, *worker;
+  struct audio_thread_event_log *log;
+
+  thread = audio_thread_create();
+  ASSERT_TRUE(thread);
+  EXPECT_EQ(0, thread->worker_idx);
+  EXPECT_EQ(-1, thread->cpu);
+  log = atlog;
+  ASSERT_TRUE(log);
+
+  worker = audio_thread_create_worker(1, 3);
+  ASSERT_TRUE(worker);
+  EXPECT_EQ(2, worker->worker_idx);
+  EXPECT_EQ(3, worker->cpu);
+  EXPECT_EQ(log, atlog);
+
+  // The log is kept until the last thread is destroyed.
+  audio_thread_destroy(thread);
+  EXPECT_EQ(log, atlog);
+  audio_thread_destroy(worker);
+  EXPECT_EQ(NULL, atlog);
+}
+
 extern "C" {
 
 int cras_iodev_add_stream(struct cras_iodev *iodev, struct dev_stream *stream)
@@ -777,6 +870,12 @@ double cras_iodev_get_est_rate_ratio(const struct cras_iodev *iodev)
   return 1.0;
 }
 
+unsigned int cras_level_meter_get(const struct cras_level_meter *meter,
+                                  float *peak, float *rms)
+{
+  return 0;
+}
+
 unsigned int cras_iodev_max_stream_offset(const struct cras_iodev *iodev)
 {
   return 0;
@@ -930,6 +1029,30 @@ int cras_set_rt_scheduling(int rt_lim)
 }
 
 int cras_set_thread_priority(int priority)
+{
+  cras_set_thread_priority_called++;
+  return 0;
+}
+
+int cras_set_thread_deadline(uint64_t runtime_ns, uint64_t period_ns)
+{
+  cras_set_thread_deadline_called++;
+  cras_set_thread_deadline_runtime_ns = runtime_ns;
+  cras_set_thread_deadline_period_ns = period_ns;
+  return cras_set_thread_deadline_ret;
+}
+
+int cras_set_thread_cpu(int cpu)
+{
+  return 0;
+}
+
+unsigned int cras_system_get_wake_tolerance_us()
+{
+  return 0;
+}
+
+int cras_system_get_sched_deadline()
 {
   return 0;
 }
@@ -1075,6 +1198,45 @@ int cras_iodev_output_underrun(struct cras_iodev *odev)
   return 0;
 }
 
+void cras_iodev_update_min_buffer_level(struct cras_iodev *odev,
+                                        const struct timespec *now)
+{
+}
+
+void cras_iodev_begin_io_cycle(struct cras_iodev *iodev,
+                               const struct timespec *wake_ts)
+{
+}
+
+void cras_iodev_end_io_cycle(struct cras_iodev *iodev)
+{
+}
+
+void cras_iodev_log_stream_fetch(struct cras_iodev *odev,
+                                 cras_stream_id_t stream_id,
+                                 const struct timespec *pending)
+{
+}
+
+void cras_iodev_log_output_write(struct cras_iodev *odev,
+                                 unsigned int hw_level, unsigned int frames)
+{
+}
+
+void cras_iodev_log_output_level(struct cras_iodev *odev,
+                                 unsigned int hw_level)
+{
+}
+
+unsigned int cras_underrun_log_get(const struct cras_underrun_log *log,
+                                   struct cras_dev_cycle_info *cycles,
+                                   struct timespec *frozen_ts)
+{
+  frozen_ts->tv_sec = 0;
+  frozen_ts->tv_nsec = 0;
+  return 0;
+}
+
 int cras_iodev_prepare_output_before_write_samples(struct cras_iodev *odev)
 {
   cras_iodev_prepare_output_before_write_samples_called++;
@@ -1098,6 +1260,18 @@ int cras_server_metrics_num_underruns(unsigned num_underruns)
   return 0;
 }
 
+int cras_server_metrics_time_to_first_sample(unsigned delay_msec)
+{
+  return 0;
+}
+
+unsigned int preroll_buffer_read_area(struct preroll_buffer *buf,
+				      uint64_t *pos,
+				      struct cras_audio_area **area)
+{
+  return 0;
+}
+
 float cras_iodev_get_software_gain_scaler(const struct cras_iodev *iodev)
 {
   return 1.0f;
@@ -109,6 +109,38 @@ TEST_F(BufferShareTestSuite, TwoDevs) {
   buffer_share_destroy(dm);
 }
 
+TEST_F(BufferShareTestSuite, Slots) {
+  buffer_share *dm = buffer_share_create(1024);
+  int slot[INITIAL_ID_SIZE + 1];
+  unsigned int i;
+
+  for (i = 0; i < INITIAL_ID_SIZE; i++) {
+    EXPECT_EQ(0, buffer_share_add_id(dm, 0xf00 + i, NULL));
+    slot[i] = buffer_share_id_slot(dm, 0xf00 + i);
+    EXPECT_LE(0, slot[i]);
+  }
+  EXPECT_EQ(-ENOENT, buffer_share_id_slot(dm, 0xf00 + INITIAL_ID_SIZE));
+
+  // Slots are kept when the id array grows and when other ids leave.
+  EXPECT_EQ(0, buffer_share_add_id(dm, 0xf00 + INITIAL_ID_SIZE, NULL));
+  slot[INITIAL_ID_SIZE] = buffer_share_id_slot(dm, 0xf00 + INITIAL_ID_SIZE);
+  EXPECT_EQ(0, buffer_share_rm_id(dm, 0xf00));
+  for (i = 1; i <= INITIAL_ID_SIZE; i++)
+    EXPECT_EQ(slot[i], buffer_share_id_slot(dm, 0xf00 + i));
+
+  for (i = 1; i <= INITIAL_ID_SIZE; i++)
+    buffer_share_slot_offset_update(dm, slot[i], 100 * i);
+  EXPECT_EQ(200, buffer_share_slot_offset(dm, slot[2]));
+  EXPECT_EQ(200, buffer_share_id_offset(dm, 0xf02));
+  EXPECT_EQ(100 * INITIAL_ID_SIZE, buffer_share_max_offset(dm));
+
+  EXPECT_EQ(100, buffer_share_get_new_write_point(dm));
+  EXPECT_EQ(0, buffer_share_slot_offset(dm, slot[1]));
+  EXPECT_EQ(100 * (INITIAL_ID_SIZE - 1), buffer_share_max_offset(dm));
+
+  buffer_share_destroy(dm);
+}
+
 }  //  namespace
 
 int main(int argc, char **argv) {
@@ -37,6 +37,7 @@ static const size_t MAX_ATTACHED_CLIENTS = 10; /* Max clients to print out. */
 static int pipefd[2];
 static struct timespec last_latency;
 static int show_latency;
+static int low_latency;
 static float last_rms_sqr_sum;
 static int last_rms_size;
 static float total_rms_sqr_sum;
@@ -344,6 +345,25 @@ static void print_attached_client_list(struct cras_client *client)
 		       clients[i].gid);
 }
 
+static void print_alsa_card_ready_info(struct cras_client *client)
+{
+	struct cras_alsa_card_ready_info cards[CRAS_MAX_ALSA_CARDS];
+	int i, num_cards;
+
+	num_cards = cras_client_get_alsa_card_ready_info(client, cards,
+							 CRAS_MAX_ALSA_CARDS);
+	if (num_cards < 0)
+		return;
+	printf("ALSA cards:\n");
+	printf("\tCard\tProbe(ms)\tMain(ms)\tReady(ms)\n");
+	for (i = 0; i < num_cards; i++)
+		printf("\t%u\t%u\t\t%u\t\t%u\n",
+		       cards[i].card_index,
+		       cards[i].probe_ms,
+		       cards[i].complete_ms,
+		       cards[i].ready_ms);
+}
+
 static void print_active_stream_info(struct cras_client *client)
 {
 	struct timespec ts;
@@ -460,6 +480,14 @@ static void show_alog_tag(const struct audio_thread_event_log *log,
 		printf("%-30s written:%d queued:%u\n",
 		       "A2DP_WRITE", data1, data2);
 		break;
+	case AUDIO_THREAD_A2DP_SEND_PACKET:
+		printf("%-30s frames:%d encode_us:%u packets:%u\n",
+		       "A2DP_SEND_PACKET", data1, data2, data3);
+		break;
+	case AUDIO_THREAD_A2DP_SET_BITPOOL:
+		printf("%-30s bitpool:%u queued_bytes:%u eagain:%u\n",
+		       "A2DP_SET_BITPOOL", data1, data2, data3);
+		break;
 	case AUDIO_THREAD_DEV_STREAM_MIX:
 		printf("%-30s written:%u read:%u\n",
 		       "DEV_STREAM_MIX", data1, data2);
@@ -472,6 +500,10 @@ static void show_alog_tag(const struct audio_thread_event_log *log,
 		printf("%-30s stream:%x write:%u shm_fr:%u\n",
 		       "CAPTURE_WRITE", data1, data2, data3);
 		break;
+	case AUDIO_THREAD_CAPTURE_PREROLL:
+		printf("%-30s stream:%x read:%u lag:%u\n",
+		       "CAPTURE_PREROLL", data1, data2, data3);
+		break;
 	case AUDIO_THREAD_CONV_COPY:
 		printf("%-30s wr_buf:%u shm_writable:%u offset:%u\n",
 		       "CONV_COPY", data1, data2, data3);
@@ -535,16 +567,92 @@ static void show_alog_tag(const struct audio_thread_event_log *log,
 	case AUDIO_THREAD_SEVERE_UNDERRUN:
 		printf("%-30s dev:%u\n", "SEVERE_UNDERRUN", data1);
 		break;
+	case AUDIO_THREAD_WAKE_PREDICTION:
+		printf("%-30s dev:%u err:%d correction:%d\n",
+		       "WAKE_PREDICTION", data1, (int)data2, (int)data3);
+		break;
+	case AUDIO_THREAD_MIN_BUFFER_LEVEL:
+		printf("%-30s dev:%u from:%u to:%u\n",
+		       "MIN_BUFFER_LEVEL", data1, data2, data3);
+		break;
+	case AUDIO_THREAD_DEV_HW_CALLS:
+		printf("%-30s dev:%u calls:%u cached_levels:%u\n",
+		       "DEV_HW_CALLS", data1, data2, data3);
+		break;
 	default:
 		printf("%-30s tag:%u\n","UNKNOWN", tag);
 		break;
 	}
 }
 
+/* Prints the wake up prediction errors of a device, if it has any. */
+static void print_wake_err_hist(const struct audio_dev_debug_info *dev)
+{
+	static const char *labels[CRAS_WAKE_ERR_HIST_BUCKETS] = {
+		"<-1000", "<-250", "<-50", "<50", "<250", "<1000", ">=1000"
+	};
+	unsigned int i, total = 0;
+
+	for (i = 0; i < CRAS_WAKE_ERR_HIST_BUCKETS; i++)
+		total += dev->wake_err_hist[i];
+	if (!total)
+		return;
+
+	printf("wake_correction_frames: %d\n", (int)dev->wake_correction_frames);
+	printf("wake_err_hist(usec):");
+	for (i = 0; i < CRAS_WAKE_ERR_HIST_BUCKETS; i++)
+		printf(" %s:%u", labels[i], (unsigned int)dev->wake_err_hist[i]);
+	printf("\n");
+}
+
+/* Prints the wake ups of a device frozen at its last underrun, if any. */
+static void print_underrun_cycles(const struct audio_dev_debug_info *dev)
+{
+	unsigned int i;
+
+	if (!dev->num_underrun_cycles ||
+	    dev->num_underrun_cycles > CRAS_UNDERRUN_LOG_CYCLES)
+		return;
+
+	printf("last_underrun: %u.%09u\n", (unsigned int)dev->underrun_log_sec,
+	       (unsigned int)dev->underrun_log_nsec);
+	printf("%-20s %8s %8s %8s %8s %-10s %8s\n", "wake", "before",
+	       "written", "after", "dsp_us", "stream", "fetch_us");
+	for (i = 0; i < dev->num_underrun_cycles; i++) {
+		const struct cras_dev_cycle_info *c = &dev->underrun_cycles[i];
+
+		printf("%10u.%09u %8u %8u %8u %8u %-10llx %8u\n",
+		       (unsigned int)c->wake_sec, (unsigned int)c->wake_nsec,
+		       (unsigned int)c->hw_level_before,
+		       (unsigned int)c->frames_written,
+		       (unsigned int)c->hw_level_after,
+		       (unsigned int)c->dsp_us,
+		       (unsigned long long)c->slowest_stream_id,
+		       (unsigned int)c->slowest_fetch_us);
+	}
+}
+
 static void print_audio_debug_info(const struct audio_debug_info *info)
 {
 	int i, j;
 	printf("Audio Debug Stats:\n");
+	printf("wakeups_per_sec: %u\n", (unsigned int)info->wakeups_per_sec);
+	printf("-------------threads------------\n");
+	for (i = 0; i < info->num_threads && i < MAX_DEBUG_THREADS; i++) {
+		printf("audio_thread: %d\n"
+		       "sched_deadline: %u\n"
+		       "runtime_us: %u\n"
+		       "period_us: %u\n"
+		       "budget_overruns: %u\n"
+		       "longest_wake_us: %u\n",
+		       i,
+		       (unsigned int)info->threads[i].sched_deadline,
+		       (unsigned int)info->threads[i].runtime_us,
+		       (unsigned int)info->threads[i].period_us,
+		       (unsigned int)info->threads[i].budget_overruns,
+		       (unsigned int)info->threads[i].longest_wake_us);
+		printf("\n");
+	}
 	printf("-------------devices------------\n");
 	if (info->num_devs > MAX_DEBUG_DEVS)
 		return;
@@ -563,7 +671,11 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 		       "est_rate_ratio: %lf\n"
 		       "num_underruns: %u\n"
 		       "num_severe_underruns: %u\n"
-		       "highest_hw_level: %u\n",
+		       "highest_hw_level: %u\n"
+		       "audio_thread: %u\n"
+		       "longest_wake_to_write_us: %u\n"
+		       "min_slack_frames: %d\n"
+		       "missed_deadlines: %u\n",
 		       (unsigned int)info->devs[i].buffer_size,
 		       (unsigned int)info->devs[i].min_buffer_level,
 		       (unsigned int)info->devs[i].min_cb_level,
@@ -573,7 +685,37 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 		       info->devs[i].est_rate_ratio,
 		       (unsigned int)info->devs[i].num_underruns,
 		       (unsigned int)info->devs[i].num_severe_underruns,
-		       (unsigned int)info->devs[i].highest_hw_level);
+		       (unsigned int)info->devs[i].highest_hw_level,
+		       (unsigned int)info->devs[i].audio_thread,
+		       (unsigned int)info->devs[i].longest_wake_to_write_us,
+		       (int)info->devs[i].min_slack_frames,
+		       (unsigned int)info->devs[i].missed_deadlines);
+		if (info->devs[i].num_level_channels) {
+			unsigned int ch;
+
+			printf("peak_level:");
+			for (ch = 0; ch < info->devs[i].num_level_channels &&
+				     ch < CRAS_CH_MAX; ch++)
+				printf(" %.3f", info->devs[i].peak_level[ch]);
+			printf("\nrms_level:");
+			for (ch = 0; ch < info->devs[i].num_level_channels &&
+				     ch < CRAS_CH_MAX; ch++)
+				printf(" %.3f", info->devs[i].rms_level[ch]);
+			printf("\n");
+		}
+		print_wake_err_hist(&info->devs[i]);
+		if (info->devs[i].configured_min_buffer_level !=
+		    info->devs[i].lowest_min_buffer_level)
+			printf("configured_min_buffer_level: %u\n"
+			       "lowest_min_buffer_level: %u\n"
+			       "min_buffer_level_backoffs: %u\n",
+			       (unsigned int)info->devs[i]
+				       .configured_min_buffer_level,
+			       (unsigned int)info->devs[i]
+				       .lowest_min_buffer_level,
+			       (unsigned int)info->devs[i]
+				       .min_buffer_level_backoffs);
+		print_underrun_cycles(&info->devs[i]);
 		printf("\n");
 	}
 
@@ -597,7 +739,10 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 		       "frame_rate: %u\n"
 		       "num_channels: %u\n"
 		       "longest_fetch_sec: %u.%09u\n"
-		       "num_overruns: %u\n",
+		       "num_overruns: %u\n"
+		       "delay_us: %u\n"
+		       "fetch_p99_us: %u\n"
+		       "num_late_fetches: %u\n",
 		       (unsigned int)info->streams[i].buffer_frames,
 		       (unsigned int)info->streams[i].cb_threshold,
 		       (unsigned int)info->streams[i].effects,
@@ -605,7 +750,10 @@ static void print_audio_debug_info(const struct audio_debug_info *info)
 		       (unsigned int)info->streams[i].num_channels,
 		       (unsigned int)info->streams[i].longest_fetch_sec,
 		       (unsigned int)info->streams[i].longest_fetch_nsec,
-		       (unsigned int)info->streams[i].num_overruns);
+		       (unsigned int)info->streams[i].num_overruns,
+		       (unsigned int)info->streams[i].delay_us,
+		       (unsigned int)info->streams[i].fetch_p99_us,
+		       (unsigned int)info->streams[i].num_late_fetches);
 		printf("channel map:");
 		for (channel = 0; channel < CRAS_CH_MAX; channel++)
 			printf("%d ", info->streams[i].channel_layout[channel]);
@@ -1017,7 +1165,8 @@ static int run_playback(struct cras_client *client,
 			size_t block_size,
 			enum CRAS_STREAM_TYPE stream_type,
 			size_t rate,
-			size_t num_channels)
+			size_t num_channels,
+			uint32_t flags)
 {
 	int fd;
 
@@ -1028,7 +1177,7 @@ static int run_playback(struct cras_client *client,
 	}
 
 	run_file_io_stream(client, fd, CRAS_STREAM_OUTPUT, block_size,
-			   stream_type, rate, num_channels, 0, 0, 0);
+			   stream_type, rate, num_channels, flags, 0, 0);
 
 	close(fd);
 	return 0;
@@ -1042,6 +1191,7 @@ static void print_server_info(struct cras_client *client)
 	print_user_muted(client);
 	print_device_lists(client);
 	print_attached_client_list(client);
+	print_alsa_card_ready_info(client);
 	print_active_stream_info(client);
 }
 
@@ -1130,6 +1280,7 @@ static void mute_loop_test(struct cras_client *client, int auto_reconnect)
 
 static struct option long_options[] = {
 	{"show_latency",	no_argument, &show_latency, 1},
+	{"low_latency",		no_argument, &low_latency, 1},
 	{"show_rms",            no_argument, &show_rms, 1},
 	{"show_total_rms",      no_argument, &show_total_rms, 1},
 	{"select_input",        required_argument,      0, 'a'},
@@ -1206,6 +1357,8 @@ static void show_usage()
 	printf("--help - Print this message.\n");
 	printf("--listen_for_hotword <name> - Listen and capture hotword stream if supported\n");
 	printf("--loopback_file <name> - Name of file to record from loopback device.\n");
+	printf("--low_latency - Keep the output device level to two blocks of "
+	       "the playback stream.\n");
 	printf("--mute <0|1> - Set system mute state.\n");
 	printf("--mute_loop_test <0|1> - Continuously loop mute/umute. Argument: 0 - stop on error.\n"
 	       "                         1 - automatically reconnect to CRAS.\n");
@@ -1261,6 +1414,7 @@ int main(int argc, char **argv)
 	enum CRAS_STREAM_TYPE stream_type = CRAS_STREAM_TYPE_DEFAULT;
 	int rc = 0;
 	uint32_t stream_flags = 0;
+	uint32_t playback_flags = 0;
 	cras_stream_id_t stream_id = 0;
 
 	option_index = 0;
@@ -1608,6 +1762,9 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (low_latency)
+		playback_flags = LOW_LATENCY;
+
 	duration_frames = duration_seconds * rate;
 	if (block_size == NOT_ASSIGNED)
 		block_size = get_block_size(PLAYBACK_BUFFERED_TIME_IN_US, rate);
@@ -1625,10 +1782,12 @@ int main(int argc, char **argv)
 		if (strcmp(playback_file, "-") == 0)
 			rc = run_file_io_stream(client, 0, CRAS_STREAM_OUTPUT,
 					block_size, stream_type, rate,
-					num_channels, stream_flags, 0, 0);
+					num_channels,
+					stream_flags | playback_flags, 0, 0);
 		else
 			rc = run_playback(client, playback_file, block_size,
-					  stream_type, rate, num_channels);
+					  stream_type, rate, num_channels,
+					  stream_flags | playback_flags);
 	} else if (loopback_file != NULL) {
 		rc = run_capture(client, loopback_file, block_size,
 				 stream_type, rate, num_channels,
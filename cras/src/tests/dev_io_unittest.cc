@@ -67,6 +67,82 @@ TEST_F(DevIoSuite, SendCapturedFails) {
   EXPECT_EQ(-3, dev_io_send_captured_samples(dev_list));
 }
 
+TEST_F(DevIoSuite, RunServicesEarliestDeadlineFirst) {
+  const size_t cb_threshold = 480;
+
+  cras_audio_format format;
+  fill_audio_format(&format, 48000);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+  dev_io_set_wake_ts(&start);
+
+  struct open_dev* odev_list = NULL;
+  struct open_dev* idev_list = NULL;
+  DevicePtr dev1 = create_device(CRAS_STREAM_OUTPUT, cb_threshold,
+                                 &format, CRAS_NODE_TYPE_HEADPHONE);
+  DevicePtr dev2 = create_device(CRAS_STREAM_OUTPUT, cb_threshold,
+                                 &format, CRAS_NODE_TYPE_HDMI);
+  DevicePtr dev3 = create_device(CRAS_STREAM_OUTPUT, cb_threshold,
+                                 &format, CRAS_NODE_TYPE_USB);
+  dev1->dev->ext_format = &format;
+  dev2->dev->ext_format = &format;
+  dev3->dev->ext_format = &format;
+  dev1->odev->wake_ts = start;
+  dev1->odev->wake_ts.tv_sec += 3;
+  dev2->odev->wake_ts = start;
+  dev2->odev->wake_ts.tv_sec += 1;
+  dev3->odev->wake_ts = start;
+  dev3->odev->wake_ts.tv_sec += 2;
+  DL_APPEND(odev_list, dev1->odev.get());
+  DL_APPEND(odev_list, dev2->odev.get());
+  DL_APPEND(odev_list, dev3->odev.get());
+
+  dev_io_run(&odev_list, &idev_list, NULL);
+
+  ASSERT_EQ(dev2->odev.get(), odev_list);
+  ASSERT_EQ(dev3->odev.get(), odev_list->next);
+  ASSERT_EQ(dev1->odev.get(), odev_list->next->next);
+  EXPECT_EQ(NULL, odev_list->next->next->next);
+  EXPECT_EQ(dev1->odev.get(), odev_list->prev);
+  EXPECT_EQ(0, dev1->odev->missed_deadlines);
+  EXPECT_EQ(0, dev2->odev->missed_deadlines);
+  EXPECT_EQ(0, dev3->odev->missed_deadlines);
+}
+
+TEST_F(DevIoSuite, RunCountsMissedDeadlines) {
+  const size_t cb_threshold = 480;
+
+  cras_audio_format format;
+  fill_audio_format(&format, 48000);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+  dev_io_set_wake_ts(&start);
+
+  struct open_dev* odev_list = NULL;
+  struct open_dev* idev_list = NULL;
+  DevicePtr late = create_device(CRAS_STREAM_OUTPUT, cb_threshold,
+                                 &format, CRAS_NODE_TYPE_HEADPHONE);
+  DevicePtr on_time = create_device(CRAS_STREAM_OUTPUT, cb_threshold,
+                                    &format, CRAS_NODE_TYPE_HDMI);
+  late->dev->ext_format = &format;
+  on_time->dev->ext_format = &format;
+  // Woke up 2ms after the deadline of the first device.
+  struct timespec two_ms = { 0, 2000000 };
+  subtract_timespecs(&start, &two_ms, &late->odev->wake_ts);
+  on_time->odev->wake_ts = start;
+  on_time->odev->wake_ts.tv_sec += 1;
+  DL_APPEND(odev_list, on_time->odev.get());
+  DL_APPEND(odev_list, late->odev.get());
+
+  dev_io_run(&odev_list, &idev_list, NULL);
+
+  EXPECT_EQ(late->odev.get(), odev_list);
+  EXPECT_EQ(1, late->odev->missed_deadlines);
+  EXPECT_EQ(0, on_time->odev->missed_deadlines);
+}
+
 /* Stubs */
 extern "C" {
 
@@ -86,6 +162,18 @@ int cras_server_metrics_num_underruns(unsigned num_underruns)
   return 0;
 }
 
+int cras_server_metrics_time_to_first_sample(unsigned delay_msec)
+{
+  return 0;
+}
+
+unsigned int preroll_buffer_read_area(struct preroll_buffer *buf,
+				      uint64_t *pos,
+				      struct cras_audio_area **area)
+{
+  return 0;
+}
+
 int input_data_get_for_stream(
 		struct input_data *data,
 		struct cras_rstream *stream,
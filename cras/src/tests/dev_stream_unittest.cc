@@ -57,6 +57,8 @@ struct cras_audio_area_copy_call {
   const struct cras_audio_area *src;
   unsigned int src_offset;
   float software_gain_scaler;
+  float increment;
+  int mixed;
 };
 
 struct fmt_conv_call {
@@ -128,6 +130,7 @@ class CreateSuite : public testing::Test{
       rstream_.format.num_channels = 2;
       rstream_.format = fmt_s16le_44_1;
       rstream_.flags = 0;
+      rstream_.num_attached_devs = 1;
 
       config_format_converter_from_fmt = NULL;
       config_format_converter_called = 0;
@@ -145,6 +148,7 @@ class CreateSuite : public testing::Test{
       atlog = audio_thread_event_log_init();
 
       devstr.stream = &rstream_;
+      devstr.gain_scaler = -1.0f;
       devstr.conv = NULL;
       devstr.conv_buffer = NULL;
       devstr.conv_buffer_size_frames = 0;
@@ -235,6 +239,32 @@ TEST_F(CreateSuite, CaptureNoSRC) {
 
 }
 
+TEST_F(CreateSuite, CaptureNoSRCGainRamp) {
+  unsigned int nframes = kBufferFrames / 2;
+
+  dev_stream_capture(&devstr, area, 0, 1.0f);
+  EXPECT_EQ(0, copy_area_call.mixed);
+  EXPECT_EQ(1.0f, copy_area_call.software_gain_scaler);
+  EXPECT_EQ(0.0f, copy_area_call.increment);
+
+  /* Gain change ramps across the next capture. */
+  dev_stream_capture(&devstr, area, 0, 2.0f);
+  EXPECT_EQ(1.0f, copy_area_call.software_gain_scaler);
+  EXPECT_FLOAT_EQ(1.0f / nframes, copy_area_call.increment);
+  EXPECT_EQ(2.0f, devstr.gain_scaler);
+}
+
+TEST_F(CreateSuite, CaptureNoSRCMultipleDevices) {
+  rstream_.num_attached_devs = 2;
+
+  dev_stream_capture(&devstr, area, 0, 10.0f);
+
+  /* Mixed with the other device's samples instead of overwriting them. */
+  EXPECT_EQ(1, copy_area_call.mixed);
+  EXPECT_EQ(stream_area, copy_area_call.dst);
+  EXPECT_EQ(10.0f, copy_area_call.software_gain_scaler);
+}
+
 TEST_F(CreateSuite, CaptureSRCSmallConverterBuffer) {
   float software_gain_scaler = 10;
   unsigned int conv_buf_avail_at_input_rate;
@@ -867,6 +897,48 @@ TEST_F(CreateSuite, StreamCanSendBulkAudio) {
   dev_stream_destroy(dev_stream);
 }
 
+TEST_F(CreateSuite, StreamReadingPrerollCatchesUp) {
+  struct dev_stream *dev_stream;
+  unsigned int dev_id = 9;
+  int rc;
+  struct timespec expected_next_cb_ts, catch_up_ts;
+
+  rstream_.direction = CRAS_STREAM_INPUT;
+  dev_stream = dev_stream_create(&rstream_, dev_id, &fmt_s16le_44_1,
+                                 (void *)0x55, &cb_ts);
+  dev_stream->reading_preroll = 1;
+
+  rstream_.next_cb_ts.tv_sec = 1;
+  rstream_.next_cb_ts.tv_nsec = 0;
+  cras_shm_buffer_written(&rstream_.shm, rstream_.cb_threshold);
+  clock_gettime_retspec.tv_sec = 1;
+  clock_gettime_retspec.tv_nsec = 500;
+  rc = dev_stream_capture_update_rstream(dev_stream);
+  EXPECT_EQ(1, cras_rstream_audio_ready_called);
+  EXPECT_EQ(0, rc);
+
+  // While reading pre-roll the next callback comes twice as early.
+  cras_frames_to_time(rstream_.cb_threshold / 2, rstream_.format.frame_rate,
+                      &catch_up_ts);
+  expected_next_cb_ts.tv_sec = 1;
+  expected_next_cb_ts.tv_nsec = 0;
+  add_timespecs(&expected_next_cb_ts, &catch_up_ts);
+  EXPECT_EQ(expected_next_cb_ts.tv_sec, rstream_.next_cb_ts.tv_sec);
+  EXPECT_EQ(expected_next_cb_ts.tv_nsec, rstream_.next_cb_ts.tv_nsec);
+
+  // Back to the stream's own interval once caught up.
+  dev_stream->reading_preroll = 0;
+  cras_shm_buffer_written(&rstream_.shm, rstream_.cb_threshold);
+  clock_gettime_retspec = rstream_.next_cb_ts;
+  rc = dev_stream_capture_update_rstream(dev_stream);
+  EXPECT_EQ(2, cras_rstream_audio_ready_called);
+  add_timespecs(&expected_next_cb_ts, &rstream_.sleep_interval_ts);
+  EXPECT_EQ(expected_next_cb_ts.tv_sec, rstream_.next_cb_ts.tv_sec);
+  EXPECT_EQ(expected_next_cb_ts.tv_nsec, rstream_.next_cb_ts.tv_nsec);
+
+  dev_stream_destroy(dev_stream);
+}
+
 TEST_F(CreateSuite, TriggerOnlyStreamSendOnlyOnce) {
   struct dev_stream *dev_stream;
   unsigned int dev_id = 9;
@@ -999,6 +1071,67 @@ TEST_F(CreateSuite, InputDevStreamWakeTimeByDevice) {
   dev_stream_destroy(dev_stream);
 }
 
+TEST_F(CreateSuite, OutputDevStreamWakeTimeLeadsByResponseTime) {
+  struct timespec response = {.tv_sec = 0, .tv_nsec = 2000000};
+  struct timespec wake_time_out;
+  unsigned int i;
+
+  memset(&rstream_.fetch_pred, 0, sizeof(rstream_.fetch_pred));
+  rstream_.next_cb_ts.tv_sec = 1;
+  rstream_.next_cb_ts.tv_nsec = 20000000;
+  rstream_.sleep_interval_ts.tv_sec = 0;
+  rstream_.sleep_interval_ts.tv_nsec = 10000000;
+
+  // Without a model of the client the stream wakes at its callback time.
+  EXPECT_EQ(0, dev_stream_wake_time(&devstr, 0, NULL, 0, 0, &wake_time_out));
+  EXPECT_EQ(1, wake_time_out.tv_sec);
+  EXPECT_EQ(20000000, wake_time_out.tv_nsec);
+
+  // Client answers in 2ms, ask that much earlier.
+  for (i = 0; i < FETCH_PREDICTOR_MIN_SAMPLES; i++)
+    fetch_predictor_add(&rstream_.fetch_pred, &response);
+  EXPECT_EQ(0, dev_stream_wake_time(&devstr, 0, NULL, 0, 0, &wake_time_out));
+  EXPECT_EQ(1, wake_time_out.tv_sec);
+  EXPECT_EQ(18000000, wake_time_out.tv_nsec);
+
+  // The lead is at most half the callback interval.
+  response.tv_nsec = 8000000;
+  for (i = 0; i < FETCH_PREDICTOR_MIN_SAMPLES; i++)
+    fetch_predictor_add(&rstream_.fetch_pred, &response);
+  EXPECT_EQ(0, dev_stream_wake_time(&devstr, 0, NULL, 0, 0, &wake_time_out));
+  EXPECT_EQ(1, wake_time_out.tv_sec);
+  EXPECT_EQ(15000000, wake_time_out.tv_nsec);
+
+  // Requesting samples sets the deadline to the next callback time.
+  clock_gettime_retspec.tv_sec = 1;
+  clock_gettime_retspec.tv_nsec = 16000000;
+  EXPECT_EQ(0, dev_stream_request_playback_samples(&devstr,
+                                                   &clock_gettime_retspec));
+  EXPECT_EQ(1, rstream_.fetch_deadline_ts.tv_sec);
+  EXPECT_EQ(30000000, rstream_.fetch_deadline_ts.tv_nsec);
+
+  // Streams using device timing don't have a wake up time.
+  rstream_.flags = USE_DEV_TIMING;
+  EXPECT_EQ(1, dev_stream_wake_time(&devstr, 0, NULL, 0, 0, &wake_time_out));
+}
+
+TEST_F(CreateSuite, SetDelayRecordsDelay) {
+  rstream_.format = fmt_s16le_48;
+  in_fmt.frame_rate = 48000;
+  out_fmt.frame_rate = 48000;
+  clock_gettime_retspec.tv_sec = 1;
+  clock_gettime_retspec.tv_nsec = 0;
+
+  // Playback delay counts the frames still in the stream's buffer.
+  cras_shm_buffer_written(&rstream_.shm, 100);
+  dev_stream_set_delay(&devstr, 240);
+  EXPECT_EQ(340, rstream_.delay_frames);
+
+  rstream_.direction = CRAS_STREAM_INPUT;
+  dev_stream_set_delay(&devstr, 240);
+  EXPECT_EQ(240, rstream_.delay_frames);
+}
+
 //  Test set_playback_timestamp.
 TEST(DevStreamTimimg, SetPlaybackTimeStampSimple) {
   struct cras_timespec ts;
@@ -1233,6 +1366,26 @@ unsigned int cras_audio_area_copy(const struct cras_audio_area *dst,
   copy_area_call.src = src;
   copy_area_call.src_offset = src_offset;
   copy_area_call.software_gain_scaler = software_gain_scaler;
+  copy_area_call.increment = 0;
+  copy_area_call.mixed = 1;
+  return src->frames;
+}
+
+unsigned int cras_audio_area_copy_scaled(const struct cras_audio_area *dst,
+                                         unsigned int dst_offset,
+                                         const struct cras_audio_format *dst_fmt,
+                                         const struct cras_audio_area *src,
+                                         unsigned int src_offset,
+                                         float scaler,
+                                         float increment) {
+  copy_area_call.dst = dst;
+  copy_area_call.dst_offset = dst_offset;
+  copy_area_call.dst_format_bytes = cras_get_format_bytes(dst_fmt);
+  copy_area_call.src = src;
+  copy_area_call.src_offset = src_offset;
+  copy_area_call.software_gain_scaler = scaler;
+  copy_area_call.increment = increment;
+  copy_area_call.mixed = 0;
   return src->frames;
 }
 
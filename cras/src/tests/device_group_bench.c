@@ -0,0 +1,250 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cras_config.h"
+#include "cras_mix.h"
+#include "cras_util.h"
+#include "drc.h"
+#include "dsp_util.h"
+#include "eq2.h"
+
+/* Measures the wake-to-write latency of output devices serviced by a single
+ * audio thread, in the order dev_io_playback_write() walks them, and by one
+ * thread per device pinned to a CPU of its own like the device group
+ * workers. One loaded device mixes LOADED_STREAMS streams and runs them
+ * through a three band DRC and an EQ, the way a heavy HDMI pipeline does.
+ * The other devices mix one stream each and come after the loaded device,
+ * as a device opened later is appended to the open devices.
+ *
+ * Usage: device_group_bench [num_light_devices]
+ *
+ * Run as root to get the real time priority of the audio threads. */
+
+/* 10ms callbacks of S16_LE stereo at 48kHz for CYCLES wake ups. */
+#define RATE 48000
+#define FRAMES 480
+#define CHANNELS 2
+#define FRAME_BYTES (CHANNELS * 2)
+#define PERIOD_NS 10000000
+#define CYCLES 1000
+#define LOADED_STREAMS 8
+#define MAX_DEVS 8
+
+struct bench_dev {
+	const char *name;
+	int num_streams;
+	uint8_t *streams[LOADED_STREAMS];
+	uint8_t *buf;
+	struct drc *drc;
+	struct eq2 *eq2;
+	float *planar[CHANNELS];
+	unsigned int wake_to_write_us[CYCLES];
+};
+
+/* The devices serviced by one thread, and the CPU it is pinned to. */
+struct bench_thread {
+	struct bench_dev *devs[MAX_DEVS];
+	int num_devs;
+	int cpu;
+	pthread_t tid;
+};
+
+static unsigned int elapsed_us(const struct timespec *end,
+			       const struct timespec *start)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000 +
+	       (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+static uint8_t *random_samples()
+{
+	int16_t *samples = (int16_t *)malloc(FRAMES * FRAME_BYTES);
+	int i;
+
+	for (i = 0; i < FRAMES * CHANNELS; i++)
+		samples[i] = (rand() % 20000) - 10000;
+	return (uint8_t *)samples;
+}
+
+static void init_dev(struct bench_dev *dev, const char *name, int loaded)
+{
+	int i;
+
+	memset(dev, 0, sizeof(*dev));
+	dev->name = name;
+	dev->num_streams = loaded ? LOADED_STREAMS : 1;
+	for (i = 0; i < dev->num_streams; i++)
+		dev->streams[i] = random_samples();
+	dev->buf = (uint8_t *)malloc(FRAMES * FRAME_BYTES);
+	if (!loaded)
+		return;
+
+	dev->drc = drc_new(RATE);
+	for (i = 0; i < 3; i++) {
+		drc_set_param(dev->drc, i, PARAM_CROSSOVER_LOWER_FREQ,
+			      i == 0 ? 0 : (i == 1 ? 200 : 1200) /
+					   (RATE / 2.0));
+		drc_set_param(dev->drc, i, PARAM_ENABLED, 1);
+		drc_set_param(dev->drc, i, PARAM_THRESHOLD, -29);
+		drc_set_param(dev->drc, i, PARAM_KNEE, 3);
+		drc_set_param(dev->drc, i, PARAM_RATIO, 6.677);
+		drc_set_param(dev->drc, i, PARAM_ATTACK, 0.02);
+		drc_set_param(dev->drc, i, PARAM_RELEASE, 0.2);
+		drc_set_param(dev->drc, i, PARAM_POST_GAIN, 0);
+	}
+	drc_init(dev->drc);
+
+	dev->eq2 = eq2_new();
+	for (i = 0; i < 8; i++) {
+		eq2_append_biquad(dev->eq2, 0, BQ_PEAKING,
+				  (i + 1) / 10.0, 1.0, 3.0);
+		eq2_append_biquad(dev->eq2, 1, BQ_PEAKING,
+				  (i + 1) / 10.0, 1.0, 3.0);
+	}
+	for (i = 0; i < CHANNELS; i++)
+		dev->planar[i] = (float *)malloc(FRAMES * sizeof(float));
+}
+
+/* Mixes the streams of dev into its buffer and runs the DSP of a loaded
+ * device over it. */
+static void write_dev(struct bench_dev *dev)
+{
+	int i;
+
+	memset(dev->buf, 0, FRAMES * FRAME_BYTES);
+	for (i = 0; i < dev->num_streams; i++)
+		cras_mix_add(SND_PCM_FORMAT_S16_LE, dev->buf, dev->streams[i],
+			     FRAMES * CHANNELS, i, 0, 1.0);
+	if (!dev->drc)
+		return;
+
+	dsp_util_deinterleave(dev->buf, dev->planar, CHANNELS,
+			      SND_PCM_FORMAT_S16_LE, FRAMES);
+	drc_process(dev->drc, dev->planar, FRAMES);
+	eq2_process(dev->eq2, dev->planar[0], dev->planar[1], FRAMES);
+	dsp_util_interleave(dev->planar, dev->buf, CHANNELS,
+			    SND_PCM_FORMAT_S16_LE, FRAMES);
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *thread = (struct bench_thread *)arg;
+	struct timespec next, wake, now;
+	int cycle, i;
+
+	if (thread->cpu >= 0)
+		cras_set_thread_cpu(thread->cpu);
+	if (cras_set_rt_scheduling(CRAS_SERVER_RT_THREAD_PRIORITY) == 0)
+		cras_set_thread_priority(CRAS_SERVER_RT_THREAD_PRIORITY);
+	dsp_enable_flush_denormal_to_zero();
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (cycle = 0; cycle < CYCLES; cycle++) {
+		next.tv_nsec += PERIOD_NS;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &wake);
+		for (i = 0; i < thread->num_devs; i++) {
+			write_dev(thread->devs[i]);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			thread->devs[i]->wake_to_write_us[cycle] =
+				elapsed_us(&now, &wake);
+		}
+	}
+	return NULL;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *)a;
+	unsigned int y = *(const unsigned int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print_dev(const struct bench_dev *dev)
+{
+	unsigned int sorted[CYCLES];
+
+	memcpy(sorted, dev->wake_to_write_us, sizeof(sorted));
+	qsort(sorted, CYCLES, sizeof(sorted[0]), cmp_uint);
+	printf("  %-8s p50 %5u us  p99 %5u us  max %5u us\n", dev->name,
+	       sorted[CYCLES / 2], sorted[CYCLES * 99 / 100],
+	       sorted[CYCLES - 1]);
+}
+
+/* Runs the threads to completion and prints the latency of each device. */
+static void run(const char *title, struct bench_thread *threads,
+		int num_threads, struct bench_dev *devs, int num_devs)
+{
+	int i;
+
+	for (i = 0; i < num_threads; i++)
+		pthread_create(&threads[i].tid, NULL, bench_thread_fn,
+			       &threads[i]);
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i].tid, NULL);
+
+	printf("%s\n", title);
+	for (i = 0; i < num_devs; i++)
+		print_dev(&devs[i]);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[MAX_DEVS] = {
+		"loaded", "light1", "light2", "light3",
+		"light4", "light5", "light6", "light7",
+	};
+	struct bench_dev devs[MAX_DEVS];
+	struct bench_thread threads[MAX_DEVS];
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int num_devs = 3;
+	int i;
+
+	if (argc > 1)
+		num_devs = 1 + atoi(argv[1]);
+	if (num_devs < 2 || num_devs > MAX_DEVS) {
+		fprintf(stderr, "1 to %d light devices\n", MAX_DEVS - 1);
+		return 1;
+	}
+
+	cras_mix_init(0);
+	for (i = 0; i < num_devs; i++)
+		init_dev(&devs[i], names[i], i == 0);
+	printf("%d devices, %ld CPUs, %d cycles of %d frames\n", num_devs,
+	       num_cpus, CYCLES, FRAMES);
+
+	memset(threads, 0, sizeof(threads));
+	for (i = 0; i < num_devs; i++)
+		threads[0].devs[i] = &devs[i];
+	threads[0].num_devs = num_devs;
+	threads[0].cpu = -1;
+	run("One audio thread:", threads, 1, devs, num_devs);
+
+	/* The loaded device stays on the unpinned main thread, the others are
+	 * pinned like start_device_group_workers() pins the workers. */
+	memset(threads, 0, sizeof(threads));
+	for (i = 0; i < num_devs; i++) {
+		threads[i].devs[0] = &devs[i];
+		threads[i].num_devs = 1;
+		threads[i].cpu = (i && num_cpus > 1) ? i % num_cpus : -1;
+	}
+	run("One thread per device:", threads, num_devs, devs, num_devs);
+
+	return 0;
+}
@@ -18,6 +18,8 @@ static cras_iodev *enable_dev;
 static int disable_dev_called;
 static cras_iodev *disable_dev;
 static int set_mute_called;
+static int reopen_dev_called;
+static int reopen_dev_ret;
 static cras_iodev *mute_dev;
 
 void ResetStubData() {
@@ -27,6 +29,8 @@ void ResetStubData() {
   disable_dev_called = 0;
   disable_dev = NULL;
   set_mute_called = 0;
+  reopen_dev_called = 0;
+  reopen_dev_ret = -EINVAL;
   mute_dev = NULL;
 }
 
@@ -70,13 +74,33 @@ TEST(DeviceMonitorTestSuite, HandleResetDevice) {
   // message.
   handle_device_message(main_message, NULL);
 
-  // Verify that disable/enable functions are called with correct device.
+  // Verify that disable/enable functions are called with correct device
+  // when the device can't be reopened in place.
+  EXPECT_EQ(reopen_dev_called, 1);
   EXPECT_EQ(enable_dev_called, 1);
   EXPECT_EQ(enable_dev, &dev);
   EXPECT_EQ(disable_dev_called, 1);
   EXPECT_EQ(disable_dev, &dev);
 }
 
+TEST(DeviceMonitorTestSuite, HandleResetDeviceReopen) {
+  struct cras_iodev dev;
+  struct cras_device_monitor_message msg;
+  struct cras_main_message *main_message =
+      reinterpret_cast<struct cras_main_message *>(&msg);
+
+  ResetStubData();
+  reopen_dev_ret = 0;
+
+  init_device_msg(&msg, RESET_DEVICE, &dev);
+  handle_device_message(main_message, NULL);
+
+  // A device reopened in place isn't disabled.
+  EXPECT_EQ(reopen_dev_called, 1);
+  EXPECT_EQ(enable_dev_called, 0);
+  EXPECT_EQ(disable_dev_called, 0);
+}
+
 TEST(DeviceMonitorTestSuite, MuteDevice) {
   struct cras_iodev dev;
   ResetStubData();
@@ -137,6 +161,11 @@ void cras_iodev_list_disable_dev(struct cras_iodev *dev, bool force) {
   disable_dev = dev;
 }
 
+int cras_iodev_list_reopen_dev(struct cras_iodev *dev) {
+  reopen_dev_called++;
+  return reopen_dev_ret;
+}
+
 int cras_iodev_set_mute(struct cras_iodev *dev) {
   set_mute_called++;
   mute_dev = dev;
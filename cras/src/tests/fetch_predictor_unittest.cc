@@ -0,0 +1,87 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+extern "C" {
+#include "fetch_predictor.h"
+}
+
+namespace {
+
+class FetchPredictorTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      memset(&fp_, 0, sizeof(fp_));
+      max_.tv_sec = 0;
+      max_.tv_nsec = 5000000;
+    }
+
+    void Add(unsigned int usec) {
+      struct timespec ts = { 0, (long)usec * 1000 };
+      fetch_predictor_add(&fp_, &ts);
+    }
+
+    // Returns the lead in usec.
+    unsigned int Lead() {
+      struct timespec lead;
+      fetch_predictor_lead(&fp_, &max_, &lead);
+      return lead.tv_sec * 1000000 + lead.tv_nsec / 1000;
+    }
+
+    struct fetch_predictor fp_;
+    struct timespec max_;
+};
+
+TEST_F(FetchPredictorTestSuite, NoLeadUntilEnoughSamples) {
+  unsigned int i;
+
+  for (i = 0; i < FETCH_PREDICTOR_MIN_SAMPLES - 1; i++)
+    Add(1000);
+  EXPECT_EQ(0, Lead());
+  Add(1000);
+  EXPECT_EQ(1000, Lead());
+}
+
+TEST_F(FetchPredictorTestSuite, P99IgnoresRareOutlier) {
+  unsigned int i;
+
+  // Below 100 samples the longest response is the P99.
+  for (i = 0; i < 50; i++)
+    Add(200 + i);
+  Add(3000);
+  EXPECT_EQ(3000, Lead());
+
+  // With the ring full, the single longest response is ignored.
+  for (i = 0; i < FETCH_PREDICTOR_SAMPLES - 51; i++)
+    Add(300);
+  EXPECT_EQ(FETCH_PREDICTOR_SAMPLES, fp_.num);
+  EXPECT_EQ(300, Lead());
+
+  // Two slow responses are not rare.
+  Add(2000);
+  EXPECT_EQ(2000, Lead());
+
+  // Old responses leave the ring.
+  for (i = 0; i < FETCH_PREDICTOR_SAMPLES; i++)
+    Add(100);
+  EXPECT_EQ(100, Lead());
+}
+
+TEST_F(FetchPredictorTestSuite, LeadLimitedToMax) {
+  unsigned int i;
+
+  for (i = 0; i < FETCH_PREDICTOR_MIN_SAMPLES; i++)
+    Add(8000);
+  EXPECT_EQ(8000, fp_.p99_us);
+  EXPECT_EQ(5000, Lead());
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
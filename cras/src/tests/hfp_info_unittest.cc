@@ -4,6 +4,7 @@
  */
 
 #include <gtest/gtest.h>
+#include <math.h>
 #include <stdint.h>
 #include <time.h>
 
@@ -17,7 +18,112 @@ static cras_audio_format format;
 
 static thread_callback thread_cb;
 static void *cb_data;
+static thread_callback tx_thread_cb;
 static timespec ts;
+static struct cras_audio_codec *msbc_enc;
+static struct cras_audio_codec *msbc_ref;
+
+/* Fills a frame with a 400Hz tone of the given amplitude. */
+static void msbc_tone(int16_t *pcm, int16_t level)
+{
+  unsigned int i;
+
+  for (i = 0; i < MSBC_CODE_FRAMES; i++)
+    pcm[i] = level * sin(2 * M_PI * i * 400 / 16000);
+}
+
+/* Builds an mSBC packet carrying a frame of tone at |level|, encoded by
+ * the real codec. */
+static void msbc_packet(uint8_t *pkt, int seq, int16_t level)
+{
+  int16_t pcm[MSBC_CODE_FRAMES];
+  size_t encoded;
+
+  msbc_tone(pcm, level);
+  memset(pkt, 0, MSBC_PKT_SIZE);
+  pkt[0] = 0x01;
+  pkt[1] = h2_header_seq[seq];
+  ASSERT_EQ(MSBC_CODE_SIZE,
+            msbc_enc->encode(msbc_enc, pcm, MSBC_CODE_SIZE,
+                             pkt + MSBC_H2_HEADER_LEN, MSBC_FRAME_SIZE,
+                             &encoded));
+  ASSERT_EQ(MSBC_FRAME_SIZE, encoded);
+  ASSERT_EQ(MSBC_SYNC_WORD, pkt[MSBC_H2_HEADER_LEN]);
+}
+
+/* Decodes a packet with a reference decoder, fed the same good packets as
+ * the one under test. */
+static void msbc_ref_decode(const uint8_t *pkt, int16_t *out)
+{
+  size_t decoded;
+
+  ASSERT_EQ(MSBC_FRAME_SIZE,
+            msbc_ref->decode(msbc_ref, pkt + MSBC_H2_HEADER_LEN,
+                             MSBC_FRAME_SIZE, out, MSBC_CODE_SIZE,
+                             &decoded));
+  ASSERT_EQ(MSBC_CODE_SIZE, decoded);
+}
+
+/* Corrupts the CRC of the frame in an mSBC packet. */
+static void msbc_corrupt(uint8_t *pkt)
+{
+  pkt[MSBC_H2_HEADER_LEN + 3] ^= 0xff;
+}
+
+static int16_t *capture_frame(unsigned int frame)
+{
+  unsigned int avail;
+  int16_t *samples =
+      (int16_t *)buf_read_pointer_size(info->capture_buf, &avail);
+  return samples + frame * MSBC_CODE_FRAMES;
+}
+
+/* Checks a concealed frame replays |last| with its gain halved |shift|
+ * times, or is silent when |last| is NULL. */
+static void expect_concealed(unsigned int frame, const int16_t *last,
+                             unsigned int shift)
+{
+  int16_t *out = capture_frame(frame);
+  unsigned int i;
+
+  for (i = 0; i < MSBC_CODE_FRAMES; i++)
+    ASSERT_EQ(last ? last[i] >> shift : 0, out[i])
+        << "frame " << frame << " " << i;
+}
+
+/* Checks a good frame fades in from |last| halved |shift| times, or from
+ * silence when |last| is NULL. */
+static void expect_faded_in(unsigned int frame, const int16_t *decoded,
+                            const int16_t *last, unsigned int shift)
+{
+  int16_t *out = capture_frame(frame);
+  int i, fade;
+
+  for (i = 0; i < MSBC_CODE_FRAMES; i++) {
+    if (i >= MSBC_PLC_FADE_FRAMES) {
+      ASSERT_EQ(decoded[i], out[i]) << "frame " << frame << " " << i;
+      continue;
+    }
+    fade = last ? last[i] >> shift : 0;
+    ASSERT_EQ((decoded[i] * i + fade * (MSBC_PLC_FADE_FRAMES - i)) /
+              MSBC_PLC_FADE_FRAMES, out[i]) << "frame " << frame << " " << i;
+  }
+}
+
+/* Creates the encoder used to build packets and the reference decoder. */
+static void MsbcSetUp()
+{
+  msbc_enc = cras_msbc_codec_create();
+  ASSERT_NE((void *)NULL, msbc_enc);
+  msbc_ref = cras_msbc_codec_create();
+  ASSERT_NE((void *)NULL, msbc_ref);
+}
+
+static void MsbcTearDown()
+{
+  cras_sbc_codec_destroy(msbc_enc);
+  cras_sbc_codec_destroy(msbc_ref);
+}
 
 void ResetStubData() {
   format.format = SND_PCM_FORMAT_S16_LE;
@@ -69,7 +175,7 @@ TEST(HfpInfo, AcquirePlaybackBuffer) {
   info = hfp_info_create();
   ASSERT_NE(info, (void *)NULL);
 
-  hfp_info_start(1, 48, info);
+  hfp_info_start(1, 48, HFP_CODEC_ID_CVSD, info);
   dev.direction = CRAS_STREAM_OUTPUT;
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
@@ -117,7 +223,7 @@ TEST(HfpInfo, AcquireCaptureBuffer) {
   info = hfp_info_create();
   ASSERT_NE(info, (void *)NULL);
 
-  hfp_info_start(1, 48, info);
+  hfp_info_start(1, 48, HFP_CODEC_ID_CVSD, info);
   dev.direction = CRAS_STREAM_INPUT;
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
@@ -164,7 +270,7 @@ TEST(HfpInfo, HfpReadWriteFD) {
   ASSERT_NE(info, (void *)NULL);
 
   dev.direction = CRAS_STREAM_INPUT;
-  hfp_info_start(sock[1], 48, info);
+  hfp_info_start(sock[1], 48, HFP_CODEC_ID_CVSD, info);
   ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
 
   /* Mock the sco fd and send some fake data */
@@ -214,7 +320,7 @@ TEST(HfpInfo, StartHfpInfo) {
   info = hfp_info_create();
   ASSERT_NE(info, (void *)NULL);
 
-  hfp_info_start(sock[0], 48, info);
+  hfp_info_start(sock[0], 48, HFP_CODEC_ID_CVSD, info);
   ASSERT_EQ(1, hfp_info_running(info));
   ASSERT_EQ(cb_data, (void *)info);
 
@@ -238,7 +344,7 @@ TEST(HfpInfo, StartHfpInfoAndRead) {
   ASSERT_NE(info, (void *)NULL);
 
   /* Start and send two chunk of fake data */
-  hfp_info_start(sock[1], 48, info);
+  hfp_info_start(sock[1], 48, HFP_CODEC_ID_CVSD, info);
   send(sock[0], sample ,48, 0);
   send(sock[0], sample ,48, 0);
 
@@ -255,6 +361,7 @@ TEST(HfpInfo, StartHfpInfoAndRead) {
   /* Trigger thread callback after idev added. */
   ts.tv_sec = 0;
   ts.tv_nsec = 5000000;
+  send(sock[0], sample ,48, 0);
   thread_cb((struct hfp_info *)cb_data);
 
   rc = hfp_buf_queued(info, &dev);
@@ -280,7 +387,7 @@ TEST(HfpInfo, StartHfpInfoAndWrite) {
   info = hfp_info_create();
   ASSERT_NE(info, (void *)NULL);
 
-  hfp_info_start(sock[1], 48, info);
+  hfp_info_start(sock[1], 48, HFP_CODEC_ID_CVSD, info);
   send(sock[0], sample ,48, 0);
   send(sock[0], sample ,48, 0);
 
@@ -293,9 +400,9 @@ TEST(HfpInfo, StartHfpInfoAndWrite) {
   /* Assert queued samples unchanged before output device added */
   ASSERT_EQ(0, hfp_buf_queued(info, &dev));
 
-  /* Put some fake data and trigger thread callback again */
+  /* Put some fake data and trigger a transmit tick */
   buf_increment_write(info->playback_buf, 1008);
-  thread_cb((struct hfp_info *)cb_data);
+  ASSERT_EQ(0, hfp_tx_ticks(info, 1));
 
   /* Assert some samples written */
   rc = recv(sock[0], sample ,48, 0);
@@ -306,6 +413,469 @@ TEST(HfpInfo, StartHfpInfoAndWrite) {
   hfp_info_destroy(info);
 }
 
+TEST(HfpInfo, BatchedAndShortReads) {
+  int sock[2];
+  uint8_t sample[480];
+
+  ResetStubData();
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 60, HFP_CODEC_ID_CVSD, info));
+  ASSERT_NE((void *)NULL, (void *)tx_thread_cb);
+  dev.direction = CRAS_STREAM_INPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  /* All the pending packets are read in one callback. */
+  send(sock[0], sample, 48, 0);
+  send(sock[0], sample, 48, 0);
+  send(sock[0], sample, 48, 0);
+  thread_cb((struct hfp_info *)cb_data);
+  EXPECT_EQ(3 * 48 / 2, hfp_buf_queued(info, &dev));
+
+  /* A short packet is kept and doesn't stop the link. */
+  send(sock[0], sample, 40, 0);
+  thread_cb((struct hfp_info *)cb_data);
+  EXPECT_EQ(1, hfp_info_running(info));
+  EXPECT_EQ(1u, info->rx_short);
+  EXPECT_EQ((3 * 48 + 40) / 2, hfp_buf_queued(info, &dev));
+
+  /* Closing the socket does. */
+  close(sock[0]);
+  thread_cb((struct hfp_info *)cb_data);
+  EXPECT_EQ(0, hfp_info_running(info));
+
+  hfp_info_destroy(info);
+}
+
+TEST(HfpInfo, TransmitWithoutReceive) {
+  int sock[2];
+  uint8_t sample[480];
+
+  ResetStubData();
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 48, HFP_CODEC_ID_CVSD, info));
+  dev.direction = CRAS_STREAM_OUTPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  /* Playback keeps its pace while nothing is received, missed ticks are
+   * caught up to a limit. */
+  buf_increment_write(info->playback_buf, 480);
+  ASSERT_EQ(0, hfp_tx_ticks(info, 2));
+  EXPECT_EQ(48, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+  EXPECT_EQ(48, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+  EXPECT_EQ(-1, recv(sock[0], sample, sizeof(sample), MSG_DONTWAIT));
+  ASSERT_EQ(0, hfp_tx_ticks(info, 100));
+  EXPECT_EQ((480 - (2 + HFP_MAX_WRITE_BATCH) * 48) / 2,
+            hfp_buf_queued(info, &dev));
+  EXPECT_EQ(0u, info->rx_missing);
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+}
+
+TEST(HfpInfo, JitterBufferConcealsAndDropsLate) {
+  int sock[2];
+  uint8_t sample[48];
+  int i;
+
+  ResetStubData();
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 48, HFP_CODEC_ID_CVSD, info));
+  dev.direction = CRAS_STREAM_INPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  memset(sample, 0x11, sizeof(sample));
+  send(sock[0], sample, 48, 0);
+  thread_cb((struct hfp_info *)cb_data);
+
+  /* On time packets are never concealed. */
+  for (i = 0; i < 10; i++) {
+    ASSERT_EQ(0, hfp_tx_ticks(info, 1));
+    send(sock[0], sample, 48, 0);
+    thread_cb((struct hfp_info *)cb_data);
+  }
+  EXPECT_EQ(0u, info->rx_missing);
+  EXPECT_EQ(11 * 48 / 2, hfp_buf_queued(info, &dev));
+
+  /* Four ticks without packets, the jitter buffer waits for two and
+   * conceals the next two with silence. */
+  ASSERT_EQ(0, hfp_tx_ticks(info, 4));
+  EXPECT_EQ(2u, info->rx_missing);
+  EXPECT_EQ(13 * 48 / 2, hfp_buf_queued(info, &dev));
+  EXPECT_EQ(0, ((int16_t *)info->capture_buf->bytes)[12 * 48 / 2]);
+
+  /* The late ones arrive together, those already concealed are dropped
+   * and the jitter buffer grows. */
+  for (i = 0; i < 4; i++)
+    send(sock[0], sample, 48, 0);
+  thread_cb((struct hfp_info *)cb_data);
+  EXPECT_EQ(2u, info->rx_late);
+  EXPECT_EQ(3u, info->jb_packets);
+  EXPECT_EQ(15 * 48 / 2, hfp_buf_queued(info, &dev));
+
+  /* Now more lateness is tolerated. */
+  ASSERT_EQ(0, hfp_tx_ticks(info, 4));
+  EXPECT_EQ(2u, info->rx_missing);
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+}
+
+TEST(HfpInfo, MsbcJitterBufferLateAndDuplicated) {
+  int sock[2];
+  uint8_t pkt[MSBC_PKT_SIZE];
+
+  ResetStubData();
+  MsbcSetUp();
+  format.frame_rate = 16000;
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 60, HFP_CODEC_ID_MSBC, info));
+  dev.direction = CRAS_STREAM_INPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  msbc_packet(pkt, 0, 4000);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  thread_cb((struct hfp_info *)cb_data);
+  EXPECT_EQ(1u, info->rx_duplicated);
+  EXPECT_EQ(MSBC_CODE_FRAMES, hfp_buf_queued(info, &dev));
+
+  /* Packet 1 is too late, it gets concealed then dropped. */
+  ASSERT_EQ(0, hfp_tx_ticks(info, 3));
+  EXPECT_EQ(1u, info->rx_missing);
+  EXPECT_EQ(2 * MSBC_CODE_FRAMES, hfp_buf_queued(info, &dev));
+
+  msbc_packet(pkt, 1, 6000);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  msbc_packet(pkt, 2, 8000);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  thread_cb((struct hfp_info *)cb_data);
+  EXPECT_EQ(1u, info->rx_late);
+  EXPECT_EQ(1u, info->msbc_frames_lost);
+  EXPECT_EQ(3 * MSBC_CODE_FRAMES, hfp_buf_queued(info, &dev));
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+  MsbcTearDown();
+}
+
+TEST(HfpInfo, MsbcWritePackets) {
+  int rc, i;
+  int sock[2];
+  uint8_t pkt[MSBC_PKT_SIZE];
+  uint8_t expected[MSBC_PKT_SIZE];
+  int16_t decoded[MSBC_CODE_FRAMES];
+  uint8_t *buf;
+  unsigned int count;
+  int peak = 0;
+  const uint8_t seq_bytes[] = { 0x08, 0x38, 0xc8, 0xf8, 0x08 };
+
+  ResetStubData();
+  MsbcSetUp();
+  format.frame_rate = 16000;
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 60, HFP_CODEC_ID_MSBC, info));
+  ASSERT_EQ(0, info->playback_buf->used_size % MSBC_CODE_SIZE);
+  dev.direction = CRAS_STREAM_OUTPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  /* Less than a frame of PCM sends nothing. */
+  buf = buf_write_pointer_size(info->playback_buf, &count);
+  ASSERT_GE(count, 5 * MSBC_CODE_SIZE);
+  for (i = 0; i < 5; i++)
+    msbc_tone((int16_t *)(buf + i * MSBC_CODE_SIZE), 2000 * (i + 1));
+  buf_increment_write(info->playback_buf, MSBC_CODE_SIZE - 2);
+  ASSERT_EQ(0, hfp_write(info));
+
+  /* Each frame goes out as the real encoder codes it, and decodes back. */
+  buf_increment_write(info->playback_buf, 4 * MSBC_CODE_SIZE + 2);
+  for (i = 0; i < 5; i++) {
+    rc = hfp_write(info);
+    ASSERT_EQ(MSBC_PKT_SIZE, rc);
+    ASSERT_EQ(MSBC_PKT_SIZE, recv(sock[0], pkt, sizeof(pkt), 0));
+    EXPECT_EQ(0x01, pkt[0]);
+    EXPECT_EQ(seq_bytes[i], pkt[1]);
+    EXPECT_EQ(MSBC_SYNC_WORD, pkt[2]);
+    EXPECT_EQ(0, pkt[MSBC_PKT_SIZE - 1]);
+
+    msbc_packet(expected, i % 4, 2000 * (i + 1));
+    EXPECT_EQ(0, memcmp(expected + MSBC_H2_HEADER_LEN,
+                        pkt + MSBC_H2_HEADER_LEN, MSBC_FRAME_SIZE));
+    msbc_ref_decode(pkt, decoded);
+  }
+  EXPECT_EQ(0, hfp_buf_queued(info, &dev));
+
+  /* The decoder output lags the input by the filter bank delay, the last
+   * frame carries a tone as loud as what was written. */
+  for (i = 0; i < MSBC_CODE_FRAMES; i++)
+    if (abs(decoded[i]) > peak)
+      peak = abs(decoded[i]);
+  EXPECT_GT(peak, 10000 * 9 / 10);
+  EXPECT_LT(peak, 10000 * 11 / 10);
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+  MsbcTearDown();
+}
+
+TEST(HfpInfo, MsbcWriteSplitPackets) {
+  int sock[2];
+  uint8_t pkt[MSBC_PKT_SIZE * 2];
+  unsigned int i;
+
+  ResetStubData();
+  format.frame_rate = 16000;
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 24, HFP_CODEC_ID_MSBC, info));
+  dev.direction = CRAS_STREAM_OUTPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  buf_increment_write(info->playback_buf, 2 * MSBC_CODE_SIZE);
+
+  /* Five SCO packets carry two mSBC packets. */
+  for (i = 0; i < 5; i++) {
+    ASSERT_EQ(24, hfp_write(info));
+    ASSERT_EQ(24, recv(sock[0], pkt + i * 24, 24, 0));
+  }
+  EXPECT_EQ(0, hfp_write(info));
+  EXPECT_EQ(0x08, pkt[1]);
+  EXPECT_EQ(MSBC_SYNC_WORD, pkt[2]);
+  EXPECT_EQ(0x01, pkt[MSBC_PKT_SIZE]);
+  EXPECT_EQ(0x38, pkt[MSBC_PKT_SIZE + 1]);
+  EXPECT_EQ(MSBC_SYNC_WORD, pkt[MSBC_PKT_SIZE + 2]);
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+}
+
+TEST(HfpInfo, MsbcReadConcealLostPackets) {
+  int sock[2];
+  uint8_t pkt[MSBC_PKT_SIZE];
+  int16_t ref[3][MSBC_CODE_FRAMES];
+  int i;
+
+  ResetStubData();
+  MsbcSetUp();
+  format.frame_rate = 16000;
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 60, HFP_CODEC_ID_MSBC, info));
+  dev.direction = CRAS_STREAM_INPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  /* Packets 0 and 1 arrive, 2 is lost, 3 arrives. */
+  msbc_packet(pkt, 0, 4000);
+  msbc_ref_decode(pkt, ref[0]);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  msbc_packet(pkt, 1, 8000);
+  msbc_ref_decode(pkt, ref[1]);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  /* Packet 2 is lost after the far end coded it. */
+  msbc_packet(pkt, 2, 12000);
+  msbc_packet(pkt, 3, 10000);
+  msbc_ref_decode(pkt, ref[2]);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  for (i = 0; i < 3; i++)
+    ASSERT_EQ(MSBC_PKT_SIZE, hfp_read(info));
+
+  ASSERT_EQ(4 * MSBC_CODE_FRAMES, hfp_buf_queued(info, &dev));
+  expect_concealed(0, ref[0], 0);
+  expect_concealed(1, ref[1], 0);
+  /* The lost frame replays the last good one. */
+  expect_concealed(2, ref[1], 0);
+  /* The good frame fades in from the concealed one. */
+  expect_faded_in(3, ref[2], ref[1], 1);
+  EXPECT_EQ(1u, info->msbc_frames_lost);
+  EXPECT_EQ(4u, info->msbc_frames);
+
+  /* A frame which fails its CRC is concealed too, the next good one
+   * decodes as if it never arrived. */
+  memcpy(ref[1], capture_frame(3), MSBC_CODE_SIZE);
+  msbc_packet(pkt, 0, 6000);
+  msbc_corrupt(pkt);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  ASSERT_EQ(MSBC_PKT_SIZE, hfp_read(info));
+  expect_concealed(4, ref[1], 0);
+  EXPECT_EQ(2u, info->msbc_frames_lost);
+
+  msbc_packet(pkt, 1, 6000);
+  msbc_ref_decode(pkt, ref[2]);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  ASSERT_EQ(MSBC_PKT_SIZE, hfp_read(info));
+  expect_faded_in(5, ref[2], ref[1], 1);
+  EXPECT_EQ(6u, info->msbc_frames);
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+  MsbcTearDown();
+}
+
+TEST(HfpInfo, MsbcReadGarbageAndLongLoss) {
+  int sock[2];
+  uint8_t stream[8 * MSBC_PKT_SIZE];
+  int16_t ref[2][MSBC_CODE_FRAMES];
+  unsigned int i;
+
+  ResetStubData();
+  MsbcSetUp();
+  format.frame_rate = 16000;
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 24, HFP_CODEC_ID_MSBC, info));
+  dev.direction = CRAS_STREAM_INPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  /* A few bytes of garbage and a good packet, then five packets worth of
+   * garbage hide a loss longer than the sequence numbers tell. */
+  memset(stream, 0x55, sizeof(stream));
+  msbc_packet(stream + 4, 0, 8000);
+  msbc_ref_decode(stream + 4, ref[0]);
+  msbc_packet(stream + 4 + 6 * MSBC_PKT_SIZE, 2, 8000);
+  msbc_ref_decode(stream + 4 + 6 * MSBC_PKT_SIZE, ref[1]);
+
+  for (i = 0; i < 18 * 24; i += 24) {
+    ASSERT_EQ(24, send(sock[0], stream + i, 24, 0));
+    ASSERT_EQ(24, hfp_read(info));
+  }
+
+  ASSERT_EQ(7 * MSBC_CODE_FRAMES, hfp_buf_queued(info, &dev));
+  expect_concealed(0, ref[0], 0);
+  for (i = 1; i <= MSBC_PLC_MAX_LOST; i++)
+    expect_concealed(i, ref[0], i - 1);
+  expect_concealed(5, NULL, 0);
+  /* Fades in from silence. */
+  expect_faded_in(6, ref[1], NULL, 0);
+  EXPECT_EQ(5u, info->msbc_frames_lost);
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+  MsbcTearDown();
+}
+
+TEST(HfpInfo, MsbcReadWaitsForCaptureRoom) {
+  int sock[2];
+  uint8_t pkt[MSBC_PKT_SIZE];
+  unsigned int room;
+
+  ResetStubData();
+  MsbcSetUp();
+  format.frame_rate = 16000;
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 60, HFP_CODEC_ID_MSBC, info));
+  dev.direction = CRAS_STREAM_INPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  /* Leave room for two frames. */
+  room = buf_available(info->capture_buf);
+  buf_increment_write(info->capture_buf, room - 2 * MSBC_CODE_SIZE);
+
+  /* Packet 0 decodes, packet 1 is lost and packet 2 needs room for the
+   * concealed frame too, so it waits. */
+  msbc_packet(pkt, 0, 4000);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  ASSERT_EQ(MSBC_PKT_SIZE, hfp_read(info));
+  msbc_packet(pkt, 2, 4000);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  ASSERT_EQ(MSBC_PKT_SIZE, hfp_read(info));
+  EXPECT_EQ(1u, info->msbc_frames);
+  EXPECT_EQ(0u, info->msbc_frames_lost);
+  EXPECT_EQ(1, info->read_seq);
+  EXPECT_EQ((unsigned)MSBC_PKT_SIZE, info->read_pkt_len);
+
+  /* Nothing is concealed into the last frame of room either. */
+  msbc_packet(pkt, 3, 4000);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  ASSERT_EQ(MSBC_PKT_SIZE, hfp_read(info));
+  buf_increment_write(info->capture_buf, MSBC_CODE_SIZE);
+  hfp_jb_conceal_packet(info);
+  EXPECT_EQ(0u, info->msbc_frames_lost);
+  EXPECT_EQ(0u, info->rx_missing);
+  EXPECT_EQ(1, info->read_seq);
+
+  /* Once read, the waiting packets decode in sequence. */
+  buf_increment_read(info->capture_buf, 4 * MSBC_CODE_SIZE);
+  msbc_packet(pkt, 0, 4000);
+  send(sock[0], pkt, MSBC_PKT_SIZE, 0);
+  ASSERT_EQ(MSBC_PKT_SIZE, hfp_read(info));
+  EXPECT_EQ(5u, info->msbc_frames);
+  EXPECT_EQ(1u, info->msbc_frames_lost);
+  EXPECT_EQ(1, info->read_seq);
+  EXPECT_EQ(0u, info->read_pkt_len);
+
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+  MsbcTearDown();
+}
+
+TEST(HfpInfo, MsbcReadCpuPerPacket) {
+  int sock[2];
+  uint8_t *pkts;
+  struct timespec tp1, tp2;
+  unsigned int i, count = 2000;
+  double usecs;
+
+  ResetStubData();
+  MsbcSetUp();
+  format.frame_rate = 16000;
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+
+  info = hfp_info_create();
+  ASSERT_NE(info, (void *)NULL);
+  ASSERT_EQ(0, hfp_info_start(sock[1], 60, HFP_CODEC_ID_MSBC, info));
+  dev.direction = CRAS_STREAM_INPUT;
+  ASSERT_EQ(0, hfp_info_add_iodev(info, &dev));
+
+  pkts = (uint8_t *)malloc(count * MSBC_PKT_SIZE);
+  for (i = 0; i < count; i++)
+    msbc_packet(pkts + i * MSBC_PKT_SIZE, i % 4, 1000 + i * 10);
+
+  /* Times the read path through the real decoder, every fourth packet
+   * lost. */
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+  for (i = 0; i < count; i++) {
+    if (i % 4 == 3)
+      continue;
+    send(sock[0], pkts + i * MSBC_PKT_SIZE, MSBC_PKT_SIZE, 0);
+    ASSERT_EQ(MSBC_PKT_SIZE, hfp_read(info));
+    buf_increment_read(info->capture_buf, buf_queued(info->capture_buf));
+  }
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+
+  usecs = ((tp2.tv_sec - tp1.tv_sec) * 1e9 +
+           (tp2.tv_nsec - tp1.tv_nsec)) / 1e3 / count;
+  printf("mSBC read path %.2f us per packet\n", usecs);
+  EXPECT_EQ(count / 4 - 1, info->msbc_frames_lost);
+
+  free(pkts);
+  hfp_info_stop(info);
+  hfp_info_destroy(info);
+  MsbcTearDown();
+}
+
 } // namespace
 
 extern "C" {
@@ -318,6 +888,10 @@ struct audio_thread *cras_iodev_list_get_audio_thread()
 void audio_thread_add_callback(int fd, thread_callback cb,
                                void *data)
 {
+  if (cb == hfp_tx_callback) {
+    tx_thread_cb = cb;
+    return;
+  }
   thread_cb = cb;
   cb_data = data;
   return;
@@ -325,6 +899,10 @@ void audio_thread_add_callback(int fd, thread_callback cb,
 
 int audio_thread_rm_callback_sync(struct audio_thread *thread, int fd)
 {
+  if (fd == info->tx_timer_fd) {
+    tx_thread_cb = NULL;
+    return 0;
+  }
   thread_cb = NULL;
   cb_data = NULL;
   return 0;
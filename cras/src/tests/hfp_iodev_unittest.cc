@@ -10,6 +10,7 @@ extern "C" {
 #include "cras_hfp_iodev.h"
 #include "cras_iodev.h"
 #include "cras_hfp_info.h"
+#include "cras_hfp_slc.h"
 }
 
 static struct cras_iodev *iodev;
@@ -25,6 +26,7 @@ static size_t cras_iodev_set_active_node_called;
 static size_t cras_iodev_free_format_called;
 static size_t cras_iodev_free_resources_called;
 static size_t cras_bt_device_sco_connect_called;
+static int cras_bt_device_sco_connect_codec_val;
 static int cras_bt_transport_sco_connect_return_val;
 static size_t hfp_info_add_iodev_called;
 static size_t hfp_info_rm_iodev_called;
@@ -33,6 +35,8 @@ static int hfp_info_running_return_val;
 static size_t hfp_info_has_iodev_called;
 static int hfp_info_has_iodev_return_val;
 static size_t hfp_info_start_called;
+static int hfp_info_start_codec_val;
+static int hfp_slc_get_selected_codec_return_val;
 static size_t hfp_info_stop_called;
 static size_t hfp_buf_acquire_called;
 static unsigned hfp_buf_acquire_return_val;
@@ -57,6 +61,9 @@ void ResetStubData() {
   hfp_info_has_iodev_called = 0;
   hfp_info_has_iodev_return_val = 0;
   hfp_info_start_called = 0;
+  hfp_info_start_codec_val = 0;
+  hfp_slc_get_selected_codec_return_val = HFP_CODEC_ID_CVSD;
+  cras_bt_device_sco_connect_codec_val = 0;
   hfp_info_stop_called = 0;
   hfp_buf_acquire_called = 0;
   hfp_buf_acquire_return_val = 0;
@@ -145,6 +152,28 @@ TEST_F(HfpIodev, OpenHfpIodev) {
   ASSERT_EQ(1, cras_iodev_free_resources_called);
 }
 
+TEST_F(HfpIodev, OpenHfpIodevWithMsbc) {
+  iodev = hfp_iodev_create(CRAS_STREAM_INPUT, fake_device, fake_slc,
+                           CRAS_BT_DEVICE_PROFILE_HFP_AUDIOGATEWAY,
+                           fake_info);
+  iodev->format = &fake_format;
+  hfp_slc_get_selected_codec_return_val = HFP_CODEC_ID_MSBC;
+
+  iodev->update_supported_formats(iodev);
+  EXPECT_EQ(16000, iodev->supported_rates[0]);
+  EXPECT_EQ(0, iodev->supported_rates[1]);
+  EXPECT_EQ(1, iodev->supported_channel_counts[0]);
+
+  hfp_info_running_return_val = 0;
+  iodev->configure_dev(iodev);
+  EXPECT_EQ(HFP_CODEC_ID_MSBC, cras_bt_device_sco_connect_codec_val);
+  EXPECT_EQ(HFP_CODEC_ID_MSBC, hfp_info_start_codec_val);
+
+  hfp_info_running_return_val = 1;
+  iodev->close_dev(iodev);
+  hfp_iodev_destroy(iodev);
+}
+
 TEST_F(HfpIodev, OpenIodevWithHfpInfoAlreadyRunning) {
   iodev = hfp_iodev_create(CRAS_STREAM_INPUT, fake_device, fake_slc,
                            CRAS_BT_DEVICE_PROFILE_HFP_AUDIOGATEWAY,
@@ -227,9 +256,10 @@ size_t cras_system_get_volume()
 }
 
 // From bt device
-int cras_bt_device_sco_connect(struct cras_bt_device *device)
+int cras_bt_device_sco_connect(struct cras_bt_device *device, int codec)
 {
   cras_bt_device_sco_connect_called++;
+  cras_bt_device_sco_connect_codec_val = codec;
   return cras_bt_transport_sco_connect_return_val;
 }
 
@@ -292,9 +322,11 @@ int hfp_info_running(struct hfp_info *info)
   return hfp_info_running_return_val;
 }
 
-int hfp_info_start(int fd, unsigned int mtu, struct hfp_info *info)
+int hfp_info_start(int fd, unsigned int mtu, int codec,
+                   struct hfp_info *info)
 {
   hfp_info_start_called++;
+  hfp_info_start_codec_val = codec;
   return 0;
 }
 
@@ -369,6 +401,11 @@ int hfp_event_speaker_gain(struct hfp_slc_handle *handle, int gain)
   return 0;
 }
 
+int hfp_slc_get_selected_codec(struct hfp_slc_handle *handle)
+{
+  return hfp_slc_get_selected_codec_return_val;
+}
+
 } // extern "C"
 
 int main(int argc, char **argv) {
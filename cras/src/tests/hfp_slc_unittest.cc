@@ -23,6 +23,7 @@ static int cras_system_add_select_fd_called;
 static void(*slc_cb)(void *data);
 static void *slc_cb_data;
 static int fake_errno;
+static int hfp_wideband_speech_val;
 static struct cras_bt_device *device =
     reinterpret_cast<struct cras_bt_device *>(2);
 
@@ -35,6 +36,20 @@ void ResetStubData() {
   cras_bt_device_update_hardware_volume_called = 0;
   slc_cb = NULL;
   slc_cb_data = NULL;
+  hfp_wideband_speech_val = 0;
+}
+
+/* Writes an AT command to the SLC and reads back the response. */
+static void send_at_command(int sock, const char *cmd, char *buf, int len)
+{
+  int err;
+
+  err = write(sock, cmd, strlen(cmd));
+  ASSERT_EQ((int)strlen(cmd), err);
+  slc_cb(slc_cb_data);
+  err = read(sock, buf, len - 1);
+  ASSERT_GT(err, 0);
+  buf[err] = '\0';
 }
 
 namespace {
@@ -126,6 +141,72 @@ TEST(HfpSlc, DisconnectSlc) {
 
   hfp_slc_destroy(handle);
 }
+TEST(HfpSlc, CodecNegotiationMsbc) {
+  int sock[2];
+  char buf[256];
+  ResetStubData();
+  hfp_wideband_speech_val = 1;
+
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+  handle = hfp_slc_create(sock[0], 0, device, slc_initialized_cb,
+                          slc_disconnected_cb);
+  EXPECT_EQ(HFP_CODEC_ID_CVSD, hfp_slc_get_selected_codec(handle));
+
+  /* HF supports codec negotiation, AG answers it does too. */
+  send_at_command(sock[1], "AT+BRSF=128\r", buf, sizeof(buf));
+  ASSERT_NE((void *)NULL, (void *)strstr(buf, "+BRSF:"));
+  EXPECT_NE(0, atoi(strstr(buf, "+BRSF:") + 6) & 0x0200);
+
+  send_at_command(sock[1], "AT+BAC=1,2\r", buf, sizeof(buf));
+  EXPECT_NE((void *)NULL, (void *)strstr(buf, "OK"));
+
+  /* AG selects mSBC right after the SLC is established. */
+  send_at_command(sock[1], "AT+CMER=3,0,0,1\r", buf, sizeof(buf));
+  ASSERT_EQ(1, slc_initialized_cb_called);
+  if (!strstr(buf, "+BCS:")) {
+    int err = read(sock[1], buf, sizeof(buf) - 1);
+    ASSERT_GT(err, 0);
+    buf[err] = '\0';
+  }
+  EXPECT_NE((void *)NULL, (void *)strstr(buf, "+BCS:2"));
+  EXPECT_EQ(HFP_CODEC_ID_CVSD, hfp_slc_get_selected_codec(handle));
+
+  send_at_command(sock[1], "AT+BCS=2\r", buf, sizeof(buf));
+  EXPECT_NE((void *)NULL, (void *)strstr(buf, "OK"));
+  EXPECT_EQ(HFP_CODEC_ID_MSBC, hfp_slc_get_selected_codec(handle));
+
+  /* Codecs not offered are refused. */
+  send_at_command(sock[1], "AT+BCS=3\r", buf, sizeof(buf));
+  EXPECT_NE((void *)NULL, (void *)strstr(buf, "ERROR"));
+  EXPECT_EQ(HFP_CODEC_ID_MSBC, hfp_slc_get_selected_codec(handle));
+
+  hfp_slc_destroy(handle);
+}
+
+TEST(HfpSlc, CodecNegotiationDisabled) {
+  int sock[2];
+  char buf[256];
+  ResetStubData();
+
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sock));
+  handle = hfp_slc_create(sock[0], 0, device, slc_initialized_cb,
+                          slc_disconnected_cb);
+
+  send_at_command(sock[1], "AT+BRSF=128\r", buf, sizeof(buf));
+  ASSERT_NE((void *)NULL, (void *)strstr(buf, "+BRSF:"));
+  EXPECT_EQ(0, atoi(strstr(buf, "+BRSF:") + 6) & 0x0200);
+
+  send_at_command(sock[1], "AT+BAC=1,2\r", buf, sizeof(buf));
+  send_at_command(sock[1], "AT+CMER=3,0,0,1\r", buf, sizeof(buf));
+  EXPECT_EQ((void *)NULL, (void *)strstr(buf, "+BCS"));
+
+  /* An HF may still ask for mSBC but AG stays on CVSD. */
+  send_at_command(sock[1], "AT+BCS=1\r", buf, sizeof(buf));
+  EXPECT_NE((void *)NULL, (void *)strstr(buf, "OK"));
+  EXPECT_EQ(HFP_CODEC_ID_CVSD, hfp_slc_get_selected_codec(handle));
+
+  hfp_slc_destroy(handle);
+}
 } // namespace
 
 int slc_initialized_cb(struct hfp_slc_handle *handle) {
@@ -148,6 +229,11 @@ int cras_system_add_select_fd(int fd,
   return 0;
 }
 
+int cras_system_get_hfp_wideband_speech()
+{
+  return hfp_wideband_speech_val;
+}
+
 void cras_system_rm_select_fd(int fd) {
 }
 
@@ -38,6 +38,15 @@ static int audio_thread_add_open_dev_called;
 static int audio_thread_rm_open_dev_called;
 static int audio_thread_is_dev_open_ret;
 static struct audio_thread thread;
+static struct audio_thread worker_thread;
+static int cras_system_get_device_group_workers_ret;
+static int audio_thread_create_worker_called;
+static struct audio_thread *audio_thread_add_open_dev_thread;
+static struct audio_thread *audio_thread_rm_open_dev_thread;
+static struct audio_thread *audio_thread_add_stream_thread;
+static struct audio_thread *audio_thread_disconnect_stream_thread;
+static struct audio_thread *audio_thread_drain_stream_thread;
+static std::vector<struct audio_thread*> audio_thread_dump_thread_info_threads;
 static struct cras_iodev loopback_input;
 static int cras_iodev_close_called;
 static struct cras_iodev *cras_iodev_close_dev;
@@ -77,7 +86,9 @@ static size_t cras_observer_notify_output_node_volume_called;
 static size_t cras_observer_notify_node_left_right_swapped_called;
 static size_t cras_observer_notify_input_node_gain_called;
 static int cras_iodev_open_called;
+static int cras_iodev_reopen_called;
 static int cras_iodev_open_ret[8];
+static struct cras_audio_format cras_iodev_open_fmt;
 static int set_mute_called;
 static std::vector<struct cras_iodev*> set_mute_dev_vector;
 static struct cras_iodev *audio_thread_dev_start_ramp_dev;
@@ -117,6 +128,14 @@ class IoDevTestSuite : public testing::Test {
       audio_thread_disconnect_stream_stream = NULL;
       audio_thread_is_dev_open_ret = 0;
       cras_iodev_has_pinned_stream_ret.clear();
+      cras_system_get_device_group_workers_ret = 0;
+      audio_thread_create_worker_called = 0;
+      audio_thread_add_open_dev_thread = NULL;
+      audio_thread_rm_open_dev_thread = NULL;
+      audio_thread_add_stream_thread = NULL;
+      audio_thread_disconnect_stream_thread = NULL;
+      audio_thread_drain_stream_thread = NULL;
+      audio_thread_dump_thread_info_threads.clear();
 
       sample_rates_[0] = 44100;
       sample_rates_[1] = 48000;
@@ -206,7 +225,9 @@ class IoDevTestSuite : public testing::Test {
       cras_observer_notify_node_left_right_swapped_called = 0;
       cras_observer_notify_input_node_gain_called = 0;
       cras_iodev_open_called = 0;
+      cras_iodev_reopen_called = 0;
       memset(cras_iodev_open_ret, 0, sizeof(cras_iodev_open_ret));
+      memset(&cras_iodev_open_fmt, 0, sizeof(cras_iodev_open_fmt));
       set_mute_called = 0;
       set_mute_dev_vector.clear();
       audio_thread_dev_start_ramp_dev = NULL;
@@ -329,6 +350,126 @@ TEST_F(IoDevTestSuite, SetSuspendResume) {
   EXPECT_EQ(3, cras_observer_notify_active_node_called);
 }
 
+TEST_F(IoDevTestSuite, ReopenDevKeepsStreamsAttached) {
+  struct cras_rstream rstream;
+  struct cras_rstream *stream_list = NULL;
+  struct cras_audio_format fmt;
+
+  memset(&rstream, 0, sizeof(rstream));
+  memset(&fmt, 0, sizeof(fmt));
+  fmt.frame_rate = 48000;
+  cras_iodev_list_init();
+
+  d1_.direction = CRAS_STREAM_OUTPUT;
+  ASSERT_EQ(0, cras_iodev_list_add_output(&d1_));
+
+  // A closed device can't be reopened.
+  EXPECT_EQ(-EINVAL, cras_iodev_list_reopen_dev(&d1_));
+
+  cras_iodev_list_add_active_node(CRAS_STREAM_OUTPUT,
+      cras_make_node_id(d1_.info.idx, 1));
+  DL_APPEND(stream_list, &rstream);
+  stream_list_get_ret = stream_list;
+  stream_add_cb(&rstream);
+  d1_.ext_format = &fmt;
+
+  audio_thread_rm_open_dev_called = 0;
+  audio_thread_add_open_dev_called = 0;
+  audio_thread_add_stream_called = 0;
+  audio_thread_disconnect_stream_called = 0;
+  cras_iodev_close_called = 0;
+  cras_iodev_open_called = 0;
+  EXPECT_EQ(0, cras_iodev_list_reopen_dev(&d1_));
+  EXPECT_EQ(1, audio_thread_rm_open_dev_called);
+  EXPECT_EQ(1, cras_iodev_reopen_called);
+  EXPECT_EQ(1, cras_iodev_close_called);
+  EXPECT_EQ(1, cras_iodev_open_called);
+  EXPECT_EQ(1, audio_thread_add_open_dev_called);
+  EXPECT_EQ(1, audio_thread_add_stream_called);
+  EXPECT_EQ(&rstream, audio_thread_add_stream_stream);
+  EXPECT_EQ(0, audio_thread_disconnect_stream_called);
+  EXPECT_TRUE(cras_iodev_list_dev_is_enabled(&d1_));
+
+  // The device is left closed if it fails to open again.
+  cras_iodev_open_called = 0;
+  cras_iodev_open_ret[0] = -5;
+  audio_thread_add_stream_called = 0;
+  EXPECT_EQ(-5, cras_iodev_list_reopen_dev(&d1_));
+  EXPECT_EQ(0, audio_thread_add_stream_called);
+  EXPECT_EQ(CRAS_IODEV_STATE_CLOSE, d1_.state);
+  cras_iodev_open_ret[0] = 0;
+
+  d1_.ext_format = NULL;
+  cras_iodev_list_deinit();
+}
+
+TEST_F(IoDevTestSuite, ReopenPlayingDevRampsDownFirst) {
+  struct cras_rstream rstream;
+  struct cras_rstream *stream_list = NULL;
+  struct cras_audio_format fmt;
+
+  memset(&rstream, 0, sizeof(rstream));
+  memset(&fmt, 0, sizeof(fmt));
+  fmt.frame_rate = 48000;
+  cras_iodev_list_init();
+
+  d1_.direction = CRAS_STREAM_OUTPUT;
+  d1_.ramp = reinterpret_cast<cras_ramp*>(0x1);
+  ASSERT_EQ(0, cras_iodev_list_add_output(&d1_));
+  cras_iodev_list_add_active_node(CRAS_STREAM_OUTPUT,
+      cras_make_node_id(d1_.info.idx, 1));
+  DL_APPEND(stream_list, &rstream);
+  stream_list_get_ret = stream_list;
+  stream_add_cb(&rstream);
+  d1_.ext_format = &fmt;
+  cras_iodev_state_ret[&d1_] = CRAS_IODEV_STATE_NORMAL_RUN;
+
+  // A playing device ramps down, the reopen waits for it.
+  cras_tm_create_timer_called = 0;
+  EXPECT_EQ(0, cras_iodev_list_reopen_dev(&d1_));
+  EXPECT_EQ(1, audio_thread_dev_start_ramp_called);
+  EXPECT_EQ(&d1_, audio_thread_dev_start_ramp_dev);
+  EXPECT_EQ(CRAS_IODEV_RAMP_REQUEST_DOWN_REOPEN,
+            audio_thread_dev_start_ramp_req);
+  EXPECT_EQ(1, cras_tm_create_timer_called);
+  EXPECT_EQ(0, cras_iodev_reopen_called);
+
+  // Asking again while it ramps down changes nothing.
+  EXPECT_EQ(0, cras_iodev_list_reopen_dev(&d1_));
+  EXPECT_EQ(1, audio_thread_dev_start_ramp_called);
+  EXPECT_EQ(1, cras_tm_create_timer_called);
+
+  // The reset requested at the end of the ramp reopens it.
+  d1_.reset_request_pending = 1;
+  cras_tm_cancel_timer_called = 0;
+  EXPECT_EQ(0, cras_iodev_list_reopen_dev(&d1_));
+  EXPECT_EQ(1, cras_iodev_reopen_called);
+  EXPECT_EQ(1, cras_tm_cancel_timer_called);
+  EXPECT_EQ(1, audio_thread_dev_start_ramp_called);
+
+  // The timer reopens a device whose ramp doesn't finish.
+  d1_.reset_request_pending = 0;
+  d1_.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  EXPECT_EQ(0, cras_iodev_list_reopen_dev(&d1_));
+  EXPECT_EQ(2, audio_thread_dev_start_ramp_called);
+  EXPECT_EQ(1, cras_iodev_reopen_called);
+  ASSERT_NE((void *)NULL, (void *)cras_tm_timer_cb);
+  cras_tm_timer_cb(NULL, cras_tm_timer_cb_data);
+  EXPECT_EQ(2, cras_iodev_reopen_called);
+
+  // Nothing to ramp at zero volume.
+  cras_iodev_is_zero_volume_ret = 1;
+  d1_.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  EXPECT_EQ(0, cras_iodev_list_reopen_dev(&d1_));
+  EXPECT_EQ(2, audio_thread_dev_start_ramp_called);
+  EXPECT_EQ(3, cras_iodev_reopen_called);
+
+  cras_iodev_state_ret.erase(&d1_);
+  d1_.ramp = NULL;
+  d1_.ext_format = NULL;
+  cras_iodev_list_deinit();
+}
+
 TEST_F(IoDevTestSuite, InitDevFailShouldEnableFallback) {
   int rc;
   struct cras_rstream rstream;
@@ -1238,6 +1379,105 @@ TEST_F(IoDevTestSuite, IodevListSetNodeAttr) {
   cras_iodev_list_deinit();
 }
 
+TEST_F(IoDevTestSuite, WarmInputPreroll) {
+  struct cras_rstream rstream;
+  struct cras_rstream *stream_list = NULL;
+  int rc;
+
+  memset(&rstream, 0, sizeof(rstream));
+  rstream.direction = CRAS_STREAM_INPUT;
+  cras_iodev_list_init();
+
+  d1_.direction = CRAS_STREAM_INPUT;
+  EXPECT_EQ(0, cras_iodev_list_add_input(&d1_));
+  node1.idx = 1;
+  node1.dev = &d1_;
+  d2_.direction = CRAS_STREAM_OUTPUT;
+  EXPECT_EQ(0, cras_iodev_list_add_output(&d2_));
+  node2.idx = 2;
+  node2.dev = &d2_;
+
+  // Pre-roll only applies to input devices.
+  rc = cras_iodev_list_set_node_attr(cras_make_node_id(d2_.info.idx, 2),
+                                     IONODE_ATTR_PREROLL_MS, 300);
+  EXPECT_EQ(-EINVAL, rc);
+
+  // A disabled device isn't opened.
+  rc = cras_iodev_list_set_node_attr(cras_make_node_id(d1_.info.idx, 1),
+                                     IONODE_ATTR_PREROLL_MS, 300);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(300, d1_.preroll_ms);
+  EXPECT_EQ(0, cras_iodev_open_called);
+
+  // Enabling it opens the device without any stream.
+  cras_iodev_list_enable_dev(&d1_);
+  EXPECT_EQ(1, cras_iodev_open_called);
+  EXPECT_EQ(1, audio_thread_add_open_dev_called);
+  EXPECT_EQ(&d1_, audio_thread_add_open_dev_dev);
+  d1_.preroll = reinterpret_cast<struct preroll_buffer *>(0x123);
+
+  // A new stream attaches to the running device.
+  DL_APPEND(stream_list, &rstream);
+  stream_list_get_ret = stream_list;
+  EXPECT_EQ(0, stream_add_cb(&rstream));
+  EXPECT_EQ(1, cras_iodev_open_called);
+  EXPECT_EQ(1, audio_thread_add_stream_called);
+
+  // The device keeps running after the last stream is removed.
+  DL_DELETE(stream_list, &rstream);
+  stream_list_get_ret = stream_list;
+  EXPECT_EQ(0, stream_rm_cb(&rstream));
+  EXPECT_EQ(0, cras_iodev_close_called);
+
+  // Disabling the pre-roll closes the idle device.
+  rc = cras_iodev_list_set_node_attr(cras_make_node_id(d1_.info.idx, 1),
+                                     IONODE_ATTR_PREROLL_MS, 0);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1, cras_iodev_close_called);
+  EXPECT_EQ(&d1_, cras_iodev_close_dev);
+  EXPECT_EQ(1, cras_iodev_open_called);
+
+  cras_iodev_list_deinit();
+}
+
+static size_t warm_input_rates[] = { 44100, 16000, 0 };
+static size_t warm_input_channel_counts[] = { 4, 0 };
+static snd_pcm_format_t warm_input_formats[] = {
+  SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_S16_LE, (snd_pcm_format_t)0
+};
+
+static int warm_input_update_supported_formats(struct cras_iodev *iodev) {
+  iodev->supported_rates = warm_input_rates;
+  iodev->supported_channel_counts = warm_input_channel_counts;
+  iodev->supported_formats = warm_input_formats;
+  return 0;
+}
+
+TEST_F(IoDevTestSuite, WarmInputOpensInSupportedFormat) {
+  int rc;
+
+  cras_iodev_list_init();
+
+  d1_.direction = CRAS_STREAM_INPUT;
+  d1_.update_supported_formats = warm_input_update_supported_formats;
+  EXPECT_EQ(0, cras_iodev_list_add_input(&d1_));
+  node1.idx = 1;
+  node1.dev = &d1_;
+  rc = cras_iodev_list_set_node_attr(cras_make_node_id(d1_.info.idx, 1),
+                                     IONODE_ATTR_PREROLL_MS, 300);
+  EXPECT_EQ(0, rc);
+
+  // Without 48kHz stereo the device opens at rates and channels it has.
+  cras_iodev_list_enable_dev(&d1_);
+  EXPECT_EQ(1, cras_iodev_open_called);
+  EXPECT_EQ(44100, cras_iodev_open_fmt.frame_rate);
+  EXPECT_EQ(4, cras_iodev_open_fmt.num_channels);
+  EXPECT_EQ(SND_PCM_FORMAT_S16_LE, cras_iodev_open_fmt.format);
+
+  d1_.update_supported_formats = NULL;
+  cras_iodev_list_deinit();
+}
+
 TEST_F(IoDevTestSuite, AddActiveNode) {
   int rc;
   struct cras_rstream rstream;
@@ -1427,6 +1667,80 @@ TEST_F(IoDevTestSuite, AddRemovePinnedStream) {
   cras_iodev_list_deinit();
 }
 
+TEST_F(IoDevTestSuite, PinnedStreamOnDeviceGroupWorker) {
+  struct cras_rstream rstream, rstream2;
+  struct cras_rstream *stream_list = NULL;
+  struct audio_debug_info info;
+
+  cras_system_get_device_group_workers_ret = 1;
+  cras_iodev_list_init();
+  EXPECT_EQ(1, audio_thread_create_worker_called);
+
+  // d1 is enabled, d2 is only used by the stream pinned to it.
+  d1_.direction = CRAS_STREAM_OUTPUT;
+  d1_.info.idx = 1;
+  EXPECT_EQ(0, cras_iodev_list_add_output(&d1_));
+  cras_iodev_list_select_node(CRAS_STREAM_OUTPUT,
+      cras_make_node_id(d1_.info.idx, 0));
+  d2_.direction = CRAS_STREAM_OUTPUT;
+  d2_.info.idx = 2;
+  node2.type = CRAS_NODE_TYPE_HDMI;
+  EXPECT_EQ(0, cras_iodev_list_add_output(&d2_));
+
+  memset(&rstream, 0, sizeof(rstream));
+  rstream.is_pinned = 1;
+  rstream.pinned_dev_idx = d2_.info.idx;
+  memset(&rstream2, 0, sizeof(rstream2));
+  rstream2.is_pinned = 1;
+  rstream2.pinned_dev_idx = d1_.info.idx;
+
+  // d2 shares no stream with other devices, it runs on the worker.
+  EXPECT_EQ(0, stream_add_cb(&rstream));
+  EXPECT_EQ(&d2_, audio_thread_add_open_dev_dev);
+  EXPECT_EQ(&worker_thread, audio_thread_add_open_dev_thread);
+  EXPECT_EQ(&d2_, audio_thread_add_stream_dev);
+  EXPECT_EQ(&worker_thread, audio_thread_add_stream_thread);
+
+  // The enabled device stays on the main audio thread.
+  EXPECT_EQ(0, stream_add_cb(&rstream2));
+  EXPECT_EQ(&d1_, audio_thread_add_open_dev_dev);
+  EXPECT_EQ(&thread, audio_thread_add_open_dev_thread);
+  EXPECT_EQ(&thread, audio_thread_add_stream_thread);
+
+  // Removing the pinned stream drains it and closes d2 on the worker.
+  EXPECT_EQ(0, stream_rm_cb(&rstream));
+  EXPECT_EQ(&worker_thread, audio_thread_drain_stream_thread);
+  EXPECT_EQ(&worker_thread, audio_thread_rm_open_dev_thread);
+  EXPECT_EQ(&d2_, cras_iodev_close_dev);
+
+  // The worker is free for d2 again.
+  EXPECT_EQ(0, stream_add_cb(&rstream));
+  EXPECT_EQ(&worker_thread, audio_thread_add_open_dev_thread);
+
+  // Enabling d2 moves it to the main thread along with its pinned stream.
+  DL_APPEND(stream_list, &rstream);
+  stream_list_get_ret = stream_list;
+  cras_iodev_close_called = 0;
+  cras_iodev_list_select_node(CRAS_STREAM_OUTPUT,
+      cras_make_node_id(d2_.info.idx, 0));
+  EXPECT_EQ(&worker_thread, audio_thread_disconnect_stream_thread);
+  EXPECT_EQ(&rstream, audio_thread_disconnect_stream_stream);
+  EXPECT_EQ(&worker_thread, audio_thread_rm_open_dev_thread);
+  EXPECT_LE(1, cras_iodev_close_called);
+  EXPECT_EQ(&d2_, audio_thread_add_open_dev_dev);
+  EXPECT_EQ(&thread, audio_thread_add_open_dev_thread);
+  EXPECT_EQ(&rstream, audio_thread_add_stream_stream);
+  EXPECT_EQ(&thread, audio_thread_add_stream_thread);
+
+  // Debug info is collected from every thread.
+  EXPECT_EQ(0, cras_iodev_list_dump_audio_thread_info(&info));
+  ASSERT_EQ(2, audio_thread_dump_thread_info_threads.size());
+  EXPECT_EQ(&thread, audio_thread_dump_thread_info_threads[0]);
+  EXPECT_EQ(&worker_thread, audio_thread_dump_thread_info_threads[1]);
+
+  cras_iodev_list_deinit();
+}
+
 TEST_F(IoDevTestSuite, SuspendResumePinnedStream) {
   struct cras_rstream rstream;
 
@@ -1579,6 +1893,10 @@ extern "C" {
 
 // Stubs
 
+int cras_system_get_device_group_workers() {
+  return cras_system_get_device_group_workers_ret;
+}
+
 struct cras_server_state *cras_system_state_update_begin() {
   return server_state_update_begin_return;
 }
@@ -1590,6 +1908,12 @@ struct audio_thread *audio_thread_create() {
   return &thread;
 }
 
+struct audio_thread *audio_thread_create_worker(unsigned int worker_idx,
+                                                int cpu) {
+  audio_thread_create_worker_called++;
+  return &worker_thread;
+}
+
 int audio_thread_start(struct audio_thread *thread) {
   return 0;
 }
@@ -1613,6 +1937,7 @@ int audio_thread_add_open_dev(struct audio_thread *thread,
 				 struct cras_iodev *dev)
 {
   audio_thread_add_open_dev_dev = dev;
+  audio_thread_add_open_dev_thread = thread;
   audio_thread_add_open_dev_called++;
   return 0;
 }
@@ -1621,6 +1946,7 @@ int audio_thread_rm_open_dev(struct audio_thread *thread,
                                struct cras_iodev *dev)
 {
   audio_thread_rm_open_dev_called++;
+  audio_thread_rm_open_dev_thread = thread;
   return 0;
 }
 
@@ -1636,6 +1962,7 @@ int audio_thread_add_stream(struct audio_thread *thread,
                             unsigned int num_devs)
 {
   audio_thread_add_stream_called++;
+  audio_thread_add_stream_thread = thread;
   audio_thread_add_stream_stream = stream;
   audio_thread_add_stream_dev = (num_devs ? devs[0] : NULL);
   return 0;
@@ -1646,6 +1973,7 @@ int audio_thread_disconnect_stream(struct audio_thread *thread,
                                    struct cras_iodev *iodev)
 {
   audio_thread_disconnect_stream_called++;
+  audio_thread_disconnect_stream_thread = thread;
   audio_thread_disconnect_stream_stream = stream;
   audio_thread_disconnect_stream_dev = iodev;
   return 0;
@@ -1655,6 +1983,7 @@ int audio_thread_drain_stream(struct audio_thread *thread,
                               struct cras_rstream *stream)
 {
 	audio_thread_drain_stream_called++;
+	audio_thread_drain_stream_thread = thread;
 	return audio_thread_drain_stream_return;
 }
 
@@ -1742,6 +2071,7 @@ void loopback_iodev_destroy(struct cras_iodev *iodev) {
 int cras_iodev_open(struct cras_iodev *iodev, unsigned int cb_level,
                     const struct cras_audio_format *fmt)
 {
+  cras_iodev_open_fmt = *fmt;
   if (cras_iodev_open_ret[cras_iodev_open_called] == 0)
     iodev->state = CRAS_IODEV_STATE_OPEN;
   return cras_iodev_open_ret[cras_iodev_open_called++];
@@ -1754,6 +2084,12 @@ int cras_iodev_close(struct cras_iodev *iodev) {
   return 0;
 }
 
+int cras_iodev_reopen(struct cras_iodev *iodev) {
+  cras_iodev_reopen_called++;
+  cras_iodev_close(iodev);
+  return cras_iodev_open(iodev, iodev->min_cb_level, iodev->ext_format);
+}
+
 int cras_iodev_set_format(struct cras_iodev *iodev,
                           const struct cras_audio_format *fmt) {
   return 0;
@@ -1894,6 +2230,20 @@ void cras_observer_notify_input_node_gain(cras_node_id_t node_id,
   cras_observer_notify_input_node_gain_called++;
 }
 
+int audio_thread_dump_thread_info(struct audio_thread *thread,
+                                  struct audio_debug_info *info)
+{
+  audio_thread_dump_thread_info_threads.push_back(thread);
+  return 0;
+}
+
+int audio_thread_config_global_remix(struct audio_thread *thread,
+                                     unsigned int num_channels,
+                                     const float *coefficient)
+{
+  return 0;
+}
+
 int audio_thread_dev_start_ramp(struct audio_thread *thread,
                                 struct cras_iodev *dev,
                                 enum CRAS_IODEV_RAMP_REQUEST request)
@@ -117,6 +117,36 @@ int cras_iodev_output_underrun(struct cras_iodev *odev) {
   return 0;
 }
 
+void cras_iodev_update_min_buffer_level(struct cras_iodev *odev,
+                                        const struct timespec *now)
+{
+}
+
+void cras_iodev_begin_io_cycle(struct cras_iodev *iodev,
+                               const struct timespec *wake_ts)
+{
+}
+
+void cras_iodev_end_io_cycle(struct cras_iodev *iodev)
+{
+}
+
+void cras_iodev_log_stream_fetch(struct cras_iodev *odev,
+                                 cras_stream_id_t stream_id,
+                                 const struct timespec *pending)
+{
+}
+
+void cras_iodev_log_output_write(struct cras_iodev *odev,
+                                 unsigned int hw_level, unsigned int frames)
+{
+}
+
+void cras_iodev_log_output_level(struct cras_iodev *odev,
+                                 unsigned int hw_level)
+{
+}
+
 int cras_iodev_reset_request(struct cras_iodev* iodev) {
   return 0;
 }
@@ -14,6 +14,7 @@ extern "C" {
 #include "cras_audio_area.h"
 #include "audio_thread_log.h"
 #include "input_data.h"
+#include "preroll_buffer.h"
 
 // Mock software volume scalers.
 float softvol_scalers[101];
@@ -24,6 +25,7 @@ float softvol_scalers[101];
 static const float RAMP_UNMUTE_DURATION_SECS = 0.5;
 static const float RAMP_NEW_STREAM_DURATION_SECS = 0.01;
 static const float RAMP_MUTE_DURATION_SECS = 0.1;
+static const float RAMP_REOPEN_DURATION_SECS = 0.02;
 
 static int cras_iodev_list_disable_dev_called;
 static int select_node_called;
@@ -78,6 +80,8 @@ static long cras_system_get_capture_gain_ret_value;
 static uint8_t audio_buffer[BUFFER_SIZE];
 static struct cras_audio_area *audio_area;
 static unsigned int put_buffer_nframes;
+static unsigned int put_buffer_called;
+static unsigned int get_buffer_contiguous_frames;
 static int output_should_wake_ret;
 static int no_stream_called;
 static int no_stream_enable;
@@ -108,9 +112,34 @@ static float cras_scale_buffer_increment_increment;
 static int cras_scale_buffer_increment_channel;
 static struct cras_audio_format audio_fmt;
 static int buffer_share_add_id_called;
+static int buffer_share_slot_offset_update_called;
+static unsigned int buffer_share_slot_offset_update_slot;
+static unsigned int buffer_share_slot_offset_update_frames;
 static int buffer_share_get_new_write_point_ret;
 static int ext_mod_configure_called;
 static struct input_data *input_data_create_ret;
+static unsigned int preroll_buffer_create_frames;
+static int preroll_buffer_destroy_called;
+static const uint8_t *preroll_buffer_write_frames;
+static unsigned int preroll_buffer_write_nframes;
+static struct preroll_buffer preroll_buffer_create_ret;
+static int cras_level_meter_create_called;
+static struct cras_level_meter *cras_level_meter_create_ret;
+static unsigned int cras_underrun_log_create_called;
+static struct cras_underrun_log *cras_underrun_log_create_ret;
+static unsigned int cras_underrun_log_destroy_called;
+static unsigned int cras_underrun_log_freeze_called;
+static unsigned int cras_underrun_log_write_hw_level;
+static unsigned int cras_underrun_log_write_frames;
+static int cras_level_meter_destroy_called;
+static unsigned int cras_level_meter_measure_called;
+static unsigned int cras_level_meter_measure_frames;
+static float cras_level_meter_measure_scaler;
+static int cras_level_meter_measure_ret;
+static int cras_level_meter_updated_ret;
+static unsigned int cras_level_meter_send_msg_called;
+static uint32_t cras_level_meter_send_msg_dev_idx;
+static int cras_observer_output_levels_wanted_ret;
 
 // Iodev callback
 int update_channel_layout(struct cras_iodev *iodev) {
@@ -175,6 +204,8 @@ void ResetStubData() {
     audio_area = NULL;
   }
   put_buffer_nframes = 0;
+  put_buffer_called = 0;
+  get_buffer_contiguous_frames = 0;
   output_should_wake_ret= 0;
   no_stream_called = 0;
   no_stream_enable = 0;
@@ -208,7 +239,33 @@ void ResetStubData() {
   audio_fmt.frame_rate = 48000;
   audio_fmt.num_channels = 2;
   buffer_share_add_id_called = 0;
+  buffer_share_slot_offset_update_called = 0;
+  buffer_share_slot_offset_update_slot = 0;
+  buffer_share_slot_offset_update_frames = 0;
   ext_mod_configure_called = 0;
+  preroll_buffer_create_frames = 0;
+  preroll_buffer_destroy_called = 0;
+  preroll_buffer_write_frames = NULL;
+  preroll_buffer_write_nframes = 0;
+  memset(&preroll_buffer_create_ret, 0, sizeof(preroll_buffer_create_ret));
+  cras_level_meter_create_called = 0;
+  cras_level_meter_create_ret =
+      reinterpret_cast<struct cras_level_meter *>(0x55);
+  cras_level_meter_destroy_called = 0;
+  cras_underrun_log_create_called = 0;
+  cras_underrun_log_create_ret = NULL;
+  cras_underrun_log_destroy_called = 0;
+  cras_underrun_log_freeze_called = 0;
+  cras_underrun_log_write_hw_level = 0;
+  cras_underrun_log_write_frames = 0;
+  cras_level_meter_measure_called = 0;
+  cras_level_meter_measure_frames = 0;
+  cras_level_meter_measure_scaler = 0.0f;
+  cras_level_meter_measure_ret = 0;
+  cras_level_meter_updated_ret = 0;
+  cras_level_meter_send_msg_called = 0;
+  cras_level_meter_send_msg_dev_idx = 0;
+  cras_observer_output_levels_wanted_ret = 0;
 }
 
 namespace {
@@ -535,6 +592,10 @@ static int get_buffer(cras_iodev* iodev, struct cras_audio_area** area,
                unsigned int* num) {
   size_t sz = sizeof(*audio_area) + sizeof(struct cras_channel_area) * 2;
 
+  // Devices give at most the frames up to the end of their buffer.
+  if (get_buffer_contiguous_frames && *num > get_buffer_contiguous_frames)
+    *num = get_buffer_contiguous_frames;
+  free(audio_area);
   audio_area = (cras_audio_area*)calloc(1, sz);
   audio_area->frames = *num;
   audio_area->num_channels = 2;
@@ -552,6 +613,7 @@ static int get_buffer(cras_iodev* iodev, struct cras_audio_area** area,
 static int put_buffer(struct cras_iodev *iodev, unsigned int nframes)
 {
   put_buffer_nframes = nframes;
+  put_buffer_called++;
   if (audio_area) {
     free(audio_area);
     audio_area = NULL;
@@ -675,6 +737,27 @@ TEST(IoDevPutOutputBuffer, NodeVolumeZeroShouldMute) {
   EXPECT_EQ(20, rate_estimator_add_frames_num_frames);
 }
 
+TEST(IoDevPutOutputBuffer, MutedWhileWaitingForReset) {
+  struct cras_audio_format fmt;
+  struct cras_iodev iodev;
+  uint8_t *frames = reinterpret_cast<uint8_t*>(0x44);
+  int rc;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  fmt.frame_rate = 48000;
+  fmt.num_channels = 2;
+  iodev.format = &fmt;
+  iodev.put_buffer = put_buffer;
+  iodev.reset_request_pending = 1;
+
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 20, NULL, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(20, cras_mix_mute_count);
+  EXPECT_EQ(20, put_buffer_nframes);
+}
+
 TEST(IoDevPutOutputBuffer, SystemMutedWithRamp) {
   struct cras_audio_format fmt;
   struct cras_iodev iodev;
@@ -1008,6 +1091,72 @@ TEST(IoDevPutOutputBuffer, Scale32Bit) {
   EXPECT_EQ(SND_PCM_FORMAT_S32_LE, cras_scale_buffer_fmt);
 }
 
+TEST(IoDevPutOutputBuffer, LevelMeterNonEmpty) {
+  struct cras_audio_format fmt;
+  struct cras_iodev iodev;
+  uint8_t *frames = reinterpret_cast<uint8_t*>(0x44);
+  int non_empty = 0;
+  int rc;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  fmt.frame_rate = 48000;
+  fmt.num_channels = 2;
+  iodev.format = &fmt;
+  iodev.put_buffer = put_buffer;
+  iodev.level_meter = cras_level_meter_create_ret;
+
+  // Nobody asks, nothing is measured.
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 22, NULL, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(0, cras_level_meter_measure_called);
+
+  // The meter tells whether the block was non-empty.
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 22, &non_empty, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1, cras_level_meter_measure_called);
+  EXPECT_EQ(22, cras_level_meter_measure_frames);
+  EXPECT_EQ(1.0f, cras_level_meter_measure_scaler);
+  EXPECT_EQ(0, non_empty);
+
+  cras_level_meter_measure_ret = 1;
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 22, &non_empty, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1, non_empty);
+  EXPECT_EQ(0, cras_level_meter_send_msg_called);
+}
+
+TEST(IoDevPutOutputBuffer, LevelMeterSendsLevels) {
+  struct cras_audio_format fmt;
+  struct cras_iodev iodev;
+  uint8_t *frames = reinterpret_cast<uint8_t*>(0x44);
+  int rc;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  fmt.frame_rate = 48000;
+  fmt.num_channels = 2;
+  iodev.format = &fmt;
+  iodev.put_buffer = put_buffer;
+  iodev.level_meter = cras_level_meter_create_ret;
+  iodev.info.idx = 5;
+  cras_observer_output_levels_wanted_ret = 1;
+
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 22, NULL, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1, cras_level_meter_measure_called);
+  EXPECT_EQ(0, cras_level_meter_send_msg_called);
+
+  // A completed window goes to the observers.
+  cras_level_meter_updated_ret = 1;
+  rc = cras_iodev_put_output_buffer(&iodev, frames, 22, NULL, nullptr);
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1, cras_level_meter_send_msg_called);
+  EXPECT_EQ(5, cras_level_meter_send_msg_dev_idx);
+}
+
 // frames queued/avail tests
 
 static unsigned fr_queued = 0;
@@ -1064,6 +1213,53 @@ TEST(IoDevQueuedBuffer, NonZeroMinBufferLevel) {
   EXPECT_EQ(100, rc);
 }
 
+TEST(IoDevQueuedBuffer, CachedOncePerCycle) {
+  struct cras_iodev iodev;
+  struct timespec hw_tstamp, first_tstamp;
+  int rc;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.frames_queued = frames_queued;
+  iodev.put_buffer = put_buffer;
+  iodev.buffer_size = 200;
+  iodev.cache_hw_status = 1;
+  fr_queued = 80;
+
+  // Outside of a cycle every read goes to the device.
+  EXPECT_EQ(80, cras_iodev_frames_queued(&iodev, &hw_tstamp));
+  fr_queued = 90;
+  EXPECT_EQ(90, cras_iodev_frames_queued(&iodev, &hw_tstamp));
+
+  // In a cycle the first read is kept, along with its time stamp.
+  cras_iodev_begin_io_cycle(&iodev, &hw_tstamp);
+  EXPECT_EQ(90, cras_iodev_frames_queued(&iodev, &first_tstamp));
+  fr_queued = 70;
+  rc = cras_iodev_frames_queued(&iodev, &hw_tstamp);
+  EXPECT_EQ(90, rc);
+  EXPECT_EQ(first_tstamp.tv_sec, hw_tstamp.tv_sec);
+  EXPECT_EQ(first_tstamp.tv_nsec, hw_tstamp.tv_nsec);
+  EXPECT_EQ(1, iodev.hw_status.num_cached);
+
+  // The device drains while the write is in progress, so the level after
+  // it is read from the device instead of adding the frames written to the
+  // cached one. That level then shows the underrun.
+  fr_queued = 0;
+  rc = cras_iodev_put_output_buffer(&iodev, audio_buffer, 30, NULL, NULL);
+  EXPECT_EQ(0, rc);
+  fr_queued = 25;
+  EXPECT_EQ(25, cras_iodev_frames_queued(&iodev, &hw_tstamp));
+  fr_queued = 10;
+  EXPECT_EQ(25, cras_iodev_frames_queued(&iodev, &hw_tstamp));
+
+  // Next cycle reads the device again.
+  cras_iodev_end_io_cycle(&iodev);
+  cras_iodev_begin_io_cycle(&iodev, &hw_tstamp);
+  EXPECT_EQ(10, cras_iodev_frames_queued(&iodev, &hw_tstamp));
+  cras_iodev_end_io_cycle(&iodev);
+}
+
 static void update_active_node(struct cras_iodev *iodev,
                                unsigned node_idx,
                                unsigned dev_enabled)
@@ -1294,6 +1490,10 @@ static int configure_dev(struct cras_iodev *iodev) {
   return 0;
 }
 
+static int close_dev(struct cras_iodev *iodev) {
+  return 0;
+}
+
 TEST(IoDev, OpenOutputDeviceNoStart) {
   struct cras_iodev iodev;
 
@@ -1361,6 +1561,56 @@ TEST(IoDev, OpenOutputDeviceWithStart) {
   EXPECT_EQ(CRAS_IODEV_STATE_OPEN, iodev.state);
 }
 
+static int update_supported_formats_called;
+
+static int update_supported_formats(struct cras_iodev *iodev) {
+  update_supported_formats_called++;
+  return 0;
+}
+
+static int free_format_on_close(struct cras_iodev *iodev) {
+  cras_iodev_free_format(iodev);
+  return 0;
+}
+
+TEST(IoDev, ReopenKeepsFormat) {
+  struct cras_iodev iodev;
+  struct cras_audio_format fmt = audio_fmt;
+
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.configure_dev = configure_dev;
+  iodev.close_dev = free_format_on_close;
+  iodev.update_supported_formats = update_supported_formats;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.start = fake_start;
+  ResetStubData();
+  update_supported_formats_called = 0;
+
+  // A closed device can't be reopened.
+  iodev.state = CRAS_IODEV_STATE_CLOSE;
+  EXPECT_EQ(-EINVAL, cras_iodev_reopen(&iodev));
+
+  iodev.format = (struct cras_audio_format *)malloc(sizeof(fmt));
+  iodev.ext_format = (struct cras_audio_format *)malloc(sizeof(fmt));
+  fmt.frame_rate = 44100;
+  *iodev.format = fmt;
+  *iodev.ext_format = fmt;
+  iodev.min_cb_level = 441;
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  iodev_buffer_size = 4096;
+
+  EXPECT_EQ(0, cras_iodev_reopen(&iodev));
+  EXPECT_EQ(CRAS_IODEV_STATE_OPEN, iodev.state);
+  ASSERT_NE((void *)NULL, (void *)iodev.format);
+  EXPECT_EQ(44100, iodev.format->frame_rate);
+  EXPECT_EQ(44100, iodev.ext_format->frame_rate);
+  EXPECT_EQ(441, iodev.min_cb_level);
+  // The supported formats were probed at the first open.
+  EXPECT_EQ(0, update_supported_formats_called);
+
+  cras_iodev_free_format(&iodev);
+}
+
 TEST(IoDev, OpenInputDeviceNoStart) {
   struct cras_iodev iodev;
 
@@ -1424,6 +1674,31 @@ TEST(IoDev, OpenInputDeviceWithLowRateFmt) {
   EXPECT_EQ(240, iodev.min_cb_level);
 }
 
+TEST(IoDev, OpenCloseOutputLevelMeter) {
+  struct cras_iodev iodev;
+
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.configure_dev = configure_dev;
+  iodev.close_dev = close_dev;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.ext_format = &audio_fmt;
+  ResetStubData();
+
+  iodev.state = CRAS_IODEV_STATE_CLOSE;
+  iodev_buffer_size = 1024;
+  EXPECT_EQ(0, cras_iodev_open(&iodev, 240, &audio_fmt));
+  EXPECT_EQ(1, cras_level_meter_create_called);
+  EXPECT_EQ(cras_level_meter_create_ret, iodev.level_meter);
+
+  cras_iodev_close(&iodev);
+  EXPECT_EQ(1, cras_level_meter_destroy_called);
+  EXPECT_EQ(static_cast<cras_level_meter *>(NULL), iodev.level_meter);
+
+  // Failing to create the meter fails the open.
+  cras_level_meter_create_ret = NULL;
+  EXPECT_EQ(-ENOMEM, cras_iodev_open(&iodev, 240, &audio_fmt));
+}
+
 static int simple_no_stream(struct cras_iodev *dev, int enable)
 {
   simple_no_stream_enable = enable;
@@ -1495,6 +1770,126 @@ TEST(IoDev, TriggerOnlyStreamNoBufferShare) {
   /* TRIGGER_ONLY streams shall not be added to buffer_share. */
   cras_iodev_add_stream(&iodev, &stream);
   EXPECT_EQ(0, buffer_share_add_id_called);
+  EXPECT_EQ(-1, stream.share_slot);
+  EXPECT_EQ(0, cras_iodev_stream_offset(&iodev, &stream));
+  cras_iodev_stream_written(&iodev, &stream, 100);
+  EXPECT_EQ(0, buffer_share_slot_offset_update_called);
+}
+
+TEST(IoDev, StreamWrittenBySlot) {
+  struct cras_iodev iodev;
+  struct cras_rstream rstream1, rstream2;
+  struct dev_stream stream1, stream2;
+
+  memset(&iodev, 0, sizeof(iodev));
+  memset(&rstream1, 0, sizeof(rstream1));
+  memset(&rstream2, 0, sizeof(rstream2));
+  iodev.configure_dev = configure_dev;
+  iodev.no_stream = simple_no_stream;
+  iodev.ext_format = &audio_fmt;
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  rstream1.cb_threshold = 480;
+  rstream1.stream_id = 0x10001;
+  stream1.stream = &rstream1;
+  rstream2.cb_threshold = 480;
+  rstream2.stream_id = 0x10002;
+  stream2.stream = &rstream2;
+  ResetStubData();
+
+  cras_iodev_open(&iodev, rstream1.cb_threshold, &audio_fmt);
+  cras_iodev_add_stream(&iodev, &stream1);
+  cras_iodev_add_stream(&iodev, &stream2);
+  EXPECT_EQ(0, stream1.share_slot);
+  EXPECT_EQ(1, stream2.share_slot);
+
+  /* Offsets are updated in the slot found when the stream was added. */
+  cras_iodev_stream_written(&iodev, &stream2, 100);
+  EXPECT_EQ(1, buffer_share_slot_offset_update_called);
+  EXPECT_EQ(1, buffer_share_slot_offset_update_slot);
+  EXPECT_EQ(100, buffer_share_slot_offset_update_frames);
+
+  cras_iodev_rm_stream(&iodev, &rstream1);
+  cras_iodev_rm_stream(&iodev, &rstream2);
+}
+
+TEST(IoDev, LowLatencyStreamLimitsBufferAvail) {
+  struct cras_iodev iodev;
+  struct cras_rstream rstream1, rstream2;
+  struct dev_stream stream1, stream2;
+
+  memset(&iodev, 0, sizeof(iodev));
+  memset(&rstream1, 0, sizeof(rstream1));
+  memset(&rstream2, 0, sizeof(rstream2));
+  iodev.configure_dev = configure_dev;
+  iodev.no_stream = simple_no_stream;
+  iodev.ext_format = &audio_fmt;
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.min_buffer_level = 64;
+  rstream1.cb_threshold = 480;
+  stream1.stream = &rstream1;
+  rstream2.cb_threshold = 120;
+  rstream2.flags = LOW_LATENCY;
+  stream2.stream = &rstream2;
+  ResetStubData();
+
+  iodev_buffer_size = 2048;
+  cras_iodev_open(&iodev, rstream1.cb_threshold, &audio_fmt);
+  cras_iodev_add_stream(&iodev, &stream1);
+  EXPECT_EQ(0, iodev.low_latency_level);
+  EXPECT_EQ(1884, cras_iodev_buffer_avail(&iodev, 100));
+
+  /* The larger stream no longer decides how much is queued. */
+  cras_iodev_add_stream(&iodev, &stream2);
+  EXPECT_EQ(240, iodev.low_latency_level);
+  EXPECT_EQ(140, cras_iodev_buffer_avail(&iodev, 100));
+  EXPECT_EQ(0, cras_iodev_buffer_avail(&iodev, 300));
+
+  cras_iodev_rm_stream(&iodev, &rstream2);
+  EXPECT_EQ(0, iodev.low_latency_level);
+  EXPECT_EQ(1884, cras_iodev_buffer_avail(&iodev, 100));
+  cras_iodev_rm_stream(&iodev, &rstream1);
+}
+
+TEST(IoDev, LowLatencyCapAboveLargeMinBufferLevel) {
+  struct cras_iodev iodev;
+  struct cras_rstream rstream;
+  struct dev_stream stream;
+  struct timespec hw_tstamp;
+  int hw_level;
+
+  memset(&iodev, 0, sizeof(iodev));
+  memset(&rstream, 0, sizeof(rstream));
+  iodev.configure_dev = configure_dev;
+  iodev.no_stream = simple_no_stream;
+  iodev.frames_queued = frames_queued;
+  iodev.ext_format = &audio_fmt;
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.min_buffer_level = 1024;
+  rstream.cb_threshold = 120;
+  rstream.flags = LOW_LATENCY;
+  stream.stream = &rstream;
+  ResetStubData();
+
+  iodev_buffer_size = 4096;
+  cras_iodev_open(&iodev, rstream.cb_threshold, &audio_fmt);
+  cras_iodev_add_stream(&iodev, &stream);
+  EXPECT_EQ(240, iodev.low_latency_level);
+
+  /* min_buffer_level is twice the cap, the device is still filled up to
+   * 240 frames above it. */
+  fr_queued = 1000;
+  hw_level = cras_iodev_frames_queued(&iodev, &hw_tstamp);
+  EXPECT_EQ(240, cras_iodev_buffer_avail(&iodev, hw_level));
+  fr_queued = 1100;
+  hw_level = cras_iodev_frames_queued(&iodev, &hw_tstamp);
+  EXPECT_EQ(164, cras_iodev_buffer_avail(&iodev, hw_level));
+  fr_queued = 1264;
+  hw_level = cras_iodev_frames_queued(&iodev, &hw_tstamp);
+  EXPECT_EQ(0, cras_iodev_buffer_avail(&iodev, hw_level));
+
+  cras_iodev_rm_stream(&iodev, &rstream);
 }
 
 TEST(IoDev, FillZeros) {
@@ -1879,6 +2274,25 @@ TEST(IoDev, StartRampDown) {
   cras_ramp_start_cb(cras_ramp_start_cb_data);
   EXPECT_EQ(1, cras_device_monitor_set_device_mute_state_called);
   EXPECT_EQ(&iodev, cras_device_monitor_set_device_mute_state_dev);
+
+  // Case 3: Ramp down to reopen.
+  ResetStubData();
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  req = CRAS_IODEV_RAMP_REQUEST_DOWN_REOPEN;
+
+  rc = cras_iodev_start_ramp(&iodev, req);
+
+  EXPECT_EQ(0, rc);
+  EXPECT_EQ(1, cras_ramp_start_is_called);
+  EXPECT_EQ(0, cras_ramp_start_is_up);
+  EXPECT_EQ(fmt.frame_rate * RAMP_REOPEN_DURATION_SECS,
+            cras_ramp_start_duration_frames);
+  EXPECT_EQ(0, device_monitor_reset_device_called);
+
+  // The device asks to be reset once it is silent.
+  cras_ramp_start_cb(cras_ramp_start_cb_data);
+  EXPECT_EQ(1, device_monitor_reset_device_called);
+  EXPECT_EQ(1, iodev.reset_request_pending);
 }
 
 TEST(IoDev, OutputDeviceShouldWake) {
@@ -2072,6 +2486,187 @@ TEST(IoDev, HandleOutputUnderrun) {
   EXPECT_EQ(1, output_underrun_called);
 }
 
+TEST(IoDev, DynamicMinBufferLevel) {
+  struct cras_iodev iodev;
+  struct timespec now;
+  unsigned int i;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.configure_dev = configure_dev;
+  iodev.close_dev = close_dev;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.format = &audio_fmt;
+  iodev.ext_format = &audio_fmt;
+  iodev.state = CRAS_IODEV_STATE_CLOSE;
+  iodev.output_underrun = output_underrun;
+  iodev.min_buffer_level = 240;
+  iodev.dynamic_min_buffer_level = 1;
+  iodev.min_buffer_level_floor = 96;
+  iodev_buffer_size = 1024;
+  ASSERT_EQ(0, cras_iodev_open(&iodev, 240, &audio_fmt));
+  EXPECT_EQ(240, iodev.latency_ctl.configured);
+  EXPECT_EQ(96, iodev.latency_ctl.floor);
+
+  // Nothing changes while no stream plays.
+  now.tv_sec = 100;
+  now.tv_nsec = 0;
+  cras_iodev_update_min_buffer_level(&iodev, &now);
+  now.tv_sec += 10;
+  cras_iodev_update_min_buffer_level(&iodev, &now);
+  EXPECT_EQ(240, iodev.min_buffer_level);
+
+  // Playing with a jittery write period lowers the level 1ms, 48 frames,
+  // every 5 seconds.
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  for (i = 0; i < 1000; i++) {
+    now.tv_nsec += (i % 3) ? 8000000 : 12000000;
+    if (now.tv_nsec >= 1000000000) {
+      now.tv_sec++;
+      now.tv_nsec -= 1000000000;
+    }
+    cras_iodev_update_min_buffer_level(&iodev, &now);
+  }
+  EXPECT_EQ(192, iodev.min_buffer_level);
+  EXPECT_EQ(192, iodev.latency_ctl.lowest);
+
+  now.tv_sec += 5;
+  cras_iodev_update_min_buffer_level(&iodev, &now);
+  EXPECT_EQ(144, iodev.min_buffer_level);
+
+  // An underrun goes back to the configured level and keeps the level that
+  // underran from being tried again.
+  EXPECT_EQ(0, cras_iodev_output_underrun(&iodev));
+  EXPECT_EQ(1, output_underrun_called);
+  EXPECT_EQ(240, iodev.min_buffer_level);
+  EXPECT_EQ(192, iodev.latency_ctl.floor);
+  EXPECT_EQ(1, iodev.latency_ctl.num_backoffs);
+  for (i = 0; i < 5; i++) {
+    now.tv_sec += 6;
+    cras_iodev_update_min_buffer_level(&iodev, &now);
+  }
+  EXPECT_EQ(192, iodev.min_buffer_level);
+  EXPECT_EQ(144, iodev.latency_ctl.lowest);
+
+  // Closing the device restores the configured level.
+  EXPECT_EQ(0, cras_iodev_close(&iodev));
+  EXPECT_EQ(240, iodev.min_buffer_level);
+}
+
+TEST(IoDev, DynamicMinBufferLevelFloor) {
+  struct cras_iodev iodev;
+  struct timespec now;
+  unsigned int i;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.configure_dev = configure_dev;
+  iodev.close_dev = close_dev;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.format = &audio_fmt;
+  iodev.ext_format = &audio_fmt;
+  iodev.state = CRAS_IODEV_STATE_CLOSE;
+  iodev.output_underrun = output_underrun;
+  iodev.min_buffer_level = 240;
+  iodev.dynamic_min_buffer_level = 1;
+  iodev_buffer_size = 1024;
+
+  // Without a floor the level stays at the configured value.
+  ASSERT_EQ(0, cras_iodev_open(&iodev, 240, &audio_fmt));
+  EXPECT_EQ(240, iodev.latency_ctl.floor);
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  now.tv_sec = 100;
+  now.tv_nsec = 0;
+  for (i = 0; i < 5; i++) {
+    now.tv_sec += 6;
+    cras_iodev_update_min_buffer_level(&iodev, &now);
+  }
+  EXPECT_EQ(240, iodev.min_buffer_level);
+  EXPECT_EQ(0, cras_iodev_close(&iodev));
+
+  // The level isn't lowered below the floor.
+  iodev.min_buffer_level_floor = 200;
+  iodev.state = CRAS_IODEV_STATE_CLOSE;
+  ASSERT_EQ(0, cras_iodev_open(&iodev, 240, &audio_fmt));
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  for (i = 0; i < 5; i++) {
+    now.tv_sec += 6;
+    cras_iodev_update_min_buffer_level(&iodev, &now);
+  }
+  EXPECT_EQ(200, iodev.min_buffer_level);
+  EXPECT_EQ(200, iodev.latency_ctl.lowest);
+  EXPECT_EQ(0, cras_iodev_close(&iodev));
+}
+
+TEST(IoDev, StaticMinBufferLevel) {
+  struct cras_iodev iodev;
+  struct timespec now;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.configure_dev = configure_dev;
+  iodev.close_dev = close_dev;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.format = &audio_fmt;
+  iodev.ext_format = &audio_fmt;
+  iodev.state = CRAS_IODEV_STATE_CLOSE;
+  iodev.output_underrun = output_underrun;
+  iodev.min_buffer_level = 240;
+  iodev_buffer_size = 1024;
+  ASSERT_EQ(0, cras_iodev_open(&iodev, 240, &audio_fmt));
+
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  now.tv_sec = 100;
+  now.tv_nsec = 0;
+  cras_iodev_update_min_buffer_level(&iodev, &now);
+  now.tv_sec += 10;
+  cras_iodev_update_min_buffer_level(&iodev, &now);
+  EXPECT_EQ(240, iodev.min_buffer_level);
+  EXPECT_EQ(0, cras_iodev_output_underrun(&iodev));
+  EXPECT_EQ(240, iodev.min_buffer_level);
+  cras_iodev_close(&iodev);
+}
+
+TEST(IoDev, UnderrunLogKeptUntilFreed) {
+  struct cras_iodev iodev;
+
+  ResetStubData();
+  memset(&iodev, 0, sizeof(iodev));
+  iodev.configure_dev = configure_dev;
+  iodev.close_dev = close_dev;
+  iodev.direction = CRAS_STREAM_OUTPUT;
+  iodev.format = &audio_fmt;
+  iodev.ext_format = &audio_fmt;
+  iodev.state = CRAS_IODEV_STATE_CLOSE;
+  iodev.output_underrun = output_underrun;
+  iodev_buffer_size = 1024;
+  cras_underrun_log_create_ret =
+      reinterpret_cast<struct cras_underrun_log *>(0x66);
+  ASSERT_EQ(0, cras_iodev_open(&iodev, 240, &audio_fmt));
+  EXPECT_EQ(1, cras_underrun_log_create_called);
+
+  cras_iodev_log_output_write(&iodev, 100, 240);
+  EXPECT_EQ(100, cras_underrun_log_write_hw_level);
+  EXPECT_EQ(240, cras_underrun_log_write_frames);
+
+  // An underrun freezes the log for the snapshot it triggers.
+  iodev.state = CRAS_IODEV_STATE_NORMAL_RUN;
+  EXPECT_EQ(0, cras_iodev_output_underrun(&iodev));
+  EXPECT_EQ(1, cras_underrun_log_freeze_called);
+
+  // The log survives closing and reopening the device.
+  cras_iodev_close(&iodev);
+  EXPECT_EQ(0, cras_underrun_log_destroy_called);
+  iodev.state = CRAS_IODEV_STATE_CLOSE;
+  ASSERT_EQ(0, cras_iodev_open(&iodev, 240, &audio_fmt));
+  EXPECT_EQ(1, cras_underrun_log_create_called);
+  cras_iodev_close(&iodev);
+
+  cras_iodev_free_resources(&iodev);
+  EXPECT_EQ(1, cras_underrun_log_destroy_called);
+  EXPECT_EQ(NULL, iodev.underrun_log);
+}
+
 static void ext_mod_configure(
     struct ext_dsp_module *ext,
     unsigned int buffer_size,
@@ -2175,6 +2770,69 @@ TEST(IoDev, InputDspOffset) {
   EXPECT_EQ(60, iodev.input_dsp_offset);
 }
 
+TEST(IoDev, InputPreroll) {
+  struct cras_iodev iodev;
+  struct cras_audio_format fmt;
+  struct cras_rstream rstream1, rstream2;
+  struct dev_stream stream1, stream2;
+  struct input_data data;
+  unsigned int frames = 240;
+
+  ResetStubData();
+
+  memset(&rstream1, 0, sizeof(rstream1));
+  rstream1.cb_threshold = 240;
+  rstream1.stream_id = 123;
+  rstream1.flags = PREROLL_AUDIO;
+  memset(&stream1, 0, sizeof(stream1));
+  stream1.stream = &rstream1;
+  memset(&rstream2, 0, sizeof(rstream2));
+  rstream2.cb_threshold = 240;
+  rstream2.stream_id = 124;
+  memset(&stream2, 0, sizeof(stream2));
+  stream2.stream = &rstream2;
+
+  memset(&iodev, 0, sizeof(iodev));
+  fmt.format = SND_PCM_FORMAT_S16_LE;
+  fmt.frame_rate = 48000;
+  fmt.num_channels = 2;
+  iodev.configure_dev = configure_dev;
+  iodev.close_dev = close_dev;
+  iodev.ext_format = &fmt;
+  iodev.format = &fmt;
+  iodev.state = CRAS_IODEV_STATE_CLOSE;
+  iodev.get_buffer = get_buffer;
+  iodev.put_buffer = put_buffer;
+  iodev.direction = CRAS_STREAM_INPUT;
+  iodev_buffer_size = 480;
+  iodev.preroll_ms = 100;
+  input_data_create_ret = &data;
+
+  // The ring holds the pre-roll plus a buffer of slack.
+  cras_iodev_open(&iodev, 240, &fmt);
+  EXPECT_EQ(4800 + 480, preroll_buffer_create_frames);
+  EXPECT_EQ(&preroll_buffer_create_ret, iodev.preroll);
+
+  // Committed input frames are copied to the ring.
+  cras_iodev_get_input_buffer(&iodev, &frames);
+  cras_iodev_put_input_buffer(&iodev);
+  EXPECT_EQ(audio_buffer, preroll_buffer_write_frames);
+  EXPECT_EQ(240, preroll_buffer_write_nframes);
+
+  // Only streams asking for it start preroll_ms behind the writer.
+  preroll_buffer_create_ret.max_frames = 4800 + 480;
+  preroll_buffer_create_ret.write_pos = 10000;
+  cras_iodev_add_stream(&iodev, &stream1);
+  EXPECT_EQ(1, stream1.reading_preroll);
+  EXPECT_EQ(10000 - 4800, stream1.preroll_pos);
+  cras_iodev_add_stream(&iodev, &stream2);
+  EXPECT_EQ(0, stream2.reading_preroll);
+
+  cras_iodev_close(&iodev);
+  EXPECT_EQ(1, preroll_buffer_destroy_called);
+  EXPECT_EQ(static_cast<preroll_buffer *>(NULL), iodev.preroll);
+}
+
 extern "C" {
 
 //  From libpthread.
@@ -2233,6 +2891,27 @@ unsigned int buffer_share_id_offset(const struct buffer_share *mix,
   return 0;
 }
 
+int buffer_share_id_slot(const struct buffer_share *mix, unsigned int id) {
+  // Slots are handed out in the order ids are added.
+  return buffer_share_add_id_called - 1;
+}
+
+unsigned int buffer_share_slot_offset(const struct buffer_share *mix,
+                                      unsigned int slot) {
+  return 0;
+}
+
+void buffer_share_slot_offset_update(struct buffer_share *mix,
+                                     unsigned int slot, unsigned int frames) {
+  buffer_share_slot_offset_update_called++;
+  buffer_share_slot_offset_update_slot = slot;
+  buffer_share_slot_offset_update_frames = frames;
+}
+
+unsigned int buffer_share_max_offset(const struct buffer_share *mix) {
+  return 0;
+}
+
 // From cras_system_state.
 void cras_system_state_stream_added(enum CRAS_STREAM_DIRECTION direction) {
 }
@@ -2395,6 +3074,11 @@ void cras_audio_area_config_channels(struct cras_audio_area *area,
                                      const struct cras_audio_format *fmt) {
 }
 
+void cras_audio_area_config_buf_pointers(struct cras_audio_area *area,
+                                         const struct cras_audio_format *fmt,
+                                         uint8_t *base_buffer) {
+}
+
 int cras_audio_format_set_channel_layout(struct cras_audio_format *format,
 					 const int8_t layout[CRAS_CH_MAX])
 {
@@ -2445,6 +3129,81 @@ void cras_scale_buffer_increment(snd_pcm_format_t fmt, uint8_t *buff,
   cras_scale_buffer_increment_channel = channel;
 }
 
+struct cras_level_meter *cras_level_meter_create(
+    const struct cras_audio_format *fmt) {
+  cras_level_meter_create_called++;
+  return cras_level_meter_create_ret;
+}
+
+void cras_level_meter_destroy(struct cras_level_meter *meter) {
+  cras_level_meter_destroy_called++;
+}
+
+int cras_level_meter_measure(struct cras_level_meter *meter,
+                             const uint8_t *buf, unsigned int frames,
+                             float scaler) {
+  cras_level_meter_measure_called++;
+  cras_level_meter_measure_frames = frames;
+  cras_level_meter_measure_scaler = scaler;
+  return cras_level_meter_measure_ret;
+}
+
+int cras_level_meter_updated(struct cras_level_meter *meter) {
+  return cras_level_meter_updated_ret;
+}
+
+int cras_level_meter_send_msg(const struct cras_level_meter *meter,
+                              uint32_t dev_idx) {
+  cras_level_meter_send_msg_called++;
+  cras_level_meter_send_msg_dev_idx = dev_idx;
+  return 0;
+}
+
+struct cras_underrun_log *cras_underrun_log_create() {
+  cras_underrun_log_create_called++;
+  return cras_underrun_log_create_ret;
+}
+
+void cras_underrun_log_destroy(struct cras_underrun_log *log) {
+  if (log)
+    cras_underrun_log_destroy_called++;
+}
+
+void cras_underrun_log_begin_cycle(struct cras_underrun_log *log,
+                                   const struct timespec *wake_ts) {
+}
+
+void cras_underrun_log_end_cycle(struct cras_underrun_log *log) {
+}
+
+void cras_underrun_log_fetch(struct cras_underrun_log *log,
+                             uint64_t stream_id,
+                             const struct timespec *pending) {
+}
+
+void cras_underrun_log_add_dsp(struct cras_underrun_log *log,
+                               const struct timespec *elapsed) {
+}
+
+void cras_underrun_log_write(struct cras_underrun_log *log,
+                             unsigned int hw_level, unsigned int frames) {
+  cras_underrun_log_write_hw_level = hw_level;
+  cras_underrun_log_write_frames = frames;
+}
+
+void cras_underrun_log_level_after(struct cras_underrun_log *log,
+                                   unsigned int hw_level) {
+}
+
+void cras_underrun_log_freeze(struct cras_underrun_log *log,
+                              const struct timespec *now) {
+  cras_underrun_log_freeze_called++;
+}
+
+int cras_observer_output_levels_wanted() {
+  return cras_observer_output_levels_wanted_ret;
+}
+
 size_t cras_mix_mute_buffer(uint8_t *dst,
                             size_t frame_bytes,
                             size_t count) {
@@ -2562,6 +3321,27 @@ struct input_data *input_data_create(void *dev_ptr)
 void input_data_destroy(struct input_data **data)
 {
 }
+
+struct preroll_buffer *preroll_buffer_create(unsigned int max_frames,
+					     const struct cras_audio_format *fmt)
+{
+  preroll_buffer_create_frames = max_frames;
+  return &preroll_buffer_create_ret;
+}
+
+void preroll_buffer_destroy(struct preroll_buffer **buf)
+{
+  if (*buf)
+    preroll_buffer_destroy_called++;
+  *buf = NULL;
+}
+
+void preroll_buffer_write(struct preroll_buffer *buf, const uint8_t *frames,
+			  unsigned int nframes)
+{
+  preroll_buffer_write_frames = frames;
+  preroll_buffer_write_nframes = nframes;
+}
 void input_data_set_all_streams_read(struct input_data *data,
 				     unsigned int nframes)
 {
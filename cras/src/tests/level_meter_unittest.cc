@@ -0,0 +1,172 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+
+extern "C" {
+#include "cras_level_meter.h"
+#include "cras_main_message.h"
+#include "cras_mix.h"
+}
+
+static struct cras_main_message *sent_msg;
+static size_t sent_msg_length;
+static cras_message_callback handler;
+static uint32_t notify_dev_idx;
+static uint32_t notify_num_channels;
+static float notify_peak[CRAS_CH_MAX];
+static float notify_rms[CRAS_CH_MAX];
+static unsigned int notify_called;
+
+void ResetStubData() {
+  free(sent_msg);
+  sent_msg = NULL;
+  sent_msg_length = 0;
+  handler = NULL;
+  notify_dev_idx = 0;
+  notify_num_channels = 0;
+  notify_called = 0;
+}
+
+namespace {
+
+class LevelMeterTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      ResetStubData();
+      cras_mix_init(0);
+      fmt_.format = SND_PCM_FORMAT_S16_LE;
+      fmt_.frame_rate = 48000;
+      fmt_.num_channels = 2;
+      meter_ = cras_level_meter_create(&fmt_);
+      ASSERT_NE((void *)NULL, meter_);
+      // Left is a full scale square wave, right one at half scale.
+      for (size_t i = 0; i < kFrames; i++) {
+        buf_[2 * i] = (i & 1) ? INT16_MIN : INT16_MAX;
+        buf_[2 * i + 1] = (i & 1) ? -16384 : 16384;
+      }
+    }
+
+    virtual void TearDown() {
+      cras_level_meter_destroy(meter_);
+      ResetStubData();
+    }
+
+    int Measure(unsigned int frames, float scaler) {
+      return cras_level_meter_measure(meter_, (uint8_t *)buf_, frames,
+                                      scaler);
+    }
+
+    static const size_t kFrames = 480;
+    struct cras_audio_format fmt_;
+    struct cras_level_meter *meter_;
+    int16_t buf_[2 * kFrames];
+};
+
+TEST_F(LevelMeterTestSuite, WindowOfSquareWave) {
+  float peak[CRAS_CH_MAX], rms[CRAS_CH_MAX];
+  unsigned int i;
+
+  // A window is 100ms, 4800 frames at 48kHz.
+  for (i = 0; i < 9; i++)
+    EXPECT_NE(0, Measure(kFrames, 1.0f));
+  EXPECT_EQ(0, cras_level_meter_updated(meter_));
+  ASSERT_EQ(2, cras_level_meter_get(meter_, peak, rms));
+  EXPECT_EQ(0.0f, peak[0]);
+
+  EXPECT_NE(0, Measure(kFrames, 1.0f));
+  EXPECT_EQ(1, cras_level_meter_updated(meter_));
+  EXPECT_EQ(0, cras_level_meter_updated(meter_));
+  ASSERT_EQ(2, cras_level_meter_get(meter_, peak, rms));
+  EXPECT_FLOAT_EQ(1.0f, peak[0]);
+  EXPECT_NEAR(1.0f, rms[0], 0.001f);
+  EXPECT_FLOAT_EQ(0.5f, peak[1]);
+  EXPECT_NEAR(0.5f, rms[1], 0.001f);
+}
+
+TEST_F(LevelMeterTestSuite, Silence) {
+  float peak[CRAS_CH_MAX], rms[CRAS_CH_MAX];
+  unsigned int i;
+
+  memset(buf_, 0, sizeof(buf_));
+  for (i = 0; i < 10; i++)
+    EXPECT_EQ(0, Measure(kFrames, 1.0f));
+  EXPECT_EQ(1, cras_level_meter_updated(meter_));
+  ASSERT_EQ(2, cras_level_meter_get(meter_, peak, rms));
+  EXPECT_EQ(0.0f, peak[0]);
+  EXPECT_EQ(0.0f, rms[1]);
+}
+
+TEST_F(LevelMeterTestSuite, ScaledBlocks) {
+  float peak[CRAS_CH_MAX], rms[CRAS_CH_MAX];
+  unsigned int i;
+
+  for (i = 0; i < 10; i++)
+    EXPECT_NE(0, Measure(kFrames, 0.25f));
+  ASSERT_EQ(2, cras_level_meter_get(meter_, peak, rms));
+  EXPECT_FLOAT_EQ(0.25f, peak[0]);
+  EXPECT_NEAR(0.125f, rms[1], 0.001f);
+
+  // Muted blocks are empty whatever they hold.
+  EXPECT_EQ(0, Measure(kFrames, 0.0f));
+}
+
+TEST_F(LevelMeterTestSuite, SendLevelsToObservers) {
+  unsigned int i;
+
+  cras_level_meter_handler_init();
+  ASSERT_NE((void *)NULL, (void *)handler);
+
+  for (i = 0; i < 10; i++)
+    Measure(kFrames, 1.0f);
+  EXPECT_EQ(0, cras_level_meter_send_msg(meter_, 7));
+  ASSERT_NE((void *)NULL, sent_msg);
+  EXPECT_EQ(CRAS_MAIN_OUTPUT_LEVELS, sent_msg->type);
+  EXPECT_EQ(sent_msg_length, sent_msg->length);
+
+  handler(sent_msg, NULL);
+  EXPECT_EQ(1, notify_called);
+  EXPECT_EQ(7, notify_dev_idx);
+  EXPECT_EQ(2, notify_num_channels);
+  EXPECT_FLOAT_EQ(1.0f, notify_peak[0]);
+  EXPECT_FLOAT_EQ(0.5f, notify_peak[1]);
+  EXPECT_NEAR(0.5f, notify_rms[1], 0.001f);
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+extern "C" {
+
+int cras_main_message_send(struct cras_main_message *msg) {
+  free(sent_msg);
+  sent_msg = (struct cras_main_message *)malloc(msg->length);
+  memcpy(sent_msg, msg, msg->length);
+  sent_msg_length = msg->length;
+  return 0;
+}
+
+int cras_main_message_add_handler(enum CRAS_MAIN_MESSAGE_TYPE type,
+                                  cras_message_callback callback,
+                                  void *callback_data) {
+  handler = callback;
+  return 0;
+}
+
+void cras_observer_notify_output_levels(uint32_t dev_idx,
+                                        uint32_t num_channels,
+                                        const float *peak, const float *rms) {
+  notify_called++;
+  notify_dev_idx = dev_idx;
+  notify_num_channels = num_channels;
+  memcpy(notify_peak, peak, num_channels * sizeof(*peak));
+  memcpy(notify_rms, rms, num_channels * sizeof(*rms));
+}
+
+}  // extern "C"
@@ -216,6 +216,18 @@ void cras_mix_add_scale_stride(int fmt, uint8_t *dst, uint8_t *src,
 	}
 }
 
+void cras_mix_copy_scale_stride(int fmt, uint8_t *dst, uint8_t *src,
+			 unsigned int count, unsigned int dst_stride,
+			 unsigned int src_stride, float scaler)
+{
+}
+
+void cras_mix_copy_scale_stride_increment(int fmt, uint8_t *dst, uint8_t *src,
+			 unsigned int count, unsigned int dst_stride,
+			 unsigned int src_stride, float scaler, float increment)
+{
+}
+
 }  //  extern "C"
 
 int main(int argc, char **argv) {
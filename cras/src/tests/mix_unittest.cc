@@ -80,6 +80,36 @@ class MixTestSuiteS16_LE : public testing::Test{
       EXPECT_EQ(0, memcmp(compare_buffer_, mix_buffer_, kBufferFrames * 4));
     }
 
+    void TestCopyScaleStride(float scaler, float increment) {
+      float start_scaler = scaler;
+
+      _SetupBuffer();
+      for (size_t i = 0; i < kBufferFrames * 2; i += 2) {
+        int32_t tmp;
+        if (increment != 0 || need_to_scale(scaler))
+          tmp = src_buffer_[i/2] * scaler;
+        else
+          tmp = src_buffer_[i/2];
+        if (tmp > INT16_MAX)
+          tmp = INT16_MAX;
+        else if (tmp < INT16_MIN)
+          tmp = INT16_MIN;
+        compare_buffer_[i] = tmp;
+        scaler += increment;
+      }
+
+      if (increment == 0)
+        cras_mix_copy_scale_stride(
+            fmt_, (uint8_t *)mix_buffer_, (uint8_t *)src_buffer_,
+            kBufferFrames, 4, 2, start_scaler);
+      else
+        cras_mix_copy_scale_stride_increment(
+            fmt_, (uint8_t *)mix_buffer_, (uint8_t *)src_buffer_,
+            kBufferFrames, 4, 2, start_scaler, increment);
+
+      EXPECT_EQ(0, memcmp(compare_buffer_, mix_buffer_, kBufferFrames * 4));
+    }
+
     void ScaleIncrement(float start_scaler, float increment) {
       float scaler = start_scaler;
       for (size_t i = 0; i < kBufferFrames * 2; i++) {
@@ -281,6 +311,33 @@ TEST_F(MixTestSuiteS16_LE, StrideCopy) {
   TestScaleStride(0.5);
 }
 
+TEST_F(MixTestSuiteS16_LE, CopyScaleStride) {
+  TestCopyScaleStride(1.0, 0);
+  TestCopyScaleStride(100, 0);
+  TestCopyScaleStride(0.5, 0);
+}
+
+TEST_F(MixTestSuiteS16_LE, CopyScaleStrideIncrement) {
+  TestCopyScaleStride(0.5, 0.0001);
+  TestCopyScaleStride(2.0, -0.0001);
+}
+
+TEST_F(MixTestSuiteS16_LE, CopyScaleContiguous) {
+  for (size_t i = 0; i < kNumSamples; i++) {
+    int32_t tmp = src_buffer_[i] * 4.0f;
+    if (tmp > INT16_MAX)
+      tmp = INT16_MAX;
+    compare_buffer_[i] = tmp;
+  }
+  cras_mix_copy_scale_stride(fmt_, (uint8_t *)mix_buffer_,
+                             (uint8_t *)src_buffer_, kNumSamples, 2, 2, 4.0);
+  EXPECT_EQ(0, memcmp(compare_buffer_, mix_buffer_, kBufferFrames * 4));
+
+  cras_mix_copy_scale_stride(fmt_, (uint8_t *)mix_buffer_,
+                             (uint8_t *)src_buffer_, kNumSamples, 2, 2, 1.0);
+  EXPECT_EQ(0, memcmp(src_buffer_, mix_buffer_, kBufferFrames * 4));
+}
+
 class MixTestSuiteS24_LE : public testing::Test{
   protected:
     virtual void SetUp() {
@@ -339,6 +396,36 @@ class MixTestSuiteS24_LE : public testing::Test{
       EXPECT_EQ(0, memcmp(compare_buffer_, mix_buffer_, kBufferFrames * 8));
     }
 
+    void TestCopyScaleStride(float scaler, float increment) {
+      float start_scaler = scaler;
+
+      _SetupBuffer();
+      for (size_t i = 0; i < kBufferFrames * 2; i += 2) {
+        int32_t tmp;
+        if (increment != 0 || need_to_scale(scaler))
+          tmp = src_buffer_[i/2] * scaler;
+        else
+          tmp = src_buffer_[i/2];
+        if (tmp > 0x007fffff)
+          tmp = 0x007fffff;
+        else if (tmp < (int32_t)0xff800000)
+          tmp = (int32_t)0xff800000;
+        compare_buffer_[i] = tmp;
+        scaler += increment;
+      }
+
+      if (increment == 0)
+        cras_mix_copy_scale_stride(
+            fmt_, (uint8_t *)mix_buffer_, (uint8_t *)src_buffer_,
+            kBufferFrames, 8, 4, start_scaler);
+      else
+        cras_mix_copy_scale_stride_increment(
+            fmt_, (uint8_t *)mix_buffer_, (uint8_t *)src_buffer_,
+            kBufferFrames, 8, 4, start_scaler, increment);
+
+      EXPECT_EQ(0, memcmp(compare_buffer_, mix_buffer_, kBufferFrames * 8));
+    }
+
     void ScaleIncrement(float start_scaler, float increment) {
       float scaler = start_scaler;
       for (size_t i = 0; i < kBufferFrames * 2; i++) {
@@ -539,6 +626,37 @@ TEST_F(MixTestSuiteS24_LE, StrideCopy) {
   TestScaleStride(0.1);
 }
 
+TEST_F(MixTestSuiteS24_LE, CopyScaleStride) {
+  TestCopyScaleStride(1.0, 0);
+  TestCopyScaleStride(100, 0);
+  TestCopyScaleStride(0.1, 0);
+}
+
+TEST_F(MixTestSuiteS24_LE, CopyScaleStrideIncrement) {
+  TestCopyScaleStride(0.5, 0.0001);
+  TestCopyScaleStride(2.0, -0.0001);
+}
+
+TEST_F(MixTestSuiteS24_LE, CopyScaleContiguous) {
+  _SetupBuffer();
+  for (size_t i = 0; i < kNumSamples; i++) {
+    int32_t tmp = src_buffer_[i] * 4.0f;
+    if (tmp > 0x007fffff)
+      tmp = 0x007fffff;
+    else if (tmp < (int32_t)0xff800000)
+      tmp = (int32_t)0xff800000;
+    compare_buffer_[i] = tmp;
+  }
+  cras_mix_copy_scale_stride(fmt_, (uint8_t *)mix_buffer_,
+                             (uint8_t *)src_buffer_, kNumSamples, 4, 4, 4.0);
+  EXPECT_EQ(0, memcmp(compare_buffer_, mix_buffer_,
+                      kBufferFrames * fr_bytes_));
+
+  cras_mix_copy_scale_stride(fmt_, (uint8_t *)mix_buffer_,
+                             (uint8_t *)src_buffer_, kNumSamples, 4, 4, 1.0);
+  EXPECT_EQ(0, memcmp(src_buffer_, mix_buffer_, kBufferFrames * fr_bytes_));
+}
+
 class MixTestSuiteS32_LE : public testing::Test{
   protected:
     virtual void SetUp() {
@@ -597,6 +715,28 @@ class MixTestSuiteS32_LE : public testing::Test{
       EXPECT_EQ(0, memcmp(compare_buffer_, mix_buffer_, kBufferFrames * 8));
     }
 
+    void TestCopyScaleStride(float scaler) {
+      _SetupBuffer();
+      for (size_t i = 0; i < kBufferFrames * 2; i += 2) {
+        int64_t tmp;
+        if (need_to_scale(scaler))
+          tmp = src_buffer_[i/2] * scaler;
+        else
+          tmp = src_buffer_[i/2];
+        if (tmp > INT32_MAX)
+          tmp = INT32_MAX;
+        else if (tmp < INT32_MIN)
+          tmp = INT32_MIN;
+        compare_buffer_[i] = tmp;
+      }
+
+      cras_mix_copy_scale_stride(
+          fmt_, (uint8_t *)mix_buffer_, (uint8_t *)src_buffer_,
+          kBufferFrames, 8, 4, scaler);
+
+      EXPECT_EQ(0, memcmp(compare_buffer_, mix_buffer_, kBufferFrames * 8));
+    }
+
     void ScaleIncrement(float start_scaler, float increment) {
       float scaler = start_scaler;
       for (size_t i = 0; i < kBufferFrames * 2; i++) {
@@ -797,6 +937,12 @@ TEST_F(MixTestSuiteS32_LE, StrideCopy) {
   TestScaleStride(0.1);
 }
 
+TEST_F(MixTestSuiteS32_LE, CopyScaleStride) {
+  TestCopyScaleStride(1.0);
+  TestCopyScaleStride(100);
+  TestCopyScaleStride(0.1);
+}
+
 class MixTestSuiteS24_3LE : public testing::Test{
   protected:
     virtual void SetUp() {
@@ -1091,6 +1237,99 @@ TEST_F(MixTestSuiteS24_3LE, StrideCopy) {
   TestScaleStride(0.1);
 }
 
+TEST(MixMeasureLevels, S16Stereo) {
+  int16_t buf[2 * 64];
+  float peak[2] = {0.25f, 0.0f};
+  float sum[2] = {0.0f, 0.0f};
+
+  for (size_t i = 0; i < 64; i++) {
+    buf[2 * i] = (i & 1) ? -16384 : 16384;
+    buf[2 * i + 1] = 0;
+  }
+  EXPECT_NE(0, cras_mix_measure_levels(SND_PCM_FORMAT_S16_LE,
+                                       (uint8_t *)buf, 64, 2, peak, sum));
+  EXPECT_FLOAT_EQ(0.5f, peak[0]);
+  EXPECT_NEAR(64 * 0.25f, sum[0], 0.01f);
+  EXPECT_EQ(0.0f, peak[1]);
+  EXPECT_EQ(0.0f, sum[1]);
+
+  // Levels accumulate, a quieter block keeps the peak.
+  for (size_t i = 0; i < 64; i++)
+    buf[2 * i] = 8192;
+  EXPECT_NE(0, cras_mix_measure_levels(SND_PCM_FORMAT_S16_LE,
+                                       (uint8_t *)buf, 64, 2, peak, sum));
+  EXPECT_FLOAT_EQ(0.5f, peak[0]);
+  EXPECT_NEAR(64 * 0.25f + 64 * 0.0625f, sum[0], 0.01f);
+}
+
+TEST(MixMeasureLevels, S16Silence) {
+  int16_t buf[3 * 33];
+  float peak[3] = {0.0f, 0.0f, 0.0f};
+  float sum[3] = {0.0f, 0.0f, 0.0f};
+
+  memset(buf, 0, sizeof(buf));
+  EXPECT_EQ(0, cras_mix_measure_levels(SND_PCM_FORMAT_S16_LE,
+                                       (uint8_t *)buf, 33, 3, peak, sum));
+  EXPECT_EQ(0.0f, peak[2]);
+
+  // A single sample on the last channel of the last frame counts.
+  buf[3 * 33 - 1] = INT16_MIN;
+  EXPECT_NE(0, cras_mix_measure_levels(SND_PCM_FORMAT_S16_LE,
+                                       (uint8_t *)buf, 33, 3, peak, sum));
+  EXPECT_EQ(0.0f, peak[0]);
+  EXPECT_EQ(0.0f, peak[1]);
+  EXPECT_FLOAT_EQ(1.0f, peak[2]);
+  EXPECT_NEAR(1.0f, sum[2], 0.001f);
+}
+
+TEST(MixMeasureLevels, S24AndS32) {
+  int32_t buf[2 * 16];
+  float peak[2] = {0.0f, 0.0f};
+  float sum[2] = {0.0f, 0.0f};
+
+  for (size_t i = 0; i < 16; i++) {
+    buf[2 * i] = 1 << 22;
+    buf[2 * i + 1] = -(1 << 21);
+  }
+  EXPECT_NE(0, cras_mix_measure_levels(SND_PCM_FORMAT_S24_LE,
+                                       (uint8_t *)buf, 16, 2, peak, sum));
+  EXPECT_FLOAT_EQ(0.5f, peak[0]);
+  EXPECT_FLOAT_EQ(0.25f, peak[1]);
+  EXPECT_NEAR(16 * 0.25f, sum[0], 0.001f);
+  EXPECT_NEAR(16 * 0.0625f, sum[1], 0.001f);
+
+  memset(peak, 0, sizeof(peak));
+  memset(sum, 0, sizeof(sum));
+  for (size_t i = 0; i < 16; i++) {
+    buf[2 * i] = 1 << 30;
+    buf[2 * i + 1] = INT32_MIN;
+  }
+  EXPECT_NE(0, cras_mix_measure_levels(SND_PCM_FORMAT_S32_LE,
+                                       (uint8_t *)buf, 16, 2, peak, sum));
+  EXPECT_FLOAT_EQ(0.5f, peak[0]);
+  EXPECT_FLOAT_EQ(1.0f, peak[1]);
+  EXPECT_NEAR(16 * 0.25f, sum[0], 0.001f);
+  EXPECT_NEAR(16 * 1.0f, sum[1], 0.001f);
+}
+
+TEST(MixMeasureLevels, S24_3LE) {
+  uint8_t buf[3 * 2 * 16];
+  float peak[2] = {0.0f, 0.0f};
+  float sum[2] = {0.0f, 0.0f};
+
+  memset(buf, 0, sizeof(buf));
+  EXPECT_EQ(0, cras_mix_measure_levels(SND_PCM_FORMAT_S24_3LE,
+                                       buf, 16, 2, peak, sum));
+  // 0x400000 is half of full scale.
+  for (size_t i = 0; i < 16; i++)
+    buf[6 * i + 2] = 0x40;
+  EXPECT_NE(0, cras_mix_measure_levels(SND_PCM_FORMAT_S24_3LE,
+                                       buf, 16, 2, peak, sum));
+  EXPECT_FLOAT_EQ(0.5f, peak[0]);
+  EXPECT_EQ(0.0f, peak[1]);
+  EXPECT_NEAR(16 * 0.25f, sum[0], 0.001f);
+}
+
 /* Stubs */
 extern "C" {
 
@@ -56,6 +56,9 @@ static size_t cb_num_active_streams_changed_called;
 static std::vector<enum CRAS_STREAM_DIRECTION>
     cb_num_active_streams_changed_dir;
 static std::vector<uint32_t> cb_num_active_streams_changed_num;
+static size_t cb_output_levels_changed_called;
+static std::vector<uint32_t> cb_output_levels_changed_dev_idx;
+static std::vector<float> cb_output_levels_changed_peak;
 
 static void ResetStubData() {
   cras_alert_destroy_called = 0;
@@ -99,6 +102,9 @@ static void ResetStubData() {
   cb_num_active_streams_changed_called = 0;
   cb_num_active_streams_changed_dir.clear();
   cb_num_active_streams_changed_num.clear();
+  cb_output_levels_changed_called = 0;
+  cb_output_levels_changed_dev_idx.clear();
+  cb_output_levels_changed_peak.clear();
 }
 
 /* System output volume changed. */
@@ -188,6 +194,16 @@ void cb_num_active_streams_changed(void *context,
   cb_num_active_streams_changed_num.push_back(num_active_streams);
 }
 
+/* Output levels changed. */
+void cb_output_levels_changed(void *context, uint32_t dev_idx,
+                              uint32_t num_channels,
+                              const float *peak, const float *rms) {
+  cb_output_levels_changed_called++;
+  cb_context.push_back(context);
+  cb_output_levels_changed_dev_idx.push_back(dev_idx);
+  cb_output_levels_changed_peak.push_back(peak[num_channels - 1]);
+}
+
 class ObserverTest : public testing::Test {
  protected:
   virtual void SetUp() {
@@ -196,7 +212,7 @@ class ObserverTest : public testing::Test {
     ResetStubData();
     rc = cras_observer_server_init();
     ASSERT_EQ(0, rc);
-    EXPECT_EQ(15, cras_alert_create_called);
+    EXPECT_EQ(16, cras_alert_create_called);
     EXPECT_EQ(reinterpret_cast<void *>(output_volume_alert),
               cras_alert_add_callback_map[g_observer->alerts.output_volume]);
     EXPECT_EQ(reinterpret_cast<void *>(output_mute_alert),
@@ -235,6 +251,10 @@ class ObserverTest : public testing::Test {
     EXPECT_EQ(reinterpret_cast<void *>(non_empty_audio_state_changed_alert),
         cras_alert_add_callback_map[
                 g_observer->alerts.non_empty_audio_state_changed]);
+    EXPECT_EQ(reinterpret_cast<void *>(output_levels_alert),
+        cras_alert_add_callback_map[g_observer->alerts.output_levels]);
+    EXPECT_EQ(CRAS_ALERT_FLAG_KEEP_ALL_DATA,
+              cras_alert_create_flags_map[g_observer->alerts.output_levels]);
 
     cras_observer_get_ops(NULL, &ops1_);
     EXPECT_NE(0, cras_observer_ops_are_empty(&ops1_));
@@ -248,7 +268,7 @@ class ObserverTest : public testing::Test {
 
   virtual void TearDown() {
     cras_observer_server_free();
-    EXPECT_EQ(15, cras_alert_destroy_called);
+    EXPECT_EQ(16, cras_alert_destroy_called);
     ResetStubData();
   }
 
@@ -600,6 +620,37 @@ TEST_F(ObserverTest, NonEmpyAudioStateChanged) {
   EXPECT_EQ(data->non_empty, 1);
 }
 
+TEST_F(ObserverTest, NotifyOutputLevels) {
+  struct cras_observer_alert_data_output_levels *data;
+  const float peak[2] = {0.5f, 0.25f};
+  const float rms[2] = {0.125f, 0.0625f};
+
+  cras_observer_notify_output_levels(3, 2, peak, rms);
+  EXPECT_EQ(cras_alert_pending_alert_value,
+            g_observer->alerts.output_levels);
+  ASSERT_EQ(cras_alert_pending_data_size_value, sizeof(*data));
+  ASSERT_NE(cras_alert_pending_data_value, reinterpret_cast<void *>(NULL));
+  data = reinterpret_cast<struct cras_observer_alert_data_output_levels *>(
+      cras_alert_pending_data_value);
+  EXPECT_EQ(3, data->dev_idx);
+  EXPECT_EQ(2, data->num_channels);
+  EXPECT_EQ(0.25f, data->peak[1]);
+  EXPECT_EQ(0.0625f, data->rms[1]);
+
+  // Levels are only wanted while someone observes them.
+  EXPECT_EQ(0, cras_observer_output_levels_wanted());
+  ops1_.output_levels_changed = cb_output_levels_changed;
+  ops2_.output_levels_changed = cb_output_levels_changed;
+  DoObserverAlert(output_levels_alert, data);
+  EXPECT_NE(0, cras_observer_output_levels_wanted());
+  ASSERT_EQ(2, cb_output_levels_changed_called);
+  EXPECT_EQ(3, cb_output_levels_changed_dev_idx[0]);
+  EXPECT_EQ(0.25f, cb_output_levels_changed_peak[1]);
+
+  DoObserverRemoveClear(output_levels_alert, data);
+  EXPECT_EQ(0, cras_observer_output_levels_wanted());
+}
+
 // Stubs
 extern "C" {
 
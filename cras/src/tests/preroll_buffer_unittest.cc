@@ -0,0 +1,177 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "cras_audio_area.h"
+#include "cras_types.h"
+#include "preroll_buffer.h"
+}
+
+namespace {
+
+class PrerollBufferTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      fmt_.format = SND_PCM_FORMAT_S16_LE;
+      fmt_.frame_rate = 48000;
+      fmt_.num_channels = 2;
+      for (unsigned int i = 0; i < CRAS_CH_MAX; i++)
+        fmt_.channel_layout[i] = -1;
+      fmt_.channel_layout[CRAS_CH_FL] = 0;
+      fmt_.channel_layout[CRAS_CH_FR] = 1;
+      for (unsigned int i = 0; i < sizeof(samples_) / sizeof(samples_[0]);
+           i++)
+        samples_[i] = i;
+      buf_ = preroll_buffer_create(8, &fmt_);
+      ASSERT_NE(static_cast<preroll_buffer *>(NULL), buf_);
+    }
+
+    virtual void TearDown() {
+      preroll_buffer_destroy(&buf_);
+      EXPECT_EQ(static_cast<preroll_buffer *>(NULL), buf_);
+    }
+
+    // Writes |frames| frames starting at frame |first| of samples_.
+    void Write(unsigned int first, unsigned int frames) {
+      preroll_buffer_write(buf_,
+                           reinterpret_cast<uint8_t *>(samples_ + first * 2),
+                           frames);
+    }
+
+    struct cras_audio_format fmt_;
+    int16_t samples_[64];
+    struct preroll_buffer *buf_;
+};
+
+TEST_F(PrerollBufferTestSuite, CreateZeroFrames) {
+  EXPECT_EQ(static_cast<preroll_buffer *>(NULL),
+            preroll_buffer_create(0, &fmt_));
+}
+
+TEST_F(PrerollBufferTestSuite, Empty) {
+  struct cras_audio_area *area = NULL;
+  uint64_t pos = 0;
+
+  EXPECT_EQ(0, preroll_buffer_queued(buf_));
+  EXPECT_EQ(0, preroll_buffer_read_area(buf_, &pos, &area));
+  EXPECT_EQ(0, pos);
+}
+
+TEST_F(PrerollBufferTestSuite, WriteRead) {
+  struct cras_audio_area *area = NULL;
+  uint64_t pos = 0;
+  int16_t *read;
+
+  Write(0, 5);
+  EXPECT_EQ(5, preroll_buffer_queued(buf_));
+  EXPECT_EQ(5, preroll_buffer_write_pos(buf_));
+
+  pos = 2;
+  ASSERT_EQ(3, preroll_buffer_read_area(buf_, &pos, &area));
+  EXPECT_EQ(2, pos);
+  EXPECT_EQ(3, area->frames);
+  EXPECT_EQ(2, area->num_channels);
+  EXPECT_EQ(4, area->channels[0].step_bytes);
+  read = reinterpret_cast<int16_t *>(area->channels[0].buf);
+  for (unsigned int i = 0; i < 6; i++)
+    EXPECT_EQ(samples_[4 + i], read[i]);
+  EXPECT_EQ(area->channels[0].buf + 2, area->channels[1].buf);
+}
+
+TEST_F(PrerollBufferTestSuite, Wraparound) {
+  struct cras_audio_area *area = NULL;
+  uint64_t pos = 4;
+  int16_t *read;
+
+  Write(0, 6);
+  Write(6, 4);
+  EXPECT_EQ(8, preroll_buffer_queued(buf_));
+  EXPECT_EQ(10, preroll_buffer_write_pos(buf_));
+
+  // Frames 4 to 7 are contiguous, 8 and 9 wrapped to the start.
+  ASSERT_EQ(4, preroll_buffer_read_area(buf_, &pos, &area));
+  read = reinterpret_cast<int16_t *>(area->channels[0].buf);
+  for (unsigned int i = 0; i < 8; i++)
+    EXPECT_EQ(samples_[8 + i], read[i]);
+
+  pos += 4;
+  ASSERT_EQ(2, preroll_buffer_read_area(buf_, &pos, &area));
+  read = reinterpret_cast<int16_t *>(area->channels[0].buf);
+  for (unsigned int i = 0; i < 4; i++)
+    EXPECT_EQ(samples_[16 + i], read[i]);
+
+  pos += 2;
+  EXPECT_EQ(0, preroll_buffer_read_area(buf_, &pos, &area));
+}
+
+TEST_F(PrerollBufferTestSuite, OverwrittenPositionMovesForward) {
+  struct cras_audio_area *area = NULL;
+  uint64_t pos = 1;
+  int16_t *read;
+
+  Write(0, 12);
+  EXPECT_EQ(8, preroll_buffer_queued(buf_));
+
+  // Frames before 4 were overwritten.
+  ASSERT_EQ(4, preroll_buffer_read_area(buf_, &pos, &area));
+  EXPECT_EQ(4, pos);
+  read = reinterpret_cast<int16_t *>(area->channels[0].buf);
+  EXPECT_EQ(samples_[8], read[0]);
+}
+
+TEST_F(PrerollBufferTestSuite, WriteMoreThanCapacity) {
+  struct cras_audio_area *area = NULL;
+  uint64_t pos = 0;
+  int16_t *read;
+
+  Write(0, 20);
+  EXPECT_EQ(20, preroll_buffer_write_pos(buf_));
+  EXPECT_EQ(8, preroll_buffer_queued(buf_));
+
+  ASSERT_EQ(4, preroll_buffer_read_area(buf_, &pos, &area));
+  EXPECT_EQ(12, pos);
+  read = reinterpret_cast<int16_t *>(area->channels[0].buf);
+  for (unsigned int i = 0; i < 8; i++)
+    EXPECT_EQ(samples_[24 + i], read[i]);
+
+  pos += 4;
+  ASSERT_EQ(4, preroll_buffer_read_area(buf_, &pos, &area));
+  read = reinterpret_cast<int16_t *>(area->channels[0].buf);
+  EXPECT_EQ(samples_[32], read[0]);
+}
+
+}  //  namespace
+
+extern "C" {
+
+void cras_mix_add_scale_stride(snd_pcm_format_t fmt, uint8_t *dst, uint8_t *src,
+			 unsigned int count, unsigned int dst_stride,
+			 unsigned int src_stride, float scaler)
+{
+}
+
+void cras_mix_copy_scale_stride(snd_pcm_format_t fmt, uint8_t *dst,
+				uint8_t *src, unsigned int count,
+				unsigned int dst_stride,
+				unsigned int src_stride, float scaler)
+{
+}
+
+void cras_mix_copy_scale_stride_increment(snd_pcm_format_t fmt, uint8_t *dst,
+					  uint8_t *src, unsigned int count,
+					  unsigned int dst_stride,
+					  unsigned int src_stride,
+					  float scaler, float increment)
+{
+}
+
+}  //  extern "C"
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
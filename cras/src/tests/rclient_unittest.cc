@@ -695,8 +695,7 @@ void audio_thread_add_output_dev(struct audio_thread *thread,
 {
 }
 
-int audio_thread_dump_thread_info(struct audio_thread *thread,
-				  struct audio_debug_info *info)
+int cras_iodev_list_dump_audio_thread_info(struct audio_debug_info *info)
 {
   return 0;
 }
@@ -711,9 +710,8 @@ int audio_thread_resume(struct audio_thread *thread)
   return 0;
 }
 
-int audio_thread_config_global_remix(struct audio_thread *thread,
-    unsigned int num_channels,
-    const float *coefficient)
+int cras_iodev_list_config_global_remix(unsigned int num_channels,
+					const float *coefficient)
 {
   return 0;
 }
@@ -279,6 +279,46 @@ TEST_F(RstreamTestSuite, OutputStreamFlushMessages) {
   cras_rstream_destroy(s);
 }
 
+TEST_F(RstreamTestSuite, OutputStreamRecordsResponseTime) {
+  struct cras_rstream *s;
+  struct timespec ts;
+  unsigned int i;
+  int rc;
+
+  rc = cras_rstream_create(&config_, &s);
+  EXPECT_EQ(0, rc);
+
+  // Replies arriving before the deadline aren't late.
+  for (i = 0; i < FETCH_PREDICTOR_MIN_SAMPLES; i++) {
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    s->fetch_deadline_ts = ts;
+    s->fetch_deadline_ts.tv_sec += 10;
+    ts.tv_sec -= 1;
+    EXPECT_GT(cras_rstream_request_audio(s, &ts), 0);
+    stub_client_reply(AUDIO_MESSAGE_DATA_READY, 10, 0);
+    cras_rstream_flush_old_audio_messages(s);
+  }
+  EXPECT_EQ(FETCH_PREDICTOR_MIN_SAMPLES, s->fetch_pred.num);
+  EXPECT_LE(1000000, s->fetch_pred.p99_us);
+  EXPECT_EQ(0, s->num_late_fetches);
+
+  // Reply after the deadline.
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  s->fetch_deadline_ts = ts;
+  EXPECT_GT(cras_rstream_request_audio(s, &ts), 0);
+  stub_client_reply(AUDIO_MESSAGE_DATA_READY, 10, 0);
+  cras_rstream_flush_old_audio_messages(s);
+  EXPECT_EQ(1, s->num_late_fetches);
+
+  // A reply without a pending request is not counted.
+  stub_client_reply(AUDIO_MESSAGE_DATA_READY, 10, 0);
+  cras_rstream_flush_old_audio_messages(s);
+  EXPECT_EQ(FETCH_PREDICTOR_MIN_SAMPLES + 1, s->fetch_pred.num);
+  EXPECT_EQ(1, s->num_late_fetches);
+
+  cras_rstream_destroy(s);
+}
+
 TEST_F(RstreamTestSuite, InputStreamIsPendingReply) {
   struct cras_rstream *s;
   int rc;
@@ -2,11 +2,13 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <pthread.h>
 #include <stdio.h>
 #include <gtest/gtest.h>
 
 extern "C" {
 #include "cras_alert.h"
+#include "cras_main_message.h"
 #include "cras_shm.h"
 #include "cras_system_state.h"
 #include "cras_types.h"
@@ -16,6 +18,13 @@ namespace {
 static struct cras_alsa_card* kFakeAlsaCard;
 size_t cras_alsa_card_create_called;
 size_t cras_alsa_card_destroy_called;
+static size_t cras_alsa_card_probe_called;
+static size_t cras_alsa_card_complete_called;
+static cras_message_callback main_message_cb;
+static uint8_t probed_msg[256];
+static size_t probed_msg_count;
+static pthread_mutex_t probed_msg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t probed_msg_cond = PTHREAD_COND_INITIALIZER;
 static size_t add_stub_called;
 static size_t rm_stub_called;
 static size_t add_task_stub_called;
@@ -41,6 +50,9 @@ static size_t cras_observer_notify_num_active_streams_called;
 static void ResetStubData() {
   cras_alsa_card_create_called = 0;
   cras_alsa_card_destroy_called = 0;
+  cras_alsa_card_probe_called = 0;
+  cras_alsa_card_complete_called = 0;
+  probed_msg_count = 0;
   kFakeAlsaCard = reinterpret_cast<struct cras_alsa_card*>(0x33);
   add_stub_called = 0;
   rm_stub_called = 0;
@@ -84,6 +96,15 @@ static void callback_stub(void *data) {
   callback_stub_called++;
 }
 
+/* Waits for a probe worker to post its result to the main thread. */
+static void wait_for_probed_msg() {
+  pthread_mutex_lock(&probed_msg_mutex);
+  while (probed_msg_count == 0)
+    pthread_cond_wait(&probed_msg_cond, &probed_msg_mutex);
+  probed_msg_count--;
+  pthread_mutex_unlock(&probed_msg_mutex);
+}
+
 static void do_sys_init() {
   char *shm_name;
   ASSERT_GT(asprintf(&shm_name, "/cras-%d", getpid()), 0);
@@ -355,6 +376,61 @@ TEST(SystemStateSuite, AddCard) {
   cras_system_state_deinit();
 }
 
+TEST(SystemStateSuite, ProbeCard) {
+  struct cras_server_state *s;
+  cras_alsa_card_info info;
+
+  ResetStubData();
+  info.card_type = ALSA_CARD_TYPE_USB;
+  info.card_index = 0;
+  do_sys_init();
+
+  EXPECT_EQ(0, cras_system_probe_alsa_card(&info, 0));
+  wait_for_probed_msg();
+  EXPECT_EQ(1, cras_alsa_card_probe_called);
+  EXPECT_EQ(0, cras_alsa_card_create_called);
+  // The card counts as added while its devices are pending.
+  EXPECT_EQ(1, cras_system_alsa_card_exists(0));
+  EXPECT_EQ(-EEXIST, cras_system_probe_alsa_card(&info, 0));
+
+  // Devices are added once the main thread gets the probed card.
+  ASSERT_NE((void *)NULL, (void *)main_message_cb);
+  main_message_cb((struct cras_main_message *)probed_msg, NULL);
+  EXPECT_EQ(1, cras_alsa_card_complete_called);
+  EXPECT_EQ(1, cras_system_alsa_card_exists(0));
+  s = cras_system_state_get_no_lock();
+  EXPECT_EQ(1, s->num_alsa_cards);
+  EXPECT_EQ(0, s->alsa_cards[0].card_index);
+  EXPECT_EQ(7, s->alsa_cards[0].probe_ms);
+  EXPECT_EQ(3, s->alsa_cards[0].complete_ms);
+
+  EXPECT_EQ(0, cras_system_remove_alsa_card(0));
+  EXPECT_EQ(1, cras_alsa_card_destroy_called);
+  EXPECT_EQ(0, s->num_alsa_cards);
+  cras_system_state_deinit();
+}
+
+TEST(SystemStateSuite, RemoveCardWhileProbing) {
+  cras_alsa_card_info info;
+
+  ResetStubData();
+  info.card_type = ALSA_CARD_TYPE_USB;
+  info.card_index = 0;
+  do_sys_init();
+
+  EXPECT_EQ(0, cras_system_probe_alsa_card(&info, 0));
+  wait_for_probed_msg();
+  EXPECT_EQ(0, cras_system_remove_alsa_card(0));
+  EXPECT_EQ(0, cras_system_alsa_card_exists(0));
+
+  // The probed card is dropped instead of having its devices added.
+  main_message_cb((struct cras_main_message *)probed_msg, NULL);
+  EXPECT_EQ(0, cras_alsa_card_complete_called);
+  EXPECT_EQ(1, cras_alsa_card_destroy_called);
+  EXPECT_EQ(0, cras_system_alsa_card_exists(0));
+  cras_system_state_deinit();
+}
+
 TEST(SystemSettingsRegisterSelectDescriptor, AddSelectFd) {
   void *stub_data = reinterpret_cast<void *>(44);
   void *select_data = reinterpret_cast<void *>(33);
@@ -478,6 +554,46 @@ size_t cras_alsa_card_get_index(const struct cras_alsa_card *alsa_card) {
   return 0;
 }
 
+struct cras_alsa_card *cras_alsa_card_probe(struct cras_alsa_card_info *info,
+                                            const char *device_config_dir,
+                                            const char *ucm_suffix) {
+  cras_alsa_card_probe_called++;
+  return kFakeAlsaCard;
+}
+
+int cras_alsa_card_complete(struct cras_alsa_card *alsa_card,
+                            struct cras_alsa_card_info *info,
+                            struct cras_device_blacklist *blacklist) {
+  cras_alsa_card_complete_called++;
+  return 0;
+}
+
+unsigned int cras_alsa_card_get_probe_ms(
+    const struct cras_alsa_card *alsa_card) {
+  return 7;
+}
+
+unsigned int cras_alsa_card_get_complete_ms(
+    const struct cras_alsa_card *alsa_card) {
+  return 3;
+}
+
+int cras_main_message_add_handler(enum CRAS_MAIN_MESSAGE_TYPE type,
+                                  cras_message_callback callback,
+                                  void *callback_data) {
+  main_message_cb = callback;
+  return 0;
+}
+
+int cras_main_message_send(struct cras_main_message *msg) {
+  pthread_mutex_lock(&probed_msg_mutex);
+  memcpy(probed_msg, msg, msg->length);
+  probed_msg_count++;
+  pthread_cond_signal(&probed_msg_cond);
+  pthread_mutex_unlock(&probed_msg_mutex);
+  return 0;
+}
+
 struct cras_device_blacklist *cras_device_blacklist_create(
 		const char *config_path)
 {
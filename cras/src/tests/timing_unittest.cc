@@ -427,6 +427,18 @@ int cras_server_metrics_num_underruns(unsigned num_underruns)
   return 0;
 }
 
+int cras_server_metrics_time_to_first_sample(unsigned delay_msec)
+{
+  return 0;
+}
+
+unsigned int preroll_buffer_read_area(struct preroll_buffer *buf,
+				      uint64_t *pos,
+				      struct cras_audio_area **area)
+{
+  return 0;
+}
+
 int input_data_get_for_stream(
 		struct input_data *data,
 		struct cras_rstream *stream,
@@ -0,0 +1,115 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "cras_underrun_log.h"
+}
+
+namespace {
+
+class UnderrunLogTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      log_ = cras_underrun_log_create();
+      ASSERT_NE((void *)NULL, log_);
+    }
+
+    virtual void TearDown() {
+      cras_underrun_log_destroy(log_);
+    }
+
+    // Records a wake up at sec seconds writing frames on top of hw_level.
+    void Cycle(unsigned int sec, unsigned int hw_level, unsigned int frames) {
+      struct timespec ts = { (time_t)sec, 0 };
+
+      cras_underrun_log_begin_cycle(log_, &ts);
+      cras_underrun_log_write(log_, hw_level, frames);
+      cras_underrun_log_end_cycle(log_);
+    }
+
+    struct cras_underrun_log *log_;
+    struct cras_dev_cycle_info cycles_[CRAS_UNDERRUN_LOG_CYCLES];
+    struct timespec frozen_ts_;
+};
+
+TEST_F(UnderrunLogTestSuite, NothingFrozen) {
+  Cycle(1, 480, 240);
+  EXPECT_EQ(0, cras_underrun_log_get(log_, cycles_, &frozen_ts_));
+  EXPECT_EQ(0, frozen_ts_.tv_sec);
+}
+
+TEST_F(UnderrunLogTestSuite, FreezeInCycle) {
+  struct timespec ts = { 3, 0 };
+  struct timespec pending = { 0, 12000000 };
+  struct timespec dsp = { 0, 250000 };
+  struct timespec now = { 3, 500 };
+
+  Cycle(1, 480, 240);
+  Cycle(2, 240, 480);
+
+  cras_underrun_log_begin_cycle(log_, &ts);
+  cras_underrun_log_fetch(log_, 0x10001, &pending);
+  pending.tv_nsec = 2000000;
+  cras_underrun_log_fetch(log_, 0x10002, &pending);
+  cras_underrun_log_add_dsp(log_, &dsp);
+  cras_underrun_log_add_dsp(log_, &dsp);
+  cras_underrun_log_write(log_, 0, 100);
+  cras_underrun_log_level_after(log_, 60);
+  cras_underrun_log_freeze(log_, &now);
+  cras_underrun_log_end_cycle(log_);
+
+  // The wake up that underran is last, oldest first before it.
+  ASSERT_EQ(3, cras_underrun_log_get(log_, cycles_, &frozen_ts_));
+  EXPECT_EQ(3, frozen_ts_.tv_sec);
+  EXPECT_EQ(500, frozen_ts_.tv_nsec);
+  EXPECT_EQ(1, cycles_[0].wake_sec);
+  EXPECT_EQ(480, cycles_[0].hw_level_before);
+  EXPECT_EQ(720, cycles_[0].hw_level_after);
+  EXPECT_EQ(2, cycles_[1].wake_sec);
+  EXPECT_EQ(3, cycles_[2].wake_sec);
+  EXPECT_EQ(0, cycles_[2].hw_level_before);
+  EXPECT_EQ(60, cycles_[2].hw_level_after);
+  EXPECT_EQ(100, cycles_[2].frames_written);
+  EXPECT_EQ(500, cycles_[2].dsp_us);
+  EXPECT_EQ(0x10001, cycles_[2].slowest_stream_id);
+  EXPECT_EQ(12000, cycles_[2].slowest_fetch_us);
+
+  // Later wake ups don't change the frozen copy.
+  Cycle(4, 960, 0);
+  EXPECT_EQ(3, cras_underrun_log_get(log_, cycles_, &frozen_ts_));
+  EXPECT_EQ(3, cycles_[2].wake_sec);
+}
+
+TEST_F(UnderrunLogTestSuite, RingKeepsLastCycles) {
+  struct timespec ts = { 100, 0 };
+  unsigned int i;
+
+  for (i = 0; i < CRAS_UNDERRUN_LOG_CYCLES + 5; i++)
+    Cycle(i, i, 0);
+
+  // Frozen between wake ups, the ring holds the last completed ones.
+  cras_underrun_log_freeze(log_, &ts);
+  ASSERT_EQ(CRAS_UNDERRUN_LOG_CYCLES,
+            cras_underrun_log_get(log_, cycles_, &frozen_ts_));
+  EXPECT_EQ(5, cycles_[0].wake_sec);
+  EXPECT_EQ(CRAS_UNDERRUN_LOG_CYCLES + 4,
+            cycles_[CRAS_UNDERRUN_LOG_CYCLES - 1].wake_sec);
+
+  // Frozen in a wake up, it takes the place of the oldest one.
+  cras_underrun_log_begin_cycle(log_, &ts);
+  cras_underrun_log_freeze(log_, &ts);
+  ASSERT_EQ(CRAS_UNDERRUN_LOG_CYCLES,
+            cras_underrun_log_get(log_, cycles_, &frozen_ts_));
+  EXPECT_EQ(6, cycles_[0].wake_sec);
+  EXPECT_EQ(100, cycles_[CRAS_UNDERRUN_LOG_CYCLES - 1].wake_sec);
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
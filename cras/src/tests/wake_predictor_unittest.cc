@@ -0,0 +1,144 @@
+// Copyright 2019 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+extern "C" {
+#include "wake_predictor.h"
+}
+
+namespace {
+
+class WakePredictorTestSuite : public testing::Test {
+  protected:
+    virtual void SetUp() {
+      memset(&wp_, 0, sizeof(wp_));
+      start_.tv_sec = 100;
+      start_.tv_nsec = 0;
+    }
+
+    // Returns the time msec after start_.
+    struct timespec After(unsigned int msec) {
+      struct timespec ts = start_;
+      ts.tv_nsec += msec * 1000000;
+      ts.tv_sec += ts.tv_nsec / 1000000000;
+      ts.tv_nsec %= 1000000000;
+      return ts;
+    }
+
+    struct wake_predictor wp_;
+    struct timespec start_;
+};
+
+TEST_F(WakePredictorTestSuite, NoPrediction) {
+  struct timespec ts = After(10);
+  int err = 0;
+
+  EXPECT_EQ(0, wake_predictor_check(&wp_, 480, &ts, &err));
+  EXPECT_EQ(0.0, wp_.correction);
+}
+
+TEST_F(WakePredictorTestSuite, ExactPrediction) {
+  struct timespec ts = After(10);
+  int err = -1;
+
+  wake_predictor_start(&wp_, 960, &start_, 48000);
+  EXPECT_EQ(1, wake_predictor_check(&wp_, 480, &ts, &err));
+  EXPECT_EQ(0, err);
+  EXPECT_EQ(0.0, wp_.correction);
+  EXPECT_EQ(1, wp_.err_hist[CRAS_WAKE_ERR_HIST_BUCKETS / 2]);
+
+  // A prediction is only checked once.
+  EXPECT_EQ(0, wake_predictor_check(&wp_, 480, &ts, &err));
+}
+
+TEST_F(WakePredictorTestSuite, SlowDeviceCorrectsLater) {
+  struct timespec ts = After(10);
+  int err = 0;
+  unsigned int i;
+
+  // The device keeps 24 frames, 500 usec, more than predicted.
+  for (i = 0; i < 40; i++) {
+    wake_predictor_start(&wp_, 960, &start_, 48000);
+    EXPECT_EQ(1, wake_predictor_check(&wp_, 504, &ts, &err));
+    EXPECT_EQ(24, err);
+  }
+  EXPECT_EQ(40, wp_.err_hist[5]);
+  EXPECT_NEAR(24.0, wp_.correction, 0.5);
+
+  // Sleeping longer is limited to half a millisecond and the level.
+  EXPECT_EQ(464, wake_predictor_adjust(&wp_, 440, 960, 48000));
+  EXPECT_EQ(460, wake_predictor_adjust(&wp_, 440, 460, 48000));
+  wp_.correction = 100;
+  EXPECT_EQ(464, wake_predictor_adjust(&wp_, 440, 960, 48000));
+}
+
+TEST_F(WakePredictorTestSuite, FastDeviceCorrectsEarlier) {
+  struct timespec ts = After(10);
+  int err = 0;
+  unsigned int i;
+
+  for (i = 0; i < 40; i++) {
+    wake_predictor_start(&wp_, 960, &start_, 48000);
+    EXPECT_EQ(1, wake_predictor_check(&wp_, 420, &ts, &err));
+    EXPECT_EQ(-60, err);
+  }
+  EXPECT_EQ(40, wp_.err_hist[0]);
+  EXPECT_EQ(416, wake_predictor_adjust(&wp_, 440, 960, 48000));
+  EXPECT_EQ(0, wake_predictor_adjust(&wp_, 10, 960, 48000));
+}
+
+TEST_F(WakePredictorTestSuite, IgnoredLevels) {
+  struct timespec ts = After(10);
+  int err = 0;
+
+  // Underrun.
+  wake_predictor_start(&wp_, 960, &start_, 48000);
+  EXPECT_EQ(0, wake_predictor_check(&wp_, 0, &ts, &err));
+
+  // Hardware pointer didn't move since the prediction.
+  wake_predictor_start(&wp_, 960, &start_, 48000);
+  EXPECT_EQ(0, wake_predictor_check(&wp_, 960, &start_, &err));
+
+  // Stale prediction.
+  ts = start_;
+  ts.tv_sec += 2;
+  wake_predictor_start(&wp_, 960, &start_, 48000);
+  EXPECT_EQ(0, wake_predictor_check(&wp_, 480, &ts, &err));
+
+  // Cancelled prediction.
+  ts = After(10);
+  wake_predictor_start(&wp_, 960, &start_, 48000);
+  wake_predictor_cancel(&wp_);
+  EXPECT_EQ(0, wake_predictor_check(&wp_, 480, &ts, &err));
+
+  EXPECT_EQ(0.0, wp_.correction);
+  for (unsigned int i = 0; i < CRAS_WAKE_ERR_HIST_BUCKETS; i++)
+    EXPECT_EQ(0, wp_.err_hist[i]);
+}
+
+TEST_F(WakePredictorTestSuite, ResetDropsCorrection) {
+  struct timespec ts = After(10);
+  int err = 0;
+
+  wake_predictor_start(&wp_, 960, &start_, 48000);
+  EXPECT_EQ(1, wake_predictor_check(&wp_, 504, &ts, &err));
+  EXPECT_NE(0.0, wp_.correction);
+
+  // The pending prediction and the correction go, the histogram stays.
+  wake_predictor_start(&wp_, 960, &start_, 48000);
+  wake_predictor_reset(&wp_);
+  EXPECT_EQ(0, wake_predictor_check(&wp_, 504, &ts, &err));
+  EXPECT_EQ(0.0, wp_.correction);
+  EXPECT_EQ(440, wake_predictor_adjust(&wp_, 440, 960, 48000));
+  EXPECT_EQ(1, wp_.err_hist[5]);
+}
+
+}  //  namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,169 @@
+/* Copyright 2019 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <alsa/asoundlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <time.h>
+
+#include "buffer_share.h"
+#include "cras_mix.h"
+
+/* Measures the per callback CPU cost of the stream offset bookkeeping done
+ * by write_streams() in dev_io.c, with the streams looked up in the device's
+ * buffer_share by id as before, and by the slot kept in each dev_stream.
+ * The cost of mixing the streams is printed alongside for scale. */
+
+/* One 10ms callback of S16_LE stereo at 48kHz. */
+#define FRAMES 480
+#define CHANNELS 2
+#define FRAME_BYTES (CHANNELS * 2)
+#define ITERATIONS 100000
+#define MAX_STREAMS 64
+
+/* The streams attached to the device, as write_streams() sees them. */
+struct bench_stream {
+	unsigned int stream_id;
+	int share_slot;
+	uint8_t *samples;
+	struct bench_stream *next;
+};
+
+static double tp_diff(struct timespec *tp2, struct timespec *tp1)
+{
+	return (tp2->tv_sec - tp1->tv_sec)
+		+ (tp2->tv_nsec - tp1->tv_nsec) * 1e-9;
+}
+
+/* One callback, each stream found by id in every step. */
+static unsigned int by_id(struct buffer_share *mix,
+			  struct bench_stream *streams)
+{
+	struct bench_stream *curr;
+	unsigned int max_offset = 0;
+
+	for (curr = streams; curr; curr = curr->next)
+		max_offset = MAX(max_offset,
+				 buffer_share_id_offset(mix, curr->stream_id));
+	for (curr = streams; curr; curr = curr->next) {
+		unsigned int offset = buffer_share_id_offset(mix,
+							     curr->stream_id);
+		buffer_share_offset_update(mix, curr->stream_id,
+					   FRAMES - offset);
+	}
+	return buffer_share_get_new_write_point(mix) + max_offset;
+}
+
+/* One callback, each stream indexed by its slot. */
+static unsigned int by_slot(struct buffer_share *mix,
+			    struct bench_stream *streams)
+{
+	struct bench_stream *curr;
+	unsigned int max_offset;
+
+	max_offset = buffer_share_max_offset(mix);
+	for (curr = streams; curr; curr = curr->next) {
+		unsigned int offset = buffer_share_slot_offset(
+				mix, curr->share_slot);
+		buffer_share_slot_offset_update(mix, curr->share_slot,
+						FRAMES - offset);
+	}
+	return buffer_share_get_new_write_point(mix) + max_offset;
+}
+
+/* Mixes every stream into dst, the work the bookkeeping surrounds. */
+static void mix_streams(uint8_t *dst, struct bench_stream *streams)
+{
+	struct bench_stream *curr;
+	unsigned int index = 0;
+
+	memset(dst, 0, FRAMES * FRAME_BYTES);
+	for (curr = streams; curr; curr = curr->next)
+		cras_mix_add(SND_PCM_FORMAT_S16_LE, dst, curr->samples,
+			     FRAMES * CHANNELS, index++, 0, 1.0);
+}
+
+/* Prints the CPU time per callback spent with num_streams attached. */
+static void bench(struct bench_stream *all, unsigned int num_streams,
+		  uint8_t *dst)
+{
+	struct buffer_share *mix;
+	struct bench_stream *streams = NULL;
+	struct timespec tp1, tp2;
+	double id_secs, slot_secs, mix_secs;
+	unsigned int i, check = 0;
+
+	/* Add streams in reverse so the list keeps the order of all. */
+	mix = buffer_share_create(FRAMES * 4);
+	for (i = num_streams; i > 0; i--) {
+		struct bench_stream *s = &all[i - 1];
+
+		buffer_share_add_id(mix, s->stream_id, NULL);
+		s->share_slot = buffer_share_id_slot(mix, s->stream_id);
+		s->next = streams;
+		streams = s;
+	}
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+	for (i = 0; i < ITERATIONS; i++)
+		check += by_id(mix, streams);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+	id_secs = tp_diff(&tp2, &tp1);
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+	for (i = 0; i < ITERATIONS; i++)
+		check -= by_slot(mix, streams);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+	slot_secs = tp_diff(&tp2, &tp1);
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp1);
+	for (i = 0; i < ITERATIONS; i++)
+		mix_streams(dst, streams);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp2);
+	mix_secs = tp_diff(&tp2, &tp1);
+
+	printf("%2u streams  by id %7.0f ns  by slot %7.0f ns  mix %8.0f ns%s\n",
+	       num_streams, id_secs * 1e9 / ITERATIONS,
+	       slot_secs * 1e9 / ITERATIONS, mix_secs * 1e9 / ITERATIONS,
+	       check ? "  (results differ)" : "");
+	buffer_share_destroy(mix);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_stream *all;
+	uint8_t *dst;
+	int16_t *samples;
+	unsigned int i, j;
+
+	cras_mix_init(0);
+
+	dst = (uint8_t *)malloc(FRAMES * FRAME_BYTES);
+	all = (struct bench_stream *)calloc(MAX_STREAMS, sizeof(*all));
+	if (!dst || !all)
+		return 1;
+	for (i = 0; i < MAX_STREAMS; i++) {
+		/* Stream ids as given out to clients, client id on top. */
+		all[i].stream_id = ((i + 1) << 16) | 1;
+		all[i].samples = (uint8_t *)malloc(FRAMES * FRAME_BYTES);
+		if (!all[i].samples)
+			return 1;
+		samples = (int16_t *)all[i].samples;
+		for (j = 0; j < FRAMES * CHANNELS; j++)
+			samples[j] = (rand() % 2000) - 1000;
+	}
+
+	for (i = 1; i <= MAX_STREAMS; i *= 2)
+		bench(all, i, dst);
+
+	for (i = 0; i < MAX_STREAMS; i++)
+		free(all[i].samples);
+	free(all);
+	free(dst);
+	return 0;
+}
@@ -47,6 +47,7 @@ exec minijail0 -u cras -g cras -G -n --uts -v -l \
         -b /sys,/sys \
         -k 'tmpfs,/var,tmpfs,MS_NODEV|MS_NOEXEC|MS_NOSUID,mode=755,size=10M' \
         -b /var/lib/metrics/,/var/lib/metrics/,1 \
+        -b /var/lib/cras/,/var/lib/cras/,1 \
 	-S /usr/share/policy/cras-seccomp.policy \
         -- \
         /usr/bin/cras \